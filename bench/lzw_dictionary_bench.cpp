@@ -0,0 +1,136 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+//
+// Micro-benchmark of the LZW dictionary implementations used by the GIF writer.
+// Random noise index images are compressed with the tree and the hash table dictionaries,
+// the time per frame is reported and the two code streams are checked to be identical.
+// Build with lzw_dictionary_bench.pro, this is not part of the ser-player target.
+//
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "lzw_compressor.h"
+
+
+// Time each image size and bit depth for at least this long
+static const double C_MIN_RUN_TIME = 0.5;  // Seconds
+
+
+// ------------------------------------------
+// Compress an image, returning the GIF image data sub-blocks
+// ------------------------------------------
+static std::vector<uint8_t> compress_image(
+    int width,
+    int height,
+    int bit_depth,
+    std::vector<uint8_t> &image,
+    c_lzw_compressor::e_dictionary_type dictionary_type)
+{
+    std::vector<uint8_t> encoded_data;
+    c_lzw_compressor lzw_compressor(
+        width,
+        height,
+        0,  // x_start
+        width - 1,  // x_end
+        0,  // y_start
+        height - 1,  // y_end
+        bit_depth,
+        image.data(),
+        dictionary_type);
+
+    lzw_compressor.set_lossy_details(
+        0,  // lossy_compression_level
+        nullptr,  // p_index_to_index_colour_difference_lut
+        -1);  // transparent_index
+
+    bool all_compressed = false;
+    while (!all_compressed) {
+        all_compressed = lzw_compressor.compress_data();
+        uint8_t *p_compressed_data = lzw_compressor.get_compressed_data_ptr();
+        encoded_data.insert(encoded_data.end(), p_compressed_data, p_compressed_data + p_compressed_data[0] + 1);
+    }
+
+    return encoded_data;
+}
+
+
+// ------------------------------------------
+// Time per frame in milliseconds
+// ------------------------------------------
+static double time_dictionary(
+    int width,
+    int height,
+    int bit_depth,
+    std::vector<uint8_t> &image,
+    c_lzw_compressor::e_dictionary_type dictionary_type)
+{
+    int frames = 0;
+    double run_time = 0.0;
+    auto start_time = std::chrono::steady_clock::now();
+    while (run_time < C_MIN_RUN_TIME) {
+        compress_image(width, height, bit_depth, image, dictionary_type);
+        frames++;
+        run_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+
+    return 1000.0 * run_time / frames;
+}
+
+
+int main()
+{
+    static const int C_SIZES[][2] = {{64, 48}, {320, 240}, {640, 480}};
+    static const int C_BIT_DEPTHS[] = {2, 4, 6, 8};
+
+    std::mt19937 random_generator(1);
+    bool mismatch = false;
+
+    printf("bits  size        tree (ms)  hash (ms)  speedup\n");
+    for (int bit_depth : C_BIT_DEPTHS) {
+        for (const auto &size : C_SIZES) {
+            int width = size[0];
+            int height = size[1];
+
+            // Random noise, the worst case for the dictionary
+            std::vector<uint8_t> image(width * height);
+            std::uniform_int_distribution<int> index_distribution(0, (1 << bit_depth) - 1);
+            for (auto &index : image) {
+                index = (uint8_t)index_distribution(random_generator);
+            }
+
+            if (compress_image(width, height, bit_depth, image, c_lzw_compressor::DICTIONARY_TREE) !=
+                compress_image(width, height, bit_depth, image, c_lzw_compressor::DICTIONARY_HASH)) {
+                printf("%4d  %3dx%-3d     code streams differ\n", bit_depth, width, height);
+                mismatch = true;
+                continue;
+            }
+
+            double tree_time = time_dictionary(width, height, bit_depth, image, c_lzw_compressor::DICTIONARY_TREE);
+            double hash_time = time_dictionary(width, height, bit_depth, image, c_lzw_compressor::DICTIONARY_HASH);
+            printf("%4d  %3dx%-3d  %10.3f %10.3f  %6.2fx\n",
+                   bit_depth, width, height, tree_time, hash_time, tree_time / hash_time);
+        }
+    }
+
+    return (mismatch) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
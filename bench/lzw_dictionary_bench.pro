@@ -0,0 +1,37 @@
+# ---------------------------------------------------------------------
+# Copyright (C) 2020 Chris Garry
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>
+# ---------------------------------------------------------------------
+
+# ---------------------------------------------------------------------
+# LZW dictionary micro-benchmark, not part of the ser-player build.
+# Example: qmake CONFIG+=release && make && ./lzw_dictionary_bench
+# ---------------------------------------------------------------------
+
+QT -= gui
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TARGET = lzw_dictionary_bench
+TEMPLATE = app
+
+INCLUDEPATH += ../src
+
+SOURCES += \
+    lzw_dictionary_bench.cpp \
+    ../src/lzw_compressor.cpp
+
+HEADERS += \
+    ../src/lzw_compressor.h
@@ -156,7 +156,12 @@ SOURCES += src/main.cpp\
     src/save_frames_progress_dialog.cpp \
     src/markers_dialog.cpp \
     src/image.cpp \
+    src/debayer_row.cpp \
     src/histogram_thread.cpp \
+    src/frame_cache.cpp \
+    src/frame_pipeline.cpp \
+    src/frame_buffer_pool.cpp \
+    src/playback_scheduler.cpp \
     src/histogram_dialog.cpp \
     src/pipp_ser_write.cpp \
     src/header_details_dialog.cpp \
@@ -165,8 +170,11 @@ SOURCES += src/main.cpp\
     src/icon_groupbox.cpp \
     src/gif_write.cpp \
     src/lzw_compressor.cpp \
+    src/frame_compare.cpp \
+    src/inverse_colour_map.cpp \
     src/pipp_avi_write.cpp \
     src/pipp_avi_write_dib.cpp \
+    src/pipp_avi_write_zlib.cpp \
     src/selection_box_dialog.cpp \
     src/neuquant.c \
     src/playback_controls_widget.cpp \
@@ -177,18 +185,18 @@ SOURCES += src/main.cpp\
 !contains(DEFINES, DISABLE_NEW_VERSION_CHECK): SOURCES += src/new_version_checker.cpp
 
 macx {
-    SOURCES += src/pipp_utf8_osx.cpp
+    SOURCES += src/pipp_utf8_osx.cpp src/pipp_utf8_posix.cpp
 } else:bsd {
-    SOURCES += src/pipp_utf8_bsd.cpp
+    SOURCES += src/pipp_utf8_bsd.cpp src/pipp_utf8_posix.cpp
 } else:linux {
-    SOURCES += src/pipp_utf8_linux.cpp
+    SOURCES += src/pipp_utf8_linux.cpp src/pipp_utf8_posix.cpp
 } else:win32 {
     SOURCES += src/pipp_utf8.cpp
 } else:gnukfreebsd {
-    SOURCES += src/pipp_utf8_linux.cpp
+    SOURCES += src/pipp_utf8_linux.cpp src/pipp_utf8_posix.cpp
 } else {
     message("Defaulting to linux version of pipp_utf8_XXX.cpp")
-    SOURCES += src/pipp_utf8_linux.cpp
+    SOURCES += src/pipp_utf8_linux.cpp src/pipp_utf8_posix.cpp
 }
 
 HEADERS  += src/ser_player.h \
@@ -204,7 +212,12 @@ HEADERS  += src/ser_player.h \
     src/save_frames_progress_dialog.h \
     src/markers_dialog.h \
     src/image.h \
+    src/debayer_row.h \
     src/histogram_thread.h \
+    src/frame_cache.h \
+    src/frame_pipeline.h \
+    src/frame_buffer_pool.h \
+    src/playback_scheduler.h \
     src/histogram_dialog.h \
     src/pipp_ser_write.h \
     src/header_details_dialog.h \
@@ -213,9 +226,12 @@ HEADERS  += src/ser_player.h \
     src/icon_groupbox.h \
     src/gif_write.h \
     src/lzw_compressor.h \
+    src/frame_compare.h \
+    src/inverse_colour_map.h \
     src/pipp_video_write.h \
     src/pipp_avi_write.h \
     src/pipp_avi_write_dib.h \
+    src/pipp_avi_write_zlib.h \
     src/selection_box_dialog.h \
     src/neuquant.h \
     src/playback_controls_widget.h \
@@ -228,8 +244,9 @@ HEADERS  += src/ser_player.h \
 INCLUDEPATH += src
 
 contains(DEFINES, USE_SYSTEM_LIBPNG) {
-    # Use the system version of libpng
+    # Use the system version of libpng, zlib is also used by the AVI writer
     LIBS += -lpng
+    LIBS += -lz
 } else {
     # Use our local copy of libpng
     SOURCES += libpng/png.c \
@@ -0,0 +1,543 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#include "debayer_row.h"
+
+
+// SIMD versions are only built for x86 and can be turned off with DISABLE_SIMD_DEBAYER
+#if !defined(DISABLE_SIMD_DEBAYER)
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define DEBAYER_SSE2
+        #include <emmintrin.h>
+
+        #if defined(__GNUC__) || defined(_MSC_VER)
+            #define DEBAYER_AVX2
+            #include <immintrin.h>
+            #if defined(_MSC_VER)
+                #include <intrin.h>
+                #define DEBAYER_AVX2_FUNCTION
+            #else
+                #define DEBAYER_AVX2_FUNCTION __attribute__((target("avx2")))
+            #endif
+        #endif
+    #endif
+#endif
+
+
+// Implementation for one line
+typedef void (*debayer_row_8bit_fn)(const uint8_t *, uint8_t *, int32_t, uint32_t, uint32_t);
+typedef void (*debayer_row_16bit_fn)(const uint16_t *, uint16_t *, int32_t, uint32_t, uint32_t);
+
+
+// ------------------------------------------
+// Scalar version for pixels x_start to x_end-1
+// Also used for the pixels at the end of the line that do not fill a SIMD register
+// ------------------------------------------
+template <typename T>
+static void debayer_row_scalar(
+    const T *p_raw_line,
+    T *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase,
+    int32_t x_start,
+    int32_t x_end)
+{
+    const T *raw_data_ptr = p_raw_line + x_start;
+    T *rgb_data_ptr1 = p_bgr_line + 3 * x_start;
+    for (int32_t x = x_start; x < x_end; x++) {
+        uint32_t bayer = ((x + bayer_x) % 2) + (2 * row_phase);
+        switch (bayer) {
+            case 0:
+                // Blue - Average of 4 corners;
+                *rgb_data_ptr1++ = ( *(raw_data_ptr-width-1) + *(raw_data_ptr-width+1) +
+                                     *(raw_data_ptr+width-1) + *(raw_data_ptr+width+1) ) / 4;
+
+                // Green - Return average of 4 nearest neighbours
+                *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) +
+                                     *(raw_data_ptr+width) + *(raw_data_ptr-width) ) /4;
+
+                // Red - Simple case just return data at this position
+                *rgb_data_ptr1++ = *raw_data_ptr++;
+                break;
+
+            case 1:
+                // Blue - Average of above and below pixels
+                *rgb_data_ptr1++ = ( *(raw_data_ptr-width) + *(raw_data_ptr+width) ) / 2;
+
+                // Green - just this position
+                *rgb_data_ptr1++ = *raw_data_ptr;
+
+                // Red - Average of left and right pixels
+                *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) ) / 2;
+                raw_data_ptr++;
+                break;
+
+            case 2:
+                // Blue - Average of left and right pixels
+                *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) ) / 2;
+
+                // Green - just this position
+                *rgb_data_ptr1++ = *raw_data_ptr;
+
+                // Red - Average of above and below pixels
+                *rgb_data_ptr1++ = ( *(raw_data_ptr-width) + *(raw_data_ptr+width) ) / 2;
+                raw_data_ptr++;
+                break;
+
+            default:
+                // Blue - Simple case just return data at this position
+                *rgb_data_ptr1++ = *raw_data_ptr;
+
+                // Green - Return average of 4 nearest neighbours
+                // Note: the pixel below is used twice and the pixel above is not used
+                *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) +
+                                     *(raw_data_ptr+width) + *(raw_data_ptr+width) ) /4;
+
+                // Red - Average of 4 corners;
+                *rgb_data_ptr1++ = ( *(raw_data_ptr-width-1) + *(raw_data_ptr-width+1) +
+                                     *(raw_data_ptr+width-1) + *(raw_data_ptr+width+1) ) / 4;
+                raw_data_ptr++;
+                break;
+        }
+    }
+}
+
+
+static void debayer_row_8bit_scalar(
+    const uint8_t *p_raw_line,
+    uint8_t *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase)
+{
+    debayer_row_scalar <uint8_t> (p_raw_line, p_bgr_line, width, bayer_x, row_phase, 1, width - 1);
+}
+
+
+static void debayer_row_16bit_scalar(
+    const uint16_t *p_raw_line,
+    uint16_t *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase)
+{
+    debayer_row_scalar <uint16_t> (p_raw_line, p_bgr_line, width, bayer_x, row_phase, 1, width - 1);
+}
+
+
+//
+// SIMD versions
+// Each block of pixels starts at an odd x position, so the bayer phase of each lane is
+// the same for every block on a line.  All the candidate values are worked out for
+// every lane and a mask picks the right one for the lane's phase:
+//
+//   Phase       Blue            Green           Red
+//   0           corners/4       neighbours/4    this pixel
+//   1           (up+down)/2     this pixel      (left+right)/2
+//   2           (left+right)/2  this pixel      (up+down)/2
+//   3           this pixel      see note        corners/4
+//
+// Note: phase 3 green is (left + right + 2 * down) / 4 to match the scalar version.
+// 8-bit data is worked on in 16-bit lanes and 16-bit data in 32-bit lanes so sums
+// cannot overflow.  The planar results are then interleaved into BGR order.
+//
+
+#ifdef DEBAYER_SSE2
+static inline __m128i sse2_select(__m128i mask, __m128i if_set, __m128i if_clear)
+{
+    return _mm_or_si128(_mm_and_si128(mask, if_set), _mm_andnot_si128(mask, if_clear));
+}
+
+
+static void debayer_row_8bit_sse2(
+    const uint8_t *p_raw_line,
+    uint8_t *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase)
+{
+    const int32_t C_LANES = 8;
+    const __m128i zero = _mm_setzero_si128();
+
+    // Lanes with an even bayer phase (0 or 2) have their mask set
+    uint32_t lane0_phase = (1 + bayer_x) % 2;
+    const __m128i even_mask = (lane0_phase == 0) ?
+                _mm_set_epi16(0, -1, 0, -1, 0, -1, 0, -1) :
+                _mm_set_epi16(-1, 0, -1, 0, -1, 0, -1, 0);
+
+    int32_t x = 1;
+    for ( ; x + C_LANES <= width - 1; x += C_LANES) {
+        const uint8_t *p = p_raw_line + x;
+        __m128i up_left = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p - width - 1)), zero);
+        __m128i up = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p - width)), zero);
+        __m128i up_right = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p - width + 1)), zero);
+        __m128i left = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p - 1)), zero);
+        __m128i centre = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), zero);
+        __m128i right = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + 1)), zero);
+        __m128i down_left = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + width - 1)), zero);
+        __m128i down = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + width)), zero);
+        __m128i down_right = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + width + 1)), zero);
+
+        __m128i left_right = _mm_add_epi16(left, right);
+        __m128i corners = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(up_left, up_right),
+                                                       _mm_add_epi16(down_left, down_right)), 2);
+        __m128i vertical = _mm_srli_epi16(_mm_add_epi16(up, down), 1);
+        __m128i horizontal = _mm_srli_epi16(left_right, 1);
+
+        __m128i blue, green, red;
+        if (row_phase == 0) {
+            __m128i neighbours = _mm_srli_epi16(_mm_add_epi16(left_right, _mm_add_epi16(up, down)), 2);
+            blue = sse2_select(even_mask, corners, vertical);
+            green = sse2_select(even_mask, neighbours, centre);
+            red = sse2_select(even_mask, centre, horizontal);
+        } else {
+            __m128i neighbours = _mm_srli_epi16(_mm_add_epi16(left_right, _mm_add_epi16(down, down)), 2);
+            blue = sse2_select(even_mask, horizontal, centre);
+            green = sse2_select(even_mask, centre, neighbours);
+            red = sse2_select(even_mask, vertical, corners);
+        }
+
+        uint16_t blue_lanes[C_LANES];
+        uint16_t green_lanes[C_LANES];
+        uint16_t red_lanes[C_LANES];
+        _mm_storeu_si128((__m128i *)blue_lanes, blue);
+        _mm_storeu_si128((__m128i *)green_lanes, green);
+        _mm_storeu_si128((__m128i *)red_lanes, red);
+
+        uint8_t *p_write = p_bgr_line + 3 * x;
+        for (int32_t lane = 0; lane < C_LANES; lane++) {
+            *p_write++ = (uint8_t)blue_lanes[lane];
+            *p_write++ = (uint8_t)green_lanes[lane];
+            *p_write++ = (uint8_t)red_lanes[lane];
+        }
+    }
+
+    // Remaining pixels
+    debayer_row_scalar <uint8_t> (p_raw_line, p_bgr_line, width, bayer_x, row_phase, x, width - 1);
+}
+
+
+static void debayer_row_16bit_sse2(
+    const uint16_t *p_raw_line,
+    uint16_t *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase)
+{
+    const int32_t C_LANES = 4;
+    const __m128i zero = _mm_setzero_si128();
+
+    // Lanes with an even bayer phase (0 or 2) have their mask set
+    uint32_t lane0_phase = (1 + bayer_x) % 2;
+    const __m128i even_mask = (lane0_phase == 0) ?
+                _mm_set_epi32(0, -1, 0, -1) :
+                _mm_set_epi32(-1, 0, -1, 0);
+
+    int32_t x = 1;
+    for ( ; x + C_LANES <= width - 1; x += C_LANES) {
+        const uint16_t *p = p_raw_line + x;
+        __m128i up_left = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(p - width - 1)), zero);
+        __m128i up = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(p - width)), zero);
+        __m128i up_right = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(p - width + 1)), zero);
+        __m128i left = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(p - 1)), zero);
+        __m128i centre = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), zero);
+        __m128i right = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(p + 1)), zero);
+        __m128i down_left = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(p + width - 1)), zero);
+        __m128i down = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(p + width)), zero);
+        __m128i down_right = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(p + width + 1)), zero);
+
+        __m128i left_right = _mm_add_epi32(left, right);
+        __m128i corners = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(up_left, up_right),
+                                                       _mm_add_epi32(down_left, down_right)), 2);
+        __m128i vertical = _mm_srli_epi32(_mm_add_epi32(up, down), 1);
+        __m128i horizontal = _mm_srli_epi32(left_right, 1);
+
+        __m128i blue, green, red;
+        if (row_phase == 0) {
+            __m128i neighbours = _mm_srli_epi32(_mm_add_epi32(left_right, _mm_add_epi32(up, down)), 2);
+            blue = sse2_select(even_mask, corners, vertical);
+            green = sse2_select(even_mask, neighbours, centre);
+            red = sse2_select(even_mask, centre, horizontal);
+        } else {
+            __m128i neighbours = _mm_srli_epi32(_mm_add_epi32(left_right, _mm_add_epi32(down, down)), 2);
+            blue = sse2_select(even_mask, horizontal, centre);
+            green = sse2_select(even_mask, centre, neighbours);
+            red = sse2_select(even_mask, vertical, corners);
+        }
+
+        uint32_t blue_lanes[C_LANES];
+        uint32_t green_lanes[C_LANES];
+        uint32_t red_lanes[C_LANES];
+        _mm_storeu_si128((__m128i *)blue_lanes, blue);
+        _mm_storeu_si128((__m128i *)green_lanes, green);
+        _mm_storeu_si128((__m128i *)red_lanes, red);
+
+        uint16_t *p_write = p_bgr_line + 3 * x;
+        for (int32_t lane = 0; lane < C_LANES; lane++) {
+            *p_write++ = (uint16_t)blue_lanes[lane];
+            *p_write++ = (uint16_t)green_lanes[lane];
+            *p_write++ = (uint16_t)red_lanes[lane];
+        }
+    }
+
+    // Remaining pixels
+    debayer_row_scalar <uint16_t> (p_raw_line, p_bgr_line, width, bayer_x, row_phase, x, width - 1);
+}
+#endif  // DEBAYER_SSE2
+
+
+#ifdef DEBAYER_AVX2
+DEBAYER_AVX2_FUNCTION
+static void debayer_row_8bit_avx2(
+    const uint8_t *p_raw_line,
+    uint8_t *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase)
+{
+    const int32_t C_LANES = 16;
+
+    // Lanes with an even bayer phase (0 or 2) have their mask set
+    uint32_t lane0_phase = (1 + bayer_x) % 2;
+    const __m256i even_mask = (lane0_phase == 0) ?
+                _mm256_set1_epi32(0x0000ffff) :
+                _mm256_set1_epi32((int)0xffff0000);
+
+    int32_t x = 1;
+    for ( ; x + C_LANES <= width - 1; x += C_LANES) {
+        const uint8_t *p = p_raw_line + x;
+        __m256i up_left = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p - width - 1)));
+        __m256i up = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p - width)));
+        __m256i up_right = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p - width + 1)));
+        __m256i left = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p - 1)));
+        __m256i centre = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+        __m256i right = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p + 1)));
+        __m256i down_left = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p + width - 1)));
+        __m256i down = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p + width)));
+        __m256i down_right = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p + width + 1)));
+
+        __m256i left_right = _mm256_add_epi16(left, right);
+        __m256i corners = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(up_left, up_right),
+                                                             _mm256_add_epi16(down_left, down_right)), 2);
+        __m256i vertical = _mm256_srli_epi16(_mm256_add_epi16(up, down), 1);
+        __m256i horizontal = _mm256_srli_epi16(left_right, 1);
+
+        __m256i blue, green, red;
+        if (row_phase == 0) {
+            __m256i neighbours = _mm256_srli_epi16(_mm256_add_epi16(left_right, _mm256_add_epi16(up, down)), 2);
+            blue = _mm256_blendv_epi8(vertical, corners, even_mask);
+            green = _mm256_blendv_epi8(centre, neighbours, even_mask);
+            red = _mm256_blendv_epi8(horizontal, centre, even_mask);
+        } else {
+            __m256i neighbours = _mm256_srli_epi16(_mm256_add_epi16(left_right, _mm256_add_epi16(down, down)), 2);
+            blue = _mm256_blendv_epi8(centre, horizontal, even_mask);
+            green = _mm256_blendv_epi8(neighbours, centre, even_mask);
+            red = _mm256_blendv_epi8(corners, vertical, even_mask);
+        }
+
+        uint16_t blue_lanes[C_LANES];
+        uint16_t green_lanes[C_LANES];
+        uint16_t red_lanes[C_LANES];
+        _mm256_storeu_si256((__m256i *)blue_lanes, blue);
+        _mm256_storeu_si256((__m256i *)green_lanes, green);
+        _mm256_storeu_si256((__m256i *)red_lanes, red);
+
+        uint8_t *p_write = p_bgr_line + 3 * x;
+        for (int32_t lane = 0; lane < C_LANES; lane++) {
+            *p_write++ = (uint8_t)blue_lanes[lane];
+            *p_write++ = (uint8_t)green_lanes[lane];
+            *p_write++ = (uint8_t)red_lanes[lane];
+        }
+    }
+
+    // Remaining pixels
+    debayer_row_scalar <uint8_t> (p_raw_line, p_bgr_line, width, bayer_x, row_phase, x, width - 1);
+}
+
+
+DEBAYER_AVX2_FUNCTION
+static void debayer_row_16bit_avx2(
+    const uint16_t *p_raw_line,
+    uint16_t *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase)
+{
+    const int32_t C_LANES = 8;
+
+    // Lanes with an even bayer phase (0 or 2) have their mask set
+    uint32_t lane0_phase = (1 + bayer_x) % 2;
+    const __m256i even_mask = (lane0_phase == 0) ?
+                _mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1) :
+                _mm256_set_epi32(-1, 0, -1, 0, -1, 0, -1, 0);
+
+    int32_t x = 1;
+    for ( ; x + C_LANES <= width - 1; x += C_LANES) {
+        const uint16_t *p = p_raw_line + x;
+        __m256i up_left = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p - width - 1)));
+        __m256i up = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p - width)));
+        __m256i up_right = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p - width + 1)));
+        __m256i left = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p - 1)));
+        __m256i centre = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+        __m256i right = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p + 1)));
+        __m256i down_left = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p + width - 1)));
+        __m256i down = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p + width)));
+        __m256i down_right = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p + width + 1)));
+
+        __m256i left_right = _mm256_add_epi32(left, right);
+        __m256i corners = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(up_left, up_right),
+                                                             _mm256_add_epi32(down_left, down_right)), 2);
+        __m256i vertical = _mm256_srli_epi32(_mm256_add_epi32(up, down), 1);
+        __m256i horizontal = _mm256_srli_epi32(left_right, 1);
+
+        __m256i blue, green, red;
+        if (row_phase == 0) {
+            __m256i neighbours = _mm256_srli_epi32(_mm256_add_epi32(left_right, _mm256_add_epi32(up, down)), 2);
+            blue = _mm256_blendv_epi8(vertical, corners, even_mask);
+            green = _mm256_blendv_epi8(centre, neighbours, even_mask);
+            red = _mm256_blendv_epi8(horizontal, centre, even_mask);
+        } else {
+            __m256i neighbours = _mm256_srli_epi32(_mm256_add_epi32(left_right, _mm256_add_epi32(down, down)), 2);
+            blue = _mm256_blendv_epi8(centre, horizontal, even_mask);
+            green = _mm256_blendv_epi8(neighbours, centre, even_mask);
+            red = _mm256_blendv_epi8(corners, vertical, even_mask);
+        }
+
+        uint32_t blue_lanes[C_LANES];
+        uint32_t green_lanes[C_LANES];
+        uint32_t red_lanes[C_LANES];
+        _mm256_storeu_si256((__m256i *)blue_lanes, blue);
+        _mm256_storeu_si256((__m256i *)green_lanes, green);
+        _mm256_storeu_si256((__m256i *)red_lanes, red);
+
+        uint16_t *p_write = p_bgr_line + 3 * x;
+        for (int32_t lane = 0; lane < C_LANES; lane++) {
+            *p_write++ = (uint16_t)blue_lanes[lane];
+            *p_write++ = (uint16_t)green_lanes[lane];
+            *p_write++ = (uint16_t)red_lanes[lane];
+        }
+    }
+
+    // Remaining pixels
+    debayer_row_scalar <uint16_t> (p_raw_line, p_bgr_line, width, bayer_x, row_phase, x, width - 1);
+}
+
+
+// ------------------------------------------
+// Check that both the CPU and the OS support AVX2
+// ------------------------------------------
+static bool cpu_has_avx2()
+{
+#if defined(_MSC_VER)
+    int cpu_info[4];
+    __cpuid(cpu_info, 0);
+    if (cpu_info[0] < 7) {
+        return false;
+    }
+
+    // OSXSAVE and AVX
+    __cpuid(cpu_info, 1);
+    if ((cpu_info[2] & (1 << 27)) == 0 || (cpu_info[2] & (1 << 28)) == 0) {
+        return false;
+    }
+
+    // OS saves the YMM registers
+    if ((_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+
+    __cpuidex(cpu_info, 7, 0);
+    return (cpu_info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif  // DEBAYER_AVX2
+
+
+// ------------------------------------------
+// Pick the fastest implementation this CPU supports
+// ------------------------------------------
+struct s_debayer_row_functions {
+    debayer_row_8bit_fn p_8bit;
+    debayer_row_16bit_fn p_16bit;
+    const char *p_name;
+};
+
+
+static s_debayer_row_functions select_debayer_row_functions()
+{
+    s_debayer_row_functions functions;
+    functions.p_8bit = debayer_row_8bit_scalar;
+    functions.p_16bit = debayer_row_16bit_scalar;
+    functions.p_name = "scalar";
+
+#ifdef DEBAYER_SSE2
+    functions.p_8bit = debayer_row_8bit_sse2;
+    functions.p_16bit = debayer_row_16bit_sse2;
+    functions.p_name = "sse2";
+#endif
+
+#ifdef DEBAYER_AVX2
+    if (cpu_has_avx2()) {
+        functions.p_8bit = debayer_row_8bit_avx2;
+        functions.p_16bit = debayer_row_16bit_avx2;
+        functions.p_name = "avx2";
+    }
+#endif
+
+    return functions;
+}
+
+
+static const s_debayer_row_functions &get_debayer_row_functions()
+{
+    // Selected once, the first time a frame is debayered
+    static const s_debayer_row_functions functions = select_debayer_row_functions();
+    return functions;
+}
+
+
+void debayer_row_bilinear(
+    const uint8_t *p_raw_line,
+    uint8_t *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase)
+{
+    get_debayer_row_functions().p_8bit(p_raw_line, p_bgr_line, width, bayer_x, row_phase);
+}
+
+
+void debayer_row_bilinear(
+    const uint16_t *p_raw_line,
+    uint16_t *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase)
+{
+    get_debayer_row_functions().p_16bit(p_raw_line, p_bgr_line, width, bayer_x, row_phase);
+}
+
+
+const char *get_debayer_row_implementation()
+{
+    return get_debayer_row_functions().p_name;
+}
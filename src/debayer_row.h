@@ -0,0 +1,52 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#ifndef DEBAYER_ROW_H
+#define DEBAYER_ROW_H
+
+#include <cstdint>
+
+
+//
+// Bilinear debayering of the interior pixels of one line (x = 1 to width-2)
+// p_raw_line points to the start of the line in the raw data, the lines above and
+// below are read at -width and +width so this must not be the first or last line.
+// p_bgr_line points to the start of the same line in the BGR output buffer.
+// bayer_x is the bayer x phase of the frame and row_phase is ((y + bayer_y) % 2).
+// Uses AVX2 or SSE2 when the CPU has them, the output is the same on every path.
+//
+void debayer_row_bilinear(
+    const uint8_t *p_raw_line,
+    uint8_t *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase);
+
+
+void debayer_row_bilinear(
+    const uint16_t *p_raw_line,
+    uint16_t *p_bgr_line,
+    int32_t width,
+    uint32_t bayer_x,
+    uint32_t row_phase);
+
+
+// Name of the implementation selected for this CPU ("avx2", "sse2" or "scalar")
+const char *get_debayer_row_implementation();
+
+#endif  // DEBAYER_ROW_H
@@ -0,0 +1,190 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "frame_buffer_pool.h"
+
+
+// Smallest size class
+static const uint64_t C_MIN_CLASS_SIZE = 256;
+
+// Number of size classes between each power of 2
+static const int C_CLASSES_PER_DOUBLING = 8;
+
+// Released buffers are freed rather than kept once the pool holds this much
+static const uint64_t C_MAX_POOLED_BYTES = 512 * 1024 * 1024;
+
+// Each buffer starts with a header holding its size class, this keeps the data 16-byte aligned
+static const size_t C_HEADER_SIZE = 16;
+
+
+// ------------------------------------------
+// Pool state
+// ------------------------------------------
+struct s_pool_state {
+    std::mutex mutex;
+    std::map<uint64_t, std::vector<uint8_t *>> free_buffers;  // Keyed by class size
+    c_frame_buffer_pool::s_stats stats;
+
+    s_pool_state()
+    {
+        stats.hit_count = 0;
+        stats.miss_count = 0;
+        stats.bytes_in_use = 0;
+        stats.peak_bytes_in_use = 0;
+        stats.pooled_bytes = 0;
+    }
+
+    ~s_pool_state()
+    {
+        for (auto &free_list : free_buffers) {
+            for (uint8_t *p_block : free_list.second) {
+                delete [] p_block;
+            }
+        }
+    }
+};
+
+
+static s_pool_state &get_pool_state()
+{
+    static s_pool_state pool_state;
+    return pool_state;
+}
+
+
+// ------------------------------------------
+// Round size up to its size class
+// ------------------------------------------
+static uint64_t get_class_size(
+        uint64_t size)
+{
+    if (size <= C_MIN_CLASS_SIZE) {
+        return C_MIN_CLASS_SIZE;
+    }
+
+    // Largest power of 2 below size
+    uint64_t base = C_MIN_CLASS_SIZE;
+    while (base * 2 < size) {
+        base *= 2;
+    }
+
+    uint64_t step = base / C_CLASSES_PER_DOUBLING;
+    return base + ((size - base + step - 1) / step) * step;
+}
+
+
+uint8_t *c_frame_buffer_pool::get_buffer(
+        size_t size)
+{
+    uint64_t class_size = get_class_size(size);
+    s_pool_state &pool = get_pool_state();
+    uint8_t *p_block = nullptr;
+
+    {
+        std::lock_guard<std::mutex> locker(pool.mutex);
+        std::vector<uint8_t *> &free_list = pool.free_buffers[class_size];
+        if (!free_list.empty()) {
+            p_block = free_list.back();
+            free_list.pop_back();
+            pool.stats.pooled_bytes -= class_size;
+            pool.stats.hit_count++;
+        } else {
+            pool.stats.miss_count++;
+        }
+
+        pool.stats.bytes_in_use += class_size;
+        if (pool.stats.bytes_in_use > pool.stats.peak_bytes_in_use) {
+            pool.stats.peak_bytes_in_use = pool.stats.bytes_in_use;
+        }
+    }
+
+    if (p_block == nullptr) {
+        // Allocate outside the lock
+        p_block = new uint8_t[class_size + C_HEADER_SIZE];
+        *(uint64_t *)p_block = class_size;
+    }
+
+    return p_block + C_HEADER_SIZE;
+}
+
+
+void c_frame_buffer_pool::release_buffer(
+        uint8_t *p_buffer)
+{
+    if (p_buffer == nullptr) {
+        return;
+    }
+
+    uint8_t *p_block = p_buffer - C_HEADER_SIZE;
+    uint64_t class_size = *(uint64_t *)p_block;
+    s_pool_state &pool = get_pool_state();
+
+    {
+        std::lock_guard<std::mutex> locker(pool.mutex);
+        pool.stats.bytes_in_use -= class_size;
+        if (pool.stats.pooled_bytes + class_size <= C_MAX_POOLED_BYTES) {
+            pool.free_buffers[class_size].push_back(p_block);
+            pool.stats.pooled_bytes += class_size;
+            p_block = nullptr;
+        }
+    }
+
+    // Pool is full, free outside the lock
+    delete [] p_block;
+}
+
+
+void c_frame_buffer_pool::free_unused_buffers()
+{
+    std::map<uint64_t, std::vector<uint8_t *>> free_buffers;
+    s_pool_state &pool = get_pool_state();
+
+    {
+        std::lock_guard<std::mutex> locker(pool.mutex);
+        free_buffers.swap(pool.free_buffers);
+        pool.stats.pooled_bytes = 0;
+    }
+
+    for (auto &free_list : free_buffers) {
+        for (uint8_t *p_block : free_list.second) {
+            delete [] p_block;
+        }
+    }
+}
+
+
+c_frame_buffer_pool::s_stats c_frame_buffer_pool::get_stats()
+{
+    s_pool_state &pool = get_pool_state();
+    std::lock_guard<std::mutex> locker(pool.mutex);
+    return pool.stats;
+}
+
+
+void c_frame_buffer_pool::reset_stats()
+{
+    s_pool_state &pool = get_pool_state();
+    std::lock_guard<std::mutex> locker(pool.mutex);
+    pool.stats.hit_count = 0;
+    pool.stats.miss_count = 0;
+    pool.stats.peak_bytes_in_use = pool.stats.bytes_in_use;
+}
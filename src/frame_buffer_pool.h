@@ -0,0 +1,92 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#ifndef FRAME_BUFFER_POOL_H
+#define FRAME_BUFFER_POOL_H
+
+#include <cstdint>
+#include <cstddef>
+
+
+//
+// Pool of frame sized buffers shared by the whole application
+// Buffers that are released are kept and handed out again, so once playback or an
+// export has got going no frame buffers are allocated from the heap.
+// Buffer sizes are rounded up to size classes (8 per power of 2) so frames of the
+// same size always share buffers.  All functions are thread-safe.
+//
+class c_frame_buffer_pool
+{
+public:
+    struct s_stats {
+        uint64_t hit_count;  // Requests served from the pool
+        uint64_t miss_count;  // Requests that needed a heap allocation
+        uint64_t bytes_in_use;  // Bytes in buffers that have not been released
+        uint64_t peak_bytes_in_use;  // Highest value of bytes_in_use
+        uint64_t pooled_bytes;  // Bytes in released buffers kept for reuse
+    };
+
+    // Get a buffer of at least size bytes, the contents are undefined
+    static uint8_t *get_buffer(
+            size_t size);
+
+    // Return a buffer to the pool, nullptr is ignored
+    // p_buffer must have come from get_buffer()
+    static void release_buffer(
+            uint8_t *p_buffer);
+
+    // Free all released buffers, for example when a new file with a different frame size is opened
+    static void free_unused_buffers();
+
+    static s_stats get_stats();
+
+    static void reset_stats();
+};
+
+
+//
+// Buffer from the frame buffer pool that is released when it goes out of scope
+//
+class c_pooled_buffer
+{
+public:
+    explicit c_pooled_buffer(size_t size)
+        : mp_buffer(c_frame_buffer_pool::get_buffer(size))
+    {
+    }
+
+    ~c_pooled_buffer()
+    {
+        c_frame_buffer_pool::release_buffer(mp_buffer);
+    }
+
+    uint8_t *get()
+    {
+        return mp_buffer;
+    }
+
+
+private:
+    // Not copyable
+    c_pooled_buffer(const c_pooled_buffer &);
+    c_pooled_buffer &operator=(const c_pooled_buffer &);
+
+    uint8_t *mp_buffer;
+};
+
+#endif // FRAME_BUFFER_POOL_H
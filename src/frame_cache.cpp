@@ -0,0 +1,258 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#include <QtConcurrent>
+#include <QMutexLocker>
+#include <cstring>
+
+#include "frame_cache.h"
+
+
+// Default memory budget for cached frames
+static const uint64_t C_DEFAULT_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+// Limits on the number of cached frames
+static const int C_MIN_SLOTS = 2;
+static const int C_MAX_SLOTS = 64;
+
+
+c_frame_cache::c_frame_cache()
+    : m_frame_size(0),
+      m_memory_budget(C_DEFAULT_MEMORY_BUDGET),
+      m_is_running(false),
+      m_stop(false),
+      m_hit_count(0),
+      m_miss_count(0)
+{
+    m_ser_file.set_memory_mapping(true);
+}
+
+
+c_frame_cache::~c_frame_cache()
+{
+    close();
+}
+
+
+// ------------------------------------------
+// Open SER file for reading ahead
+// ------------------------------------------
+bool c_frame_cache::open(const std::string &filename_utf8)
+{
+    close();
+
+    if (m_ser_file.open(filename_utf8, 0, 1) <= 0) {
+        m_ser_file.close();
+        return true;
+    }
+
+    m_frame_size = m_ser_file.get_buffer_size();
+
+    // Work out how many frames fit into the memory budget
+    uint64_t slot_count = m_memory_budget / (uint64_t)m_frame_size;
+    if (slot_count > C_MAX_SLOTS) {
+        slot_count = C_MAX_SLOTS;
+    }
+
+    if (slot_count < C_MIN_SLOTS) {
+        // Frames are too large for the budget, do not cache anything
+        m_ser_file.close();
+        return true;
+    }
+
+    m_slots.resize(slot_count);
+    for (s_slot &slot : m_slots) {
+        slot.frame_number = -1;
+        slot.valid = false;
+        slot.timestamp = 0;
+        slot.p_buffer.reset(new uint8_t[m_frame_size]);
+    }
+
+    reset_stats();
+    return false;
+}
+
+
+// ------------------------------------------
+// Stop reading ahead and close the SER file
+// ------------------------------------------
+void c_frame_cache::close()
+{
+    m_mutex.lock();
+    m_stop = true;
+    m_upcoming_frames.clear();
+    m_mutex.unlock();
+
+    // Wait for the read-ahead thread to notice
+    m_read_ahead_thread.waitForFinished();
+
+    m_stop = false;
+    m_slots.clear();
+    m_ser_file.close();
+}
+
+
+// ------------------------------------------
+// Set the memory used for cached frames
+// ------------------------------------------
+void c_frame_cache::set_memory_budget(uint64_t budget)
+{
+    m_memory_budget = budget;
+}
+
+
+// ------------------------------------------
+// Set frames that are expected to be displayed next
+// ------------------------------------------
+void c_frame_cache::set_upcoming_frames(const QVector<int> &frame_numbers)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_slots.empty()) {
+        return;
+    }
+
+    // There is no point reading further ahead than the cache can hold
+    m_upcoming_frames = frame_numbers.mid(0, (int)m_slots.size());
+
+    if (!m_is_running && !m_upcoming_frames.isEmpty()) {
+        m_is_running = true;
+        m_read_ahead_thread = QtConcurrent::run(this, &c_frame_cache::read_ahead);
+    }
+}
+
+
+// ------------------------------------------
+// Copy a frame out of the cache
+// ------------------------------------------
+bool c_frame_cache::get_frame(int frame_number, uint8_t *p_buffer, uint64_t &timestamp, bool count_stats)
+{
+    QMutexLocker locker(&m_mutex);
+    for (s_slot &slot : m_slots) {
+        if (slot.valid && slot.frame_number == frame_number) {
+            memcpy(p_buffer, slot.p_buffer.get(), m_frame_size);
+            timestamp = slot.timestamp;
+            if (count_stats) {
+                m_hit_count++;
+            }
+
+            return true;
+        }
+    }
+
+    if (count_stats) {
+        m_miss_count++;
+    }
+
+    return false;
+}
+
+
+uint64_t c_frame_cache::get_hit_count()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hit_count;
+}
+
+
+uint64_t c_frame_cache::get_miss_count()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_miss_count;
+}
+
+
+void c_frame_cache::reset_stats()
+{
+    QMutexLocker locker(&m_mutex);
+    m_hit_count = 0;
+    m_miss_count = 0;
+}
+
+
+// ------------------------------------------
+// Read-ahead thread
+// ------------------------------------------
+void c_frame_cache::read_ahead()
+{
+    while (true) {
+        m_mutex.lock();
+        if (m_stop) {
+            m_is_running = false;
+            m_mutex.unlock();
+            return;
+        }
+
+        // Find the first upcoming frame that is not already cached
+        int frame_to_read = -1;
+        for (int frame_number : m_upcoming_frames) {
+            bool cached = false;
+            for (const s_slot &slot : m_slots) {
+                if (slot.frame_number == frame_number) {
+                    cached = true;
+                    break;
+                }
+            }
+
+            if (!cached) {
+                frame_to_read = frame_number;
+                break;
+            }
+        }
+
+        // Find a slot holding a frame that is no longer wanted
+        s_slot *p_slot = nullptr;
+        if (frame_to_read > 0) {
+            for (s_slot &slot : m_slots) {
+                if (!m_upcoming_frames.contains(slot.frame_number)) {
+                    p_slot = &slot;
+                    if (!slot.valid) {
+                        break;  // Prefer empty slots
+                    }
+                }
+            }
+        }
+
+        if (p_slot == nullptr) {
+            // Nothing more to read until the upcoming frames change
+            m_is_running = false;
+            m_mutex.unlock();
+            return;
+        }
+
+        // Claim the slot, it will not be handed out until it is marked valid again
+        p_slot->frame_number = frame_to_read;
+        p_slot->valid = false;
+        m_mutex.unlock();
+
+        // Read the frame without holding the lock
+        int32_t ret = m_ser_file.get_frame(frame_to_read, p_slot->p_buffer.get());
+        uint64_t timestamp = m_ser_file.get_timestamp();
+
+        m_mutex.lock();
+        if (ret >= 0) {
+            p_slot->timestamp = timestamp;
+            p_slot->valid = true;
+        } else {
+            // Read failed, do not try this frame again
+            p_slot->frame_number = -1;
+            m_upcoming_frames.removeAll(frame_to_read);
+        }
+
+        m_mutex.unlock();
+    }
+}
@@ -0,0 +1,102 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <QFuture>
+#include <QMutex>
+#include <QVector>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "pipp_ser.h"
+
+
+//
+// Read-ahead cache of raw SER frames
+// A background thread reads the frames that are about to be displayed into a
+// fixed ring of buffers using its own c_pipp_ser instance, so disk access is
+// kept off the GUI thread during playback.
+//
+class c_frame_cache
+{
+public:
+    // Constructor
+    c_frame_cache();
+
+    // Destructor
+    ~c_frame_cache();
+
+    // Open SER file for reading ahead, returns true on error
+    bool open(const std::string &filename_utf8);
+
+    // Stop reading ahead and close the SER file
+    void close();
+
+    // Set the memory used for cached frames, takes effect at the next open()
+    void set_memory_budget(uint64_t budget);
+
+    // Get the number of frames that can be held in the cache
+    int get_slot_count()
+    {
+        return (int)m_slots.size();
+    }
+
+    // Set frames that are expected to be displayed next, in display order
+    // Frames not in this list may be dropped from the cache
+    void set_upcoming_frames(const QVector<int> &frame_numbers);
+
+    // Copy a frame out of the cache, returns false if the frame is not cached
+    // Only lookups with count_stats set are included in the hit and miss counts
+    bool get_frame(int frame_number, uint8_t *p_buffer, uint64_t &timestamp, bool count_stats = true);
+
+    // Cache statistics for playback lookups
+    uint64_t get_hit_count();
+    uint64_t get_miss_count();
+    void reset_stats();
+
+
+private:
+    void read_ahead();
+
+
+private:
+    struct s_slot {
+        int frame_number;
+        bool valid;  // Frame data has been read into this slot
+        uint64_t timestamp;
+        std::unique_ptr<uint8_t[]> p_buffer;
+    };
+
+    QMutex m_mutex;
+    c_pipp_ser m_ser_file;
+    std::vector<s_slot> m_slots;
+    QVector<int> m_upcoming_frames;
+    int32_t m_frame_size;
+    uint64_t m_memory_budget;
+    bool m_is_running;
+    bool m_stop;
+    uint64_t m_hit_count;
+    uint64_t m_miss_count;
+    QFuture<void> m_read_ahead_thread;
+};
+
+#endif // FRAME_CACHE_H
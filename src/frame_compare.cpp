@@ -0,0 +1,278 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#include <cstdlib>
+#include "frame_compare.h"
+
+
+// SIMD versions are only built for x86 and can be turned off with DISABLE_SIMD_FRAME_COMPARE
+#if !defined(DISABLE_SIMD_FRAME_COMPARE)
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define FRAME_COMPARE_SSE2
+        #include <emmintrin.h>
+    #endif
+#endif
+
+
+// Pixels handled by each SIMD step, 16 mono pixels or 16 BGR pixels (3 registers)
+static const int C_SIMD_PIXELS = 16;
+
+// Bit set for the first byte of each of 16 BGR pixels in a 48-bit mask
+static const uint64_t C_PIXEL_START_BITS = 0x249249249249ULL;
+
+
+// ------------------------------------------
+// Scalar pixel comparison
+// ------------------------------------------
+static inline bool pixel_changed(
+    const uint8_t *p_this,
+    const uint8_t *p_last,
+    int bytes_per_pixel,
+    int tolerance)
+{
+    int diff = abs((int)p_this[0] - p_last[0]);
+    if (bytes_per_pixel == 3) {
+        diff += abs((int)p_this[1] - p_last[1]);
+        diff += abs((int)p_this[2] - p_last[2]);
+    }
+
+    return diff > tolerance;
+}
+
+
+#ifdef FRAME_COMPARE_SSE2
+// ------------------------------------------
+// Absolute differences of 16 bytes
+// ------------------------------------------
+static inline __m128i abs_diff_epu8(
+    const uint8_t *p_this,
+    const uint8_t *p_last)
+{
+    __m128i this_data = _mm_loadu_si128((const __m128i *)p_this);
+    __m128i last_data = _mm_loadu_si128((const __m128i *)p_last);
+    return _mm_or_si128(_mm_subs_epu8(this_data, last_data), _mm_subs_epu8(last_data, this_data));
+}
+
+
+// ------------------------------------------
+// Bit mask of the changed pixels in 16 pixels starting at p_this
+// Mono: bit n is pixel n, BGR: bit 3n is pixel n
+// ------------------------------------------
+static inline uint64_t get_changed_pixel_bits(
+    const uint8_t *p_this,
+    const uint8_t *p_last,
+    int bytes_per_pixel,
+    int tolerance)
+{
+    const __m128i zero = _mm_setzero_si128();
+    if (bytes_per_pixel == 1) {
+        // Saturating subtract of the tolerance leaves non-zero bytes for changed pixels
+        __m128i tolerance_8 = _mm_set1_epi8((char)tolerance);
+        __m128i over = _mm_subs_epu8(abs_diff_epu8(p_this, p_last), tolerance_8);
+        return (uint64_t)(_mm_movemask_epi8(_mm_cmpeq_epi8(over, zero)) ^ 0xFFFF);
+    }
+
+    __m128i diff[3];
+    diff[0] = abs_diff_epu8(p_this, p_last);
+    diff[1] = abs_diff_epu8(p_this + 16, p_last + 16);
+    diff[2] = abs_diff_epu8(p_this + 32, p_last + 32);
+
+    // Quick exit for identical pixels, the usual case in an unchanged border
+    __m128i any_diff = _mm_or_si128(_mm_or_si128(diff[0], diff[1]), diff[2]);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(any_diff, zero)) == 0xFFFF) {
+        return 0;
+    }
+
+    // Widen to 16 bits and add each byte to the next 2 so the first byte of each pixel holds the pixel's total
+    __m128i wide[7];
+    for (int i = 0; i < 3; i++) {
+        wide[i * 2 + 0] = _mm_unpacklo_epi8(diff[i], zero);
+        wide[i * 2 + 1] = _mm_unpackhi_epi8(diff[i], zero);
+    }
+
+    wide[6] = zero;
+    __m128i tolerance_16 = _mm_set1_epi16((short)tolerance);
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; i += 2) {
+        __m128i over[2];
+        for (int j = 0; j < 2; j++) {
+            __m128i this_wide = wide[i + j];
+            __m128i next_wide = wide[i + j + 1];
+            __m128i next_1 = _mm_or_si128(_mm_srli_si128(this_wide, 2), _mm_slli_si128(next_wide, 14));
+            __m128i next_2 = _mm_or_si128(_mm_srli_si128(this_wide, 4), _mm_slli_si128(next_wide, 12));
+            __m128i total = _mm_add_epi16(_mm_add_epi16(this_wide, next_1), next_2);
+            over[j] = _mm_cmpgt_epi16(total, tolerance_16);
+        }
+
+        bits |= (uint64_t)_mm_movemask_epi8(_mm_packs_epi16(over[0], over[1])) << (i * 8);
+    }
+
+    return bits & C_PIXEL_START_BITS;
+}
+#endif  // FRAME_COMPARE_SSE2
+
+
+int find_first_changed_pixel(
+    const uint8_t *p_this_line,
+    const uint8_t *p_last_line,
+    int x_start,
+    int x_end,
+    int bytes_per_pixel,
+    int tolerance)
+{
+    if (tolerance >= 255 * bytes_per_pixel) {
+        // Nothing can count as changed
+        return x_end;
+    }
+
+    int x = x_start;
+#ifdef FRAME_COMPARE_SSE2
+    for ( ; x + C_SIMD_PIXELS <= x_end; x += C_SIMD_PIXELS) {
+        int offset = x * bytes_per_pixel;
+        uint64_t bits = get_changed_pixel_bits(p_this_line + offset, p_last_line + offset, bytes_per_pixel, tolerance);
+        if (bits != 0) {
+            // Lowest changed pixel
+            int pixel = 0;
+            while (((bits >> (pixel * bytes_per_pixel)) & 1) == 0) {
+                pixel++;
+            }
+
+            return x + pixel;
+        }
+    }
+#endif
+
+    for ( ; x < x_end; x++) {
+        int offset = x * bytes_per_pixel;
+        if (pixel_changed(p_this_line + offset, p_last_line + offset, bytes_per_pixel, tolerance)) {
+            return x;
+        }
+    }
+
+    return x_end;
+}
+
+
+int find_last_changed_pixel(
+    const uint8_t *p_this_line,
+    const uint8_t *p_last_line,
+    int x_start,
+    int x_end,
+    int bytes_per_pixel,
+    int tolerance)
+{
+    if (tolerance >= 255 * bytes_per_pixel) {
+        // Nothing can count as changed
+        return x_start - 1;
+    }
+
+    int x = x_end;
+#ifdef FRAME_COMPARE_SSE2
+    for ( ; x - C_SIMD_PIXELS >= x_start; x -= C_SIMD_PIXELS) {
+        int offset = (x - C_SIMD_PIXELS) * bytes_per_pixel;
+        uint64_t bits = get_changed_pixel_bits(p_this_line + offset, p_last_line + offset, bytes_per_pixel, tolerance);
+        if (bits != 0) {
+            // Highest changed pixel
+            int pixel = C_SIMD_PIXELS - 1;
+            while (((bits >> (pixel * bytes_per_pixel)) & 1) == 0) {
+                pixel--;
+            }
+
+            return x - C_SIMD_PIXELS + pixel;
+        }
+    }
+#endif
+
+    for (x--; x >= x_start; x--) {
+        int offset = x * bytes_per_pixel;
+        if (pixel_changed(p_this_line + offset, p_last_line + offset, bytes_per_pixel, tolerance)) {
+            return x;
+        }
+    }
+
+    return x_start - 1;
+}
+
+
+void get_transparent_pixel_mask(
+    const uint8_t *p_this_line,
+    uint8_t *p_last_line,
+    uint8_t *p_mask,
+    int x_start,
+    int x_end,
+    int tolerance)
+{
+    if (tolerance > 255) {
+        tolerance = 255;
+    }
+
+    const uint8_t *p_this = p_this_line + x_start * 3;
+    uint8_t *p_last = p_last_line + x_start * 3;
+    int x = x_start;
+#ifdef FRAME_COMPARE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i tolerance_8 = _mm_set1_epi8((char)tolerance);
+    for ( ; x + C_SIMD_PIXELS <= x_end; x += C_SIMD_PIXELS) {
+        // Non-zero bytes for channels that differ by more than the tolerance
+        uint64_t bits = 0;
+        for (int i = 0; i < 3; i++) {
+            __m128i over = _mm_subs_epu8(abs_diff_epu8(p_this + i * 16, p_last + i * 16), tolerance_8);
+            bits |= (uint64_t)(_mm_movemask_epi8(_mm_cmpeq_epi8(over, zero)) ^ 0xFFFF) << (i * 16);
+        }
+
+        if (bits == 0) {
+            // All 16 pixels are transparent
+            _mm_storeu_si128((__m128i *)p_mask, _mm_set1_epi8(1));
+            p_mask += C_SIMD_PIXELS;
+        } else {
+            for (int pixel = 0; pixel < C_SIMD_PIXELS; pixel++) {
+                if ((bits >> (pixel * 3)) & 0x7) {
+                    *p_mask++ = 0;
+                    p_last[pixel * 3 + 0] = p_this[pixel * 3 + 0];
+                    p_last[pixel * 3 + 1] = p_this[pixel * 3 + 1];
+                    p_last[pixel * 3 + 2] = p_this[pixel * 3 + 2];
+                } else {
+                    *p_mask++ = 1;
+                }
+            }
+        }
+
+        p_this += C_SIMD_PIXELS * 3;
+        p_last += C_SIMD_PIXELS * 3;
+    }
+#endif
+
+    for ( ; x < x_end; x++) {
+        bool not_transparent = abs((int)p_this[0] - p_last[0]) > tolerance;
+        not_transparent |= abs((int)p_this[1] - p_last[1]) > tolerance;
+        not_transparent |= abs((int)p_this[2] - p_last[2]) > tolerance;
+        if (not_transparent) {
+            // This pixel is not transparent, update last line pixel for comparison with the next frame
+            *p_mask++ = 0;
+            p_last[0] = p_this[0];
+            p_last[1] = p_this[1];
+            p_last[2] = p_this[2];
+        } else {
+            // This pixel is close enough to the previous pixel to be transparent
+            *p_mask++ = 1;
+        }
+
+        p_this += 3;
+        p_last += 3;
+    }
+}
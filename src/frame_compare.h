@@ -0,0 +1,63 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#ifndef FRAME_COMPARE_H
+#define FRAME_COMPARE_H
+
+#include <cstdint>
+
+
+//
+// Comparisons of a line of a frame with the same line of the previous frame, used by the GIF writer
+// p_this_line and p_last_line point to the start of the lines, bytes_per_pixel is 1 (mono) or 3 (BGR).
+// A pixel has changed when the sum of the absolute differences of its channels is more than tolerance.
+// Uses SSE2 when it is available, the results are the same on every path.
+//
+
+// First changed pixel in x_start to x_end-1, x_end if none have changed
+int find_first_changed_pixel(
+    const uint8_t *p_this_line,
+    const uint8_t *p_last_line,
+    int x_start,
+    int x_end,
+    int bytes_per_pixel,
+    int tolerance);
+
+
+// Last changed pixel in x_start to x_end-1, x_start-1 if none have changed
+int find_last_changed_pixel(
+    const uint8_t *p_this_line,
+    const uint8_t *p_last_line,
+    int x_start,
+    int x_end,
+    int bytes_per_pixel,
+    int tolerance);
+
+
+// Mark pixels x_start to x_end-1 of a BGR line as transparent (1) or not (0) in p_mask.
+// A pixel is transparent when no channel differs from the last line by more than tolerance.
+// Pixels that are not transparent are copied to p_last_line, transparent pixels leave it unchanged.
+void get_transparent_pixel_mask(
+    const uint8_t *p_this_line,
+    uint8_t *p_last_line,
+    uint8_t *p_mask,
+    int x_start,
+    int x_end,
+    int tolerance);
+
+#endif  // FRAME_COMPARE_H
@@ -0,0 +1,308 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#include <QtConcurrent>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+
+#include "frame_pipeline.h"
+#include "frame_cache.h"
+
+
+// Limits on the number of frames in flight
+static const int C_MIN_SLOTS = 2;
+static const int C_MAX_SLOTS = 8;
+
+
+c_frame_pipeline::c_frame_pipeline(c_frame_cache *p_frame_cache)
+    : mp_frame_cache(p_frame_cache),
+      m_generation(0)
+{
+    m_ser_file.set_memory_mapping(true);
+}
+
+
+c_frame_pipeline::~c_frame_pipeline()
+{
+    close();
+}
+
+
+// ------------------------------------------
+// Open SER file for the pipeline
+// ------------------------------------------
+bool c_frame_pipeline::open(const std::string &filename_utf8)
+{
+    close();
+
+    if (m_ser_file.open(filename_utf8, 0, 1) <= 0) {
+        m_ser_file.close();
+        return true;
+    }
+
+    // One frame in flight per core, the GUI thread takes care of displaying
+    int slot_count = QThread::idealThreadCount();
+    slot_count = (slot_count < C_MIN_SLOTS) ? C_MIN_SLOTS : slot_count;
+    slot_count = (slot_count > C_MAX_SLOTS) ? C_MAX_SLOTS : slot_count;
+
+    m_slots.resize(slot_count);
+    for (s_slot &slot : m_slots) {
+        slot.state = SLOT_EMPTY;
+        slot.frame_number = -1;
+        slot.generation = -1;
+        slot.valid = false;
+        slot.timestamp = 0;
+        slot.times.read_ms = 0.0;
+        slot.times.process_ms = 0.0;
+        slot.p_image.reset(new c_image);
+    }
+
+    return false;
+}
+
+
+// ------------------------------------------
+// Wait for frames in flight and close the SER file
+// ------------------------------------------
+void c_frame_pipeline::close()
+{
+    cancel();
+    for (s_slot &slot : m_slots) {
+        slot.future.waitForFinished();
+    }
+
+    m_slots.clear();
+    m_ser_file.close();
+}
+
+
+// ------------------------------------------
+// Discard all processed and in-flight frames
+// ------------------------------------------
+void c_frame_pipeline::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Frames still being processed are discarded when they complete
+    m_generation++;
+    for (s_slot &slot : m_slots) {
+        if (slot.state == SLOT_DONE) {
+            slot.state = SLOT_EMPTY;
+        }
+    }
+}
+
+
+// ------------------------------------------
+// Start processing upcoming frames
+// ------------------------------------------
+void c_frame_pipeline::schedule_frames(
+        const QVector<int> &frame_numbers,
+        const c_image *p_settings_image,
+        const s_frame_processing &processing)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Free processed frames that are no longer wanted
+    for (s_slot &slot : m_slots) {
+        if (slot.state == SLOT_DONE && !frame_numbers.contains(slot.frame_number)) {
+            slot.state = SLOT_EMPTY;
+        }
+    }
+
+    for (int frame_number : frame_numbers) {
+        // Check if this frame is already processed or in flight
+        bool scheduled = false;
+        for (const s_slot &slot : m_slots) {
+            if (slot.state != SLOT_EMPTY && slot.generation == m_generation && slot.frame_number == frame_number) {
+                scheduled = true;
+                break;
+            }
+        }
+
+        if (scheduled) {
+            continue;
+        }
+
+        // Find a free slot
+        int slot_index = -1;
+        for (int i = 0; i < (int)m_slots.size(); i++) {
+            if (m_slots[i].state == SLOT_EMPTY) {
+                slot_index = i;
+                break;
+            }
+        }
+
+        if (slot_index < 0) {
+            // All slots are in use, try again when the next frame is displayed
+            break;
+        }
+
+        s_slot &slot = m_slots[slot_index];
+        slot.state = SLOT_BUSY;
+        slot.frame_number = frame_number;
+        slot.generation = m_generation;
+        slot.processing = processing;
+        slot.p_image->copy_processing_settings(*p_settings_image);
+        slot.future = QtConcurrent::run(this, &c_frame_pipeline::process_slot, slot_index);
+    }
+}
+
+
+// ------------------------------------------
+// Take a processed frame
+// ------------------------------------------
+bool c_frame_pipeline::take_frame(int frame_number, c_image *p_image, uint64_t &timestamp, s_frame_times &times)
+{
+    QMutexLocker locker(&m_mutex);
+    for (s_slot &slot : m_slots) {
+        if (slot.state == SLOT_DONE && slot.generation == m_generation && slot.frame_number == frame_number) {
+            bool valid = slot.valid;
+            if (valid) {
+                // The slot keeps the old image buffer for reuse
+                p_image->swap_image_data(*slot.p_image);
+                timestamp = slot.timestamp;
+                times = slot.times;
+            }
+
+            slot.state = SLOT_EMPTY;
+            return valid;
+        }
+    }
+
+    return false;
+}
+
+
+// ------------------------------------------
+// Apply processing stages to a frame
+// ------------------------------------------
+void c_frame_pipeline::process_image(
+        c_image *p_image,
+        const s_frame_processing &processing)
+{
+    // Stages that work on one sample at a time can be done by the display conversion
+    // instead, as long as no stage that mixes samples has to see their output first
+    bool fold_into_display = processing.display_conversion && processing.display_only;
+    bool fold_8_bit_conversion = fold_into_display && processing.conv_to_8_bit &&
+            !(processing.do_processing && (processing.debayer_enable ||
+                                           processing.monochrome_conversion_enable ||
+                                           processing.colour_saturation != 1.0));
+
+    if (processing.conv_to_8_bit && !fold_8_bit_conversion) {
+        p_image->convert_image_to_8bit();
+    }
+
+    bool fold_luts = false;
+    if (processing.do_processing) {
+        // Debayer frame if required
+        if (processing.debayer_enable) {
+            p_image->debayer_image_bilinear(processing.debayer_colour_id);
+        }
+
+        if (processing.crop_enable) {
+            p_image->crop_image(
+                    processing.crop_x_pos,
+                    processing.crop_y_pos,
+                    processing.crop_width,
+                    processing.crop_height);
+        }
+
+        p_image->align_colour_channels();
+
+        if (processing.monochrome_conversion_enable) {
+            p_image->monochrome_conversion(processing.monochrome_conversion_type);
+        }
+
+        // The display conversion applies the 8-bit LUTs, so only fold them into it
+        // if the frame is 8-bit by then and colour saturation does not need their output
+        fold_luts = fold_into_display &&
+                    (p_image->get_byte_depth() == 1 || fold_8_bit_conversion) &&
+                    (processing.colour_saturation == 1.0 || !p_image->get_colour());
+        if (!fold_luts) {
+            p_image->do_lut_based_processing();
+        }
+
+        // Adjust colour saturation if required
+        p_image->change_colour_saturation(processing.colour_saturation);
+    }
+
+    if (processing.display_conversion) {
+        p_image->conv_data_ready_for_display(fold_luts);
+    }
+}
+
+
+// ------------------------------------------
+// Read and process the frame for one slot
+// Runs on the thread pool
+// ------------------------------------------
+void c_frame_pipeline::process_slot(int slot_index)
+{
+    // Only this thread touches a busy slot's image and details
+    s_slot &slot = m_slots[slot_index];
+    c_image *p_image = slot.p_image.get();
+
+    bool is_colour = false;
+    if (m_ser_file.get_colour_id() == COLOURID_RGB || m_ser_file.get_colour_id() == COLOURID_BGR) {
+        is_colour = true;
+    }
+
+    p_image->set_image_details(
+                m_ser_file.get_width(),  // width
+                m_ser_file.get_height(),  // height
+                m_ser_file.get_byte_depth(),  // byte_depth
+                m_ser_file.get_colour_id(),  // colour_id
+                is_colour);  // colour
+
+    // Read stage, use the read-ahead cache if it already has this frame
+    // Prefetch lookups are left out of the cache's playback statistics
+    QElapsedTimer stage_timer;
+    stage_timer.start();
+    s_frame_times times;
+    uint64_t timestamp = 0;
+    bool valid = mp_frame_cache != nullptr &&
+                 mp_frame_cache->get_frame(slot.frame_number, p_image->get_p_buffer(), timestamp, false);
+    if (!valid) {
+        QMutexLocker read_locker(&m_read_mutex);
+        valid = m_ser_file.get_frame(slot.frame_number, p_image->get_p_buffer()) >= 0;
+        timestamp = m_ser_file.get_timestamp();
+    }
+
+    times.read_ms = stage_timer.nsecsElapsed() / 1000000.0;
+
+    // Processing stages
+    stage_timer.start();
+    if (valid) {
+        process_image(p_image, slot.processing);
+    }
+
+    times.process_ms = stage_timer.nsecsElapsed() / 1000000.0;
+
+    QMutexLocker locker(&m_mutex);
+    if (slot.generation == m_generation) {
+        slot.valid = valid;
+        slot.timestamp = timestamp;
+        slot.times = times;
+        slot.state = SLOT_DONE;
+    } else {
+        // Settings changed while this frame was in flight, discard it
+        slot.state = SLOT_EMPTY;
+    }
+}
@@ -0,0 +1,135 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <QFuture>
+#include <QMutex>
+#include <QVector>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "pipp_ser.h"
+
+
+class c_frame_cache;
+
+
+//
+// Processes upcoming frames on the thread pool during playback
+// Each frame in flight has its own c_image, so frame N can be displayed while
+// frame N+1 is being processed and frame N+2 is being read by the frame cache.
+// Results are handed out by frame number so display order is always preserved.
+//
+class c_frame_pipeline
+{
+public:
+    // Processing to apply to each frame
+    struct s_frame_processing {
+        bool conv_to_8_bit;
+        bool do_processing;
+        bool debayer_enable;
+        int debayer_colour_id;
+        bool crop_enable;
+        int crop_x_pos;
+        int crop_y_pos;
+        int crop_width;
+        int crop_height;
+        bool monochrome_conversion_enable;
+        int monochrome_conversion_type;
+        double colour_saturation;
+        bool display_conversion;  // Also convert the frame into the image's display buffer
+        bool display_only;  // Frame data is only needed for display, stages may be folded into the display conversion
+    };
+
+    // Time a worker spent on each stage of a frame
+    struct s_frame_times {
+        double read_ms;
+        double process_ms;
+    };
+
+    // Constructor
+    c_frame_pipeline(c_frame_cache *p_frame_cache);
+
+    // Destructor
+    ~c_frame_pipeline();
+
+    // Open SER file for the pipeline, returns true on error
+    bool open(const std::string &filename_utf8);
+
+    // Wait for frames in flight and close the SER file
+    void close();
+
+    // Discard all processed and in-flight frames, used when processing settings change
+    void cancel();
+
+    // Get the maximum number of frames in flight
+    int get_slot_count()
+    {
+        return (int)m_slots.size();
+    }
+
+    // Start processing frames that are expected to be displayed next, in display order
+    // Processing settings are copied from p_settings_image
+    void schedule_frames(
+            const QVector<int> &frame_numbers,
+            const c_image *p_settings_image,
+            const s_frame_processing &processing);
+
+    // Take a processed frame, the frame data is swapped into p_image
+    // Returns false if the frame has not been processed
+    bool take_frame(int frame_number, c_image *p_image, uint64_t &timestamp, s_frame_times &times);
+
+    // Apply processing stages to a frame that has been read into p_image
+    static void process_image(
+            c_image *p_image,
+            const s_frame_processing &processing);
+
+
+private:
+    void process_slot(int slot_index);
+
+
+private:
+    enum e_slot_state {SLOT_EMPTY, SLOT_BUSY, SLOT_DONE};
+
+    struct s_slot {
+        e_slot_state state;
+        int frame_number;
+        int generation;
+        bool valid;
+        uint64_t timestamp;
+        s_frame_times times;
+        s_frame_processing processing;
+        std::unique_ptr<c_image> p_image;
+        QFuture<void> future;
+    };
+
+    c_frame_cache *mp_frame_cache;
+    c_pipp_ser m_ser_file;
+    QMutex m_read_mutex;  // Protects m_ser_file
+    QMutex m_mutex;  // Protects slot states and m_generation
+    std::vector<s_slot> m_slots;
+    int m_generation;
+};
+
+#endif // FRAME_PIPELINE_H
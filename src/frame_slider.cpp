@@ -196,7 +196,61 @@ bool c_frame_slider::goto_next_frame()
 }
 
 
-int c_frame_slider::get_start_frame()
+QVector<int> c_frame_slider::get_upcoming_frames(int count) const
+{
+    // Follows the same rules as goto_next_frame() without moving the slider
+    QVector<int> frames;
+    int current_value = value();
+    int current_direction = (m_direction == 2) ? m_current_direction : m_direction;
+    const int start_frame = get_start_frame();
+    const int end_frame = get_end_frame();
+
+    // Limit number of loop iterations in case the start and end frames are the same
+    for (int i = 0; i < 2 * count + 2 && frames.size() < count; i++) {
+        int next_value = current_value;
+        if (current_direction == 0) {
+            // Forward play
+            if (current_value < start_frame) {
+                next_value = start_frame;
+            } else if (current_value < end_frame) {
+                next_value = current_value + 1;
+            } else if (m_direction == 2) {
+                // Forward + Reverse play, turn around without changing frame
+                current_direction = 1;
+            } else if (m_repeat) {
+                next_value = start_frame;
+            } else {
+                break;  // End of playback
+            }
+        } else {
+            // Reverse play
+            if (current_value > end_frame) {
+                next_value = end_frame;
+            } else if (current_value > start_frame) {
+                next_value = current_value - 1;
+            } else if (m_repeat) {
+                if (m_direction == 2) {
+                    // Forward + Reverse play, turn around without changing frame
+                    current_direction = 0;
+                } else {
+                    next_value = end_frame;
+                }
+            } else {
+                break;  // End of playback
+            }
+        }
+
+        if (next_value != current_value) {
+            frames.append(next_value);
+            current_value = next_value;
+        }
+    }
+
+    return frames;
+}
+
+
+int c_frame_slider::get_start_frame() const
 {
     int ret;
     if (m_markers_enabled) {
@@ -209,7 +263,7 @@ int c_frame_slider::get_start_frame()
 }
 
 
-int c_frame_slider::get_end_frame()
+int c_frame_slider::get_end_frame() const
 {
     int ret;
     if (m_markers_enabled) {
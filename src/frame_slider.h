@@ -20,6 +20,7 @@
 #define FRAME_SLIDER_H
 
 #include <QSlider>
+#include <QVector>
 
 
 class c_markers_dialog;
@@ -36,8 +37,9 @@ public:
     void set_direction(int dir);
     void goto_first_frame();
     bool goto_next_frame();
-    int get_start_frame();
-    int get_end_frame();
+    QVector<int> get_upcoming_frames(int count) const;
+    int get_start_frame() const;
+    int get_end_frame() const;
 
 signals:
     void start_marker_changed(int frame);
@@ -19,6 +19,8 @@
 #include "gif_write.h"
 #include "pipp_utf8.h"
 #include "lzw_compressor.h"
+#include "frame_buffer_pool.h"
+#include "frame_compare.h"
 
 extern "C" {
     #include "neuquant.h"
@@ -29,17 +31,56 @@ extern "C" {
     #include <QDebug>
 #endif
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cassert>
 #include <functional>
 #include <memory>
+#include <thread>
+
+
+// Sample frames kept for the global colour table
+static const int C_MAX_PALETTE_SAMPLE_FRAMES = 16;
+
+// Adaptive palette mode re-quantises when a frame's mean colour error with the current colour
+// table is more than this many times the error of the pixels the table was made from
+static const double C_MAX_PALETTE_ERROR_RATIO = 2.0;
+
+// With NeuQuant warm start, one frame in this many is a key frame that is learnt from scratch
+static const int C_NEUQUANT_KEY_FRAME_INTERVAL = 16;
+
+// Warm started frames only need refining so are learnt from this many times fewer pixels
+static const int C_NEUQUANT_WARM_START_SAMPLE_FACTOR = 2;
+
+// Size of the output buffer, data is written to the file in blocks of this size
+static const size_t C_OUTPUT_BUFFER_SIZE = 4 * 1024 * 1024;
+
+
+// ------------------------------------------
+// NeuQuant network
+// ------------------------------------------
+struct c_gif_write::s_neuquant_buffers {
+    neuquant_net network;
+};
 
 
 c_gif_write::c_gif_write() :
+    m_palette_mode(PALETTE_MODE_LOCAL),
+    m_header_written(false),
+    m_repeat_count(0),
     m_file_write_error(false),
     mp_gif_file(nullptr),
-    m_open(false)
+    m_open(false),
+    m_stats(),
+    m_output_buffer_used(0),
+    m_neuquant_sample_factor(1),
+    m_neuquant_warm_start(false),
+    m_frames_since_neuquant_key_frame(0)
 {
+    // Number of frames that can be encoded at the same time
+    m_max_pending_frames = std::max(1, (int)std::thread::hardware_concurrency());
+
     // Header structure fixed fields
     m_gif_header.m_signature[0] = 'G';
     m_gif_header.m_signature[1] = 'I';
@@ -117,6 +158,15 @@ c_gif_write::c_gif_write() :
 }
 
 
+c_gif_write::~c_gif_write()
+{
+    // Worker threads must not outlive the object
+    for (s_pending_frame &pending_frame : m_pending_frames) {
+        pending_frame.encoded.wait();
+    }
+}
+
+
 // ------------------------------------------
 // Create a new GIF file
 // ------------------------------------------
@@ -136,7 +186,8 @@ bool c_gif_write::create(
         bool use_transparent_pixels,
         int transparent_tolerence,
         int lossy_compression_level,
-        int bit_depth)
+        int bit_depth,
+        e_palette_mode palette_mode)
 {
     // Check for unsupported arguments and do early return if required
     if (width > 0xFFFF || height > 0xFFFF) {
@@ -177,6 +228,18 @@ bool c_gif_write::create(
     m_transparent_tolerence = transparent_tolerence;
     m_lossy_compression_level = lossy_compression_level;
     m_bit_depth = bit_depth;
+    m_palette_mode = palette_mode;
+    m_repeat_count = repeat_count;
+    m_header_written = false;
+    m_palette_samples.clear();
+    mp_palette.reset();
+    m_adaptive_palette = std::shared_future<std::shared_ptr<const s_palette>>();
+    m_stats = s_stats();
+    m_free_frame_jobs.clear();  // Frame size may have changed
+    m_neuquant_sample_factor = 1;
+    m_neuquant_warm_start = false;
+    m_frames_since_neuquant_key_frame = 0;
+    m_neuquant_key_colour_table = std::shared_future<std::vector<uint8_t>>();
 
     // Open new GIF file
 #ifdef QT_BUILD
@@ -198,30 +261,20 @@ bool c_gif_write::create(
         return true;
     }
 
-    // Update header structure variable fields now we have more information
-    m_gif_header.m_logical_screen_width[0] = (uint8_t)(m_width & 0xFF);
-    m_gif_header.m_logical_screen_width[1] = (uint8_t)(m_width >> 8);
-    m_gif_header.m_logical_screen_height[0] = (uint8_t)(m_height & 0xFF);
-    m_gif_header.m_logical_screen_height[1] = (uint8_t)(m_height >> 8);
-
-    if (!m_colour) {
-        // Header packed_fields byte for monochrome encoding
-        m_gif_header.m_packed_fields  = 1 << 7;  // Global Color Table Flag
-        m_gif_header.m_packed_fields |= 0x7 << 4;  // Color Resolution: 8-bits per pixel
-        m_gif_header.m_packed_fields |= 0 << 3;  // Sort Flag: Not sorted
-        m_gif_header.m_packed_fields |= (m_bit_depth - 1) << 0;  // Size of Global Color Table: 256 entries
-    } else {
-        // Header packed fields byte for colour encoding
-        m_gif_header.m_packed_fields  = 0 << 7;  // Global Color Table Flag
-        m_gif_header.m_packed_fields |= 0x7 << 4;  // Color Resolution: 8-bits per pixel
-        m_gif_header.m_packed_fields |= 0 << 3;  // Sort Flag: Not sorted
-        m_gif_header.m_packed_fields |= 0 << 0;  // Size of Global Color Table: Not used
+    // All writes go through our own output buffer so the C library's buffering is not needed
+    setvbuf(mp_gif_file, nullptr, _IONBF, 0);
+    if (mp_output_buffer == nullptr) {
+        mp_output_buffer.reset(new c_pooled_buffer(C_OUTPUT_BUFFER_SIZE));
     }
 
-    m_gif_header.m_background_colour_index = 0;  // We do not use background colour pixels as yet
+    m_output_buffer_used = 0;
 
-    // Write GIF header to the file
-    fwrite_error_check(&m_gif_header, 1, sizeof(m_gif_header), mp_gif_file);
+    if (m_colour && m_palette_mode == PALETTE_MODE_LOCAL) {
+        // No global colour table
+        write_file_header(nullptr);
+    }
+
+    // For colour files with a global colour table the header is written with the first frame
 
     if (!m_colour) {
         const int colour_table_entries = 1 << m_bit_depth;
@@ -247,7 +300,7 @@ bool c_gif_write::create(
             p_mono_table[1] = p_mono_table[0];
         }
 
-        fwrite_error_check(p_global_colour_table.get(), 1, colour_table_entries * 3, mp_gif_file);
+        write_file_header(p_global_colour_table.get());
         p_global_colour_table.reset(nullptr);
 
         // Create a reverse LUT from LUT
@@ -299,15 +352,10 @@ bool c_gif_write::create(
         }
     }
 
-    // Update Netscape extension and write to file
-    // Netscape extension variable fields
-    m_netscape_extension.m_loop_count[0] = (uint8_t)(repeat_count & 0xFF);
-    m_netscape_extension.m_loop_count[1] = (uint8_t)(repeat_count >> 8);
-    fwrite_error_check(&m_netscape_extension, 1, sizeof(m_netscape_extension), mp_gif_file);
-
     if (m_file_write_error) {
         fclose(mp_gif_file);
         mp_gif_file = nullptr;
+        m_output_buffer_used = 0;
     } else {
         m_open = true;
     }
@@ -318,6 +366,84 @@ bool c_gif_write::create(
 }
 
 
+// ------------------------------------------
+// Write GIF header, global colour table and Netscape extension
+// ------------------------------------------
+void c_gif_write::write_file_header(
+        const uint8_t *p_global_colour_table)
+{
+    // Update header structure variable fields now we have more information
+    m_gif_header.m_logical_screen_width[0] = (uint8_t)(m_width & 0xFF);
+    m_gif_header.m_logical_screen_width[1] = (uint8_t)(m_width >> 8);
+    m_gif_header.m_logical_screen_height[0] = (uint8_t)(m_height & 0xFF);
+    m_gif_header.m_logical_screen_height[1] = (uint8_t)(m_height >> 8);
+
+    if (p_global_colour_table != nullptr) {
+        // Header packed_fields byte with a global colour table (always the case for monochrome)
+        m_gif_header.m_packed_fields  = 1 << 7;  // Global Color Table Flag
+        m_gif_header.m_packed_fields |= 0x7 << 4;  // Color Resolution: 8-bits per pixel
+        m_gif_header.m_packed_fields |= 0 << 3;  // Sort Flag: Not sorted
+        m_gif_header.m_packed_fields |= (m_bit_depth - 1) << 0;  // Size of Global Color Table: 256 entries
+    } else {
+        // Header packed fields byte for colour encoding with local colour tables
+        m_gif_header.m_packed_fields  = 0 << 7;  // Global Color Table Flag
+        m_gif_header.m_packed_fields |= 0x7 << 4;  // Color Resolution: 8-bits per pixel
+        m_gif_header.m_packed_fields |= 0 << 3;  // Sort Flag: Not sorted
+        m_gif_header.m_packed_fields |= 0 << 0;  // Size of Global Color Table: Not used
+    }
+
+    m_gif_header.m_background_colour_index = 0;  // We do not use background colour pixels as yet
+
+    // Write GIF header to the file
+    write_data(&m_gif_header, sizeof(m_gif_header));
+
+    if (p_global_colour_table != nullptr) {
+        write_data(p_global_colour_table, (1 << m_bit_depth) * 3);
+    }
+
+    // Update Netscape extension and write to file
+    // Netscape extension variable fields
+    m_netscape_extension.m_loop_count[0] = (uint8_t)(m_repeat_count & 0xFF);
+    m_netscape_extension.m_loop_count[1] = (uint8_t)(m_repeat_count >> 8);
+    write_data(&m_netscape_extension, sizeof(m_netscape_extension));
+
+    m_header_written = true;
+}
+
+
+// ------------------------------------------
+// Set NeuQuant learning options
+// ------------------------------------------
+void c_gif_write::set_neuquant_options(
+        int sample_factor,
+        bool warm_start)
+{
+    m_neuquant_sample_factor = std::min(30, std::max(1, sample_factor));
+    m_neuquant_warm_start = warm_start;
+}
+
+
+// ------------------------------------------
+// Add a sample frame for the global colour table
+// ------------------------------------------
+void c_gif_write::add_palette_sample(
+        const uint8_t *p_data)
+{
+    if (!m_colour || m_palette_mode == PALETTE_MODE_LOCAL || m_header_written || p_data == nullptr) {
+        return;
+    }
+
+    // The samples are quantised as one tall image, its height must fit in 16 bits
+    size_t frame_size = m_width * m_height * 3;
+    size_t sample_frames = m_palette_samples.size() / frame_size;
+    if (sample_frames >= (size_t)C_MAX_PALETTE_SAMPLE_FRAMES || (sample_frames + 1) * m_height > 0xFFFF) {
+        return;
+    }
+
+    m_palette_samples.insert(m_palette_samples.end(), p_data, p_data + frame_size);
+}
+
+
 // ------------------------------------------
 // Write frame to GIF file
 // ------------------------------------------
@@ -336,9 +462,10 @@ bool c_gif_write::write_frame(
         return true;
     }
 
-    //  Create buffer for indexed pixels image
-    std::unique_ptr<uint8_t[]> p_index_image(new uint8_t[m_width * m_height]);
-    std::unique_ptr<uint8_t[]> p_colour_table;
+    // Everything that depends on the previous frame is done here, in frame order.
+    // Quantisation and compression are then done by a worker thread.
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    std::unique_ptr<s_frame_job> p_job = get_frame_job();
 
     // Scan top/bottom lines and left/right columns to check for lines/columns identical to previous frame
     // These areas do not need to be encoded.
@@ -371,7 +498,7 @@ bool c_gif_write::write_frame(
         // Create an indexed version of the image including transparent pixels if required
         //
         // Create a buffer for the indexed image
-        uint8_t *p_write_data = p_index_image.get();
+        uint8_t *p_write_data = p_job->p_index_image.get();
         for (int y = y_start; y <= y_end; y++) {
             int x = x_start;
             uint8_t *p_current_data = p_data + (y * m_width + x);
@@ -406,6 +533,8 @@ bool c_gif_write::write_frame(
                 }
             }
         }
+
+        p_job->use_transparent_mask = false;
     } else {
         // Colour data
         detect_unchanged_border(
@@ -416,38 +545,323 @@ bool c_gif_write::write_frame(
             y_start,  // uint16_t &y_start
             y_end);  // uint16_t &y_end
 
-        int num_colours = 1 << m_bit_depth;
         bool first_frame = false;
         if (mp_last_image.get() == nullptr) {
             // This is the first frame
             first_frame = true;
             first_frame_and_not_transparent = true;
+            mp_last_image.reset(new uint8_t[m_width * m_height * 3]);
         }
 
         if (m_use_transparent_pixels && !first_frame) {
-            m_transparent_index = num_colours - 1;
-            num_colours--;
+            m_transparent_index = (1 << m_bit_depth) - 1;
+        }
+
+        if (m_palette_mode != PALETTE_MODE_LOCAL) {
+            if (!m_header_written) {
+                // Create the global colour table from the sample frames, or this frame if there are none
+                uint8_t *p_samples = p_data;
+                int sample_rows = m_height;
+                if (!m_palette_samples.empty()) {
+                    p_samples = m_palette_samples.data();
+                    sample_rows = (int)(m_palette_samples.size() / (m_width * 3));
+                }
+
+                mp_palette = create_palette(p_samples, sample_rows, true);
+                m_palette_samples = std::vector<uint8_t>();
+                write_file_header(mp_palette->colour_table.data());
+
+                // In adaptive mode the frames that follow start from the global colour table
+                std::promise<std::shared_ptr<const s_palette>> first_palette;
+                first_palette.set_value(mp_palette);
+                m_adaptive_palette = first_palette.get_future().share();
+                p_job->p_palette = mp_palette;
+            } else if (m_palette_mode == PALETTE_MODE_ADAPTIVE) {
+                // Whether this frame keeps the previous frame's colour table depends on that frame's choice,
+                // so the choice is made on the worker threads in frame order rather than here.  Only the
+                // drift check and any re-quantisation wait for the previous frame, indexing and compression
+                // still run in parallel.
+                p_job->previous_palette = m_adaptive_palette;
+                p_job->p_adaptive_palette = std::make_shared<std::promise<std::shared_ptr<const s_palette>>>();
+                m_adaptive_palette = p_job->p_adaptive_palette->get_future().share();
+            } else {
+                p_job->p_palette = mp_palette;
+            }
+        } else if (m_colour_quant_type == COLOUR_QUANT_TYPE_NEUQUANT && m_neuquant_warm_start) {
+            // Key frames are learnt from scratch, the frames after them start from the key frame's colour table.
+            // Using key frames rather than the previous frame keeps the output the same however the frames are
+            // scheduled on the worker threads, and frames between key frames can still be quantised in parallel.
+            if (m_frames_since_neuquant_key_frame == 0) {
+                p_job->p_neuquant_key_colour_table = std::make_shared<std::promise<std::vector<uint8_t>>>();
+                m_neuquant_key_colour_table = p_job->p_neuquant_key_colour_table->get_future().share();
+            } else {
+                p_job->neuquant_warm_start_colour_table = m_neuquant_key_colour_table;
+            }
+
+            m_frames_since_neuquant_key_frame = (m_frames_since_neuquant_key_frame + 1) % C_NEUQUANT_KEY_FRAME_INTERVAL;
+        }
+
+        // Keep a copy of the frame for the worker thread
+        std::copy(p_data, p_data + m_width * m_height * 3, p_job->p_data.get());
+
+        //
+        // Mark pixels that are close enough to the previous frame to be transparent
+        // and update the last image with the pixels that are not
+        //
+        uint8_t *p_mask = p_job->p_transparent_mask.get();
+        int active_width = x_end - x_start + 1;
+        for (int y = y_start; y <= y_end; y++) {
+            uint8_t *p_current_line = p_data + y * m_width * 3;
+            uint8_t *p_last_line = mp_last_image.get() + y * m_width * 3;
+            if (m_use_transparent_pixels && !first_frame) {
+                get_transparent_pixel_mask(p_current_line, p_last_line, p_mask, x_start, x_end + 1, m_transparent_tolerence);
+                p_mask += active_width;
+            } else {  // Not using transparent pixels or first frame
+                // Write these pixels to last image buffer
+                std::copy(p_current_line + x_start * 3, p_current_line + (x_end + 1) * 3, p_last_line + x_start * 3);
+            }
+        }
+
+        p_job->use_transparent_mask = m_use_transparent_pixels && !first_frame;
+    }
+
+//    printf("Active area: (%d, %d) - (%d, %d)\n", x_start, x_end, y_start, y_end);
+
+    //if (m_use_transparent_pixels && mp_last_image.get() != nullptr) {
+    p_job->transparent_flag = m_use_transparent_pixels && !first_frame_and_not_transparent;
+    p_job->transparent_index = m_transparent_index;
+    p_job->display_time = display_time;
+    p_job->x_start = x_start;
+    p_job->x_end = x_end;
+    p_job->y_start = y_start;
+    p_job->y_end = y_end;
+    p_job->encode_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    // Start encoding the frame on a worker thread
+    s_pending_frame pending_frame;
+    pending_frame.encoded = std::async(std::launch::async, &c_gif_write::encode_frame, this, p_job.get());
+    pending_frame.p_job = std::move(p_job);
+    m_pending_frames.push_back(std::move(pending_frame));
+
+    // Write out finished frames, waiting for the oldest ones if too many are in progress
+    write_encoded_frames(m_max_pending_frames);
+
+    // Tidy up after write failures
+    if (m_file_write_error) {
+        write_encoded_frames(0);
+        fclose(mp_gif_file);
+        mp_gif_file = nullptr;
+        m_output_buffer_used = 0;
+        m_open = false;
+    }
+
+    bool ret = m_file_write_error;
+    m_file_write_error = false;
+    return ret;
+}
+
+
+// ------------------------------------------
+// Wait for all frames to be written
+// ------------------------------------------
+bool c_gif_write::flush()
+{
+    if (mp_gif_file == nullptr) {
+        return false;
+    }
+
+    write_encoded_frames(0);
+    flush_output_buffer();
+
+    // Tidy up after write failures
+    if (m_file_write_error) {
+        fclose(mp_gif_file);
+        mp_gif_file = nullptr;
+        m_output_buffer_used = 0;
+        m_open = false;
+    }
+
+    bool ret = m_file_write_error;
+    m_file_write_error = false;
+    return ret;
+}
+
+
+// ------------------------------------------
+// Choose the colour table for a frame in adaptive palette mode
+// ------------------------------------------
+void c_gif_write::choose_adaptive_palette(
+        s_frame_job *p_job)
+{
+    std::shared_ptr<const s_palette> p_palette = p_job->previous_palette.get();
+
+    // Only re-quantise when this frame's colours have drifted away from the current colour table
+    double max_error = std::max(1.0, p_palette->mean_error) * C_MAX_PALETTE_ERROR_RATIO;
+    if (get_palette_error(*p_palette, p_job->p_data.get(), m_height) > max_error) {
+        p_palette = create_palette(p_job->p_data.get(), m_height, false);
+    }
+
+    p_job->p_palette = p_palette;
+    p_job->p_adaptive_palette->set_value(p_palette);
+}
+
+
+// ------------------------------------------
+// Write encoded frames to the file
+// ------------------------------------------
+void c_gif_write::write_encoded_frames(
+        size_t max_pending)
+{
+    while (m_pending_frames.size() > max_pending) {
+        s_pending_frame &pending_frame = m_pending_frames.front();
+        pending_frame.encoded.wait();
+        std::unique_ptr<s_frame_job> p_job = std::move(pending_frame.p_job);
+        m_pending_frames.pop_front();
+
+        if (mp_gif_file != nullptr) {
+            write_data(p_job->encoded_data.data(), p_job->encoded_data.size());
+
+            // Update statistics
+            uint64_t frame_bytes = p_job->encoded_data.size();
+            m_stats.frame_count++;
+            m_stats.total_frame_bytes += frame_bytes;
+            m_stats.last_frame_bytes = frame_bytes;
+            m_stats.max_frame_bytes = std::max(m_stats.max_frame_bytes, frame_bytes);
+            m_stats.total_encode_time += p_job->encode_time;
+            m_stats.last_encode_time = p_job->encode_time;
+            m_stats.max_encode_time = std::max(m_stats.max_encode_time, p_job->encode_time);
+        }
+
+        // Keep the job and its buffers for a later frame
+        p_job->p_palette.reset();
+        p_job->p_neuquant_key_colour_table.reset();
+        p_job->neuquant_warm_start_colour_table = std::shared_future<std::vector<uint8_t>>();
+        p_job->previous_palette = std::shared_future<std::shared_ptr<const s_palette>>();
+        p_job->p_adaptive_palette.reset();
+        m_free_frame_jobs.push_back(std::move(p_job));
+    }
+}
+
+
+// ------------------------------------------
+// Get a frame job
+// ------------------------------------------
+std::unique_ptr<c_gif_write::s_frame_job> c_gif_write::get_frame_job()
+{
+    std::unique_ptr<s_frame_job> p_job;
+    if (!m_free_frame_jobs.empty()) {
+        p_job = std::move(m_free_frame_jobs.back());
+        m_free_frame_jobs.pop_back();
+        p_job->encoded_data.clear();  // Keeps its capacity
+        p_job->colour_table.clear();
+    } else {
+        p_job.reset(new s_frame_job(
+            (m_colour) ? m_width * m_height * 3 : 0,  // data_size
+            m_width * m_height));  // pixel_count
+    }
+
+    return p_job;
+}
+
+
+// ------------------------------------------
+// Quantise, index and compress a frame
+// ------------------------------------------
+void c_gif_write::encode_frame(
+        s_frame_job *p_job)
+{
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    const uint16_t x_start = p_job->x_start;
+    const uint16_t x_end = p_job->x_end;
+    const uint16_t y_start = p_job->y_start;
+    const uint16_t y_end = p_job->y_end;
+    std::vector<uint8_t> &encoded_data = p_job->encoded_data;
+    std::vector<uint8_t> &colour_table = p_job->colour_table;
+    std::unique_ptr<c_pooled_buffer> p_colour_difference_lut;
+    uint8_t *p_index_to_index_colour_difference_lut = mp_index_to_index_colour_difference_lut.get();
+    if (p_job->p_adaptive_palette != nullptr) {
+        choose_adaptive_palette(p_job);
+    }
+
+    const s_palette *p_palette = p_job->p_palette.get();
+
+    if (m_colour && p_palette != nullptr) {
+        // Colour data with a shared colour table - just look up each pixel's index
+        if (!p_palette->is_global) {
+            colour_table = p_palette->colour_table;
         }
 
         if (m_lossy_compression_level > 0) {
-            mp_index_to_index_colour_difference_lut.reset(new uint8_t[256 * 256]);
+            p_index_to_index_colour_difference_lut = const_cast<uint8_t *>(p_palette->colour_difference_lut.data());
         }
 
+        c_inverse_colour_map &inverse_colour_map = *p_palette->p_inverse_colour_map;
+        uint8_t *p_write_data = p_job->p_index_image.get();
+        const uint8_t *p_mask = p_job->p_transparent_mask.get();
+        for (int y = y_start; y <= y_end; y++) {
+            int x = x_start;
+            const uint8_t *p_current_data = p_job->p_data.get() + (y * m_width + x) * 3;
+            for ( ; x <= x_end; x++) {
+                uint8_t b = *p_current_data++;
+                uint8_t g = *p_current_data++;
+                uint8_t r = *p_current_data++;
+                if (p_job->use_transparent_mask && *p_mask++) {
+                    // This pixel is close enough to the previous pixel to be transparent
+                    *p_write_data++ = p_job->transparent_index;
+                } else {
+                    *p_write_data++ = inverse_colour_map.get_index(b, g, r);
+                }
+            }
+        }
+    } else if (m_colour) {
         // Colour data - convert values to indexed values
-        p_colour_table.reset(new uint8_t[3 * (1 << m_bit_depth)]);
-        std::unique_ptr<uint8_t[]> p_rev_colour_table(new uint8_t[1 << (3 * 6)]);
+        uint8_t *p_data = p_job->p_data.get();
+        int num_colours = 1 << m_bit_depth;
+        if (p_job->use_transparent_mask) {
+            num_colours--;
+        }
+
+        if (m_lossy_compression_level > 0) {
+            p_colour_difference_lut.reset(new c_pooled_buffer(256 * 256));
+            p_index_to_index_colour_difference_lut = p_colour_difference_lut->get();
+        }
+
+        colour_table.assign(3 * (1 << m_bit_depth), 0);
+        c_pooled_buffer p_rev_colour_table(1 << (3 * 6));
 
+        // NeuQuant frames map each colour to its nearest colour table entry, median cut frames use
+        // the quantiser's own assignment of the colours in the frame to colour table entries
+        std::shared_ptr<c_inverse_colour_map> p_inverse_colour_map;
         if (m_colour_quant_type == COLOUR_QUANT_TYPE_NEUQUANT) {
+            // Wait for the key frame's colour table if this frame warm starts from it
+            std::vector<uint8_t> warm_start_colour_table;
+            if (p_job->neuquant_warm_start_colour_table.valid()) {
+                warm_start_colour_table = p_job->neuquant_warm_start_colour_table.get();
+            }
+
+            std::unique_ptr<s_neuquant_buffers> p_neuquant_buffers = get_neuquant_buffers();
             quantise_colours_neuquant(
+                *p_neuquant_buffers,  // s_neuquant_buffers &buffers
+                (warm_start_colour_table.empty()) ? nullptr : &warm_start_colour_table,
                 p_data,  // uint8_t *p_data
+                m_height,  // int height
 //                x_start,  // uint16_t x_start,
 //                x_end,  // uint16_t x_end,
 //                y_start,  // uint16_t y_start,
 //                y_end,  // uint16_t y_end,
                 num_colours,  // int number_of_colours
-                p_colour_table.get(),
-                mp_index_to_index_colour_difference_lut.get()); // uint8_t *p_index_to_index_colour_difference
+                colour_table.data(),
+                p_index_to_index_colour_difference_lut); // uint8_t *p_index_to_index_colour_difference
+            release_neuquant_buffers(std::move(p_neuquant_buffers));
+            p_inverse_colour_map = get_inverse_colour_map(colour_table.data(), num_colours, true);
+
+            if (p_job->p_neuquant_key_colour_table != nullptr) {
+                // Let the frames that follow this key frame start from its colour table
+                p_job->p_neuquant_key_colour_table->set_value(
+                    std::vector<uint8_t>(colour_table.begin(), colour_table.begin() + 3 * num_colours));
+            }
         } else {
+            std::unique_ptr<s_median_cut_buffers> p_median_cut_buffers = get_median_cut_buffers();
             quantise_colours_median_cut(
                 p_data,  // uint8_t *p_data
                 x_start,  // uint16_t x_start,
@@ -455,136 +869,99 @@ bool c_gif_write::write_frame(
                 y_start,  // uint16_t y_start,
                 y_end,  // uint16_t y_end,
                 num_colours,  // int number_of_colours
-                p_colour_table.get(),
+                colour_table.data(),
                 p_rev_colour_table.get(),
-                mp_index_to_index_colour_difference_lut.get()); // uint8_t *p_index_to_index_colour_difference
-        }
-
-        // Buffer to keep image data for processing the next frame
-        if (mp_last_image.get() == nullptr) {
-            // Create buffer if required
-            mp_last_image.reset(new uint8_t[m_width * m_height * 3]);
+                p_index_to_index_colour_difference_lut, // uint8_t *p_index_to_index_colour_difference
+                *p_median_cut_buffers);
+            release_median_cut_buffers(std::move(p_median_cut_buffers));
         }
 
         //
         // Create an indexed version of the image including transparent pixels if required
         //
-        // Create a buffer for the index image
-        uint8_t *p_write_data = p_index_image.get();
-        uint8_t(c_gif_write::*p_get_best_index)(uint8_t b, uint8_t g, uint8_t r, uint8_t *p_rev_colour_table);
-        if (m_colour_quant_type == COLOUR_QUANT_TYPE_NEUQUANT) {
-            p_get_best_index = &c_gif_write::get_best_index_neuquant;
-        } else {
-            p_get_best_index = &c_gif_write::get_best_index_median_cut;
-        }
+        uint8_t *p_write_data = p_job->p_index_image.get();
+        const uint8_t *p_mask = p_job->p_transparent_mask.get();
 
         for (int y = y_start; y <= y_end; y++) {
             int x = x_start;
             uint8_t *p_current_data = p_data + (y * m_width + x) * 3;
-            uint8_t *p_last_data = mp_last_image.get() + (y * m_width + x) * 3;
             for ( ; x <= x_end; x++) {
-                if (m_use_transparent_pixels && !first_frame) {
-                    uint8_t b = *p_current_data++;
-                    int b_diff = abs(b - (*p_last_data++));
-                    bool not_transparent = b_diff > m_transparent_tolerence;
-                    uint8_t g = *p_current_data++;
-                    int g_diff = abs(g - (*p_last_data++));
-                    not_transparent |= g_diff > m_transparent_tolerence;
-                    uint8_t r = *p_current_data++;
-                    int r_diff = abs(r - (*p_last_data++));
-                    not_transparent |= r_diff > m_transparent_tolerence;
-                    if (not_transparent) {
-                        // This pixel is not transparent
-                        *p_write_data++ = (this->*p_get_best_index)(b, g, r, p_rev_colour_table.get());
-
-                        // Update last image pixel for comparison with the next frame
-                        *(p_last_data - 3) = b;
-                        *(p_last_data - 2) = g;
-                        *(p_last_data - 1) = r;
+                uint8_t b = *p_current_data++;
+                uint8_t g = *p_current_data++;
+                uint8_t r = *p_current_data++;
+                if (p_job->use_transparent_mask && *p_mask++) {
+                    // This pixel is close enough to the previous pixel to be transparent
+                    *p_write_data++ = p_job->transparent_index;
+                } else {
+                    // Write indexed data to buffer ready for compression
+                    if (p_inverse_colour_map != nullptr) {
+                        *p_write_data++ = p_inverse_colour_map->get_index(b, g, r);
                     } else {
-                        // This pixel is close enough to the previous pixel to be transparent
-                        *p_write_data++ = m_transparent_index;
-                        // Note that the last image pixel value is left unchanged
+                        *p_write_data++ = get_best_index_median_cut(b, g, r, p_rev_colour_table.get());
                     }
-                } else {  // Not using transparent pixels or first frame
-                    uint8_t b = *p_current_data++;
-                    uint8_t g = *p_current_data++;
-                    uint8_t r = *p_current_data++;
-
-                    // Write indexed data to buffer ready for compression
-                    *p_write_data++ = (this->*p_get_best_index)(b, g, r, p_rev_colour_table.get());
-
-                    // Write these pixels to last image buffer
-                    *p_last_data++ = b;
-                    *p_last_data++ = g;
-                    *p_last_data++ = r;
                 }
             }
         }
-
-        p_rev_colour_table.reset(nullptr);
     }
 
-//    printf("Active area: (%d, %d) - (%d, %d)\n", x_start, x_end, y_start, y_end);
-
-    // Update graphic control extension structure variables fields
-    m_graphic_control_extension.m_packed_field  = 0 << 2;  // Disposal method: None specified
-    m_graphic_control_extension.m_packed_field |= 0 << 1;  // User Input Flag: No user input expected
-
-    //if (m_use_transparent_pixels && mp_last_image.get() != nullptr) {
-    if (m_use_transparent_pixels && !first_frame_and_not_transparent) {
-        m_graphic_control_extension.m_packed_field |= 1 << 0;  // Transparent colour flag
+    // Graphic control extension
+    s_graphic_control_extension graphic_control_extension = m_graphic_control_extension;
+    graphic_control_extension.m_packed_field  = 0 << 2;  // Disposal method: None specified
+    graphic_control_extension.m_packed_field |= 0 << 1;  // User Input Flag: No user input expected
+    if (p_job->transparent_flag) {
+        graphic_control_extension.m_packed_field |= 1 << 0;  // Transparent colour flag
     }
 
-    m_graphic_control_extension.m_delay_time[0] = display_time & 0xFF;
-    m_graphic_control_extension.m_delay_time[1] = display_time >> 8;
-    m_graphic_control_extension.m_transparent_colour_index = (uint8_t)m_transparent_index;
-
-    // Write graphic control extension to the file
-    fwrite_error_check(&m_graphic_control_extension, 1, sizeof(m_graphic_control_extension), mp_gif_file);
-
-    // Update image descriptor structure variable fields
-    m_image_descriptor.m_image_left_position[0] = (uint8_t)(x_start & 0xFF);
-    m_image_descriptor.m_image_left_position[1] = (uint8_t)(x_start >> 8);
-    m_image_descriptor.m_image_top_position[0] = (uint8_t)(y_start & 0xFF);
-    m_image_descriptor.m_image_top_position[1] = (uint8_t)(y_start >> 8);
+    graphic_control_extension.m_delay_time[0] = p_job->display_time & 0xFF;
+    graphic_control_extension.m_delay_time[1] = p_job->display_time >> 8;
+    graphic_control_extension.m_transparent_colour_index = (uint8_t)p_job->transparent_index;
+    const uint8_t *p_bytes = (const uint8_t *)&graphic_control_extension;
+    encoded_data.insert(encoded_data.end(), p_bytes, p_bytes + sizeof(graphic_control_extension));
+
+    // Image descriptor
+    s_image_descriptor image_descriptor = m_image_descriptor;
+    image_descriptor.m_image_left_position[0] = (uint8_t)(x_start & 0xFF);
+    image_descriptor.m_image_left_position[1] = (uint8_t)(x_start >> 8);
+    image_descriptor.m_image_top_position[0] = (uint8_t)(y_start & 0xFF);
+    image_descriptor.m_image_top_position[1] = (uint8_t)(y_start >> 8);
     uint16_t active_width = 1 + x_end - x_start;
-    m_image_descriptor.m_image_width[0] = (uint8_t)(active_width & 0xFF);
-    m_image_descriptor.m_image_width[1] = (uint8_t)(active_width >> 8);
+    image_descriptor.m_image_width[0] = (uint8_t)(active_width & 0xFF);
+    image_descriptor.m_image_width[1] = (uint8_t)(active_width >> 8);
     uint16_t active_height = 1 + y_end - y_start;
-    m_image_descriptor.m_image_height[0] = (uint8_t)(active_height & 0xFF);
-    m_image_descriptor.m_image_height[1] = (uint8_t)(active_height >> 8);
+    image_descriptor.m_image_height[0] = (uint8_t)(active_height & 0xFF);
+    image_descriptor.m_image_height[1] = (uint8_t)(active_height >> 8);
     if (!m_colour) {
         // Monochrome data
         // Image descriptor packed fields byte for monochrome encoding
-        m_image_descriptor.m_packed_fields  = 0 << 7;  // Local Color Table Flag - No local colour table for monochrome
-        m_image_descriptor.m_packed_fields |= 0 << 6;  // Interlace flag - No interlacing
-        m_image_descriptor.m_packed_fields |= 0 << 5;  // Sort flag - Colour table is not sorted
-        m_image_descriptor.m_packed_fields |= 0 << 0;  // Size of local colour table
+        image_descriptor.m_packed_fields  = 0 << 7;  // Local Color Table Flag - No local colour table for monochrome
+        image_descriptor.m_packed_fields |= 0 << 6;  // Interlace flag - No interlacing
+        image_descriptor.m_packed_fields |= 0 << 5;  // Sort flag - Colour table is not sorted
+        image_descriptor.m_packed_fields |= 0 << 0;  // Size of local colour table
+    } else if (colour_table.empty()) {
+        // Colour data using the global colour table
+        image_descriptor.m_packed_fields  = 0 << 7;  // Local Color Table Flag - No local colour table
+        image_descriptor.m_packed_fields |= 0 << 6;  // Interlace flag - No interlacing
+        image_descriptor.m_packed_fields |= 0 << 5;  // Sort flag - Colour table is not sorted
+        image_descriptor.m_packed_fields |= 0 << 0;  // Size of local colour table
     } else {
         // Colour data
         // Image descriptor packed fields byte for colour encoding
-        m_image_descriptor.m_packed_fields  = 1 << 7;  // Local Color Table Flag - Use local colour table for colour
-        m_image_descriptor.m_packed_fields |= 0 << 6;  // Interlace flag - No interlacing
-        m_image_descriptor.m_packed_fields |= 0 << 5;  // Sort flag - Colour table is not sorted
-        m_image_descriptor.m_packed_fields |= (m_bit_depth-1) << 0;  // Size of local colour table
+        image_descriptor.m_packed_fields  = 1 << 7;  // Local Color Table Flag - Use local colour table for colour
+        image_descriptor.m_packed_fields |= 0 << 6;  // Interlace flag - No interlacing
+        image_descriptor.m_packed_fields |= 0 << 5;  // Sort flag - Colour table is not sorted
+        image_descriptor.m_packed_fields |= (m_bit_depth-1) << 0;  // Size of local colour table
     }
 
-    // Write image descriptor to the file
-    fwrite_error_check(&m_image_descriptor, 1, sizeof(m_image_descriptor), mp_gif_file);
-
-    if (m_colour && p_colour_table != nullptr) {
-        // Write local colour table to file
-        fwrite_error_check(p_colour_table.get(), 1, (1 << m_bit_depth) * 3, mp_gif_file);
+    p_bytes = (const uint8_t *)&image_descriptor;
+    encoded_data.insert(encoded_data.end(), p_bytes, p_bytes + sizeof(image_descriptor));
 
-        // Release colour table as it is no longer required
-        p_colour_table.reset(nullptr);
-    }
+    // Local colour table
+    encoded_data.insert(encoded_data.end(), colour_table.begin(), colour_table.end());
 
-    // Write LZW minimum code size to file
-    fwrite_error_check(&m_bit_depth, 1, 1, mp_gif_file);
+    // LZW minimum code size
+    encoded_data.push_back((uint8_t)m_bit_depth);
 
-    // Compress image data and write to file
+    // Compress image data
     c_lzw_compressor lzw_compressor(
         x_end - x_start + 1,  // m_width,
         y_end - y_start + 1,  // m_height
@@ -593,48 +970,217 @@ bool c_gif_write::write_frame(
         0,  // y_start,
         y_end - y_start,  // y_end,
         m_bit_depth,
-        p_index_image.get());
-
+        p_job->p_index_image.get());
 
     // Set details of lossy compression
     lzw_compressor.set_lossy_details(
         m_lossy_compression_level,  // int lossy_compression_level
-        mp_index_to_index_colour_difference_lut.get(),  // p_index_to_index_colour_difference_lut
-        m_transparent_index);  // int transparent_index
+        p_index_to_index_colour_difference_lut,  // p_index_to_index_colour_difference_lut
+        p_job->transparent_index);  // int transparent_index
 
     bool all_compressed = false;
     while (!all_compressed) {
         // Compress up to 255 byte block of data (256 with byte count header)
         all_compressed = lzw_compressor.compress_data();
-
-        // Write compressed data block to file
         uint8_t *p_compressed_data = lzw_compressor.get_compressed_data_ptr();
-        fwrite_error_check(p_compressed_data, 1, p_compressed_data[0] + 1, mp_gif_file);
+        encoded_data.insert(encoded_data.end(), p_compressed_data, p_compressed_data + p_compressed_data[0] + 1);
     }
 
-    // Data for this frame has been written to the file, free buffer
-    p_index_image.reset(nullptr);
+    // Block terminator
+    encoded_data.push_back(0);
+
+    p_job->encode_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
 
-    // Release index to index colour difference table if one was used
-    if (m_colour) {
-        mp_index_to_index_colour_difference_lut.reset(nullptr);
+
+// ------------------------------------------
+// Quantise to a shared colour table
+// ------------------------------------------
+std::shared_ptr<c_gif_write::s_palette> c_gif_write::create_palette(
+        uint8_t *p_data,
+        int rows,
+        bool is_global)
+{
+    std::shared_ptr<s_palette> p_palette(new s_palette);
+    p_palette->is_global = is_global;
+
+    // The last entry is always kept free for transparent pixels, even in the first frame
+    int num_colours = 1 << m_bit_depth;
+    if (m_use_transparent_pixels) {
+        num_colours--;
     }
 
+    p_palette->colour_table.assign(3 * (1 << m_bit_depth), 0);
+    uint8_t *p_colour_table = p_palette->colour_table.data();
+    uint8_t *p_colour_difference_lut = nullptr;
+    if (m_lossy_compression_level > 0) {
+        p_palette->colour_difference_lut.assign(256 * 256, 0);
+        p_colour_difference_lut = p_palette->colour_difference_lut.data();
+    }
 
-    // Write block terminator to file
-    char null_term = 0;
-    fwrite_error_check(&null_term, 1, 1, mp_gif_file);
+    if (m_colour_quant_type == COLOUR_QUANT_TYPE_NEUQUANT) {
+        std::unique_ptr<s_neuquant_buffers> p_neuquant_buffers = get_neuquant_buffers();
+        quantise_colours_neuquant(
+            *p_neuquant_buffers,  // s_neuquant_buffers &buffers
+            nullptr,  // const std::vector<uint8_t> *p_warm_start_colour_table
+            p_data,  // uint8_t *p_data
+            rows,  // int height
+            num_colours,  // int number_of_colours
+            p_colour_table,
+            p_colour_difference_lut); // uint8_t *p_index_to_index_colour_difference
+        release_neuquant_buffers(std::move(p_neuquant_buffers));
+    } else {
+        std::unique_ptr<s_median_cut_buffers> p_median_cut_buffers = get_median_cut_buffers();
+        c_pooled_buffer p_rev_colour_table(1 << (3 * 6));
+        quantise_colours_median_cut(
+            p_data,  // uint8_t *p_data
+            0,  // uint16_t x_start,
+            m_width - 1,  // uint16_t x_end,
+            0,  // uint16_t y_start,
+            rows - 1,  // uint16_t y_end,
+            num_colours,  // int number_of_colours
+            p_colour_table,
+            p_rev_colour_table.get(),
+            p_colour_difference_lut, // uint8_t *p_index_to_index_colour_difference
+            *p_median_cut_buffers);
+        release_median_cut_buffers(std::move(p_median_cut_buffers));
+    }
 
-    // Tidy up after write failures
-    if (m_file_write_error) {
-        fclose(mp_gif_file);
-        mp_gif_file = nullptr;
-        m_open = false;
+    // Later frames contain colours that were not in the sample, so colours are mapped to the
+    // nearest colour table entry as they are met rather than with the quantiser's assignment
+    p_palette->p_inverse_colour_map = get_inverse_colour_map(p_colour_table, num_colours, false);
+
+    p_palette->mean_error = 0.0;
+    if (m_palette_mode == PALETTE_MODE_ADAPTIVE) {
+        p_palette->mean_error = get_palette_error(*p_palette, p_data, rows);
     }
 
-    bool ret = m_file_write_error;
-    m_file_write_error = false;
-    return ret;
+    return p_palette;
+}
+
+
+// ------------------------------------------
+// Mean colour error of frame data mapped to a colour table
+// ------------------------------------------
+double c_gif_write::get_palette_error(
+        const s_palette &palette,
+        const uint8_t *p_data,
+        int rows)
+{
+    c_inverse_colour_map &inverse_colour_map = *palette.p_inverse_colour_map;
+    const uint8_t *p_colour_table = palette.colour_table.data();
+    const uint8_t *p_end = p_data + m_width * rows * 3;
+    uint64_t total_error = 0;
+    while (p_data < p_end) {
+        uint8_t b = *p_data++;
+        uint8_t g = *p_data++;
+        uint8_t r = *p_data++;
+        const uint8_t *p_colour = p_colour_table + 3 * inverse_colour_map.get_index(b, g, r);
+        total_error += abs(r - p_colour[0]) + abs(g - p_colour[1]) + abs(b - p_colour[2]);
+    }
+
+    return (double)total_error / ((uint64_t)m_width * rows);
+}
+
+
+// ------------------------------------------
+// Get median cut buffers for a worker thread
+// ------------------------------------------
+std::unique_ptr<c_gif_write::s_median_cut_buffers> c_gif_write::get_median_cut_buffers()
+{
+    std::unique_ptr<s_median_cut_buffers> p_buffers;
+    {
+        std::lock_guard<std::mutex> locker(m_median_cut_buffers_mutex);
+        if (!m_free_median_cut_buffers.empty()) {
+            p_buffers = std::move(m_free_median_cut_buffers.back());
+            m_free_median_cut_buffers.pop_back();
+        }
+    }
+
+    if (p_buffers == nullptr) {
+        p_buffers.reset(new s_median_cut_buffers);
+        p_buffers->p_histogram.reset(new uint32_t[1 << 18]());
+    }
+
+    return p_buffers;
+}
+
+
+void c_gif_write::release_median_cut_buffers(
+        std::unique_ptr<s_median_cut_buffers> p_buffers)
+{
+    std::lock_guard<std::mutex> locker(m_median_cut_buffers_mutex);
+    m_free_median_cut_buffers.push_back(std::move(p_buffers));
+}
+
+
+// ------------------------------------------
+// Get a NeuQuant network from the free list or create a new one
+// ------------------------------------------
+std::unique_ptr<c_gif_write::s_neuquant_buffers> c_gif_write::get_neuquant_buffers()
+{
+    std::unique_ptr<s_neuquant_buffers> p_buffers;
+    {
+        std::lock_guard<std::mutex> locker(m_neuquant_buffers_mutex);
+        if (!m_free_neuquant_buffers.empty()) {
+            p_buffers = std::move(m_free_neuquant_buffers.back());
+            m_free_neuquant_buffers.pop_back();
+        }
+    }
+
+    if (p_buffers == nullptr) {
+        p_buffers.reset(new s_neuquant_buffers);
+    }
+
+    return p_buffers;
+}
+
+
+void c_gif_write::release_neuquant_buffers(
+        std::unique_ptr<s_neuquant_buffers> p_buffers)
+{
+    std::lock_guard<std::mutex> locker(m_neuquant_buffers_mutex);
+    m_free_neuquant_buffers.push_back(std::move(p_buffers));
+}
+
+
+// ------------------------------------------
+// Get the inverse colour map for a colour table
+// ------------------------------------------
+std::shared_ptr<c_inverse_colour_map> c_gif_write::get_inverse_colour_map(
+        const uint8_t *p_colour_table,
+        int number_of_colours,
+        bool exact)
+{
+    std::lock_guard<std::mutex> locker(m_inverse_colour_maps_mutex);
+    std::shared_ptr<c_inverse_colour_map> p_map;
+    for (auto it = m_inverse_colour_maps.begin(); it != m_inverse_colour_maps.end(); ++it) {
+        if ((*it)->has_colour_table(p_colour_table, number_of_colours, exact)) {
+            // Same colour table as an earlier frame, the cells it filled in are still valid
+            p_map = *it;
+            m_inverse_colour_maps.erase(it);
+            break;
+        }
+    }
+
+    if (p_map == nullptr) {
+        for (auto it = m_inverse_colour_maps.begin(); it != m_inverse_colour_maps.end(); ++it) {
+            if (it->use_count() == 1) {
+                // Reuse the least recently used map that no frame or palette is using
+                p_map = *it;
+                p_map->set_colour_table(p_colour_table, number_of_colours, exact);
+                m_inverse_colour_maps.erase(it);
+                break;
+            }
+        }
+    }
+
+    if (p_map == nullptr) {
+        p_map = std::make_shared<c_inverse_colour_map>(p_colour_table, number_of_colours, exact);
+    }
+
+    m_inverse_colour_maps.push_back(p_map);
+    return p_map;
 }
 
 
@@ -645,20 +1191,37 @@ uint64_t c_gif_write::close()
 {
     uint64_t filesize = 0;
 
+    // Write any frames that are still being encoded
+    write_encoded_frames(0);
+
     // Relese memory used for tables
     mp_rev_mono_table.reset(nullptr);
     mp_index_to_index_colour_difference_lut.reset(nullptr);
     mp_last_image.reset(nullptr);
+    m_free_median_cut_buffers.clear();
+    m_palette_samples = std::vector<uint8_t>();
+    mp_palette.reset();
+    m_adaptive_palette = std::shared_future<std::shared_ptr<const s_palette>>();
+    m_free_neuquant_buffers.clear();
+    m_inverse_colour_maps.clear();
+    m_neuquant_key_colour_table = std::shared_future<std::vector<uint8_t>>();
+    m_free_frame_jobs.clear();
 
     if (mp_gif_file != nullptr) {
+        if (!m_header_written) {
+            // No frames were written so there is no global colour table
+            write_file_header(nullptr);
+        }
+
         // Write comment block out if defined
     #ifdef GIF_COMMENT_STRING
-        fwrite_error_check(&m_comment_extension, 1, sizeof(m_comment_extension), mp_gif_file);
+        write_data(&m_comment_extension, sizeof(m_comment_extension));
     #endif
 
         // Write file terminator to file
         char file_terminator = 0x3B;
-        fwrite_error_check(&file_terminator, 1, 1, mp_gif_file);
+        write_data(&file_terminator, 1);
+        flush_output_buffer();
 
         filesize = ftell64(mp_gif_file);  // Get final file size
 
@@ -667,6 +1230,8 @@ uint64_t c_gif_write::close()
         mp_gif_file = nullptr;
     }
 
+    m_output_buffer_used = 0;
+    mp_output_buffer.reset(nullptr);
     m_open = false;
     return filesize;
 }
@@ -677,15 +1242,50 @@ uint64_t c_gif_write::close()
 // ------------------------------------------
 uint64_t c_gif_write::get_current_filesize()
 {
+    write_encoded_frames(0);
     uint64_t filesize = 0L;
     if (mp_gif_file != nullptr) {
-        filesize = ftell64(mp_gif_file);
+        filesize = ftell64(mp_gif_file) + m_output_buffer_used;
     }
 
     return filesize;
 }
 
 
+// ------------------------------------------
+// Write data through the output buffer
+// ------------------------------------------
+void c_gif_write::write_data(
+    const void *p_data,
+    size_t size)
+{
+    if (m_output_buffer_used + size > C_OUTPUT_BUFFER_SIZE) {
+        flush_output_buffer();
+    }
+
+    if (size >= C_OUTPUT_BUFFER_SIZE) {
+        // Too big to be worth buffering
+        fwrite_error_check(p_data, 1, size, mp_gif_file);
+    } else {
+        memcpy(mp_output_buffer->get() + m_output_buffer_used, p_data, size);
+        m_output_buffer_used += size;
+    }
+}
+
+
+// ------------------------------------------
+// Write the output buffer to the file
+// ------------------------------------------
+void c_gif_write::flush_output_buffer()
+{
+    if (m_output_buffer_used > 0 && mp_gif_file != nullptr) {
+        fwrite_error_check(mp_output_buffer->get(), 1, m_output_buffer_used, mp_gif_file);
+    }
+
+    m_output_buffer_used = 0;
+}
+
+
 // ------------------------------------------
 // fwrite() function with error checking
 // ------------------------------------------
@@ -713,18 +1313,14 @@ void c_gif_write::quantise_colours_median_cut(
         int number_of_colours,
         uint8_t *p_colour_table,
         uint8_t *p_rev_colour_table,
-        uint8_t *p_index_to_index_colour_difference_lut)
+        uint8_t *p_index_to_index_colour_difference_lut,
+        s_median_cut_buffers &buffers)
 {
     assert (p_data != nullptr);
     assert (p_colour_table != nullptr);
     assert (p_rev_colour_table != nullptr);
 
-    std::unique_ptr<uint32_t[]> p_histogram_lut(new uint32_t[1 << 18]());
-    std::unique_ptr<uint32_t[]> p_index_lut(new uint32_t[1 << 18]);
-
-    for (int x = 0; x < (1 << 18); x++) {
-        p_index_lut[x] = x;
-    }
+    uint32_t *p_histogram = buffers.p_histogram.get();
 
     // Create histogram
     for (int y = y_start; y <= y_end; y++) {
@@ -735,44 +1331,27 @@ void c_gif_write::quantise_colours_median_cut(
             uint8_t g = (*p_data_ptr++) >> 2;
             uint8_t r = (*p_data_ptr++) >> 2;
             uint32_t index = (r << 12) | (g << 6) | (b << 0);
-            p_histogram_lut[index]++;
+            p_histogram[index]++;
         }
     }
 
-    // Remove zero entries from table
-    int number_of_hist_entries = 0;
-    for (int x = 0; x < (1 << 18); x++) {
-        p_histogram_lut[number_of_hist_entries] = p_histogram_lut[x];
-        p_index_lut[number_of_hist_entries] = p_index_lut[x];
-        if (p_histogram_lut[number_of_hist_entries] > 0) {
-            number_of_hist_entries++;
+    // Gather the non-zero entries as sort keys, clearing the histogram ready for the next frame
+    // Key = (inverted count << 18) | colour index, so sorting keys into ascending order sorts
+    // by count (most numerous first) and then by colour index.  This is the same order
+    // the original (stable) bubble sort gave.
+    std::vector<uint64_t> &entries = buffers.entries;
+    entries.clear();
+    for (uint32_t x = 0; x < (1 << 18); x++) {
+        uint32_t count = p_histogram[x];
+        if (count > 0) {
+            entries.push_back(((uint64_t)(0xFFFFFFFF - count) << 18) | x);
+            p_histogram[x] = 0;
         }
     }
 
-    // Sort LUTs by histogram value
-    // Nasty bubble sort - to be replaced with a faster algorithm!
-    bool did_swap;
-    do {
-        did_swap = false;
-        for (int i = 0; i < number_of_hist_entries - 1; i++) {
-            if (p_histogram_lut[i] < p_histogram_lut[i+1]) {
-                uint32_t temp = p_histogram_lut[i];
-                p_histogram_lut[i] = p_histogram_lut[i+1];
-                p_histogram_lut[i+1] = temp;
-
-                temp = p_index_lut[i];
-                p_index_lut[i] = p_index_lut[i+1];
-                p_index_lut[i+1] = temp;
-                did_swap = true;
-            }
-        }
-    } while (did_swap);
-
-    // Count number of pixels in histogram table
-    uint64_t total_pixels_in_hist_table = 0;
-    for (int i = 0; i < number_of_hist_entries; i++) {
-        total_pixels_in_hist_table += p_histogram_lut[i];
-    }
+    std::sort(entries.begin(), entries.end());
+    const int number_of_hist_entries = (int)entries.size();
+    const uint64_t *p_entries = entries.data();
 
     // Create colour table and reverse colour table
     std::unique_ptr<uint8_t[]> p_colour_r_palette(new uint8_t[256]);
@@ -804,17 +1383,18 @@ void c_gif_write::quantise_colours_median_cut(
         colour_found_count = 0;
         for (hist_entry = 0; hist_entry < number_of_hist_entries; hist_entry++) {
             // Extract 6-bit RGB values from index table
-            uint32_t temp;
+            uint64_t entry;
             if (attempt == 1) {
                 // Examine colours from least numerous to most numerous
-                temp = p_index_lut[number_of_hist_entries - hist_entry - 1];
-                pixels_in_colour_table += p_histogram_lut[number_of_hist_entries - hist_entry - 1];
+                entry = p_entries[number_of_hist_entries - hist_entry - 1];
             } else {
                 // Examine colours from most numerous to least numerous
-                temp = p_index_lut[hist_entry];
-                pixels_in_colour_table += p_histogram_lut[hist_entry];
+                entry = p_entries[hist_entry];
             }
 
+            pixels_in_colour_table += 0xFFFFFFFF - (uint32_t)(entry >> 18);
+            uint32_t temp = (uint32_t)(entry & 0x3FFFF);
+
             uint8_t b = temp & 0x3F;
             temp >>= 6;
             uint8_t g = temp & 0x3F;
@@ -886,15 +1466,12 @@ void c_gif_write::quantise_colours_median_cut(
         }
     }
 
-    // Delete histogram table as only the index table is required from here
-    p_histogram_lut.reset(nullptr);
-
     // We have now filled the colour palette but need to find the closest values in the
     // colour palette for the remaining values in the histogram LUT to add to the
     // colour to index LUT
     for ( ; hist_entry < number_of_hist_entries; hist_entry++) {
         // Extract RGB values from index table
-        uint32_t temp = p_index_lut[hist_entry];
+        uint32_t temp = (uint32_t)(p_entries[hist_entry] & 0x3FFFF);
         uint8_t b = temp & 0x3F;
         temp >>= 6;
         uint8_t g = temp & 0x3F;
@@ -919,9 +1496,6 @@ void c_gif_write::quantise_colours_median_cut(
         p_rev_colour_table[r << 12 | g << 6 | b] = (uint8_t)best_entry;
     }
 
-    // Delete index table as it has done its job in creating the colour palette and reverse colour palettes
-    p_index_lut.reset(nullptr);
-
     // Create the real colour table
     // Update colour values to use all 8 bits rather than just 6 bits
     // The bottom 2 bits are just copies of the original top 2 bits
@@ -969,7 +1543,10 @@ uint8_t c_gif_write::get_best_index_median_cut(uint8_t b, uint8_t g, uint8_t r,
 
 
 void c_gif_write::quantise_colours_neuquant(
+    s_neuquant_buffers &buffers,
+    const std::vector<uint8_t> *p_warm_start_colour_table,
     uint8_t *p_data,
+    int height,
 //    uint16_t x_start,
 //    uint16_t x_end,
 //    uint16_t y_start,
@@ -984,7 +1561,6 @@ void c_gif_write::quantise_colours_neuquant(
     uint8_t *p_image_data = p_data;
     uint8_t *p_temp_buffer = nullptr;
     int width = m_width;// x_end - x_start + 1;
-    int height = m_height;// y_end - y_start + 1;
     if (false)
     {
         // Test code for reducing colours
@@ -1040,12 +1616,33 @@ void c_gif_write::quantise_colours_neuquant(
 */
     }
          
-    const int samplefac = 1;
-    initnet(p_image_data, 3 * width*height, samplefac, number_of_colours);
-    learn();
-    unbiasnet();
-    writecolourmap(p_colour_table);
-    inxbuild();
+    // Stacked sample frames are learnt at a lower sampling rate so this costs about the same as a single frame
+    int samplefac = m_neuquant_sample_factor * height / m_height;
+    if (p_warm_start_colour_table != nullptr) {
+        samplefac *= C_NEUQUANT_WARM_START_SAMPLE_FACTOR;
+    }
+
+    samplefac = std::min(30, std::max(1, samplefac));
+
+    // Learning needs at least ncycles sample pixels, small images are learnt from every
+    // pixel in the same way as NeuQuant's own minpicturebytes check
+    if (3 * width * height < minpicturebytes) {
+        samplefac = 1;
+    } else {
+        samplefac = std::max(1, std::min(samplefac, width * height / ncycles));
+    }
+
+    neuquant_net *p_network = &buffers.network;
+    if (p_warm_start_colour_table != nullptr) {
+        initnetfromcolourmap(p_network, p_image_data, 3 * width*height, samplefac, number_of_colours,
+                             p_warm_start_colour_table->data(), (int)p_warm_start_colour_table->size() / 3);
+    } else {
+        initnet(p_network, p_image_data, 3 * width*height, samplefac, number_of_colours);
+    }
+
+    learn(p_network);
+    unbiasnet(p_network);
+    writecolourmap(p_network, p_colour_table);
 
     delete[] p_temp_buffer;  // Delete temp buffer if one was used
 
@@ -1071,13 +1668,6 @@ void c_gif_write::quantise_colours_neuquant(
     }
 }
 
-uint8_t c_gif_write::get_best_index_neuquant(uint8_t b, uint8_t g, uint8_t r, uint8_t *p_rev_colour_table)
-{
-    (void)p_rev_colour_table;  // Remove unused arg compiler warning
-    return inxsearch(b, g, r);
-}
-
-
 void c_gif_write::detect_unchanged_border(
             const uint8_t *p_this_image,
             const uint8_t *p_last_image,
@@ -1088,174 +1678,56 @@ void c_gif_write::detect_unchanged_border(
 {
     assert(p_this_image != nullptr);
 
-    if (!m_colour) {
-        // Monochome version of the code
-        if (p_last_image != nullptr) {  // p_last_image == nullptr for first frame
-            const uint8_t *p_last_data = p_last_image;
-            const uint8_t *p_current_data = p_this_image;
-            // Scan top lines
-            bool mismatch = false;
-            for (y_start = 0; y_start <= y_end; y_start++) {
-                for (int x = 0; x < m_width; x++) {
-                    mismatch |= abs((int)(*p_current_data++) - (*p_last_data++)) > m_unchanged_border_tolerance;
-                }
-
-                // Break out of loop on mismatch
-                if (mismatch) {
-                    break;
-                }
-            }
-
-            if (y_start > y_end) {
-                // The 2 frames are exactly the same
-                // Save a minimal sized image
-                y_start = 0;
-                y_end = 1;
-                x_start = 0;
-                x_end = 1;
-            } else {
-                // Scan bottom lines
-                mismatch = false;
-                for ( ; y_end > y_start; y_end--) {
-                    p_last_data = p_last_image + y_end * m_width;
-                    p_current_data = p_this_image + y_end * m_width;
-                    for (int x = 0; x < m_width; x++) {
-                        mismatch |= abs((int)(*p_current_data++) - (*p_last_data++)) > m_unchanged_border_tolerance;
-                    }
-
-                    // Break out of look on mismatch
-                    if (mismatch) {
-                        break;
-                    }
-                }
-
-                // Scan left columns
-                mismatch = false;
-                for (x_start = 0; x_start < m_width; x_start++) {
-                    p_last_data = p_last_image + y_start * m_width + x_start;
-                    p_current_data = p_this_image + y_start * m_width + x_start;
-                    for (int y = y_start; y <= y_end; y++) {
-                        mismatch |= abs((int)(*p_current_data) - (*p_last_data)) > m_unchanged_border_tolerance;
-                        p_current_data += m_width;
-                        p_last_data += m_width;
-                    }
-
-                    // Break out of look on mismatch
-                    if (mismatch) {
-                        break;
-                    }
-                }
-
-                // Scan right columns
-                mismatch = false;
-                for (; x_end > x_start; x_end--) {
-                    p_last_data = p_last_image + y_start * m_width + x_end;
-                    p_current_data = p_this_image + y_start * m_width + x_end;
-                    for (int y = y_start; y <= y_end; y++) {
-                        mismatch |= abs((int)(*p_current_data) - (*p_last_data)) > m_unchanged_border_tolerance;
-                        p_current_data += m_width;
-                        p_last_data += m_width;
-                    }
+    if (p_last_image == nullptr) {
+        // First frame, there is no unchanged border
+        return;
+    }
 
-                    // Break out of look on mismatch
-                    if (mismatch) {
-                        break;
-                    }
-                }
-            }
+    const int bytes_per_pixel = (m_colour) ? 3 : 1;
+    const int line_size = m_width * bytes_per_pixel;
 
-            // At this point x_start, x_end, y_start and y_end should be updated to allow for
-            // an unchanged border for this frame
+    // Scan top lines, each line comparison stops at the first changed pixel
+    for (y_start = 0; y_start <= y_end; y_start++) {
+        int offset = y_start * line_size;
+        if (find_first_changed_pixel(p_this_image + offset, p_last_image + offset, 0, m_width,
+                                     bytes_per_pixel, m_unchanged_border_tolerance) < m_width) {
+            break;
         }
-    } else {
-        // Colour version of code
-        if (p_last_image != nullptr) {
-            const uint8_t *p_last_data = p_last_image;
-            const uint8_t *p_current_data = p_this_image;
-            // Scan top lines
-            bool mismatch = false;
-            for (y_start = 0; y_start <= y_end; y_start++) {
-                for (int x = 0; x < m_width; x++) {
-                    int diff = abs((int)(*p_current_data++) - (*p_last_data++));
-                    diff += abs((int)(*p_current_data++) - (*p_last_data++));
-                    diff += abs((int)(*p_current_data++) - (*p_last_data++));
-                    mismatch |= diff > m_unchanged_border_tolerance;
-                }
+    }
 
-                // Break out of loop on mismatch
-                if (mismatch) {
-                    break;
-                }
+    if (y_start > y_end) {
+        // The 2 frames are exactly the same
+        // Save a minimal sized image
+        y_start = 0;
+        y_end = 1;
+        x_start = 0;
+        x_end = 1;
+    } else {
+        // Scan bottom lines
+        for ( ; y_end > y_start; y_end--) {
+            int offset = y_end * line_size;
+            if (find_first_changed_pixel(p_this_image + offset, p_last_image + offset, 0, m_width,
+                                         bytes_per_pixel, m_unchanged_border_tolerance) < m_width) {
+                break;
             }
+        }
 
-            if (y_start > y_end) {
-                // The 2 frames are exactly the same
-                // Save a minimal sized image
-                y_start = 0;
-                y_end = 1;
-                x_start = 0;
-                x_end = 1;
-            } else {
-                // Scan bottom lines
-                mismatch = false;
-                for ( ; y_end > y_start; y_end--) {
-                    p_last_data = p_last_image + y_end * m_width * 3;
-                    p_current_data = p_this_image + y_end * m_width * 3;
-                    for (int x = 0; x < m_width; x++) {
-                        int diff = abs((int)(*p_current_data++) - (*p_last_data++));
-                        diff += abs((int)(*p_current_data++) - (*p_last_data++));
-                        diff += abs((int)(*p_current_data++) - (*p_last_data++));
-                        mismatch |= diff > m_unchanged_border_tolerance;
-                    }
-
-                    // Break out of look on mismatch
-                    if (mismatch) {
-                        break;
-                    }
-                }
-
-                // Scan left columns
-                mismatch = false;
-                int pixel_in_line_minus_2 = m_width * 3 - 2;
-                for (x_start = 0; x_start < m_width; x_start++) {
-                    p_last_data = p_last_image + (y_start * m_width + x_start) * 3;
-                    p_current_data = p_this_image + (y_start * m_width + x_start) * 3;
-                    for (int y = y_start; y <= y_end; y++) {
-                        int diff = abs((int)(*p_current_data++) - (*p_last_data++));
-                        diff += abs((int)(*p_current_data++) - (*p_last_data++));
-                        diff += abs((int)(*p_current_data) - (*p_last_data));
-                        mismatch |= diff > m_unchanged_border_tolerance;
-                        p_current_data += pixel_in_line_minus_2;
-                        p_last_data += pixel_in_line_minus_2;
-                    }
-
-                    // Break out of look on mismatch
-                    if (mismatch) {
-                        break;
-                    }
-                }
-
-                // Scan right columns
-                mismatch = false;
-                for (; x_end > x_start; x_end--) {
-                    p_last_data = p_last_image + (y_start * m_width + x_end) * 3;
-                    p_current_data = p_this_image + (y_start * m_width + x_end) * 3;
-                    for (int y = y_start; y <= y_end; y++) {
-                        int diff = abs((int)(*p_current_data++) - (*p_last_data++));
-                        diff += abs((int)(*p_current_data++) - (*p_last_data++));
-                        diff += abs((int)(*p_current_data) - (*p_last_data));
-                        mismatch |= diff > m_unchanged_border_tolerance;
-                        p_current_data += pixel_in_line_minus_2;
-                        p_last_data += pixel_in_line_minus_2;
-                    }
-
-                    // Break out of look on mismatch
-                    if (mismatch) {
-                        break;
-                    }
-                }
-            }
+        // Scan left and right columns
+        // This is done a line at a time so the data is read in order.  The first and last changed
+        // pixels of each line are found, only looking outside the columns already known to have changed.
+        int first_changed = m_width;
+        int last_changed = -1;
+        for (int y = y_start; y <= y_end; y++) {
+            int offset = y * line_size;
+            first_changed = find_first_changed_pixel(p_this_image + offset, p_last_image + offset, 0, first_changed,
+                                                     bytes_per_pixel, m_unchanged_border_tolerance);
+            last_changed = find_last_changed_pixel(p_this_image + offset, p_last_image + offset, last_changed + 1, m_width,
+                                                   bytes_per_pixel, m_unchanged_border_tolerance);
         }
+
+        // The top line has a changed pixel so both of these have been found
+        x_start = first_changed;
+        x_end = last_changed;
     }
 
     // At this point x_start, x_end, y_start and y_end should be updated to allow for
@@ -25,7 +25,14 @@
 #endif
 
 #include <cstdint>
+#include <deque>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <vector>
+
+#include "frame_buffer_pool.h"
+#include "inverse_colour_map.h"
 
 #ifndef GIF_COMMENT_STRING
     #define GIF_COMMENT_STRING "Created by PIPP"
@@ -41,8 +48,28 @@ class c_gif_write {
             COLOUR_QUANT_TYPE_MEDIAN_CUT
         };
 
+        // How colour frames get their colour tables (monochrome always uses a fixed global table)
+        enum e_palette_mode {
+            PALETTE_MODE_LOCAL,  // Quantise every frame to its own local colour table
+            PALETTE_MODE_GLOBAL,  // One global colour table from the sample frames, used for every frame
+            PALETTE_MODE_ADAPTIVE  // Start with the global colour table, re-quantise when a frame's colours no longer fit it
+        };
+
+        // Statistics for the frames written to the file so far
+        struct s_stats {
+            int frame_count;
+            uint64_t total_frame_bytes;  // Bytes written for frames, not including the header
+            uint64_t last_frame_bytes;
+            uint64_t max_frame_bytes;
+            double total_encode_time;  // Seconds spent encoding frames, the sum over all threads
+            double last_encode_time;
+            double max_encode_time;
+        };
+
         c_gif_write();
 
+        ~c_gif_write();
+
         // ------------------------------------------
         // Create a new GIF file
         // ------------------------------------------
@@ -62,17 +89,48 @@ class c_gif_write {
                 bool use_transparent_pixels,
                 int transparent_tolerence,
                 int lossy_compression_level,
-                int bit_depth);
+                int bit_depth,
+                e_palette_mode palette_mode = PALETTE_MODE_LOCAL);
+
+
+        // ------------------------------------------
+        // Set NeuQuant learning options, call after create() and before the first write_frame()
+        // sample_factor: learn from 1 in every sample_factor pixels (1 to 30), higher is faster but less accurate
+        // warm_start: frames with local colour tables start learning from the colour table of a recent
+        // key frame rather than from scratch, key frames are learnt from scratch
+        // ------------------------------------------
+        void set_neuquant_options(
+                int sample_factor,
+                bool warm_start);
+
+
+        // ------------------------------------------
+        // Add a sample frame for the global colour table
+        // Call between create() and the first write_frame() for colour files using
+        // PALETTE_MODE_GLOBAL or PALETTE_MODE_ADAPTIVE, a few frames spread across the
+        // animation are enough.  If no samples are added the first frame is used.
+        // ------------------------------------------
+        void add_palette_sample(
+                const uint8_t *p_data);
 
 
         // ------------------------------------------
         // Write frame to GIF file
+        // The frame is compared with the previous frame straight away and then
+        // quantised and compressed on a worker thread, frames are written to the
+        // file in order.  A write error may be reported by a later call.
         // ------------------------------------------
         bool write_frame(
                 uint8_t  *p_data,
                 uint16_t display_time);
 
 
+        // ------------------------------------------
+        // Wait for all frames to be written to the file, returns true on error
+        // ------------------------------------------
+        bool flush();
+
+
         // ------------------------------------------
         // Finish and close GIF file
         // ------------------------------------------
@@ -90,14 +148,176 @@ class c_gif_write {
 
         // ------------------------------------------
         // Get the current filesize
+        // Waits for frames that are still being encoded to be written
         // ------------------------------------------
         uint64_t get_current_filesize();
 
 
+        // ------------------------------------------
+        // Get bytes and encoding time per frame
+        // Only frames that have been written to the file are included, call flush() first
+        // for figures covering every frame.  Reset by create().
+        // ------------------------------------------
+        s_stats get_stats()
+        {
+            return m_stats;
+        }
+
+
     private:
+        //
+        // Private structures
+        //
+
+        // Buffers used by the median cut quantiser, reused between frames
+        struct s_median_cut_buffers {
+            std::unique_ptr<uint32_t[]> p_histogram;  // All zeros between frames
+            std::vector<uint64_t> entries;  // Sort keys of the used histogram entries
+        };
+
+        // NeuQuant network, reused between frames (defined in gif_write.cpp)
+        struct s_neuquant_buffers;
+
+        // A colour table shared by several frames
+        struct s_palette {
+            std::vector<uint8_t> colour_table;
+            std::shared_ptr<c_inverse_colour_map> p_inverse_colour_map;  // Nearest colour table index for each colour
+            std::vector<uint8_t> colour_difference_lut;  // Index to index colour differences (lossy compression only)
+            double mean_error;  // Mean colour error of the pixels the table was made from
+            bool is_global;  // Written as the global colour table, frames using it need no local colour table
+        };
+
+        // A frame waiting to be, or being, encoded by a worker thread
+        struct s_frame_job {
+            s_frame_job(size_t data_size, size_t pixel_count)
+                : p_data(data_size),
+                  p_index_image(pixel_count),
+                  p_transparent_mask(pixel_count)
+            {
+            }
+
+            c_pooled_buffer p_data;  // Copy of the frame (colour only)
+            c_pooled_buffer p_index_image;  // Indexed pixels of the active area
+            c_pooled_buffer p_transparent_mask;  // Non-zero for transparent pixels of the active area (colour only)
+            bool use_transparent_mask;
+            bool transparent_flag;  // Set transparent colour flag in graphic control extension
+            int transparent_index;
+            uint16_t display_time;
+            uint16_t x_start;
+            uint16_t x_end;
+            uint16_t y_start;
+            uint16_t y_end;
+            std::vector<uint8_t> encoded_data;  // Everything written to the file for this frame
+            std::vector<uint8_t> colour_table;  // Local colour table
+            std::shared_ptr<const s_palette> p_palette;  // Colour table to use, nullptr to quantise this frame
+            double encode_time;  // Seconds
+
+            // NeuQuant warm start, key frames publish their colour table for the frames that follow them
+            std::shared_ptr<std::promise<std::vector<uint8_t>>> p_neuquant_key_colour_table;  // Key frames only
+            std::shared_future<std::vector<uint8_t>> neuquant_warm_start_colour_table;  // Frames that warm start only
+
+            // Adaptive palette mode, each frame's colour table is chosen from the previous frame's on the worker thread
+            std::shared_future<std::shared_ptr<const s_palette>> previous_palette;
+            std::shared_ptr<std::promise<std::shared_ptr<const s_palette>>> p_adaptive_palette;  // This frame's choice
+        };
+
+        struct s_pending_frame {
+            std::unique_ptr<s_frame_job> p_job;
+            std::future<void> encoded;
+        };
+
+
         //
         // Private functions
         //
+        // ------------------------------------------
+        // Quantise, index and compress a frame into p_job->encoded_data
+        // Runs on a worker thread
+        // ------------------------------------------
+        void encode_frame(
+            s_frame_job *p_job);
+
+
+        // ------------------------------------------
+        // Keep the previous frame's colour table, or re-quantise if this frame's colours have drifted from it
+        // Runs on a worker thread, waiting for the previous frame's choice
+        // ------------------------------------------
+        void choose_adaptive_palette(
+            s_frame_job *p_job);
+
+
+        // ------------------------------------------
+        // Write encoded frames to the file until at most max_pending frames are left
+        // ------------------------------------------
+        void write_encoded_frames(
+            size_t max_pending);
+
+
+        // ------------------------------------------
+        // Get a frame job, reusing one from an earlier frame if there is one
+        // ------------------------------------------
+        std::unique_ptr<s_frame_job> get_frame_job();
+
+
+        // ------------------------------------------
+        // Write data to the file through the output buffer
+        // ------------------------------------------
+        void write_data(
+            const void *p_data,
+            size_t size);
+
+
+        // ------------------------------------------
+        // Write the contents of the output buffer to the file
+        // ------------------------------------------
+        void flush_output_buffer();
+
+
+        // ------------------------------------------
+        // Write GIF header, global colour table and Netscape extension
+        // ------------------------------------------
+        void write_file_header(
+            const uint8_t *p_global_colour_table);
+
+
+        // ------------------------------------------
+        // Quantise rows of frame data (stacked frames for sample frames) to a shared colour table
+        // ------------------------------------------
+        std::shared_ptr<s_palette> create_palette(
+            uint8_t *p_data,
+            int rows,
+            bool is_global);
+
+
+        // ------------------------------------------
+        // Mean colour error (sum of absolute channel differences) of rows of frame data mapped to a colour table
+        // Used to decide when to re-quantise in adaptive mode
+        // ------------------------------------------
+        double get_palette_error(
+            const s_palette &palette,
+            const uint8_t *p_data,
+            int rows);
+
+
+        std::unique_ptr<s_median_cut_buffers> get_median_cut_buffers();
+
+        void release_median_cut_buffers(
+            std::unique_ptr<s_median_cut_buffers> p_buffers);
+
+        std::unique_ptr<s_neuquant_buffers> get_neuquant_buffers();
+
+        void release_neuquant_buffers(
+            std::unique_ptr<s_neuquant_buffers> p_buffers);
+
+
+        // ------------------------------------------
+        // Get an inverse colour map for a colour table, frames with the same colour table share one
+        // ------------------------------------------
+        std::shared_ptr<c_inverse_colour_map> get_inverse_colour_map(
+            const uint8_t *p_colour_table,
+            int number_of_colours,
+            bool exact);
+
         // ------------------------------------------
         // fwrite() function with error checking
         // ------------------------------------------
@@ -117,13 +337,17 @@ class c_gif_write {
                 int number_of_colours,
                 uint8_t *p_colour_table,
                 uint8_t *p_rev_colour_table,
-                uint8_t *p_index_to_index_colour_difference);
+                uint8_t *p_index_to_index_colour_difference,
+                s_median_cut_buffers &buffers);
 
         uint8_t get_best_index_median_cut(uint8_t b, uint8_t g, uint8_t r, uint8_t *p_rev_colour_table);
 
 
         void quantise_colours_neuquant(
+            s_neuquant_buffers &buffers,
+            const std::vector<uint8_t> *p_warm_start_colour_table,
             uint8_t *p_data,
+            int height,
 //            uint16_t x_start,
 //            uint16_t x_end,
 //            uint16_t y_start,
@@ -133,8 +357,6 @@ class c_gif_write {
 //            uint8_t *p_rev_colour_table,
             uint8_t *p_index_to_index_colour_difference);
 
-        uint8_t get_best_index_neuquant(uint8_t b, uint8_t g, uint8_t r, uint8_t *p_rev_colour_table);
-
 
         void detect_unchanged_border(
             const uint8_t *p_this_image,
@@ -146,7 +368,7 @@ class c_gif_write {
 
 
         //
-        // Private structures
+        // GIF file structures
         //
         struct s_gif_header {
             uint8_t m_signature[3]; // "GIF";
@@ -253,6 +475,14 @@ class c_gif_write {
         int m_lossy_compression_level;
         int m_bit_depth;
         e_colour_quant_type m_colour_quant_type;
+        e_palette_mode m_palette_mode;
+
+        // Shared colour tables
+        bool m_header_written;  // Not written until the global colour table is known
+        int m_repeat_count;
+        std::vector<uint8_t> m_palette_samples;  // Sample frames stacked one above another
+        std::shared_ptr<const s_palette> mp_palette;  // Global colour table
+        std::shared_future<std::shared_ptr<const s_palette>> m_adaptive_palette;  // Chosen for the last frame (adaptive mode)
 
         // File writing error flag
         bool m_file_write_error;
@@ -270,6 +500,28 @@ class c_gif_write {
         FILE *mp_gif_file;
         bool m_open;
         std::unique_ptr<uint8_t[]> mp_last_image;
+        s_stats m_stats;
+
+        // Output buffer, the file is written in large blocks rather than a few bytes at a time
+        std::unique_ptr<c_pooled_buffer> mp_output_buffer;
+        size_t m_output_buffer_used;
+
+        // Worker threads
+        int m_max_pending_frames;
+        std::deque<s_pending_frame> m_pending_frames;  // In file order
+        std::vector<std::unique_ptr<s_frame_job>> m_free_frame_jobs;  // Jobs for frames that have been written, for reuse
+        std::mutex m_median_cut_buffers_mutex;
+        std::vector<std::unique_ptr<s_median_cut_buffers>> m_free_median_cut_buffers;
+        std::mutex m_neuquant_buffers_mutex;
+        std::vector<std::unique_ptr<s_neuquant_buffers>> m_free_neuquant_buffers;
+        std::mutex m_inverse_colour_maps_mutex;
+        std::vector<std::shared_ptr<c_inverse_colour_map>> m_inverse_colour_maps;  // Least recently used first
+
+        // NeuQuant options
+        int m_neuquant_sample_factor;
+        bool m_neuquant_warm_start;
+        int m_frames_since_neuquant_key_frame;
+        std::shared_future<std::vector<uint8_t>> m_neuquant_key_colour_table;  // From the last key frame
 
         // GIF implementation details
         s_gif_header m_gif_header;
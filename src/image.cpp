@@ -17,13 +17,38 @@
 
 
 #include <QDebug>
+#include <QtConcurrent>
+#include <QThreadPool>
+#include <QVector>
 #include <cstring>  // memset()
 #include <cmath>  // sqrt()
+#include <utility>  // std::swap()
 
 #include "image.h"
+#include "debayer_row.h"
+#include "frame_buffer_pool.h"
 #include "pipp_ser.h"
 
 
+// Frames smaller than this are not worth splitting across threads
+static const int32_t C_MIN_PIXELS_PER_BAND = 32 * 1024;
+
+// 0 means one thread per core
+int c_image::m_thread_count = 0;
+
+
+// ------------------------------------------
+// Thread pool shared by all images
+// This is kept separate from the global thread pool so that frames being
+// processed on global pool threads can wait for their bands without starving it
+// ------------------------------------------
+static QThreadPool *get_image_thread_pool()
+{
+    static QThreadPool image_thread_pool;
+    return &image_thread_pool;
+}
+
+
 void c_image::set_image_details(int32_t width,
                                 int32_t height,
                                 int32_t byte_depth,
@@ -240,6 +265,125 @@ void c_image::set_colour_align(
 }
 
 
+void c_image::copy_processing_settings(
+        const c_image &other)
+{
+    // Keep the 16-bit LUTs if they were built for the same settings
+    if (m_invert != other.m_invert ||
+        m_colour_balance_enabled != other.m_colour_balance_enabled ||
+        m_red_gain != other.m_red_gain ||
+        m_green_gain != other.m_green_gain ||
+        m_blue_gain != other.m_blue_gain ||
+        m_gain != other.m_gain ||
+        m_gamma != other.m_gamma) {
+        m_mono_lut_16bit_valid = false;
+        m_colour_luts_16bit_valid = false;
+    }
+
+    m_invert = other.m_invert;
+    m_colour_balance_enabled = other.m_colour_balance_enabled;
+    m_red_gain = other.m_red_gain;
+    m_green_gain = other.m_green_gain;
+    m_blue_gain = other.m_blue_gain;
+    m_gain = other.m_gain;
+    m_gamma = other.m_gamma;
+    m_rgb_align_enabled = other.m_rgb_align_enabled;
+    m_red_align_x = other.m_red_align_x;
+    m_red_align_y = other.m_red_align_y;
+    m_blue_align_x = other.m_blue_align_x;
+    m_blue_align_y = other.m_blue_align_y;
+    memcpy(m_mono_lut, other.m_mono_lut, sizeof(m_mono_lut));
+    memcpy(m_red_lut, other.m_red_lut, sizeof(m_red_lut));
+    memcpy(m_green_lut, other.m_green_lut, sizeof(m_green_lut));
+    memcpy(m_blue_lut, other.m_blue_lut, sizeof(m_blue_lut));
+}
+
+
+void c_image::swap_image_data(
+        c_image &other)
+{
+    std::swap(m_width, other.m_width);
+    std::swap(m_height, other.m_height);
+    std::swap(m_byte_depth, other.m_byte_depth);
+    std::swap(m_colour_id, other.m_colour_id);
+    std::swap(m_colour, other.m_colour);
+    std::swap(mp_buffer, other.mp_buffer);
+    std::swap(m_buffer_size, other.m_buffer_size);
+    m_display_buffer.swap(other.m_display_buffer);
+    std::swap(m_display_bytes_per_line, other.m_display_bytes_per_line);
+}
+
+
+void c_image::set_thread_count(
+        int thread_count)
+{
+    m_thread_count = (thread_count < 0) ? 0 : thread_count;
+    if (m_thread_count > 0) {
+        // The calling thread processes one band itself
+        get_image_thread_pool()->setMaxThreadCount((m_thread_count > 1) ? m_thread_count - 1 : 1);
+    } else {
+        get_image_thread_pool()->setMaxThreadCount(QThread::idealThreadCount());
+    }
+}
+
+
+int c_image::get_thread_count()
+{
+    if (m_thread_count > 0) {
+        return m_thread_count;
+    }
+
+    int ideal_thread_count = QThread::idealThreadCount();
+    return (ideal_thread_count > 0) ? ideal_thread_count : 1;
+}
+
+
+// ------------------------------------------
+// Split rows into bands and process them in parallel
+// ------------------------------------------
+void c_image::run_row_bands(
+        int32_t row_count,
+        const std::function<void(int32_t, int32_t)> &band_function)
+{
+    int32_t band_count = get_thread_count();
+
+    // Keep enough pixels in each band to make the thread hand over worthwhile
+    int32_t pixels_per_row = (m_width > 0) ? m_width : 1;
+    int32_t max_band_count = (row_count * pixels_per_row) / C_MIN_PIXELS_PER_BAND;
+    band_count = (band_count > max_band_count) ? max_band_count : band_count;
+    band_count = (band_count > row_count) ? row_count : band_count;
+
+    if (band_count <= 1) {
+        // Not worth splitting, process on this thread
+        band_function(0, row_count);
+        return;
+    }
+
+    // Spread rows as evenly as possible, the first bands get any extra rows
+    int32_t rows_per_band = row_count / band_count;
+    int32_t extra_rows = row_count % band_count;
+
+    QVector<QFuture<void>> band_futures;
+    int32_t first_band_end = rows_per_band + ((extra_rows > 0) ? 1 : 0);
+    int32_t start_row = first_band_end;
+    for (int32_t band = 1; band < band_count; band++) {
+        int32_t end_row = start_row + rows_per_band + ((band < extra_rows) ? 1 : 0);
+        band_futures.append(QtConcurrent::run(get_image_thread_pool(), [&band_function, start_row, end_row]() {
+            band_function(start_row, end_row);
+        }));
+
+        start_row = end_row;
+    }
+
+    // Process the first band on this thread while the others run
+    band_function(0, first_band_end);
+
+    for (QFuture<void> &band_future : band_futures) {
+        band_future.waitForFinished();
+    }
+}
+
+
 void c_image::setup_luts()
 {
     for (int x = 0; x < 256; x++) {
@@ -287,6 +431,90 @@ void c_image::setup_luts()
         m_blue_lut[x] = (uint8_t)temp_b;
         m_mono_lut[x] = (uint8_t)temp_m;
     }
+
+    // The 16-bit LUTs are rebuilt the next time a 16-bit frame is processed
+    m_mono_lut_16bit_valid = false;
+    m_colour_luts_16bit_valid = false;
+}
+
+
+// ------------------------------------------
+// Build the 16-bit LUTs needed for the current image if they are out of date
+// Mono images, and colour images without colour balance, just use the mono LUT
+// ------------------------------------------
+void c_image::setup_luts_16bit()
+{
+    if ((!m_colour || !m_colour_balance_enabled) && !m_mono_lut_16bit_valid) {
+        m_mono_lut_16bit.resize(65536);
+        m_mono_lut_16bit_is_identity = true;
+        for (int x = 0; x < 65536; x++) {
+            double mono_data = x;
+
+            // Invert pixel
+            if (m_invert) {
+                mono_data = 65535.0 - mono_data;
+            }
+
+            // Apply main gain
+            mono_data *= m_gain;
+            mono_data = (mono_data > 65535.0) ? 65535.0 : mono_data;
+
+            // Apply gamma
+            mono_data = (uint16_t)(pow((double)(mono_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5);
+            mono_data = (mono_data > 65535.0) ? 65535.0 : mono_data;
+
+            m_mono_lut_16bit[x] = mono_data;
+            if (m_mono_lut_16bit[x] != x) {
+                m_mono_lut_16bit_is_identity = false;
+            }
+        }
+
+        m_mono_lut_16bit_valid = true;
+    }
+
+    if (m_colour && m_colour_balance_enabled && !m_colour_luts_16bit_valid) {
+        m_red_lut_16bit.resize(65536);
+        m_green_lut_16bit.resize(65536);
+        m_blue_lut_16bit.resize(65536);
+        m_colour_luts_16bit_are_identity = true;
+        for (int x = 0; x < 65536; x++) {
+            double b_data = x;
+            double g_data = x;
+            double r_data = x;
+
+            // Invert pixel
+            if (m_invert) {
+                b_data = 65535.0 - b_data;
+                g_data = 65535.0 - g_data;
+                r_data = 65535.0 - r_data;
+            }
+
+            // Apply colour balance gains and main gain
+            b_data *=  m_blue_gain * m_gain;
+            g_data *=  m_green_gain * m_gain;
+            r_data *=  m_red_gain * m_gain;
+            b_data = (b_data > 65535.0) ? 65535.0 : b_data;
+            g_data = (g_data > 65535.0) ? 65535.0 : g_data;
+            r_data = (r_data > 65535.0) ? 65535.0 : r_data;
+
+            // Apply gamma
+            b_data = pow((double)(b_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
+            g_data = pow((double)(g_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
+            r_data = pow((double)(r_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
+            b_data = (b_data > 65535.0) ? 65535.0 : b_data;
+            g_data = (g_data > 65535.0) ? 65535.0 : g_data;
+            r_data = (r_data > 65535.0) ? 65535.0 : r_data;
+
+            m_blue_lut_16bit[x] = (uint16_t)b_data;
+            m_green_lut_16bit[x] = (uint16_t)g_data;
+            m_red_lut_16bit[x] = (uint16_t)r_data;
+            if (m_blue_lut_16bit[x] != x || m_green_lut_16bit[x] != x || m_red_lut_16bit[x] != x) {
+                m_colour_luts_16bit_are_identity = false;
+            }
+        }
+
+        m_colour_luts_16bit_valid = true;
+    }
 }
 
 
@@ -435,83 +663,76 @@ void c_image::do_lut_based_processing()
         if (!m_colour) {
             // Mono images just use 1 LUT
             if (m_gain != 1.0 || m_gamma != 1.0 || m_invert) {
-                uint8_t *p_frame_data = mp_buffer;
-                for (int pixel = 0; pixel < m_width * m_height; pixel++) {
-                    *p_frame_data = m_mono_lut[*p_frame_data];
-                    p_frame_data++;
-                }
+                run_row_bands(m_height, [this](int32_t start_row, int32_t end_row) {
+                    uint8_t *p_frame_data = mp_buffer + start_row * m_width;
+                    for (int pixel = start_row * m_width; pixel < end_row * m_width; pixel++) {
+                        *p_frame_data = m_mono_lut[*p_frame_data];
+                        p_frame_data++;
+                    }
+                });
             }
         } else {
             // Colour images use all 3 LUTs
             if ((m_colour_balance_enabled && m_colour) || m_gain != 1.0 || m_gamma != 1.0 || m_invert) {
-                uint8_t *p_frame_data = mp_buffer;
-                for (int pixel = 0; pixel < m_width * m_height; pixel++) {
-                    *p_frame_data = m_blue_lut[*p_frame_data];
-                    p_frame_data++;
-                    *p_frame_data = m_green_lut[*p_frame_data];
-                    p_frame_data++;
-                    *p_frame_data = m_red_lut[*p_frame_data];
-                    p_frame_data++;
-                }
+                run_row_bands(m_height, [this](int32_t start_row, int32_t end_row) {
+                    uint8_t *p_frame_data = mp_buffer + start_row * m_width * 3;
+                    for (int pixel = start_row * m_width; pixel < end_row * m_width; pixel++) {
+                        *p_frame_data = m_blue_lut[*p_frame_data];
+                        p_frame_data++;
+                        *p_frame_data = m_green_lut[*p_frame_data];
+                        p_frame_data++;
+                        *p_frame_data = m_red_lut[*p_frame_data];
+                        p_frame_data++;
+                    }
+                });
             }
         }
     } else {
-        // 16-bit version
+        // 16-bit version also uses LUTs, these are built the first time they are needed
+        setup_luts_16bit();
         if (!m_colour) {
             // Monochrome processing
-            uint16_t *data_ptr = (uint16_t *)mp_buffer;
-            for (int x = 0; x < m_width * m_height; x++) {
-                double mono_data = *data_ptr;
-
-                // Invert pixel
-                if (m_invert) {
-                    mono_data = 65535.0 - mono_data;
-                }
-
-                // Apply main gain
-                mono_data *= m_gain;
-                mono_data = (mono_data > 65535.0) ? 65535.0 : mono_data;
-
-                // Apply gamma
-                mono_data = (uint16_t)(pow((double)(mono_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5);
-                mono_data = (mono_data > 65535.0) ? 65535.0 : mono_data;
-
-                *data_ptr++ = mono_data;
+            if (!m_mono_lut_16bit_is_identity) {
+                const uint16_t *p_mono_lut = m_mono_lut_16bit.data();
+                run_row_bands(m_height, [this, p_mono_lut](int32_t start_row, int32_t end_row) {
+                    uint16_t *data_ptr = ((uint16_t *)mp_buffer) + start_row * m_width;
+                    for (int x = start_row * m_width; x < end_row * m_width; x++) {
+                        *data_ptr = p_mono_lut[*data_ptr];
+                        data_ptr++;
+                    }
+                });
             }
         } else {
             // Colour processing
-            uint16_t *data_ptr = (uint16_t *)mp_buffer;
-            for (int x = 0; x < m_width * m_height; x++) {
-                double b_data = *data_ptr;
-                double g_data = *(data_ptr + 1);
-                double r_data = *(data_ptr + 2);
-
-                // Invert pixel
-                if (m_invert) {
-                    b_data = 65535.0 - b_data;
-                    g_data = 65535.0 - g_data;
-                    r_data = 65535.0 - r_data;
-                }
-
-                // Apply colour balance gains and main gain
-                b_data *=  m_blue_gain * m_gain;
-                g_data *=  m_green_gain * m_gain;
-                r_data *=  m_red_gain * m_gain;
-                b_data = (b_data > 65535.0) ? 65535.0 : b_data;
-                g_data = (g_data > 65535.0) ? 65535.0 : g_data;
-                r_data = (r_data > 65535.0) ? 65535.0 : r_data;
-
-                // Apply gamma
-                b_data = pow((double)(b_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
-                g_data = pow((double)(g_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
-                r_data = pow((double)(r_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
-                b_data = (b_data > 65535.0) ? 65535.0 : b_data;
-                g_data = (g_data > 65535.0) ? 65535.0 : g_data;
-                r_data = (r_data > 65535.0) ? 65535.0 : r_data;
-
-                *data_ptr++ = (uint16_t)b_data;
-                *data_ptr++ = (uint16_t)g_data;
-                *data_ptr++ = (uint16_t)r_data;
+            const uint16_t *p_blue_lut;
+            const uint16_t *p_green_lut;
+            const uint16_t *p_red_lut;
+            bool luts_are_identity;
+            if (m_colour_balance_enabled) {
+                p_blue_lut = m_blue_lut_16bit.data();
+                p_green_lut = m_green_lut_16bit.data();
+                p_red_lut = m_red_lut_16bit.data();
+                luts_are_identity = m_colour_luts_16bit_are_identity;
+            } else {
+                // All channels have the same gain
+                p_blue_lut = m_mono_lut_16bit.data();
+                p_green_lut = m_mono_lut_16bit.data();
+                p_red_lut = m_mono_lut_16bit.data();
+                luts_are_identity = m_mono_lut_16bit_is_identity;
+            }
+
+            if (!luts_are_identity) {
+                run_row_bands(m_height, [&](int32_t start_row, int32_t end_row) {
+                    uint16_t *data_ptr = ((uint16_t *)mp_buffer) + start_row * m_width * 3;
+                    for (int x = start_row * m_width; x < end_row * m_width; x++) {
+                        *data_ptr = p_blue_lut[*data_ptr];
+                        data_ptr++;
+                        *data_ptr = p_green_lut[*data_ptr];
+                        data_ptr++;
+                        *data_ptr = p_red_lut[*data_ptr];
+                        data_ptr++;
+                    }
+                });
             }
         }
     }
@@ -544,117 +765,104 @@ void c_image::align_colour_channels()
 template <typename T>
 void c_image::align_colour_channels_int()
 {
-    T *p_new_buffer = new T[m_width * m_height * 3];  // Create new buffer
-    memcpy(p_new_buffer, mp_buffer, m_width * m_height * 3 * sizeof(T));  // Copy current data into new buffer
-
-
-    //
-    // Blue channel
-    //
-    if (m_blue_align_x != 0 || m_blue_align_y != 0) {
-        T *p_wr_data = p_new_buffer;
-        int blue_active_y_start = (m_blue_align_y < 0) ? 0 : m_blue_align_y;
-        int blue_active_y_end = (m_blue_align_y > 0) ? m_height - 1 : m_height - 1 + m_blue_align_y;
-        int blue_active_x_start = (m_blue_align_x < 0) ? 0 : m_blue_align_x;
-        int blue_active_x_end = (m_blue_align_x > 0) ? m_width - 1: m_width - 1 + m_blue_align_x;
-
-        // Copy blue channel to new buffer
-        int y;
-        for (y = 0; y < blue_active_y_start; y++) {
-            // Write inital blank lines to new buffer (if any)
-            for (int x = 0; x < m_width; x++) {
-                *p_wr_data = 0;  // Blue data
-                p_wr_data += 3;
-            }
-        }
-
-        // Active lines
-        for ( ; y < blue_active_y_end; y++) {
-            // Write inital blank pixels at start of the line (if any)
-            int x;
-            for (x = 0; x < blue_active_x_start; x++) {
-                *p_wr_data = 0;  // Blue data
-                p_wr_data += 3;
-            }
-
-            // Write active pixels to new buffer
-            T *p_blue_rd_data = ((T *)mp_buffer) + (y - m_blue_align_y) * m_width * 3 + (x - m_blue_align_x)* 3;
-            for ( ; x < blue_active_x_end; x++) {
-                *p_wr_data = *p_blue_rd_data;
-                p_blue_rd_data += 3;
-                p_wr_data += 3;
-            }
-
-            // Write final blank pixels at end of line (if any)
-            for ( ; x < m_width; x++) {
-                *p_wr_data = 0;  // Blue data
-                p_wr_data += 3;
-            }
+    T *p_new_buffer = (T *)c_frame_buffer_pool::get_buffer(m_width * m_height * 3 * sizeof(T));  // Create new buffer
+
+    // Active area of the blue channel
+    int blue_active_y_start = (m_blue_align_y < 0) ? 0 : m_blue_align_y;
+    int blue_active_y_end = (m_blue_align_y > 0) ? m_height - 1 : m_height - 1 + m_blue_align_y;
+    int blue_active_x_start = (m_blue_align_x < 0) ? 0 : m_blue_align_x;
+    int blue_active_x_end = (m_blue_align_x > 0) ? m_width - 1: m_width - 1 + m_blue_align_x;
+
+    // Active area of the red channel
+    int red_active_y_start = (m_red_align_y < 0) ? 0 : m_red_align_y;
+    int red_active_y_end = (m_red_align_y > 0) ? m_height - 1 : m_height - 1 + m_red_align_y;
+    int red_active_x_start = (m_red_align_x < 0) ? 0 : m_red_align_x;
+    int red_active_x_end = (m_red_align_x > 0) ? m_width - 1: m_width - 1 + m_red_align_x;
+
+    run_row_bands(m_height, [&](int32_t start_row, int32_t end_row) {
+        // Copy current data into new buffer
+        memcpy(p_new_buffer + start_row * m_width * 3,
+               ((T *)mp_buffer) + start_row * m_width * 3,
+               (end_row - start_row) * m_width * 3 * sizeof(T));
+
+        //
+        // Blue channel
+        //
+        if (m_blue_align_x != 0 || m_blue_align_y != 0) {
+            for (int y = start_row; y < end_row; y++) {
+                T *p_wr_data = p_new_buffer + y * m_width * 3;
+                if (y < blue_active_y_start || y >= blue_active_y_end) {
+                    // Blank line
+                    for (int x = 0; x < m_width; x++) {
+                        *p_wr_data = 0;  // Blue data
+                        p_wr_data += 3;
+                    }
+
+                    continue;
+                }
 
-        }
+                // Write inital blank pixels at start of the line (if any)
+                int x;
+                for (x = 0; x < blue_active_x_start; x++) {
+                    *p_wr_data = 0;  // Blue data
+                    p_wr_data += 3;
+                }
 
-        // Copy final blank lines to new buffer (if any)
-        for ( ; y < m_height; y++) {
-            for (int x = 0; x < m_width; x++) {
-                *p_wr_data = 0;  // Blue data
-                p_wr_data += 3;
-            }
-        }
-    }
+                // Write active pixels to new buffer
+                T *p_blue_rd_data = ((T *)mp_buffer) + (y - m_blue_align_y) * m_width * 3 + (x - m_blue_align_x)* 3;
+                for ( ; x < blue_active_x_end; x++) {
+                    *p_wr_data = *p_blue_rd_data;
+                    p_blue_rd_data += 3;
+                    p_wr_data += 3;
+                }
 
-    //
-    // Red channel
-    //
-    if (m_red_align_x != 0 || m_red_align_y != 0) {
-        T *p_wr_data = p_new_buffer + 2;
-        int red_active_y_start = (m_red_align_y < 0) ? 0 : m_red_align_y;
-        int red_active_y_end = (m_red_align_y > 0) ? m_height - 1 : m_height - 1 + m_red_align_y;
-        int red_active_x_start = (m_red_align_x < 0) ? 0 : m_red_align_x;
-        int red_active_x_end = (m_red_align_x > 0) ? m_width - 1: m_width - 1 + m_red_align_x;
-
-        // Copy blue channel to new buffer
-        int y;
-        for (y = 0; y < red_active_y_start; y++) {
-            // Write inital blank lines to new buffer (if any)
-            for (int x = 0; x < m_width; x++) {
-                *p_wr_data = 0;  // Red data
-                p_wr_data += 3;
+                // Write final blank pixels at end of line (if any)
+                for ( ; x < m_width; x++) {
+                    *p_wr_data = 0;  // Blue data
+                    p_wr_data += 3;
+                }
             }
         }
 
-        // Active lines
-        for ( ; y < red_active_y_end; y++) {
-            // Write inital blank pixels at start of the line (if any)
-            int x;
-            for (x = 0; x < red_active_x_start; x++) {
-                *p_wr_data = 0;  // Red data
-                p_wr_data += 3;
-            }
-
-            // Write active pixels to new buffer
-            T *p_red_rd_data = ((T *)mp_buffer) + (y - m_red_align_y) * m_width * 3 + (x - m_red_align_x)* 3 + 2;
-            for ( ; x < red_active_x_end; x++) {
-                *p_wr_data = *p_red_rd_data;
-                p_red_rd_data += 3;
-                p_wr_data += 3;
-            }
+        //
+        // Red channel
+        //
+        if (m_red_align_x != 0 || m_red_align_y != 0) {
+            for (int y = start_row; y < end_row; y++) {
+                T *p_wr_data = p_new_buffer + y * m_width * 3 + 2;
+                if (y < red_active_y_start || y >= red_active_y_end) {
+                    // Blank line
+                    for (int x = 0; x < m_width; x++) {
+                        *p_wr_data = 0;  // Red data
+                        p_wr_data += 3;
+                    }
+
+                    continue;
+                }
 
-            // Write final blank pixels at end of line (if any)
-            for ( ; x < m_width; x++) {
-                *p_wr_data = 0;  // Red data
-                p_wr_data += 3;
-            }
+                // Write inital blank pixels at start of the line (if any)
+                int x;
+                for (x = 0; x < red_active_x_start; x++) {
+                    *p_wr_data = 0;  // Red data
+                    p_wr_data += 3;
+                }
 
-        }
+                // Write active pixels to new buffer
+                T *p_red_rd_data = ((T *)mp_buffer) + (y - m_red_align_y) * m_width * 3 + (x - m_red_align_x)* 3 + 2;
+                for ( ; x < red_active_x_end; x++) {
+                    *p_wr_data = *p_red_rd_data;
+                    p_red_rd_data += 3;
+                    p_wr_data += 3;
+                }
 
-        // Copy final blank lines to new buffer (if any)
-        for ( ; y < m_height; y++) {
-            for (int x = 0; x < m_width; x++) {
-                *p_wr_data = 0;  // Red data
-                p_wr_data += 3;
+                // Write final blank pixels at end of line (if any)
+                for ( ; x < m_width; x++) {
+                    *p_wr_data = 0;  // Red data
+                    p_wr_data += 3;
+                }
             }
         }
-    }
+    });
 
     set_new_buffer((uint8_t *)p_new_buffer, m_width * m_height * 3 * sizeof(T));
 }
@@ -667,40 +875,42 @@ void c_image::change_colour_saturation_int(
     // Only chnage colour saturation for colour images
     // saturation == 1.0 means no change so do nothing
     if (m_colour && saturation != 1.0) {
-        const double C_Pr = .299;
-        const double C_Pg = .587;
-        const double C_Pb = .114;
-
-        T *p_frame_data = (T *)mp_buffer;
-        for (int pixel = 0; pixel < m_width * m_height; pixel++) {
-            T *p_blue = p_frame_data++;
-            T *p_green = p_frame_data++;
-            T *p_red = p_frame_data++;
-
-            if (*p_blue != *p_green || *p_blue != *p_red) {
-                // This is not a monochrome pixel - apply colour saturation
-                double P = sqrt( C_Pr * (*p_red) * (*p_red) +
-                                 C_Pg * (*p_green) * (*p_green) +
-                                 C_Pb * (*p_blue) * (*p_blue) );
-
-                double dred = P + ((double)(*p_red) - P) * saturation;
-                double dgreen = P + ((double)(*p_green) - P) * saturation;
-                double dblue = P + ((double)(*p_blue) - P) * saturation;
-
-                // Clip values in 0 to 255 range
-                dred = (dred < 0) ? 0 : dred;
-                dgreen = (dgreen < 0) ? 0 : dgreen;
-                dblue = (dblue < 0) ? 0 : dblue;
-
-                dred = (dred > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dred;
-                dgreen = (dgreen > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dgreen;
-                dblue = (dblue > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dblue;
-
-                *p_red = (T)dred;
-                *p_green = (T)dgreen;
-                *p_blue = (T)dblue;
+        run_row_bands(m_height, [this, saturation](int32_t start_row, int32_t end_row) {
+            const double C_Pr = .299;
+            const double C_Pg = .587;
+            const double C_Pb = .114;
+
+            T *p_frame_data = ((T *)mp_buffer) + start_row * m_width * 3;
+            for (int pixel = start_row * m_width; pixel < end_row * m_width; pixel++) {
+                T *p_blue = p_frame_data++;
+                T *p_green = p_frame_data++;
+                T *p_red = p_frame_data++;
+
+                if (*p_blue != *p_green || *p_blue != *p_red) {
+                    // This is not a monochrome pixel - apply colour saturation
+                    double P = sqrt( C_Pr * (*p_red) * (*p_red) +
+                                     C_Pg * (*p_green) * (*p_green) +
+                                     C_Pb * (*p_blue) * (*p_blue) );
+
+                    double dred = P + ((double)(*p_red) - P) * saturation;
+                    double dgreen = P + ((double)(*p_green) - P) * saturation;
+                    double dblue = P + ((double)(*p_blue) - P) * saturation;
+
+                    // Clip values in 0 to 255 range
+                    dred = (dred < 0) ? 0 : dred;
+                    dgreen = (dgreen < 0) ? 0 : dgreen;
+                    dblue = (dblue < 0) ? 0 : dblue;
+
+                    dred = (dred > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dred;
+                    dgreen = (dgreen > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dgreen;
+                    dblue = (dblue > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dblue;
+
+                    *p_red = (T)dred;
+                    *p_green = (T)dgreen;
+                    *p_blue = (T)dblue;
+                }
             }
-        }
+        });
     }
 }
 
@@ -875,7 +1085,7 @@ void c_image::add_horizontal_bars(int top_bar, int bottom_bar)
        line_length *= 3;
    }
 
-   T *p_new_buffer = new T[line_length * new_height];
+   T *p_new_buffer = (T *)c_frame_buffer_pool::get_buffer(line_length * new_height * sizeof(T));
    T *p_wr_data = p_new_buffer;
 
    // Write bottom bar to buffer
@@ -908,7 +1118,7 @@ void c_image::add_vertical_bars(
         new_line_length *= 3;
     }
 
-    T *p_new_buffer = new T[new_line_length * m_height];
+    T *p_new_buffer = (T *)c_frame_buffer_pool::get_buffer(new_line_length * m_height * sizeof(T));
     T *p_wr_data = p_new_buffer;
     T *p_rd_data = (T *)mp_buffer;
 
@@ -1101,54 +1311,65 @@ void c_image::resize_image_bilinear(
         int req_height)
 {
     // Start by reducing the height
+    // Reduced lines go into a new buffer so bands never read lines another band has written
     if (req_height < m_height) {
         double y_spacing = (double)m_height / (double)req_height;
         double y_start = (double(m_height-1) - double(req_height-1) * y_spacing) / 2;
 
         if (m_colour) {
             // Do reduction for colour data
-            T *p_write_data = (T *)mp_buffer;
-            const int read_line_length = m_width * 3;
-            for (int y = 0; y < req_height; y++) {
-                double new_y_pos = y_start + y_spacing * y;
-                int row = int(new_y_pos);  // Remove fractional part
-                double fraction_1 = new_y_pos - row;  // Keep just fractional part
-                double fraction_2 = 1 - fraction_1;
-                T *p_read_data = ((T *)mp_buffer) + row * 3 * m_width;
-                for (int x = 0; x < m_width; x++) {
-                    // Blue
-                    T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
-
-                    // Green
-                    pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
-
-                    // Blue
-                    pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
+            T *p_reduced_buffer = (T *)c_frame_buffer_pool::get_buffer(m_width * req_height * 3 * sizeof(T));  // New (smaller) buffer
+            run_row_bands(req_height, [&](int32_t start_row, int32_t end_row) {
+                T *p_write_data = p_reduced_buffer + start_row * m_width * 3;
+                const int read_line_length = m_width * 3;
+                for (int y = start_row; y < end_row; y++) {
+                    double new_y_pos = y_start + y_spacing * y;
+                    int row = int(new_y_pos);  // Remove fractional part
+                    double fraction_1 = new_y_pos - row;  // Keep just fractional part
+                    double fraction_2 = 1 - fraction_1;
+                    T *p_read_data = ((T *)mp_buffer) + row * 3 * m_width;
+                    for (int x = 0; x < m_width; x++) {
+                        // Blue
+                        T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
+                        *p_write_data++ = pix;
+                        p_read_data++;
+
+                        // Green
+                        pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
+                        *p_write_data++ = pix;
+                        p_read_data++;
+
+                        // Blue
+                        pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
+                        *p_write_data++ = pix;
+                        p_read_data++;
+                    }
                 }
-            }
+            });
+
+            set_new_buffer((uint8_t *) p_reduced_buffer, m_width * req_height * 3 * sizeof(T));
         } else {
             // Do reduction for monochrome data
-            T *p_write_data = (T *)mp_buffer;
-            const int read_line_length = m_width;
-            for (int y = 0; y < req_height; y++) {
-                double new_y_pos = y_start + y_spacing * y;
-                int row = int(new_y_pos);  // Remove fractional part
-                double fraction_1 = new_y_pos - row;  // Keep just fractional part
-                double fraction_2 = 1 - fraction_1;
-                T *p_read_data = ((T *)mp_buffer) + row * m_width;
-                for (int x = 0; x < m_width; x++) {
-                    // Monochrome
-                    T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
+            T *p_reduced_buffer = (T *)c_frame_buffer_pool::get_buffer(m_width * req_height * sizeof(T));  // New (smaller) buffer
+            run_row_bands(req_height, [&](int32_t start_row, int32_t end_row) {
+                T *p_write_data = p_reduced_buffer + start_row * m_width;
+                const int read_line_length = m_width;
+                for (int y = start_row; y < end_row; y++) {
+                    double new_y_pos = y_start + y_spacing * y;
+                    int row = int(new_y_pos);  // Remove fractional part
+                    double fraction_1 = new_y_pos - row;  // Keep just fractional part
+                    double fraction_2 = 1 - fraction_1;
+                    T *p_read_data = ((T *)mp_buffer) + row * m_width;
+                    for (int x = 0; x < m_width; x++) {
+                        // Monochrome
+                        T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
+                        *p_write_data++ = pix;
+                        p_read_data++;
+                    }
                 }
-            }
+            });
+
+            set_new_buffer((uint8_t *) p_reduced_buffer, m_width * req_height * sizeof(T));
         }
 
         m_height = req_height;  // Height has been reduced
@@ -1161,48 +1382,52 @@ void c_image::resize_image_bilinear(
 
         if (m_colour) {
             // Do reduction for colour data
-            T *p_reduced_buffer = new T[req_width * req_height * 3];  // New (smaller) buffer
-            for (int x = 0; x < req_width; x++) {
-                double new_x_pos = x_start + x_spacing * x;
-                int col = int(new_x_pos);  // Remove fractional part
-                double fraction_1 = new_x_pos - col;  // Keep just fractional part
-                double fraction_2 = 1 - fraction_1;
-                for (int y = 0; y < req_height; y++) {
-                    T *p_read_data = ((T *)mp_buffer) + y * 3 * m_width + 3 * col;
-                    T *p_write_data = p_reduced_buffer + y * 3 * req_width + 3 * x;
-                    // Blue
-                    T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 3)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
-
-                    // Green
-                    pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 3)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
-
-                    // Blue
-                    pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 3)));
-                    *p_write_data++ = pix;
+            T *p_reduced_buffer = (T *)c_frame_buffer_pool::get_buffer(req_width * req_height * 3 * sizeof(T));  // New (smaller) buffer
+            run_row_bands(req_height, [&](int32_t start_row, int32_t end_row) {
+                for (int y = start_row; y < end_row; y++) {
+                    T *p_write_data = p_reduced_buffer + y * 3 * req_width;
+                    for (int x = 0; x < req_width; x++) {
+                        double new_x_pos = x_start + x_spacing * x;
+                        int col = int(new_x_pos);  // Remove fractional part
+                        double fraction_1 = new_x_pos - col;  // Keep just fractional part
+                        double fraction_2 = 1 - fraction_1;
+                        T *p_read_data = ((T *)mp_buffer) + y * 3 * m_width + 3 * col;
+                        // Blue
+                        T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 3)));
+                        *p_write_data++ = pix;
+                        p_read_data++;
+
+                        // Green
+                        pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 3)));
+                        *p_write_data++ = pix;
+                        p_read_data++;
+
+                        // Blue
+                        pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 3)));
+                        *p_write_data++ = pix;
+                    }
                 }
-            }
+            });
 
             set_new_buffer((uint8_t *) p_reduced_buffer, req_width * req_height * 3 * sizeof(T));
         } else {
             // Do reduction for monochrome data
-            T *p_reduced_buffer = new T[req_width * req_height];  // New (smaller) buffer
-            for (int x = 0; x < req_width; x++) {
-                double new_x_pos = x_start + x_spacing * x;
-                int col = int(new_x_pos);  // Remove fractional part
-                double fraction_1 = new_x_pos - col;  // Keep just fractional part
-                double fraction_2 = 1 - fraction_1;
-                for (int y = 0; y < req_height; y++) {
-                    T *p_read_data = ((T *)mp_buffer) + y * m_width + col;
-                    T *p_write_data = p_reduced_buffer + y * req_width + x;
-                    // Monochrome
-                    T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 1)));
-                    *p_write_data++ = pix;
+            T *p_reduced_buffer = (T *)c_frame_buffer_pool::get_buffer(req_width * req_height * sizeof(T));  // New (smaller) buffer
+            run_row_bands(req_height, [&](int32_t start_row, int32_t end_row) {
+                for (int y = start_row; y < end_row; y++) {
+                    T *p_write_data = p_reduced_buffer + y * req_width;
+                    for (int x = 0; x < req_width; x++) {
+                        double new_x_pos = x_start + x_spacing * x;
+                        int col = int(new_x_pos);  // Remove fractional part
+                        double fraction_1 = new_x_pos - col;  // Keep just fractional part
+                        double fraction_2 = 1 - fraction_1;
+                        T *p_read_data = ((T *)mp_buffer) + y * m_width + col;
+                        // Monochrome
+                        T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 1)));
+                        *p_write_data++ = pix;
+                    }
                 }
-            }
+            });
 
             set_new_buffer((uint8_t *) p_reduced_buffer, req_width * req_height * sizeof(T));
         }
@@ -1216,7 +1441,7 @@ void c_image::conv_data_ready_for_gif()
 {
     int buffer_size = m_width * m_height;
     buffer_size = (m_colour) ? 3 * buffer_size : buffer_size;
-    uint8_t *p_output_buffer = new uint8_t [buffer_size];
+    uint8_t *p_output_buffer = c_frame_buffer_pool::get_buffer(buffer_size);
     if (m_colour) {
         // Colour data
         if (m_byte_depth == 1) {
@@ -1271,99 +1496,104 @@ void c_image::conv_data_ready_for_gif()
         }
     }
 
-    delete[] mp_buffer;  // Free input buffer
+    c_frame_buffer_pool::release_buffer(mp_buffer);  // Free input buffer
     mp_buffer = p_output_buffer;  // Update pointer to output buffer
     m_buffer_size = buffer_size;
 }
 
 
-void c_image::conv_data_ready_for_qimage()
+void c_image::conv_data_ready_for_display(
+        bool apply_luts)
 {
-    // Create buffer for converted data
     int line_pad = (m_width * 3) % 4;
     if (line_pad != 0) {
         line_pad = 4 - line_pad;
     }
 
-    int32_t buffer_size = (m_width + line_pad) * m_height * 3;
-    uint8_t *p_output_buffer = new uint8_t [buffer_size];
-
-    if (m_colour) {
-        // Colour data needs to be changed from BGR to RGB format and flipped vertically
-        uint8_t *p_write_data = p_output_buffer;
-        if (m_byte_depth == 1) {
-            // 8-bit data
-            for (int32_t y = m_height - 1; y >= 0; y--) {
-                uint8_t *p_read_data = mp_buffer + y * m_width * 3;
-                for (int32_t x = 0; x < m_width; x++) {
-                    uint8_t b_pixel = *p_read_data++;
-                    uint8_t g_pixel = *p_read_data++;
-                    uint8_t r_pixel = *p_read_data++;
-                    *p_write_data++ = r_pixel;
-                    *p_write_data++ = g_pixel;
-                    *p_write_data++ = b_pixel;
-                }
+    // The display buffer is only reallocated when the frame size changes
+    m_display_bytes_per_line = m_width * 3 + line_pad;
+    m_display_buffer.resize(m_display_bytes_per_line * m_height);
+    uint8_t *p_output_buffer = m_display_buffer.data();
 
-                for (int32_t x = 0; x < line_pad; x++) {
-                    *p_write_data++ = 0;
-                }
-            }
-        } else {
-            // 16-bit data
-            for (int32_t y = m_height - 1; y >= 0; y--) {
-                uint16_t *p_read_data = ((uint16_t *)mp_buffer) + y * m_width * 3;
-                for (int32_t x = 0; x < m_width; x++) {
-                    uint8_t b_pixel = (*p_read_data++) >> 8;
-                    uint8_t g_pixel = (*p_read_data++) >> 8;
-                    uint8_t r_pixel = (*p_read_data++) >> 8;
-                    *p_write_data++ = r_pixel;
-                    *p_write_data++ = g_pixel;
-                    *p_write_data++ = b_pixel;
-                }
+    // Only use the LUTs if do_lut_based_processing() would have used them
+    if (m_gain == 1.0 && m_gamma == 1.0 && !m_invert && !(m_colour_balance_enabled && m_colour)) {
+        apply_luts = false;
+    }
 
-                for (int32_t x = 0; x < line_pad; x++) {
-                    *p_write_data++ = 0;
-                }
-            }
-        }
+    // Without LUTs an identity table keeps to a single code path
+    uint8_t identity_lut[256];
+    const uint8_t *p_blue_lut = identity_lut;
+    const uint8_t *p_green_lut = identity_lut;
+    const uint8_t *p_red_lut = identity_lut;
+    const uint8_t *p_mono_lut = identity_lut;
+    if (apply_luts) {
+        p_blue_lut = m_blue_lut;
+        p_green_lut = m_green_lut;
+        p_red_lut = m_red_lut;
+        p_mono_lut = m_mono_lut;
     } else {
-        // Monochrome data just needs to be flipped vertically
-        uint8_t *p_write_data = p_output_buffer;
-        if (m_byte_depth == 1) {
-            // 8-bit data
-            for (int32_t y = m_height - 1; y >= 0; y--) {
-                uint8_t *p_read_data = mp_buffer + y * m_width;
-                for (int32_t x = 0; x < m_width; x++) {
-                    *p_write_data++ = *p_read_data;
-                    *p_write_data++ = *p_read_data;
-                    *p_write_data++ = *p_read_data++;
-                }
+        for (int x = 0; x < 256; x++) {
+            identity_lut[x] = x;
+        }
+    }
 
-                for (int32_t x = 0; x < line_pad; x++) {
-                    *p_write_data++ = 0;
+    run_row_bands(m_height, [&](int32_t start_row, int32_t end_row) {
+        for (int32_t y = start_row; y < end_row; y++) {
+            // Lines are flipped vertically
+            uint8_t *p_write_data = p_output_buffer + (m_height - 1 - y) * m_display_bytes_per_line;
+            if (m_colour) {
+                // Colour data is changed from BGR to RGB format
+                if (m_byte_depth == 1) {
+                    // 8-bit data
+                    const uint8_t *p_read_data = mp_buffer + y * m_width * 3;
+                    for (int32_t x = 0; x < m_width; x++) {
+                        uint8_t b_pixel = p_blue_lut[*p_read_data++];
+                        uint8_t g_pixel = p_green_lut[*p_read_data++];
+                        uint8_t r_pixel = p_red_lut[*p_read_data++];
+                        *p_write_data++ = r_pixel;
+                        *p_write_data++ = g_pixel;
+                        *p_write_data++ = b_pixel;
+                    }
+                } else {
+                    // 16-bit data
+                    const uint16_t *p_read_data = ((uint16_t *)mp_buffer) + y * m_width * 3;
+                    for (int32_t x = 0; x < m_width; x++) {
+                        uint8_t b_pixel = p_blue_lut[(*p_read_data++) >> 8];
+                        uint8_t g_pixel = p_green_lut[(*p_read_data++) >> 8];
+                        uint8_t r_pixel = p_red_lut[(*p_read_data++) >> 8];
+                        *p_write_data++ = r_pixel;
+                        *p_write_data++ = g_pixel;
+                        *p_write_data++ = b_pixel;
+                    }
                 }
-            }
-        } else {
-            // 16-bit data
-            for (int32_t y = m_height - 1; y >= 0; y--) {
-                uint16_t *p_read_data = ((uint16_t *)mp_buffer) + y * m_width;
-                for (int32_t x = 0; x < m_width; x++) {
-                    uint8_t temp = (*p_read_data++) >> 8;
-                    *p_write_data++ = temp;
-                    *p_write_data++ = temp;
-                    *p_write_data++ = temp;
+            } else {
+                // Monochrome data is copied to all 3 colours
+                if (m_byte_depth == 1) {
+                    // 8-bit data
+                    const uint8_t *p_read_data = mp_buffer + y * m_width;
+                    for (int32_t x = 0; x < m_width; x++) {
+                        uint8_t pixel = p_mono_lut[*p_read_data++];
+                        *p_write_data++ = pixel;
+                        *p_write_data++ = pixel;
+                        *p_write_data++ = pixel;
+                    }
+                } else {
+                    // 16-bit data
+                    const uint16_t *p_read_data = ((uint16_t *)mp_buffer) + y * m_width;
+                    for (int32_t x = 0; x < m_width; x++) {
+                        uint8_t pixel = p_mono_lut[(*p_read_data++) >> 8];
+                        *p_write_data++ = pixel;
+                        *p_write_data++ = pixel;
+                        *p_write_data++ = pixel;
+                    }
                 }
+            }
 
-                for (int32_t x = 0; x < line_pad; x++) {
-                    *p_write_data++ = 0;
-                }
+            for (int32_t x = 0; x < line_pad; x++) {
+                *p_write_data++ = 0;
             }
         }
-    }
-
-    delete[] mp_buffer;  // Free input buffer
-    mp_buffer = p_output_buffer;  // Update pointer to output buffer
-    m_buffer_size = buffer_size;
+    });
 }
 
 
@@ -1661,24 +1891,24 @@ bool c_image::debayer_image_bilinear_int(int32_t colour_id)
         colour_id == COLOURID_BAYER_YMCY ||
         colour_id == COLOURID_BAYER_MYYC) {
         // Start by inverting all the pixels to make them RGB
-        T *p_raw_data_ptr = (T *)mp_buffer;
-        for (int y = 0; y < (m_height); y++) {
-            for (int x = 0; x < (m_width); x++) {
-                *p_raw_data_ptr = 255 - *p_raw_data_ptr;
-                p_raw_data_ptr++;
+        run_row_bands(m_height, [this](int32_t start_row, int32_t end_row) {
+            T *p_raw_data_ptr = ((T *)mp_buffer) + start_row * m_width;
+            for (int y = start_row; y < end_row; y++) {
+                for (int x = 0; x < (m_width); x++) {
+                    *p_raw_data_ptr = 255 - *p_raw_data_ptr;
+                    p_raw_data_ptr++;
+                }
             }
-        }
+        });
     }
 
     int32_t x, y;
-    T *raw_data_ptr;
-    T *rgb_data_ptr1;
 
     uint32_t bayer_x = bayer_code % 2;
     uint32_t bayer_y = ((bayer_code/2) % 2) ^ (m_height % 2);
 
     // Buffer to create RGB image in
-    T *rgb_data = (T *)new uint8_t[3 * m_width * m_height * m_byte_depth];
+    T *rgb_data = (T *)c_frame_buffer_pool::get_buffer(3 * m_width * m_height * m_byte_depth);
 
     // Debayer bottom line
     y = 0;
@@ -1709,93 +1939,42 @@ bool c_image::debayer_image_bilinear_int(int32_t colour_id)
     }
 
     // Debayer to create blue, green and red data
-    rgb_data_ptr1 = rgb_data + (3 * (m_width + 1));
-    raw_data_ptr = ((T *)mp_buffer) + (m_width + 1);
-
-    for (y = 1; y < (m_height-1); y++) {
-        for (x = 1; x < (m_width-1); x++) {
-            uint32_t bayer = ((x + bayer_x) % 2) + (2 * ((y + bayer_y) % 2));
-            // Blue channel
-            switch (bayer) {
-                case 0:
-                    // Blue - Average of 4 corners;
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-m_width-1) + *(raw_data_ptr-m_width+1) +
-                                         *(raw_data_ptr+m_width-1) + *(raw_data_ptr+m_width+1) ) / 4;
-
-                    // Green - Return average of 4 nearest neighbours
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) +
-                                         *(raw_data_ptr+m_width) + *(raw_data_ptr-m_width) ) /4;
-
-                    // Red - Simple case just return data at this position
-                    *rgb_data_ptr1++ = *raw_data_ptr++;
-                    break;
-
-                case 1:
-                    // Blue - Average of above and below pixels
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-m_width) + *(raw_data_ptr+m_width) ) / 2;
-
-                    // Green - just this position
-                    *rgb_data_ptr1++ = *raw_data_ptr;
-
-                    // Red - Average of left and right pixels
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) ) / 2;
-                    raw_data_ptr++;
-                    break;
-
-                case 2:
-                    // Blue - Average of left and right pixels
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) ) / 2;
-
-                    // Green - just this position
-                    *rgb_data_ptr1++ = *raw_data_ptr;
-
-                    // Red - Average of above and below pixels
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-m_width) + *(raw_data_ptr+m_width) ) / 2;
-                    raw_data_ptr++;
-                    break;
-
-                default:
-                    // Blue - Simple case just return data at this position
-                    *rgb_data_ptr1++ = *raw_data_ptr;
-
-                    // Green - Return average of 4 nearest neighbours
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) +
-                                         *(raw_data_ptr+m_width) + *(raw_data_ptr+m_width) ) /4;
-
-                    // Red - Average of 4 corners;
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-m_width-1) + *(raw_data_ptr-m_width+1) +
-                                         *(raw_data_ptr+m_width-1) + *(raw_data_ptr+m_width+1) ) / 4;
-                    raw_data_ptr++;
-                    break;
-            }
+    // Bands of lines are debayered in parallel, each band only writes its own lines
+    run_row_bands(m_height - 2, [&](int32_t start_row, int32_t end_row) {
+        for (int32_t y = start_row + 1; y < end_row + 1; y++) {
+            debayer_row_bilinear(
+                ((T *)mp_buffer) + y * m_width,  // p_raw_line
+                rgb_data + 3 * y * m_width,  // p_bgr_line
+                m_width,  // width
+                bayer_x,  // bayer_x
+                (y + bayer_y) % 2);  // row_phase
         }
-
-        rgb_data_ptr1 += 6;
-        raw_data_ptr += 2;
-    }
+    });
 
     if (colour_id == COLOURID_BAYER_CYYM ||
         colour_id == COLOURID_BAYER_YCMY ||
         colour_id == COLOURID_BAYER_YMCY ||
         colour_id == COLOURID_BAYER_MYYC) {
 		// We currently have data in GBR order, change order to BGR
-        T *p_read_data_ptr = (T *)rgb_data;
-        T *p_write_data_ptr = (T *)rgb_data;
-        for (int y = 0; y < (m_height); y++) {
-            for (int x = 0; x < (m_width); x++) {
-                T green = *p_read_data_ptr++;
-                T blue = *p_read_data_ptr++;
-                p_read_data_ptr++;
-
-                *p_write_data_ptr++ = blue;
-                *p_write_data_ptr++ = green;
-                p_write_data_ptr++;
+        run_row_bands(m_height, [&](int32_t start_row, int32_t end_row) {
+            T *p_read_data_ptr = ((T *)rgb_data) + start_row * m_width * 3;
+            T *p_write_data_ptr = ((T *)rgb_data) + start_row * m_width * 3;
+            for (int y = start_row; y < end_row; y++) {
+                for (int x = 0; x < (m_width); x++) {
+                    T green = *p_read_data_ptr++;
+                    T blue = *p_read_data_ptr++;
+                    p_read_data_ptr++;
+
+                    *p_write_data_ptr++ = blue;
+                    *p_write_data_ptr++ = green;
+                    p_write_data_ptr++;
+                }
             }
-        }
+        });
     }
 
     // Make new debayered data the frame buffer data
-    delete[] mp_buffer;
+    c_frame_buffer_pool::release_buffer(mp_buffer);
     mp_buffer = (uint8_t *)rgb_data;
     m_colour_id = COLOURID_BGR;
     m_colour = true;
@@ -1810,8 +1989,8 @@ bool c_image::debayer_image_bilinear_int(int32_t colour_id)
 void c_image::set_buffer_size(int32_t size)
 {
     if (size > m_buffer_size) {
-        delete [] mp_buffer;
-        mp_buffer = new uint8_t[size];
+        c_frame_buffer_pool::release_buffer(mp_buffer);
+        mp_buffer = c_frame_buffer_pool::get_buffer(size);
         m_buffer_size = size;
     }
 }
@@ -1819,7 +1998,7 @@ void c_image::set_buffer_size(int32_t size)
 
 void c_image::set_new_buffer(uint8_t *p_buffer, int32_t size)
 {
-    delete [] mp_buffer;
+    c_frame_buffer_pool::release_buffer(mp_buffer);
     mp_buffer = p_buffer;
     m_buffer_size = size;
 }
@@ -21,6 +21,10 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <functional>
+#include <vector>
+
+#include "frame_buffer_pool.h"
 
 
 
@@ -39,6 +43,14 @@ class c_image
         uint8_t m_red_lut[256];
         uint8_t m_green_lut[256];
         uint8_t m_blue_lut[256];
+        std::vector<uint16_t> m_mono_lut_16bit;
+        std::vector<uint16_t> m_red_lut_16bit;
+        std::vector<uint16_t> m_green_lut_16bit;
+        std::vector<uint16_t> m_blue_lut_16bit;
+        bool m_mono_lut_16bit_valid;
+        bool m_colour_luts_16bit_valid;
+        bool m_mono_lut_16bit_is_identity;
+        bool m_colour_luts_16bit_are_identity;
         bool m_invert;
         bool m_colour_balance_enabled;
         double m_red_gain;
@@ -51,6 +63,9 @@ class c_image
         int m_red_align_y;
         int m_blue_align_x;
         int m_blue_align_y;
+        std::vector<uint8_t> m_display_buffer;
+        int32_t m_display_bytes_per_line;
+        static int m_thread_count;
 
 
     // ------------------------------------------
@@ -69,6 +84,10 @@ class c_image
             m_colour(false),
             mp_buffer(nullptr),
             m_buffer_size(0),
+            m_mono_lut_16bit_valid(false),
+            m_colour_luts_16bit_valid(false),
+            m_mono_lut_16bit_is_identity(false),
+            m_colour_luts_16bit_are_identity(false),
             m_invert(false),
             m_colour_balance_enabled(false),
             m_red_gain(1.0),
@@ -80,7 +99,8 @@ class c_image
             m_red_align_x(0),
             m_red_align_y(0),
             m_blue_align_x(0),
-            m_blue_align_y(0)
+            m_blue_align_y(0),
+            m_display_bytes_per_line(0)
         {
         }
 
@@ -90,7 +110,7 @@ class c_image
         // Destructor
         // ------------------------------------------
         ~c_image() {
-            delete [] mp_buffer;
+            c_frame_buffer_pool::release_buffer(mp_buffer);
         }
 
         
@@ -194,15 +214,53 @@ class c_image
                 int total_width,
                 int total_height);
 
-        void conv_data_ready_for_qimage();
+        // Convert frame data to RGB888 with 4-byte aligned lines and flipped vertically in a
+        // single pass, writing to a display buffer that is reused from frame to frame.
+        // 16-bit data is converted to 8-bit, and if apply_luts is true the gain, gamma, invert
+        // and colour balance LUTs are applied as well.  The frame data itself is not changed.
+        void conv_data_ready_for_display(
+                bool apply_luts);
+
+        uint8_t *get_p_display_buffer()
+        {
+            return m_display_buffer.data();
+        }
+
+        int32_t get_display_bytes_per_line()
+        {
+            return m_display_bytes_per_line;
+        }
 
         void conv_data_ready_for_gif();
+
+        // Copy invert, gain, gamma, colour balance and colour align settings from another image
+        void copy_processing_settings(
+                const c_image &other);
+
+        // Exchange image data and image details with another image without copying the data
+        void swap_image_data(
+                c_image &other);
+
+        // Set the number of threads the processing functions split each frame across
+        // 0 uses one thread per core, 1 processes frames on the calling thread only
+        static void set_thread_count(
+                int thread_count);
+
+        static int get_thread_count();
         
         
     private:
         void set_buffer_size(int32_t size);
-        void set_new_buffer(uint8_t *p_buffer, int32_t size);
+        void set_new_buffer(uint8_t *p_buffer, int32_t size);  // p_buffer must come from c_frame_buffer_pool
         void setup_luts();
+        void setup_luts_16bit();
+
+        // Split rows 0 to row_count-1 into bands and call band_function(start_row, end_row)
+        // for each band on the image thread pool, returns when all bands are complete
+        // Bands never share rows so kernels give the same output as a single band
+        void run_row_bands(
+                int32_t row_count,
+                const std::function<void(int32_t, int32_t)> &band_function);
 
         template <typename T>
         void change_colour_saturation_int(
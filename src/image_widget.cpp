@@ -23,6 +23,11 @@
 #include <QPainter>
 #include <QPaintEvent>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
 namespace {
     enum e_drag_handles {
         m_drag_handle_none = 0,
@@ -37,11 +42,71 @@ namespace {
         m_drag_handle_bottom_right};
 
     const int drag_box_size = 15;
+
+
+    // ------------------------------------------
+    // Box filter downscale of an RGB888 image
+    // Each destination pixel is the average of the block of source pixels it covers,
+    // using integer arithmetic only.  This is much quicker than a smooth transform
+    // and gives the same quality when reducing the image size.
+    // ------------------------------------------
+    void downscale_rgb888(
+            const QImage &src,
+            QImage &dst)
+    {
+        const int src_width = src.width();
+        const int src_height = src.height();
+        const int dst_width = dst.width();
+        const int dst_height = dst.height();
+
+        // First source column of each destination column
+        std::vector<int> x_start(dst_width + 1);
+        for (int x = 0; x <= dst_width; x++) {
+            x_start[x] = (int)(((int64_t)x * src_width) / dst_width);
+        }
+
+        std::vector<uint32_t> row_sums(dst_width * 3);
+        for (int y = 0; y < dst_height; y++) {
+            int y_start = (int)(((int64_t)y * src_height) / dst_height);
+            int y_end = (int)(((int64_t)(y + 1) * src_height) / dst_height);
+
+            // Sum the source lines covered by this destination line
+            std::fill(row_sums.begin(), row_sums.end(), 0);
+            for (int src_y = y_start; src_y < y_end; src_y++) {
+                const uchar *p_src = src.constScanLine(src_y);
+                uint32_t *p_sum = row_sums.data();
+                for (int x = 0; x < dst_width; x++) {
+                    uint32_t r = 0, g = 0, b = 0;
+                    for (int src_x = x_start[x]; src_x < x_start[x + 1]; src_x++) {
+                        r += p_src[src_x * 3];
+                        g += p_src[src_x * 3 + 1];
+                        b += p_src[src_x * 3 + 2];
+                    }
+
+                    p_sum[0] += r;
+                    p_sum[1] += g;
+                    p_sum[2] += b;
+                    p_sum += 3;
+                }
+            }
+
+            // Divide by the number of pixels in each block
+            uchar *p_dst = dst.scanLine(y);
+            const uint32_t *p_sum = row_sums.data();
+            for (int x = 0; x < dst_width; x++) {
+                uint32_t count = (uint32_t)((x_start[x + 1] - x_start[x]) * (y_end - y_start));
+                *p_dst++ = (uchar)((*p_sum++ + count / 2) / count);
+                *p_dst++ = (uchar)((*p_sum++ + count / 2) / count);
+                *p_dst++ = (uchar)((*p_sum++ + count / 2) / count);
+            }
+        }
+    }
 }
 
 
 c_image_Widget::c_image_Widget(QWidget *parent) :
     QWidget(parent),
+    m_scaled_image_valid(false),
     m_zoom_level(100),
     m_scale_factor(1.0),
     m_active_drag_handle(m_drag_handle_bottom_right)
@@ -211,14 +276,14 @@ void c_image_Widget::mouseMoveEvent(QMouseEvent *p_event)
                 m_selected_area_bottom_right += correction;
             }
 
-            int max_x = (m_image_Pixmap.width() - 1);
+            int max_x = (m_image.width() - 1);
             if (m_selected_area_bottom_right.x() > max_x) {
                 QPoint correction = QPoint(max_x - m_selected_area_bottom_right.x(), 0);
                 m_selected_area_top_left += correction;
                 m_selected_area_bottom_right += correction;
             }
 
-            int max_y = (m_image_Pixmap.height() - 1);
+            int max_y = (m_image.height() - 1);
             if (m_selected_area_bottom_right.y() > max_y) {
                 QPoint correction = QPoint(0, max_y - m_selected_area_bottom_right.y());
                 m_selected_area_top_left += correction;
@@ -234,12 +299,12 @@ void c_image_Widget::mouseMoveEvent(QMouseEvent *p_event)
                 m_selected_area_top_left.setY(0);
             }
 
-            int max_x = (qreal)(m_image_Pixmap.width() - 1);
+            int max_x = (qreal)(m_image.width() - 1);
             if (m_selected_area_bottom_right.x() > max_x) {
                 m_selected_area_bottom_right.setX(max_x);
             }
 
-            int max_y = (qreal)(m_image_Pixmap.height() - 1);
+            int max_y = (qreal)(m_image.height() - 1);
             if (m_selected_area_bottom_right.y() > max_y) {
                 m_selected_area_bottom_right.setY(max_y);
             }
@@ -301,49 +366,80 @@ void c_image_Widget::paintEvent(QPaintEvent *p_event)
     QWidget::paintEvent(p_event);
 
     // Early return
-    if (m_image_Pixmap.isNull()) {
+    if (m_image.isNull()) {
         return;
     }
 
     QPainter painter(this);
     painter.setRenderHint(QPainter::Antialiasing);
 
-    QSize pixSize = m_image_Pixmap.size();
-    pixSize.scale(p_event->rect().size(), Qt::KeepAspectRatio);
+    QSize scaled_size = m_image.size();
+    scaled_size.scale(size(), Qt::KeepAspectRatio);
+    if (scaled_size.isEmpty()) {
+        return;
+    }
+
+//    m_zoom_level = (scaled_size.width() * 100) / m_image.size().width();
 
-//    m_zoom_level = (pixSize.width() * 100) / m_image_Pixmap.size().width();
+    // Only rescale when the frame or the widget size has changed since the last paint
+    if (scaled_size != m_image.size() && (!m_scaled_image_valid || m_scaled_image.size() != scaled_size)) {
+        update_scaled_image(scaled_size);
+    }
 
-    QPixmap scaled_Pixmap = m_image_Pixmap.scaled(pixSize,
-                                     Qt::KeepAspectRatio,
-                                     Qt::SmoothTransformation);
+    const QImage &display_image = (scaled_size == m_image.size()) ? m_image : m_scaled_image;
+
+    // Calculate position to draw image in middle of widget
+    int x = (width() - scaled_size.width()) / 2;
+    int y = (height() - scaled_size.height()) / 2;
+    m_drawn_image_rect = QRect(QPoint(x, y), scaled_size);
+
+    // Only draw the part of the image that needs repainting
+    QRect damaged_rect = p_event->rect() & m_drawn_image_rect;
+    if (!damaged_rect.isEmpty()) {
+        painter.drawImage(damaged_rect.topLeft(), display_image, damaged_rect.translated(-x, -y));
+    }
 
     if (mp_selection_box_dialog->isVisible()) {
-        draw_selection_rectangle(scaled_Pixmap);
+        painter.translate(x, y);
+        draw_selection_rectangle(painter, scaled_size);
+        m_sel_top_left_Rect.translate(x, y);
+        m_sel_top_right_Rect.translate(x, y);
+        m_sel_bottom_left_Rect.translate(x, y);
+        m_sel_bottom_right_Rect.translate(x, y);
+        m_sel_top_centre_Rect.translate(x, y);
+        m_sel_bottom_centre_Rect.translate(x, y);
+        m_sel_middle_left_Rect.translate(x, y);
+        m_sel_middle_right_Rect.translate(x, y);
+        m_sel_area_Rect.translate(x, y);
+    }
+}
+
+
+void c_image_Widget::update_scaled_image(const QSize &scaled_size)
+{
+    if (scaled_size.width() < m_image.width() && scaled_size.height() < m_image.height()) {
+        // Zoom is below 100%, use the fast integer downscaler into the existing buffer
+        if (m_scaled_image.size() != scaled_size) {
+            m_scaled_image = QImage(scaled_size, QImage::Format_RGB888);
+        }
+
+        downscale_rgb888(m_image, m_scaled_image);
+    } else {
+        m_scaled_image = m_image.scaled(scaled_size,
+                                        Qt::KeepAspectRatio,
+                                        Qt::SmoothTransformation);
     }
 
-    // Calculate position to draw image in middle of widget
-    int x = (p_event->rect().size().width() - scaled_Pixmap.size().width()) / 2;
-    int y = (p_event->rect().size().height() - scaled_Pixmap.size().height()) / 2;
-    m_sel_top_left_Rect.translate(x, y);
-    m_sel_top_right_Rect.translate(x, y);
-    m_sel_bottom_left_Rect.translate(x, y);
-    m_sel_bottom_right_Rect.translate(x, y);
-    m_sel_top_centre_Rect.translate(x, y);
-    m_sel_bottom_centre_Rect.translate(x, y);
-    m_sel_middle_left_Rect.translate(x, y);
-    m_sel_middle_right_Rect.translate(x, y);
-    m_sel_area_Rect.translate(x, y);
-
-    painter.drawPixmap(QPoint(x, y), scaled_Pixmap);
+    m_scaled_image_valid = true;
 }
 
 
-void c_image_Widget::draw_selection_rectangle(QPixmap &pixmap)
+void c_image_Widget::draw_selection_rectangle(QPainter &painter, const QSize &scaled_size)
 {
-    int x_scale_num = pixmap.width()-1;
-    int x_scale_denum = m_image_Pixmap.size().width()-1;
-    int y_scale_num = pixmap.height()-1;
-    int y_scale_denum = m_image_Pixmap.size().height()-1;
+    int x_scale_num = scaled_size.width()-1;
+    int x_scale_denum = m_image.size().width()-1;
+    int y_scale_num = scaled_size.height()-1;
+    int y_scale_denum = m_image.size().height()-1;
 
     if (y_scale_num > x_scale_num) {
         m_scale_factor = qreal(y_scale_num) / y_scale_denum;
@@ -384,30 +480,31 @@ void c_image_Widget::draw_selection_rectangle(QPixmap &pixmap)
     m_sel_middle_left_Rect.translate(0, shift_to_middle);
     m_sel_middle_right_Rect.translate(0, shift_to_middle);
 
-    QPainter p(&pixmap);
+    painter.save();
+    painter.setRenderHint(QPainter::Antialiasing, false);
     //p.setPen(QPen(Qt::red, 1, Qt::DashLine));
-    p.setPen(QPen(mp_selection_box_dialog->get_selection_colour(), 1, Qt::DashLine));
+    painter.setPen(QPen(mp_selection_box_dialog->get_selection_colour(), 1, Qt::DashLine));
 
     // Draw main rectangle
-    p.drawRect(m_sel_area_Rect);
+    painter.drawRect(m_sel_area_Rect);
 
     // Draw drag boxes
-    p.drawRect(m_sel_top_left_Rect);
-    p.drawRect(m_sel_top_right_Rect);
-    p.drawRect(m_sel_bottom_right_Rect);
-    p.drawRect(m_sel_bottom_left_Rect);
-    p.drawRect(m_sel_top_centre_Rect);
-    p.drawRect(m_sel_bottom_centre_Rect);
-    p.drawRect(m_sel_middle_left_Rect);
-    p.drawRect(m_sel_middle_right_Rect);
-
-    p.end();
+    painter.drawRect(m_sel_top_left_Rect);
+    painter.drawRect(m_sel_top_right_Rect);
+    painter.drawRect(m_sel_bottom_right_Rect);
+    painter.drawRect(m_sel_bottom_left_Rect);
+    painter.drawRect(m_sel_top_centre_Rect);
+    painter.drawRect(m_sel_bottom_centre_Rect);
+    painter.drawRect(m_sel_middle_left_Rect);
+    painter.drawRect(m_sel_middle_right_Rect);
+
+    painter.restore();
 }
 
 
-const QPixmap* c_image_Widget::pixmap() const
+const QImage* c_image_Widget::image() const
 {
-    return &m_image_Pixmap;
+    return &m_image;
 }
 
 
@@ -419,7 +516,7 @@ QSize c_image_Widget::minimumSizeHint() const
 
 QSize c_image_Widget::sizeHint() const
 {
-    if (m_image_Pixmap.isNull()) {
+    if (m_image.isNull()) {
         return QSize(100, 100);
     } else {
         // To do
@@ -444,7 +541,7 @@ void c_image_Widget::resizeEvent(QResizeEvent *e)
 
     m_current_Size = QSize(w, h);
     updateGeometry();
-    int zoom_level = (w * 100) / m_image_Pixmap.size().width();
+    int zoom_level = (w * 100) / m_image.size().width();
     if (zoom_level != m_zoom_level) {
         m_zoom_level = zoom_level;
         emit zoom_changed_signal(zoom_level);
@@ -454,23 +551,48 @@ void c_image_Widget::resizeEvent(QResizeEvent *e)
 
 int c_image_Widget::heightForWidth(int width) const
 {
-    int height = ((qreal)m_image_Pixmap.height()*width)/m_image_Pixmap.width();
+    int height = ((qreal)m_image.height()*width)/m_image.width();
     return height;
 }
 
 
 int c_image_Widget::widthForHeight(int height) const
 {
-    int width = ((qreal)m_image_Pixmap.width()*height)/m_image_Pixmap.height();
+    int width = ((qreal)m_image.width()*height)/m_image.height();
     return width;
 }
 
 
-void c_image_Widget::setPixmap (const QPixmap &pixmap){
-    m_image_Pixmap = pixmap;
-    m_image_size = pixmap.size();
-    //m_current_Size = pixmap.size();
-    updateGeometry();
-    repaint();
+void c_image_Widget::setPixmap(const QPixmap &pixmap)
+{
+    set_image(pixmap.toImage());
 }
 
+
+void c_image_Widget::set_image(const QImage &image)
+{
+    bool size_changed = (image.size() != m_image.size());
+    if (size_changed || m_image.isNull()) {
+        // Always take a deep copy, the image may wrap a buffer that the caller will reuse
+        m_image = (image.format() == QImage::Format_RGB888) ? image.copy() : image.convertToFormat(QImage::Format_RGB888);
+        m_image_size = image.size();
+        updateGeometry();
+    } else {
+        // Same size as the previous frame, copy into the existing backing store
+        const QImage rgb_image = (image.format() == QImage::Format_RGB888) ? image : image.convertToFormat(QImage::Format_RGB888);
+        int line_bytes = rgb_image.width() * 3;
+        for (int y = 0; y < rgb_image.height(); y++) {
+            memcpy(m_image.scanLine(y), rgb_image.constScanLine(y), line_bytes);
+        }
+    }
+
+    //m_current_Size = image.size();
+    m_scaled_image_valid = false;
+
+    // Only the image area needs repainting unless the image size has changed
+    if (size_changed || m_drawn_image_rect.isEmpty()) {
+        repaint();
+    } else {
+        repaint(m_drawn_image_rect);
+    }
+}
@@ -19,10 +19,12 @@
 #ifndef IMAGE_WIDGET_H
 #define IMAGE_WIDGET_H
 
+#include <QImage>
 #include <QWidget>
 
 // Forward declarations
 class c_selection_box_dialog;
+class QPainter;
 
 
 class c_image_Widget : public QWidget
@@ -31,7 +33,7 @@ class c_image_Widget : public QWidget
 
 public:
     explicit c_image_Widget(QWidget *parent = 0);
-    const QPixmap* pixmap() const;
+    const QImage* image() const;
     int get_zoom_level();
     QSize get_image_size();
     void disable_area_selection();
@@ -43,6 +45,7 @@ signals:
 
 public slots:
     void setPixmap(const QPixmap&);
+    void set_image(const QImage &image);
     void enable_area_selection_slot(const QSize &frame_size, const QRect &selected_area);
     void set_selection_slot(QRect selection);
     void cancel_area_selection_slot();
@@ -60,10 +63,14 @@ protected:
     void mouseDoubleClickEvent(QMouseEvent *p_event);
 
 private:
-    void draw_selection_rectangle(QPixmap &pixmap);
+    void draw_selection_rectangle(QPainter &painter, const QSize &scaled_size);
+    void update_scaled_image(const QSize &scaled_size);
 
     c_selection_box_dialog *mp_selection_box_dialog;
-    QPixmap m_image_Pixmap;
+    QImage m_image;  // Persistent copy of the displayed frame (RGB888)
+    QImage m_scaled_image;  // m_image scaled to the widget, only recalculated when the frame or size changes
+    bool m_scaled_image_valid;
+    QRect m_drawn_image_rect;  // Where the image was last drawn in the widget
     QSize m_image_size;
     QSize m_current_Size;
     int m_zoom_level;
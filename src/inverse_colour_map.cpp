@@ -0,0 +1,181 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#include <cstdlib>
+#include <cstring>
+#include "inverse_colour_map.h"
+
+
+// SIMD versions are only built for x86 and can be turned off with DISABLE_SIMD_INVERSE_COLOUR_MAP
+#if !defined(DISABLE_SIMD_INVERSE_COLOUR_MAP)
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define INVERSE_COLOUR_MAP_SSE2
+        #include <emmintrin.h>
+    #endif
+#endif
+
+
+// Number of cells, 6 bits for each of R, G and B
+static const int C_NUMBER_OF_CELLS = 1 << (3 * 6);
+
+// Colour table entries compared by each SIMD step
+static const int C_SIMD_ENTRIES = 8;
+
+// Channel value of the padding entries, far enough from any colour that they are never the nearest
+static const int16_t C_PADDING_VALUE = 0x1000;
+
+// Generations fit in the top 18 bits of a cell entry, 0 is never used so cleared cells are not valid
+static const uint32_t C_MAX_GENERATION = (1 << 18) - 1;
+
+
+// ------------------------------------------
+// Constructor
+// ------------------------------------------
+c_inverse_colour_map::c_inverse_colour_map(
+    const uint8_t *p_colour_table,
+    int number_of_colours,
+    bool exact)
+    : mp_cells(new std::atomic<uint32_t>[C_NUMBER_OF_CELLS]),
+      m_generation(C_MAX_GENERATION)
+{
+    set_colour_table(p_colour_table, number_of_colours, exact);
+}
+
+
+// ------------------------------------------
+// Use a different colour table
+// ------------------------------------------
+void c_inverse_colour_map::set_colour_table(
+    const uint8_t *p_colour_table,
+    int number_of_colours,
+    bool exact)
+{
+    if (m_generation == C_MAX_GENERATION) {
+        // Out of generations, clear the cells and start again
+        for (int cell = 0; cell < C_NUMBER_OF_CELLS; cell++) {
+            mp_cells[cell].store(0, std::memory_order_relaxed);
+        }
+
+        m_generation = 0;
+    }
+
+    m_generation++;
+    m_tag_mask = (exact) ? 0x3 : 0;
+    m_colour_table.assign(p_colour_table, p_colour_table + 3 * number_of_colours);
+    m_number_of_colours = number_of_colours;
+
+    int padded_colours = (number_of_colours + C_SIMD_ENTRIES - 1) / C_SIMD_ENTRIES * C_SIMD_ENTRIES;
+    m_red.assign(padded_colours, C_PADDING_VALUE);
+    m_green.assign(padded_colours, C_PADDING_VALUE);
+    m_blue.assign(padded_colours, C_PADDING_VALUE);
+    for (int i = 0; i < number_of_colours; i++) {
+        m_red[i] = p_colour_table[i * 3 + 0];
+        m_green[i] = p_colour_table[i * 3 + 1];
+        m_blue[i] = p_colour_table[i * 3 + 2];
+    }
+}
+
+
+// ------------------------------------------
+// Check whether this map is for a colour table
+// ------------------------------------------
+bool c_inverse_colour_map::has_colour_table(
+    const uint8_t *p_colour_table,
+    int number_of_colours,
+    bool exact) const
+{
+    return exact == (m_tag_mask != 0) &&
+           number_of_colours == m_number_of_colours &&
+           memcmp(p_colour_table, m_colour_table.data(), 3 * number_of_colours) == 0;
+}
+
+
+// ------------------------------------------
+// Find the nearest colour table entry for a colour
+// ------------------------------------------
+uint8_t c_inverse_colour_map::fill_cell(
+    uint32_t cell,
+    uint32_t key,
+    uint8_t b,
+    uint8_t g,
+    uint8_t r)
+{
+    // Exact maps search for the colour itself, otherwise the cell's colour is
+    // the top 6 bits of each channel expanded back to 8 bits
+    int r_value = r;
+    int g_value = g;
+    int b_value = b;
+    if (m_tag_mask == 0) {
+        r_value = (r & 0xFC) | (r >> 6);
+        g_value = (g & 0xFC) | (g >> 6);
+        b_value = (b & 0xFC) | (b >> 6);
+    }
+
+    int best_diff = 0x7FFFFFFF;
+    int best_index = 0;
+#ifdef INVERSE_COLOUR_MAP_SSE2
+    // Keep the nearest entry seen in each lane, a later entry only replaces it if it is strictly nearer
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i r_values = _mm_set1_epi16((int16_t)r_value);
+    const __m128i g_values = _mm_set1_epi16((int16_t)g_value);
+    const __m128i b_values = _mm_set1_epi16((int16_t)b_value);
+    const __m128i index_step = _mm_set1_epi16(C_SIMD_ENTRIES);
+    __m128i indexes = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    __m128i best_diffs = _mm_set1_epi16(0x7FFF);
+    __m128i best_indexes = zero;
+    for (int i = 0; i < (int)m_red.size(); i += C_SIMD_ENTRIES) {
+        __m128i r_diff = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)&m_red[i]), r_values);
+        __m128i g_diff = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)&m_green[i]), g_values);
+        __m128i b_diff = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)&m_blue[i]), b_values);
+        r_diff = _mm_max_epi16(r_diff, _mm_sub_epi16(zero, r_diff));
+        g_diff = _mm_max_epi16(g_diff, _mm_sub_epi16(zero, g_diff));
+        b_diff = _mm_max_epi16(b_diff, _mm_sub_epi16(zero, b_diff));
+        __m128i diffs = _mm_add_epi16(_mm_add_epi16(r_diff, g_diff), b_diff);
+
+        __m128i nearer = _mm_cmplt_epi16(diffs, best_diffs);
+        best_diffs = _mm_min_epi16(diffs, best_diffs);
+        best_indexes = _mm_or_si128(_mm_and_si128(nearer, indexes), _mm_andnot_si128(nearer, best_indexes));
+        indexes = _mm_add_epi16(indexes, index_step);
+    }
+
+    // Nearest of the lanes, lowest index on a tie
+    int16_t lane_diffs[C_SIMD_ENTRIES];
+    int16_t lane_indexes[C_SIMD_ENTRIES];
+    _mm_storeu_si128((__m128i *)lane_diffs, best_diffs);
+    _mm_storeu_si128((__m128i *)lane_indexes, best_indexes);
+    for (int lane = 0; lane < C_SIMD_ENTRIES; lane++) {
+        if (lane_diffs[lane] < best_diff || (lane_diffs[lane] == best_diff && lane_indexes[lane] < best_index)) {
+            best_diff = lane_diffs[lane];
+            best_index = lane_indexes[lane];
+        }
+    }
+#else
+    for (int i = 0; i < m_number_of_colours; i++) {
+        int diff = abs(r_value - m_red[i]);
+        diff += abs(g_value - m_green[i]);
+        diff += abs(b_value - m_blue[i]);
+        if (diff < best_diff) {
+            best_diff = diff;
+            best_index = i;
+        }
+    }
+#endif
+
+    mp_cells[cell].store(key | (uint32_t)best_index, std::memory_order_relaxed);
+    return (uint8_t)best_index;
+}
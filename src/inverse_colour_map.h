@@ -0,0 +1,103 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#ifndef INVERSE_COLOUR_MAP_H
+#define INVERSE_COLOUR_MAP_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+//
+// Colour to colour table index map for the GIF writer
+// The 8-bit RGB colour space is split into 2^18 cells (6 bits per channel). The first time a
+// colour in a cell is looked up, the colour table entry nearest to the cell's colour (sum of
+// absolute channel differences, lowest index on a tie) is found and stored for the whole cell.
+// Exact maps find the nearest entry to the colour itself instead, each cell remembers the last
+// colour looked up in it.  Only the cells a frame actually uses are ever searched.
+// get_index() can be called from several threads at once, set_colour_table() cannot.
+//
+class c_inverse_colour_map
+{
+public:
+    c_inverse_colour_map(
+        const uint8_t *p_colour_table,
+        int number_of_colours,
+        bool exact);
+
+    // Use a different colour table, forgetting every cell found so far
+    void set_colour_table(
+        const uint8_t *p_colour_table,
+        int number_of_colours,
+        bool exact);
+
+    bool has_colour_table(
+        const uint8_t *p_colour_table,
+        int number_of_colours,
+        bool exact) const;
+
+    // Colour table index for a colour
+    uint8_t get_index(
+        uint8_t b,
+        uint8_t g,
+        uint8_t r)
+    {
+        uint32_t cell = (uint32_t)(r >> 2) << 12 | (g >> 2) << 6 | (b >> 2);
+        uint32_t key = m_generation << 14 | (r & m_tag_mask) << 12 | (g & m_tag_mask) << 10 | (b & m_tag_mask) << 8;
+        uint32_t entry = mp_cells[cell].load(std::memory_order_relaxed);
+        if ((entry & 0xFFFFFF00) == key) {
+            return (uint8_t)entry;
+        }
+
+        return fill_cell(cell, key, b, g, r);
+    }
+
+
+private:
+    // Not copyable
+    c_inverse_colour_map(const c_inverse_colour_map &);
+    c_inverse_colour_map &operator=(const c_inverse_colour_map &);
+
+    // Find the nearest colour table entry for a colour and store it in the colour's cell
+    uint8_t fill_cell(
+        uint32_t cell,
+        uint32_t key,
+        uint8_t b,
+        uint8_t g,
+        uint8_t r);
+
+    // Cell entries are the generation in the top 18 bits, a 6 bit tag and the index in the bottom 8 bits.
+    // Entries from an earlier generation (or colour table) are not valid, so changing
+    // colour table does not need all the cells to be cleared.  The tag is the bottom 2 bits of
+    // each channel of the colour the entry is for, always 0 if the map is not exact.
+    std::unique_ptr<std::atomic<uint32_t>[]> mp_cells;
+    uint32_t m_generation;
+    uint32_t m_tag_mask;  // 0x3 if the map is exact, otherwise 0
+
+    std::vector<uint8_t> m_colour_table;  // RGB
+    int m_number_of_colours;
+
+    // Colour table channels as separate 16-bit arrays for the search, padded to a multiple of 8 entries
+    std::vector<int16_t> m_red;
+    std::vector<int16_t> m_green;
+    std::vector<int16_t> m_blue;
+};
+
+#endif  // INVERSE_COLOUR_MAP_H
@@ -16,6 +16,8 @@
 // ---------------------------------------------------------------------
 
 
+#include <algorithm>
+#include <cstring>
 #include "lzw_compressor.h"
 #include <QDebug>
 
@@ -33,7 +35,8 @@ c_lzw_compressor::c_lzw_compressor(
         uint16_t y_start,
         uint16_t y_end,
         uint8_t bit_depth,
-        uint8_t *p_image_data) :
+        uint8_t *p_image_data,
+        e_dictionary_type dictionary_type) :
     m_width(width),
     m_height(height),
     m_x_start(x_start),
@@ -44,7 +47,8 @@ c_lzw_compressor::c_lzw_compressor(
     mp_image_data(p_image_data),
     m_lossy_compression_level(0),
     mp_index_to_index_colour_difference_lut(nullptr),
-    m_transparent_index(0)
+    m_transparent_index(0),
+    m_dictionary_type(dictionary_type)
 {
     // Special codes
     m_clear_code = 1 << m_bit_depth;
@@ -54,8 +58,12 @@ c_lzw_compressor::c_lzw_compressor(
     m_code_length = m_bit_depth + 1;  // Current length of codes in bits
     m_current_code = 0xFFFF;
 
-    // Create a new LZW dictonary tree
-    mp_lzw_tree.reset(new s_lzw_tree());
+    // Create a new LZW dictonary
+    if (m_dictionary_type == DICTIONARY_TREE) {
+        mp_lzw_tree.reset(new s_lzw_tree());
+    } else {
+        mp_lzw_hash_table.reset(new s_lzw_hash_table());
+    }
 
     // Reset input position variables
     m_input_x = m_x_start;
@@ -82,6 +90,54 @@ void c_lzw_compressor::set_lossy_details(
     m_lossy_compression_level = lossy_compression_level;
     mp_index_to_index_colour_difference_lut = p_index_to_index_colour_difference_lut;
     m_transparent_index = transparent_index;
+
+    // Neighbour lists are built the first time each index needs one
+    if (m_lossy_compression_level > 0) {
+        if (mp_lossy_neighbours == nullptr) {
+            mp_lossy_neighbours.reset(new uint8_t[256 * 256]);
+        }
+
+        std::fill(m_lossy_neighbour_count, m_lossy_neighbour_count + 256, -1);
+    }
+}
+
+
+// ------------------------------------------
+// Get the indexes close enough in colour to stand in for an index
+// ------------------------------------------
+const uint8_t *c_lzw_compressor::get_lossy_neighbours(
+        uint8_t index,
+        int &count)
+{
+    uint8_t *p_neighbours = mp_lossy_neighbours.get() + (index << 8);
+    if (m_lossy_neighbour_count[index] < 0) {
+        // Sort the indexes with a colour difference of 1 to m_lossy_compression_level by
+        // colour difference, indexes with the same difference stay in index order
+        const uint8_t *p_colour_diffs = mp_index_to_index_colour_difference_lut + (index << 8);
+        int level_count[256] = {0};
+        for (int compare_index = 0; compare_index < (1 << m_bit_depth); compare_index++) {
+            level_count[p_colour_diffs[compare_index]]++;
+        }
+
+        int level_start[256];
+        int neighbour_count = 0;
+        for (int level = 1; level <= m_lossy_compression_level && level < 256; level++) {
+            level_start[level] = neighbour_count;
+            neighbour_count += level_count[level];
+        }
+
+        for (int compare_index = 0; compare_index < (1 << m_bit_depth); compare_index++) {
+            int level = p_colour_diffs[compare_index];
+            if (level >= 1 && level <= m_lossy_compression_level) {
+                p_neighbours[level_start[level]++] = compare_index;
+            }
+        }
+
+        m_lossy_neighbour_count[index] = neighbour_count;
+    }
+
+    count = m_lossy_neighbour_count[index];
+    return p_neighbours;
 }
 
 
@@ -112,28 +168,20 @@ bool c_lzw_compressor::compress_data()
 
     while ((m_output_bit < 256 * 8) && !complete) {
         uint8_t next_code = *p_data_ptr;
+        uint16_t found_code;
 
 #ifdef LOSSY_LZW_SUPPORT
         // Lossy LZW experimental code - start
-        if (/*mp_index_lut != nullptr && */  next_code != m_transparent_index) {
-            if (m_current_code != 0xFFFF && mp_lzw_tree->m_current[m_current_code].m_next[next_code] == 0) {
+        if (m_lossy_compression_level > 0 && next_code != m_transparent_index) {
+            if (m_current_code != 0xFFFF && find_code(m_current_code, next_code) == 0) {
                 // Lossy compression code
-                bool match_found = false;
-                for (int compress_level = 1; compress_level <= (m_lossy_compression_level); compress_level++) {
-                    int index = next_code << 8;
-                    for (int compare_index = 0; compare_index < (1 << m_bit_depth); compare_index++) {
-                        uint8_t colour_diff = mp_index_to_index_colour_difference_lut[index | compare_index];
-                        if (colour_diff == compress_level) {
-                            if (mp_lzw_tree->m_current[m_current_code].m_next[compare_index] != 0) {
-                                next_code = compare_index;
-                                *(p_data_ptr) = next_code;
-                                match_found = true;
-                                break;
-                            }
-                        }
-                    }
-
-                    if (match_found) {
+                // Use the closest colour that extends the current run, neighbours are in order of colour difference
+                int neighbour_count;
+                const uint8_t *p_neighbours = get_lossy_neighbours(next_code, neighbour_count);
+                for (int neighbour = 0; neighbour < neighbour_count; neighbour++) {
+                    if (find_code(m_current_code, p_neighbours[neighbour]) != 0) {
+                        next_code = p_neighbours[neighbour];
+                        *(p_data_ptr) = next_code;
                         break;
                     }
                 }
@@ -146,15 +194,15 @@ bool c_lzw_compressor::compress_data()
             // First pixel - do nothing but save next_code as current_code
             m_current_code = next_code;
             output_code_to_buffer(m_clear_code, m_code_length, mp_compressed_data_buffer.get());
-        } else if (mp_lzw_tree->m_current[m_current_code].m_next[next_code] != 0) {
-            // Current run is already in the dictionary tree
-            m_current_code = mp_lzw_tree->m_current[m_current_code].m_next[next_code];
+        } else if ((found_code = find_code(m_current_code, next_code)) != 0) {
+            // Current run is already in the dictionary
+            m_current_code = found_code;
         } else { // Finish current run
             // Write current code out
             output_code_to_buffer(m_current_code, m_code_length, mp_compressed_data_buffer.get());
 
-            // Add new run into the dictionary tree
-            mp_lzw_tree->m_current[m_current_code].m_next[next_code] = m_next_free_code;
+            // Add new run into the dictionary
+            add_code(m_current_code, next_code, m_next_free_code);
 
             if(m_next_free_code >= (1ul << m_code_length))
             {
@@ -168,7 +216,7 @@ bool c_lzw_compressor::compress_data()
             {
                 // Dictionary full, delete it and start again
                 output_code_to_buffer(m_clear_code, m_code_length, mp_compressed_data_buffer.get());
-                mp_lzw_tree.reset(new s_lzw_tree());
+                clear_dictionary();
                 m_code_length = m_bit_depth + 1;
                 m_next_free_code = m_clear_code + 2;
             }
@@ -206,6 +254,71 @@ bool c_lzw_compressor::compress_data()
 }
 
 
+// ------------------------------------------
+// Find run in dictionary
+// ------------------------------------------
+uint16_t c_lzw_compressor::find_code(
+        uint32_t current_code,
+        uint8_t next_index)
+{
+    if (m_dictionary_type == DICTIONARY_TREE) {
+        return mp_lzw_tree->m_current[current_code].m_next[next_index];
+    }
+
+    // Linear probing, the table is never more than half full so runs of used entries are short
+    uint32_t key = (current_code << 8) | next_index;
+    uint32_t slot = get_hash_slot(key);
+    while (true) {
+        uint32_t entry = mp_lzw_hash_table->m_entries[slot];
+        if (entry == 0) {
+            return 0;  // Not in the dictionary
+        }
+
+        if ((entry >> 12) == key) {
+            return entry & 0xFFF;
+        }
+
+        slot = (slot + 1) & ((1 << C_HASH_BITS) - 1);
+    }
+}
+
+
+// ------------------------------------------
+// Add run to dictionary
+// ------------------------------------------
+void c_lzw_compressor::add_code(
+        uint32_t current_code,
+        uint8_t next_index,
+        uint16_t code)
+{
+    if (m_dictionary_type == DICTIONARY_TREE) {
+        mp_lzw_tree->m_current[current_code].m_next[next_index] = code;
+        return;
+    }
+
+    uint32_t key = (current_code << 8) | next_index;
+    uint32_t slot = get_hash_slot(key);
+    while (mp_lzw_hash_table->m_entries[slot] != 0) {
+        slot = (slot + 1) & ((1 << C_HASH_BITS) - 1);
+    }
+
+    mp_lzw_hash_table->m_entries[slot] = (key << 12) | code;
+}
+
+
+// ------------------------------------------
+// Empty the dictionary
+// ------------------------------------------
+void c_lzw_compressor::clear_dictionary()
+{
+    if (m_dictionary_type == DICTIONARY_TREE) {
+        mp_lzw_tree.reset(new s_lzw_tree());
+    } else {
+        memset(mp_lzw_hash_table->m_entries, 0, sizeof(mp_lzw_hash_table->m_entries));
+    }
+}
+
+
 // ------------------------------------------
 // Output code to output buffer
 // ------------------------------------------
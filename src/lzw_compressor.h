@@ -24,6 +24,13 @@
 class c_lzw_compressor {
 
     public:
+        // LZW dictionary implementations, both produce identical output
+        enum e_dictionary_type {
+            DICTIONARY_TREE = 0,  // 4096 x 256 entry table, 2 MB that must be cleared on every reset
+            DICTIONARY_HASH  // Open-addressed hash table keyed on prefix code and index, 32 KB
+        };
+
+
         // ------------------------------------------
         // Constructor
         // ------------------------------------------
@@ -35,7 +42,8 @@ class c_lzw_compressor {
                 uint16_t y_start,
                 uint16_t y_end,
                 uint8_t bit_depth,
-                uint8_t *p_image_data);
+                uint8_t *p_image_data,
+                e_dictionary_type dictionary_type = DICTIONARY_HASH);
 
 
         // ------------------------------------------
@@ -80,6 +88,36 @@ class c_lzw_compressor {
                 uint32_t code_length,
                 uint8_t *p_output_buffer);
 
+
+        // ------------------------------------------
+        // Dictionary access
+        // ------------------------------------------
+        // Returns 0 if the run current_code + next_index is not in the dictionary
+        uint16_t find_code(
+                uint32_t current_code,
+                uint8_t next_index);
+
+        void add_code(
+                uint32_t current_code,
+                uint8_t next_index,
+                uint16_t code);
+
+        void clear_dictionary();
+
+
+        // ------------------------------------------
+        // Lossy compression candidates for an index
+        // ------------------------------------------
+        const uint8_t *get_lossy_neighbours(
+                uint8_t index,
+                int &count);
+
+        uint32_t get_hash_slot(
+                uint32_t key)
+        {
+            return (key * 2654435761u) >> (32 - C_HASH_BITS);
+        }
+
         //
         // Private structures
         //
@@ -95,6 +133,16 @@ class c_lzw_compressor {
             struct s_lzw_node m_current[4096];
         };
 
+        // Hash table size, at most 4096 codes are ever in use so the table is never more than half full
+        static const int C_HASH_BITS = 13;
+
+        // Each hash entry holds (prefix code << 8 | index) in the top 20 bits and the code in the
+        // bottom 12 bits.  Codes in the dictionary are never 0 so an empty entry is 0.
+        struct s_lzw_hash_table
+        {
+            uint32_t m_entries[1 << C_HASH_BITS];
+        };
+
         //
         // Private member variables
         //
@@ -111,6 +159,10 @@ class c_lzw_compressor {
         int m_transparent_index;
         std::unique_ptr<uint8_t []> mp_compressed_data_buffer;
 
+        // Lossy compression neighbour lists, 256 entries per index ordered by colour difference
+        std::unique_ptr<uint8_t []> mp_lossy_neighbours;
+        int16_t m_lossy_neighbour_count[256];  // -1 until the index's list has been built
+
         // Special codes
         uint32_t m_clear_code;
         uint32_t m_end_of_information_code;
@@ -118,8 +170,10 @@ class c_lzw_compressor {
         uint32_t m_code_length;
         uint32_t m_current_code;
 
-        // LZW dictonary tree
+        // LZW dictonary, only one of these is used
+        e_dictionary_type m_dictionary_type;
         std::unique_ptr<s_lzw_tree> mp_lzw_tree;
+        std::unique_ptr<s_lzw_hash_table> mp_lzw_hash_table;
 
         int m_input_x;
         int m_input_y;
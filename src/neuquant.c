@@ -27,7 +27,6 @@
    ------------------- */
 
 #define netbiasshift	4			/* bias for colour values */
-#define ncycles		100			/* no. of learning cycles */
 
 /* defs for freq and bias */
 #define intbiasshift    16			/* bias for fractions */
@@ -41,13 +40,12 @@
 /* defs for decreasing radius factor */
 #define radiusbiasshift	6			/* at 32.0 biased by 6 bits */
 #define radiusbias	(((int) 1)<<radiusbiasshift)
-#define initradius	(initrad*radiusbias)	/* and decreases by a */
+#define initradius	(nq->initrad*radiusbias)	/* and decreases by a */
 #define radiusdec	30			/* factor of 1/30 each cycle */ 
 
 /* defs for decreasing alpha factor */
 #define alphabiasshift	10			/* alpha starts at 1.0 */
 #define initalpha	(((int) 1)<<alphabiasshift)
-int alphadec;					/* biased by 10 bits */
 
 /* radbias and alpharadbias used for radpower calculation */
 #define radbiasshift	8
@@ -56,34 +54,16 @@ int alphadec;					/* biased by 10 bits */
 #define alpharadbias    (((int) 1)<<alpharadbshift)
 
 
-/* Types and Global Variables
-   -------------------------- */
-#define maxnetsize		256			/* number of colours used */
-static int netsize = maxnetsize;
-static int maxnetpos = (maxnetsize - 1);
-static int initrad = (maxnetsize >> 3);		/* for 256 cols, radius starts */
-
-   
-static unsigned char *thepicture;		/* the input image itself */
-static int lengthcount;				/* lengthcount = H*W*3 */
-
-static int samplefac;				/* sampling factor 1..30 */
-
-
-typedef int pixel[4];				/* BGRc */
-static pixel network[maxnetsize];			/* the network itself */
-
-static int netindex[256];			/* for network lookup - really 256 */
-
-static int bias[maxnetsize];			/* bias and freq arrays for learning */
-static int freq[maxnetsize];
-static int radpower[maxnetsize];			/* radpower for precomputation */
+/* Warm start learning parameters, the network is already close so learning only
+   moves the nearest neighbours of each neuron rather than whole regions of it */
+#define warminitrad	8			/* radius starts at 8 rather than netsize/8 */
 
 
 /* Initialise network in range (0,0,0) to (255,255,255) and set parameters
    ----------------------------------------------------------------------- */
 
-void initnet(thepic, len, sample, number_of_colours)
+void initnet(nq, thepic, len, sample, number_of_colours)
+neuquant_net *nq;
 unsigned char *thepic;
 int len;
 int sample;
@@ -92,19 +72,47 @@ int number_of_colours;
 	register int i;
 	register int *p;
 	
-	thepicture = thepic;
-	lengthcount = len;
-	samplefac = sample;
+	nq->thepicture = thepic;
+	nq->lengthcount = len;
+	nq->samplefac = sample;
 
-    netsize = number_of_colours;
-    maxnetpos = (number_of_colours - 1);
-    initrad = (number_of_colours >> 3);		/* for 256 cols, radius starts */
+    nq->netsize = number_of_colours;
+    nq->maxnetpos = (number_of_colours - 1);
+    nq->initrad = (number_of_colours >> 3);		/* for 256 cols, radius starts */
 	
-	for (i=0; i<netsize; i++) {
-		p = network[i];
-		p[0] = p[1] = p[2] = (i << (netbiasshift+8))/netsize;
-		freq[i] = intbias/netsize;	/* 1/netsize */
-		bias[i] = 0;
+	for (i=0; i<nq->netsize; i++) {
+		p = nq->network[i];
+		p[0] = p[1] = p[2] = (i << (netbiasshift+8))/nq->netsize;
+		nq->freq[i] = intbias/nq->netsize;	/* 1/netsize */
+		nq->bias[i] = 0;
+	}
+}
+
+
+/* Initialise network from a colour map
+   ------------------------------------ */
+
+void initnetfromcolourmap(nq, thepic, len, sample, number_of_colours, p_colour_table, colour_table_colours)
+neuquant_net *nq;
+unsigned char *thepic;
+int len;
+int sample;
+int number_of_colours;
+const unsigned char *p_colour_table;
+int colour_table_colours;
+{
+	register int i;
+	register int *p;
+
+	initnet(nq, thepic, len, sample, number_of_colours);
+	nq->initrad = warminitrad;
+
+	for (i=0; i<nq->netsize && i<colour_table_colours; i++) {
+		/* Colour map is RGB, network is BGR */
+		p = nq->network[i];
+		p[0] = p_colour_table[3*i + 2] << netbiasshift;
+		p[1] = p_colour_table[3*i + 1] << netbiasshift;
+		p[2] = p_colour_table[3*i + 0] << netbiasshift;
 	}
 }
 
@@ -112,19 +120,20 @@ int number_of_colours;
 /* Unbias network to give byte values 0..255 and record position i to prepare for sort
    ----------------------------------------------------------------------------------- */
 
-void unbiasnet()
+void unbiasnet(nq)
+neuquant_net *nq;
 {
 	int i,j,temp;
 
-	for (i=0; i<netsize; i++) {
+	for (i=0; i<nq->netsize; i++) {
 		for (j=0; j<3; j++) {
 			/* OLD CODE: network[i][j] >>= netbiasshift; */
 			/* Fix based on bug report by Juergen Weigert jw@suse.de */
-			temp = (network[i][j] + (1 << (netbiasshift - 1))) >> netbiasshift;
+			temp = (nq->network[i][j] + (1 << (netbiasshift - 1))) >> netbiasshift;
 			if (temp > 255) temp = 255;
-			network[i][j] = temp;
+			nq->network[i][j] = temp;
 		}
-		network[i][3] = i;			/* record colour no */
+		nq->network[i][3] = i;			/* record colour no */
 	}
 }
 
@@ -132,13 +141,15 @@ void unbiasnet()
 /* Output colour map
    ----------------- */
 
-void writecolourmap(unsigned char *p_colour_table)
+void writecolourmap(nq, p_colour_table)
+neuquant_net *nq;
+unsigned char *p_colour_table;
 {
 	int i,j;
 
     for (i = 2; i >= 0; i--) {
-        for (j = 0; j < netsize; j++) {
-            *(p_colour_table + 3 * j + (2 - i)) = network[j][i];
+        for (j = 0; j < nq->netsize; j++) {
+            *(p_colour_table + 3 * j + (2 - i)) = nq->network[j][i];
         }
     }
 }
@@ -147,27 +158,29 @@ void writecolourmap(unsigned char *p_colour_table)
 /* Insertion sort of network and building of netindex[0..255] (to do after unbias)
    ------------------------------------------------------------------------------- */
 
-void inxbuild()
+void inxbuild(nq)
+neuquant_net *nq;
 {
 	register int i,j,smallpos,smallval;
 	register int *p,*q;
 	int previouscol,startpos;
+	int *netindex = nq->netindex;
 
 	previouscol = 0;
 	startpos = 0;
-	for (i=0; i<netsize; i++) {
-		p = network[i];
+	for (i=0; i<nq->netsize; i++) {
+		p = nq->network[i];
 		smallpos = i;
 		smallval = p[1];			/* index on g */
 		/* find smallest in i..netsize-1 */
-		for (j=i+1; j<netsize; j++) {
-			q = network[j];
+		for (j=i+1; j<nq->netsize; j++) {
+			q = nq->network[j];
 			if (q[1] < smallval) {		/* index on g */
 				smallpos = j;
 				smallval = q[1];	/* index on g */
 			}
 		}
-		q = network[smallpos];
+		q = nq->network[smallpos];
 		/* swap p (i) and q (smallpos) entries */
 		if (i != smallpos) {
 			j = q[0];   q[0] = p[0];   p[0] = j;
@@ -183,29 +196,31 @@ void inxbuild()
 			startpos = i;
 		}
 	}
-	netindex[previouscol] = (startpos+maxnetpos)>>1;
-	for (j=previouscol+1; j<256; j++) netindex[j] = maxnetpos; /* really 256 */
+	netindex[previouscol] = (startpos+nq->maxnetpos)>>1;
+	for (j=previouscol+1; j<256; j++) netindex[j] = nq->maxnetpos; /* really 256 */
 }
 
 
 /* Search for BGR values 0..255 (after net is unbiased) and return colour index
    ---------------------------------------------------------------------------- */
 
-int inxsearch(b,g,r)
+int inxsearch(nq,b,g,r)
+neuquant_net *nq;
 register int b,g,r;
 {
 	register int i,j,dist,a,bestd;
 	register int *p;
 	int best;
+	int netsize = nq->netsize;
 
 	bestd = 1000;		/* biggest possible dist is 256*3 */
 	best = -1;
-	i = netindex[g];	/* index on g */
+	i = nq->netindex[g];	/* index on g */
 	j = i-1;		/* start at netindex[g] and work outwards */
 
 	while ((i<netsize) || (j>=0)) {
 		if (i<netsize) {
-			p = network[i];
+			p = nq->network[i];
 			dist = p[1] - g;		/* inx key */
 			if (dist >= bestd) i = netsize;	/* stop iter */
 			else {
@@ -221,7 +236,7 @@ register int b,g,r;
 			}
 		}
 		if (j>=0) {
-			p = network[j];
+			p = nq->network[j];
 			dist = g - p[1]; /* inx key - reverse dif */
 			if (dist >= bestd) j = -1; /* stop iter */
 			else {
@@ -244,7 +259,8 @@ register int b,g,r;
 /* Search for biased BGR values
    ---------------------------- */
 
-int contest(b,g,r)
+static int contest(nq,b,g,r)
+neuquant_net *nq;
 register int b,g,r;
 {
 	/* finds closest neuron (min dist) and updates freq */
@@ -260,11 +276,11 @@ register int b,g,r;
 	bestbiasd = bestd;
 	bestpos = -1;
 	bestbiaspos = bestpos;
-	p = bias;
-	f = freq;
+	p = nq->bias;
+	f = nq->freq;
 
-	for (i=0; i<netsize; i++) {
-		n = network[i];
+	for (i=0; i<nq->netsize; i++) {
+		n = nq->network[i];
 		dist = n[0] - b;   if (dist<0) dist = -dist;
 		a = n[1] - g;   if (a<0) a = -a;
 		dist += a;
@@ -277,8 +293,8 @@ register int b,g,r;
 		*f++ -= betafreq;
 		*p++ += (betafreq<<gammashift);
 	}
-	freq[bestpos] += beta;
-	bias[bestpos] -= betagamma;
+	nq->freq[bestpos] += beta;
+	nq->bias[bestpos] -= betagamma;
 	return(bestbiaspos);
 }
 
@@ -286,12 +302,13 @@ register int b,g,r;
 /* Move neuron i towards biased (b,g,r) by factor alpha
    ---------------------------------------------------- */
 
-void altersingle(alpha,i,b,g,r)
+static void altersingle(nq,alpha,i,b,g,r)
+neuquant_net *nq;
 register int alpha,i,b,g,r;
 {
 	register int *n;
 
-	n = network[i];				/* alter hit neuron */
+	n = nq->network[i];				/* alter hit neuron */
 	*n -= (alpha*(*n - b)) / initalpha;
 	n++;
 	*n -= (alpha*(*n - g)) / initalpha;
@@ -303,7 +320,8 @@ register int alpha,i,b,g,r;
 /* Move adjacent neurons by precomputed alpha*(1-((i-j)^2/[r]^2)) in radpower[|i-j|]
    --------------------------------------------------------------------------------- */
 
-void alterneigh(rad,i,b,g,r)
+static void alterneigh(nq,rad,i,b,g,r)
+neuquant_net *nq;
 int rad,i;
 register int b,g,r;
 {
@@ -311,15 +329,15 @@ register int b,g,r;
 	register int *p, *q;
 
 	lo = i-rad;   if (lo<-1) lo=-1;
-	hi = i+rad;   if (hi>netsize) hi=netsize;
+	hi = i+rad;   if (hi>nq->netsize) hi=nq->netsize;
 
 	j = i+1;
 	k = i-1;
-	q = radpower;
+	q = nq->radpower;
 	while ((j<hi) || (k>lo)) {
 		a = (*(++q));
 		if (j<hi) {
-			p = network[j];
+			p = nq->network[j];
 			*p -= (a*(*p - b)) / alpharadbias;
 			p++;
 			*p -= (a*(*p - g)) / alpharadbias;
@@ -328,7 +346,7 @@ register int b,g,r;
 			j++;
 		}
 		if (k>lo) {
-			p = network[k];
+			p = nq->network[k];
 			*p -= (a*(*p - b)) / alpharadbias;
 			p++;
 			*p -= (a*(*p - g)) / alpharadbias;
@@ -343,18 +361,22 @@ register int b,g,r;
 /* Main Learning Loop
    ------------------ */
 
-void learn()
+void learn(nq)
+neuquant_net *nq;
 {
 	register int i,j,b,g,r;
-	int radius,rad,alpha,step,delta,samplepixels;
+	int radius,rad,alpha,step,delta,samplepixels,lengthcount;
 	register unsigned char *p;
 	unsigned char *lim;
+	int *radpower = nq->radpower;
 
-	alphadec = 30 + ((samplefac-1)/3);
-	p = thepicture;
-	lim = thepicture + lengthcount;
-	samplepixels = lengthcount/(3*samplefac);
+	nq->alphadec = 30 + ((nq->samplefac-1)/3);
+	lengthcount = nq->lengthcount;
+	p = nq->thepicture;
+	lim = nq->thepicture + lengthcount;
+	samplepixels = lengthcount/(3*nq->samplefac);
 	delta = samplepixels/ncycles;
+	if (delta == 0) delta = 1;	/* small images have fewer than ncycles sample pixels */
 	alpha = initalpha;
 	radius = initradius;
 	
@@ -379,17 +401,17 @@ void learn()
 		b = p[0] << netbiasshift;
 		g = p[1] << netbiasshift;
 		r = p[2] << netbiasshift;
-		j = contest(b,g,r);
+		j = contest(nq,b,g,r);
 
-		altersingle(alpha,j,b,g,r);
-		if (rad) alterneigh(rad,j,b,g,r);   /* alter neighbours */
+		altersingle(nq,alpha,j,b,g,r);
+		if (rad) alterneigh(nq,rad,j,b,g,r);   /* alter neighbours */
 
 		p += step;
-		if (p >= lim) p -= lengthcount;
+		while (p >= lim) p -= lengthcount;	/* step can be longer than a small image */
 	
 		i++;
 		if (i%delta == 0) {	
-			alpha -= alpha / alphadec;
+			alpha -= alpha / nq->alphadec;
 			radius -= radius / radiusdec;
 			rad = radius >> radiusbiasshift;
 			if (rad <= 1) rad = 0;
@@ -36,41 +36,71 @@
 
 #define minpicturebytes	(3*prime4)		/* minimum size for input image */
 
+#define ncycles		100			/* no. of learning cycles */
+
+
+#define maxnetsize	256			/* maximum number of colours */
+
+
+/* Network state, all functions take one of these so separate networks can be used at the same time
+   -------------------------------------------------------------------------------------------------- */
+typedef struct {
+	int network[maxnetsize][4];		/* the network itself - BGRc */
+	int netindex[256];			/* for network lookup - really 256 */
+	int bias[maxnetsize];			/* bias and freq arrays for learning */
+	int freq[maxnetsize];
+	int radpower[maxnetsize];		/* radpower for precomputation */
+	int netsize;				/* number of colours used */
+	int maxnetpos;
+	int initrad;				/* radius learning starts at */
+	int alphadec;				/* biased by 10 bits */
+	unsigned char *thepicture;		/* the input image itself */
+	int lengthcount;			/* lengthcount = H*W*3 */
+	int samplefac;				/* sampling factor 1..30 */
+} neuquant_net;
+
 
 /* Initialise network in range (0,0,0) to (255,255,255) and set parameters
    ----------------------------------------------------------------------- */
-void initnet(unsigned char *thepic, int len, int sample, int number_of_colours);
+void initnet(neuquant_net *nq, unsigned char *thepic, int len, int sample, int number_of_colours);
+
+/* Initialise network from an RGB colour map written by writecolourmap() before inxbuild() was called,
+   learning then refines the colour map rather than starting again.  Colours missing from the
+   colour map are initialised as initnet() does.
+   ---------------------------------------------------------------------------------------------------- */
+void initnetfromcolourmap(neuquant_net *nq, unsigned char *thepic, int len, int sample, int number_of_colours,
+                          const unsigned char *p_colour_table, int colour_table_colours);
 		
 /* Unbias network to give byte values 0..255 and record position i to prepare for sort
    ----------------------------------------------------------------------------------- */
-void unbiasnet();	/* can edit this function to do output of colour map */
+void unbiasnet(neuquant_net *nq);	/* can edit this function to do output of colour map */
 
 /* Output colour map
    ----------------- */
 
-void writecolourmap(unsigned char *p_colour_table);
+void writecolourmap(neuquant_net *nq, unsigned char *p_colour_table);
 
 /* Insertion sort of network and building of netindex[0..255] (to do after unbias)
    ------------------------------------------------------------------------------- */
-void inxbuild();
+void inxbuild(neuquant_net *nq);
 
 /* Search for BGR values 0..255 (after net is unbiased) and return colour index
    ---------------------------------------------------------------------------- */
-int inxsearch(register int b, register int g, register int r);
+int inxsearch(neuquant_net *nq, register int b, register int g, register int r);
 
 /* Main Learning Loop
    ------------------ */
-void learn();
+void learn(neuquant_net *nq);
 
 /* Program Skeleton
    ----------------
    	[select samplefac in range 1..30]
    	pic = (unsigned char*) malloc(3*width*height);
    	[read image from input file into pic]
-	initnet(pic,3*width*height,samplefac);
-	learn();
-	unbiasnet();
-	[write output image header, using writecolourmap(f),
+	initnet(&nq,pic,3*width*height,samplefac,number_of_colours);
+	learn(&nq);
+	unbiasnet(&nq);
+	[write output image header, using writecolourmap(&nq,p_colour_table),
 	possibly editing the loops in that function]
-	inxbuild();
-	[write output image using inxsearch(b,g,r)]		*/
+	inxbuild(&nq);
+	[write output image using inxsearch(&nq,b,g,r)]		*/
@@ -48,10 +48,13 @@ QStringList c_persistent_data::m_recent_save_folders = QStringList();
 bool c_persistent_data::m_check_for_updates = true;
 bool c_persistent_data::m_disconnect_playback_controls = false;
 bool c_persistent_data::m_repeat = false;
+bool c_persistent_data::m_drop_frames = false;
 int c_persistent_data::m_play_direction = 0;
 bool c_persistent_data::m_histogram_enabled = false;
 bool c_persistent_data::m_markers_enabled = false;
 int c_persistent_data::m_selection_box_colour = 0;
+int c_persistent_data::m_read_ahead_cache_size = 256;
+int c_persistent_data::m_processing_thread_count = 0;
 
 
 //
@@ -97,6 +100,10 @@ void c_persistent_data::load()
         m_repeat = settings.value("playback_repeat").toBool();
     }
 
+    if (settings.value("playback_drop_frames") != QVariant::Invalid) {
+        m_drop_frames = settings.value("playback_drop_frames").toBool();
+    }
+
     if (settings.value("play_direction") != QVariant::Invalid) {
         m_play_direction = settings.value("play_direction").toInt();
     }
@@ -112,6 +119,14 @@ void c_persistent_data::load()
     if (settings.value("selection_box_colour") != QVariant::Invalid) {
         m_selection_box_colour = settings.value("selection_box_colour").toInt();
     }
+
+    if (settings.value("read_ahead_cache_size") != QVariant::Invalid) {
+        m_read_ahead_cache_size = settings.value("read_ahead_cache_size").toInt();
+    }
+
+    if (settings.value("processing_thread_count") != QVariant::Invalid) {
+        m_processing_thread_count = settings.value("processing_thread_count").toInt();
+    }
 }
 	
 	
@@ -130,8 +145,11 @@ void c_persistent_data::save()
     settings.setValue("check_for_updates", m_check_for_updates);
     settings.setValue("disconnect_playback_controls", m_disconnect_playback_controls);
     settings.setValue("playback_repeat", m_repeat);
+    settings.setValue("playback_drop_frames", m_drop_frames);
     settings.setValue("play_direction", m_play_direction);   
     settings.setValue("histogram_enabled", m_histogram_enabled);
     settings.setValue("markers_enabled", m_markers_enabled);
     settings.setValue("selection_box_colour", m_selection_box_colour);
+    settings.setValue("read_ahead_cache_size", m_read_ahead_cache_size);
+    settings.setValue("processing_thread_count", m_processing_thread_count);
 }
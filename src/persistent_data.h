@@ -38,10 +38,13 @@ public:
     static bool m_check_for_updates;
     static bool m_disconnect_playback_controls;
     static bool m_repeat;
+    static bool m_drop_frames;  // Drop frames rather than slow down when playback falls behind
     static int m_play_direction;
     static bool m_histogram_enabled;
     static bool m_markers_enabled;
     static int m_selection_box_colour;
+    static int m_read_ahead_cache_size;  // In MB
+    static int m_processing_thread_count;  // 0 = one thread per core
 
 
     //
@@ -6,6 +6,7 @@
 #include <cstring>
 #include "pipp_avi_write.h"
 #include "pipp_utf8.h"
+#include "frame_buffer_pool.h"
 
 #include <cwchar>
 #include <memory>
@@ -15,6 +16,10 @@
 using namespace std;
 
 
+// Number of chunk buffers used for background writing, one being filled, one being written and one spare
+static const int C_WRITE_BUFFER_COUNT = 3;
+
+
 //
 // index_type codes
 //
@@ -41,12 +46,18 @@ c_pipp_avi_write::c_pipp_avi_write() :
     m_frame_size(0),
     m_colour(false),
     m_write_colour_table(false),
+    m_extra_chunk_buffers(0),
     m_total_frame_count(0),
     m_current_frame_count(0),
     m_riff_count(0),
     m_bytes_per_pixel(1),
-    m_last_frame_pos(0),
-    m_file_write_error(false)
+    m_riff_start_position(0),
+    m_file_position(0),
+    m_movi_position(0),
+    m_file_write_error(false),
+    m_background_write(false),
+    m_stop_writer(false),
+    m_background_write_error(false)
 {
     // Detect endianess of the processor
     m_big_endian_processor = (*(uint16_t *)"\0\xff" < 0x100);
@@ -201,10 +212,6 @@ c_pipp_avi_write::c_pipp_avi_write() :
     m_avi_stdindex_header.base_offset[1] = 0;
     m_avi_stdindex_header.reserved3 = 0;
 
-    // Initialise the standard index entry
-    m_avi_stdindex_entry.offset = 0;
-    m_avi_stdindex_entry.size = 0;
-
     // Initialise avi index entry
     m_avi_index_entry.chunk_id.u32 = FCC_00db;
     m_avi_index_entry.flags = AVIIF_KEYFRAME;
@@ -213,6 +220,25 @@ c_pipp_avi_write::c_pipp_avi_write() :
 }
 
 
+// ------------------------------------------
+// Destructor
+// ------------------------------------------
+c_pipp_avi_write::~c_pipp_avi_write()
+{
+    // The writer thread must not outlive this object, chunks that close() did not write are discarded
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_background_write_error = true;
+    }
+
+    stop_writer_thread();
+
+    if (mp_avi_file != NULL) {
+        fclose(mp_avi_file);
+    }
+}
+
+
 // ------------------------------------------
 // fwrite() function with error checking
 // ------------------------------------------
@@ -227,6 +253,8 @@ void c_pipp_avi_write::fwrite_error_check(
         if (size_written != count) {
             m_file_write_error = true;
         }
+
+        m_file_position += size * count;
     }
 }
 
@@ -282,6 +310,11 @@ void c_pipp_avi_write::write_headers()
     // Write BITMAPINFO header to file
     fwrite_error_check(&m_bitmap_info_header , 1 , sizeof(m_bitmap_info_header) , mp_avi_file);
 
+    // Write codec specific data to file
+    if (!m_format_extra_data.empty()) {
+        fwrite_error_check(m_format_extra_data.data(), 1, m_format_extra_data.size(), mp_avi_file);
+    }
+
     // Write colour table to file if required (for DIB mono images)
     if (m_write_colour_table) {
         uint8_t colour_table[256 * 4];
@@ -299,16 +332,14 @@ void c_pipp_avi_write::write_headers()
 
     if (m_old_avi_format != 0) {
         // Junk chunk moves next pos to 0x2000
-        m_junk_chunk_header.size = 0x2000 - (int32_t)ftell64(mp_avi_file) - sizeof(m_junk_chunk_header);
+        m_junk_chunk_header.size = 0x2000 - (int32_t)m_file_position - sizeof(m_junk_chunk_header);
 
         // Write junk header to file
         fwrite_error_check(&m_junk_chunk_header , 1 , sizeof(m_junk_chunk_header) , mp_avi_file);
 
         // Write junk data to file
-        uint8_t junk_byte = 0;
-        for (uint32_t junk_count = 0; junk_count < m_junk_chunk_header.size; junk_count++) {
-            fwrite_error_check(&junk_byte , 1 , 1, mp_avi_file);
-        }
+        std::vector<uint8_t> junk_data(m_junk_chunk_header.size, 0);
+        fwrite_error_check(junk_data.data(), 1, junk_data.size(), mp_avi_file);
     } else {
         // These fields are not present with the old AVI format
         if (m_big_endian_processor) {
@@ -380,7 +411,8 @@ void c_pipp_avi_write::write_headers()
 // ------------------------------------------
 // A new frame has been added
 // ------------------------------------------
-void c_pipp_avi_write::frame_added()
+void c_pipp_avi_write::frame_added(
+    uint32_t chunk_size)
 {
     // Split AVI files to prevent max size from being exceeded
     if (m_old_avi_format != 0) {
@@ -396,11 +428,15 @@ void c_pipp_avi_write::frame_added()
         }
     }
 
+    if (m_file_write_error) {
+        // Early return if the split file could not be created
+        return;
+    }
+
     if (m_total_frame_count == 0) {
         // Grab position of first frame in this RIFF for the base offset
         m_avi_superindex_header.entries_in_use++;
-        uint64_t base_offset = ftell64(mp_avi_file) + sizeof(m_00db_chunk_header);
-        //uint64_t base_offset = ftell64(avi_fp) - frame_size;
+        uint64_t base_offset = m_file_position + sizeof(m_00db_chunk_header);
         m_avi_stdindex_header.base_offset[1] = (uint32_t)(base_offset >> 32);
         m_avi_stdindex_header.base_offset[0] = (uint32_t)(base_offset & 0xFFFFFFFF);
     }
@@ -433,7 +469,7 @@ void c_pipp_avi_write::frame_added()
 
             // Grab position of first frame in this RIFF for the base offset
             m_avi_superindex_header.entries_in_use++;
-            uint64_t base_offset = ftell64(mp_avi_file) + sizeof(m_00db_chunk_header);
+            uint64_t base_offset = m_file_position + sizeof(m_00db_chunk_header);
             m_avi_stdindex_header.base_offset[1] = (uint32_t)(base_offset >> 32);
             m_avi_stdindex_header.base_offset[0] = (uint32_t)(base_offset & 0xFFFFFFFF);
             m_current_frame_count = 0;
@@ -441,6 +477,193 @@ void c_pipp_avi_write::frame_added()
     }
 
     m_current_frame_count++;
+
+    // Index the chunk that is about to be written at the current position
+    if (m_riff_count == 0) {
+        s_avi_old_index_entry avi_index_entry = m_avi_index_entry;
+        avi_index_entry.offset = (uint32_t)(m_file_position - m_movi_position);
+        avi_index_entry.size = chunk_size;
+
+        if (m_big_endian_processor) {
+            // Change structures from big-endian to little-endian on big-endian systems
+            swap_structure_endianess(&avi_index_entry);
+        }
+
+        m_avi_index_entries.push_back(avi_index_entry);
+    }
+
+    if (m_old_avi_format == 0) {
+        uint64_t base_offset = ((uint64_t)(uint32_t)m_avi_stdindex_header.base_offset[1] << 32)
+                             | (uint32_t)m_avi_stdindex_header.base_offset[0];
+        s_avi_stdindex_entry avi_stdindex_entry;
+        avi_stdindex_entry.offset = (int32_t)(m_file_position + sizeof(m_00db_chunk_header) - base_offset);
+        avi_stdindex_entry.size = chunk_size;
+
+        if (m_big_endian_processor) {
+            // Change structures from big-endian to little-endian on big-endian systems
+            swap_structure_endianess(&avi_stdindex_entry);
+        }
+
+        m_avi_stdindex_entries.push_back(avi_stdindex_entry);
+    }
+}
+
+
+// ------------------------------------------
+// Get a buffer for the next 00db chunk
+// ------------------------------------------
+uint8_t *c_pipp_avi_write::get_chunk_buffer()
+{
+    // Wait for a free buffer, there is only none if the writer thread has fallen behind
+    std::unique_lock<std::mutex> lock(m_write_mutex);
+    m_buffer_free_condition.wait(lock, [&] { return !m_free_write_buffers.empty(); });
+    uint8_t *p_chunk = m_free_write_buffers.back();
+    m_free_write_buffers.pop_back();
+    return p_chunk;
+}
+
+
+// ------------------------------------------
+// Give back a chunk buffer without writing it
+// ------------------------------------------
+void c_pipp_avi_write::release_chunk_buffer(
+    uint8_t *p_chunk)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_free_write_buffers.push_back(p_chunk);
+    }
+
+    m_buffer_free_condition.notify_one();
+}
+
+
+// ------------------------------------------
+// Add a chunk to the file or pass it to the writer thread
+// ------------------------------------------
+bool c_pipp_avi_write::write_chunk(
+    uint8_t *p_chunk,
+    uint32_t chunk_size)
+{
+    // Fill in the chunk header in front of the frame data
+    s_chunk_header chunk_header = m_00db_chunk_header;
+    chunk_header.size = chunk_size;
+    if (m_big_endian_processor) {
+        // Change structures from big-endian to little-endian on big-endian systems
+        swap_structure_endianess(&chunk_header);
+    }
+
+    memcpy(p_chunk, &chunk_header, sizeof(chunk_header));
+
+    // Chunks are padded to an even length
+    p_chunk[sizeof(chunk_header) + chunk_size] = 0;
+
+    if (m_background_write) {
+        bool write_error;
+        {
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            m_write_queue.push_back(p_chunk);
+            write_error = m_background_write_error;
+        }
+
+        m_chunk_queued_condition.notify_one();
+
+        // The file is tidied up by close()
+        return write_error;
+    }
+
+    add_chunk_to_file(p_chunk);
+    release_chunk_buffer(p_chunk);
+
+    // Tidy up after write failures
+    if (m_file_write_error) {
+        if (mp_avi_file != NULL) {
+            fclose(mp_avi_file);
+            mp_avi_file = NULL;
+        }
+
+        m_open = false;
+    }
+
+    bool ret = m_file_write_error;
+    m_file_write_error = false;
+    return ret;
+}
+
+
+// ------------------------------------------
+// Add a chunk to the file
+// ------------------------------------------
+void c_pipp_avi_write::add_chunk_to_file(
+    const uint8_t *p_chunk)
+{
+    s_chunk_header chunk_header;
+    memcpy(&chunk_header, p_chunk, sizeof(chunk_header));
+    if (m_big_endian_processor) {
+        // Change structures back from little-endian to big-endian on big-endian systems
+        swap_structure_endianess(&chunk_header);
+    }
+
+    // Indicate that a frame is about to be added, this may split the file
+    frame_added(chunk_header.size);
+
+    // Write chunk header, frame data and any pad byte in one go
+    fwrite_error_check(p_chunk, 1, sizeof(chunk_header) + ((chunk_header.size + 1) & ~1), mp_avi_file);
+}
+
+
+// ------------------------------------------
+// Background writer thread
+// ------------------------------------------
+void c_pipp_avi_write::writer_thread_function()
+{
+    std::unique_lock<std::mutex> lock(m_write_mutex);
+    while (true) {
+        m_chunk_queued_condition.wait(lock, [&] { return !m_write_queue.empty() || m_stop_writer; });
+        if (m_write_queue.empty()) {
+            // Stopping and all chunks have been written
+            break;
+        }
+
+        uint8_t *p_chunk = m_write_queue.front();
+        m_write_queue.pop_front();
+        bool write_error = m_background_write_error;
+        lock.unlock();
+
+        // Do not continue writing after an error has occured, the rest of the chunks are discarded
+        if (!write_error) {
+            add_chunk_to_file(p_chunk);
+            write_error = m_file_write_error;
+        }
+
+        lock.lock();
+        m_background_write_error |= write_error;
+        m_free_write_buffers.push_back(p_chunk);
+        m_buffer_free_condition.notify_one();
+    }
+}
+
+
+// ------------------------------------------
+// Write any queued chunks, stop the writer thread and free the chunk buffers
+// ------------------------------------------
+void c_pipp_avi_write::stop_writer_thread()
+{
+    if (m_writer_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            m_stop_writer = true;
+        }
+
+        m_chunk_queued_condition.notify_one();
+        m_writer_thread.join();
+    }
+
+    for (uint8_t *p_chunk : m_free_write_buffers) {
+        c_frame_buffer_pool::release_buffer(p_chunk);
+    }
+
+    m_free_write_buffers.clear();
 }
 
 
@@ -501,12 +724,12 @@ bool c_pipp_avi_write::create(
         m_max_frames_in_first_riff -= sizeof(m_movi_list_header);
         m_max_frames_in_first_riff -= (sizeof(m_ix00_chunk_header) + sizeof(m_avi_stdindex_header));
         m_max_frames_in_first_riff -= sizeof(m_idx1_chunk_header);
-        m_max_frames_in_first_riff /= (sizeof(m_00db_chunk_header) + m_frame_size + sizeof(m_avi_stdindex_entry) + sizeof(m_avi_index_entry));
+        m_max_frames_in_first_riff /= (sizeof(m_00db_chunk_header) + m_frame_size + sizeof(s_avi_stdindex_entry) + sizeof(m_avi_index_entry));
 
         // Calculate how many frames can go into the subsequent RIFFs
         m_max_frames_in_other_riffs = 0x7FFFFFFF;  // Maximum RIFF size (2GB - 1)
         m_max_frames_in_other_riffs -= (sizeof(m_avix_riff_header) + sizeof(m_movi_avix_list_header) + sizeof(m_ix00_chunk_header) + sizeof(m_avi_stdindex_header));
-        m_max_frames_in_other_riffs /= (sizeof(m_00db_chunk_header) + m_frame_size + sizeof(m_avi_stdindex_entry));
+        m_max_frames_in_other_riffs /= (sizeof(m_00db_chunk_header) + m_frame_size + sizeof(s_avi_stdindex_entry));
     }
 
     m_split_count = 0;
@@ -531,9 +754,12 @@ bool c_pipp_avi_write::create(
     m_total_frame_count = 0;
     m_current_frame_count = 0;
     m_riff_count = 0;
+    m_riff_patches.clear();
+    m_avi_index_entries.clear();
+    m_avi_stdindex_entries.clear();
 
     // Set flag to write colour table if required
-    if (!colour) {
+    if (m_bytes_per_pixel == 1) {
         m_write_colour_table = 1;
     }
 
@@ -553,7 +779,7 @@ bool c_pipp_avi_write::create(
     m_extended_avi_header.total_frames = 0;  // Increment as frames are added
 
     // Set size of strf chunk
-    m_strf_chunk_header.size = sizeof(m_bitmap_info_header);
+    m_strf_chunk_header.size = sizeof(m_bitmap_info_header) + m_format_extra_data.size();
     if (m_write_colour_table == 1) {
         m_strf_chunk_header.size += 256 * 4;
     }
@@ -577,7 +803,7 @@ bool c_pipp_avi_write::create(
     m_main_avih_header.suggested_buffer_size   = m_frame_size + 8;
     m_vids_stream_header.suggested_buffer_size = m_frame_size + 8;
 
-    m_bitmap_info_header.size = sizeof(m_bitmap_info_header);
+    m_bitmap_info_header.size = sizeof(m_bitmap_info_header) + m_format_extra_data.size();
     m_bitmap_info_header.width = width;
     m_bitmap_info_header.height = height;
     m_bitmap_info_header.bit_count = 8 * m_bytes_per_pixel;
@@ -595,7 +821,7 @@ bool c_pipp_avi_write::create(
                                + m_max_frames_in_other_riffs * m_frame_size                   // frame data
                                + sizeof(m_ix00_chunk_header)                                // ix00 chunk header  
                                + sizeof(m_avi_stdindex_header)                              // Standard index header
-                               + m_max_frames_in_other_riffs * sizeof(m_avi_stdindex_entry);  // Standard index entries
+                               + m_max_frames_in_other_riffs * sizeof(s_avi_stdindex_entry);  // Standard index entries
 
     // Set up AVIX RIFF size as maximum size
     m_avix_riff_header.size = sizeof(m_avix_riff_header.four_cc)
@@ -603,6 +829,7 @@ bool c_pipp_avi_write::create(
                           + m_movi_avix_list_header.size;
 
     mp_avi_file = fopen_utf8(filename, "wb+");
+    m_file_position = 0;
 
     // Check file opened
     // Return if file did not open
@@ -615,13 +842,30 @@ bool c_pipp_avi_write::create(
 
     // Write headers to file
     write_headers();
+    m_movi_position = m_file_position - sizeof(m_movi_list_header.four_cc);
 
     // Handle case where file opened but subsequent write failed
     if (m_open && m_file_write_error) {
         fclose(mp_avi_file);
+        mp_avi_file = NULL;
         m_open = false;
     }
 
+    if (m_open) {
+        // Chunk buffers with room for a pad byte, the writer thread needs a small set of them
+        int buffer_count = (m_background_write ? C_WRITE_BUFFER_COUNT : 1) + m_extra_chunk_buffers;
+        for (int i = 0; i < buffer_count; i++) {
+            m_free_write_buffers.push_back(c_frame_buffer_pool::get_buffer(sizeof(m_00db_chunk_header) + m_frame_size + 1));
+        }
+    }
+
+    if (m_open && m_background_write) {
+        // Start the writer thread
+        m_stop_writer = false;
+        m_background_write_error = false;
+        m_writer_thread = std::thread(&c_pipp_avi_write::writer_thread_function, this);
+    }
+
     bool ret = m_file_write_error;
     m_file_write_error = false;
     return ret;
@@ -640,6 +884,9 @@ void c_pipp_avi_write::split_create()
     m_total_frame_count = 0;
     m_current_frame_count = 0;
     m_riff_count = 0;
+    m_riff_patches.clear();
+    m_avi_index_entries.clear();
+    m_avi_stdindex_entries.clear();
 
     // Reset fields to count frames and indexes
     m_avi_superindex_header.entries_in_use = 0;  // Will be increment as needed
@@ -660,18 +907,18 @@ void c_pipp_avi_write::split_create()
 
     // Open new file
     mp_avi_file = fopen_utf8(p_split_filename.get(), "wb+");
+    m_file_position = 0;
 
     // Check file opened
-    // Return if file did not open
-    if (mp_avi_file) {
-        m_open = true;
-    } else {
+    // The AVI file stays open as far as the caller is concerned, so the error is reported by
+    // write_frame() or close() and the split can be made from the writer thread
+    if (!mp_avi_file) {
         m_file_write_error = true;
-        m_open = false;
     }
 
     // Write headers to file
     write_headers();
+    m_movi_position = m_file_position - sizeof(m_movi_list_header.four_cc);
 }
 
 
@@ -688,11 +935,11 @@ void c_pipp_avi_write::finish_riff()
     // Add odml indexes
     if (m_old_avi_format == 0) {
         m_ix00_chunk_header.size = sizeof(m_avi_stdindex_header)
-                               + m_current_frame_count * sizeof(m_avi_stdindex_entry);
+                               + m_current_frame_count * sizeof(s_avi_stdindex_entry);
 
         // Grab position of the ix00 chunk
         m_avi_superindex_entries[m_riff_count].duration = m_current_frame_count;
-        m_avi_superindex_entries[m_riff_count].offset = ftell64(mp_avi_file);
+        m_avi_superindex_entries[m_riff_count].offset = m_file_position;
         m_avi_superindex_entries[m_riff_count].size = sizeof(m_ix00_chunk_header) + m_ix00_chunk_header.size;
 
         m_avi_stdindex_header.entries_in_use = m_current_frame_count;
@@ -715,24 +962,9 @@ void c_pipp_avi_write::finish_riff()
             swap_structure_endianess(&m_avi_stdindex_header);
         }
 
-        // Write AVI standard indexes to file
-        m_avi_stdindex_entry.size = m_frame_size;
-        for (int x = 0; x < m_current_frame_count; x++) {
-            // Update entry
-            m_avi_stdindex_entry.offset = x * (m_frame_size + sizeof(m_00db_chunk_header));
-
-            if (m_big_endian_processor) {
-                // Change structures from big-endian to little-endian on big-endian systems
-                swap_structure_endianess(&m_avi_stdindex_entry);
-            }
-
-            fwrite_error_check(&m_avi_stdindex_entry, 1, sizeof(m_avi_stdindex_entry), mp_avi_file);
-
-            if (m_big_endian_processor) {
-                // Change structures back from little-endian to big-endian on big-endian systems
-                swap_structure_endianess(&m_avi_stdindex_entry);
-            }
-        }
+        // Write AVI standard indexes to file in one go
+        fwrite_error_check(m_avi_stdindex_entries.data(), sizeof(s_avi_stdindex_entry), m_avi_stdindex_entries.size(), mp_avi_file);
+        m_avi_stdindex_entries.clear();
     }
 
     // Update final fields
@@ -745,18 +977,10 @@ void c_pipp_avi_write::finish_riff()
         m_main_avih_header.total_frames = m_current_frame_count;
 
         m_bitmap_info_header.size_image = m_frame_size;
-        m_avi_index_entry.size = m_frame_size;
         m_idx1_chunk_header.size = m_current_frame_count * sizeof(s_avi_old_index_entry);
-        m_movi_list_header.size = sizeof(m_movi_list_header.four_cc)
-                              + m_current_frame_count * sizeof(s_chunk_header)  // 00db chunks
-                              + m_current_frame_count * m_frame_size;             // frame data
-
-        if (m_old_avi_format == 0) {
-            // Add ix00 index list size on
-            m_movi_list_header.size = m_movi_list_header.size
-                                  + sizeof(m_ix00_chunk_header)
-                                  + m_ix00_chunk_header.size;
-        }
+
+        // The movi LIST holds the 00db chunks and the ix00 index if there is one
+        m_movi_list_header.size = (uint32_t)(m_file_position - m_movi_position);
 
         if (m_big_endian_processor) {
             // Change structures from big-endian to little-endian on big-endian systems
@@ -771,76 +995,29 @@ void c_pipp_avi_write::finish_riff()
             swap_structure_endianess(&m_idx1_chunk_header);
         }
 
-        // Write AVI 1.0 index entries to file
-        m_avi_index_entry.offset = 0x4;
-
-        // Write all entries
-        for (int32_t x = 0; x < m_current_frame_count; x++) {
-            if (m_big_endian_processor) {
-                // Change structures from big-endian to little-endian on big-endian systems
-                swap_structure_endianess(&m_avi_index_entry);
-            }
-
-            fwrite_error_check(&m_avi_index_entry , 1 , sizeof(m_avi_index_entry), mp_avi_file);  // Write entry to file
-
-            if (m_big_endian_processor) {
-                // Change structures back from little-endian to big-endian on big-endian systems
-                swap_structure_endianess(&m_avi_index_entry);
-            }
-
-            m_avi_index_entry.offset += (sizeof(s_chunk_header) + m_frame_size);  // Increment offset
-        }
-
-        // Get the filesize
-        int64_t filesize = ftell64(mp_avi_file);
+        // Write AVI 1.0 index entries to file in one go
+        fwrite_error_check(m_avi_index_entries.data(), sizeof(s_avi_old_index_entry), m_avi_index_entries.size(), mp_avi_file);
+        m_avi_index_entries.clear();
 
         // Update final headers
-        m_avi_riff_header.size = (uint32_t)filesize - 8;
+        m_avi_riff_header.size = (uint32_t)m_file_position - 8;
     } 
 
     // Grab start position of the next RIFF
-    int64_t riff_end_position = ftell64(mp_avi_file);
+    int64_t riff_end_position = m_file_position;
 
     // Processing for subsequent RIFFs
-    if (m_riff_count > 0 && m_current_frame_count != m_max_frames_in_other_riffs) {
-        // This RIFF must be the last RIFF as it does not have the maximum number of frames in it
-        // We need to correct the RIFF and LIST sizes as it is not completely full
-
-        // Go back to the start of this RIFF
-        fseek64(mp_avi_file, m_riff_start_position, SEEK_SET);
-
-        // Write RIFF header again with correct length now that we know it
-        m_avix_riff_header.size = (int32_t)(riff_end_position - m_riff_start_position) - sizeof(m_avix_riff_header) + sizeof(m_avix_riff_header.four_cc);
-
-        if (m_big_endian_processor) {
-            // Change structures from big-endian to little-endian on big-endian systems
-            swap_structure_endianess(&m_avix_riff_header);
-        }
-
-        fwrite_error_check(&m_avix_riff_header , 1, sizeof(m_avix_riff_header), mp_avi_file);
-
-        if (m_big_endian_processor) {
-            // Change structures back from little-endian to big-endian on big-endian systems
-            swap_structure_endianess(&m_avix_riff_header);
-        }
-
-        // Write the movi LIST header again with the correct length now that we know it
-        m_movi_avix_list_header.size = m_avix_riff_header.size - sizeof(m_movi_avix_list_header);
-
-        if (m_big_endian_processor) {
-            // Change structures from big-endian to little-endian on big-endian systems
-            swap_structure_endianess(&m_movi_avix_list_header);
+    if (m_riff_count > 0) {
+        // The RIFF is smaller than its header says if it is the part filled last RIFF
+        // or if its chunks were compressed to less than m_frame_size bytes
+        // The headers are written again by patch_headers() so the file is only appended to here
+        uint32_t riff_size = (uint32_t)(riff_end_position - m_riff_start_position) - sizeof(m_avix_riff_header) + sizeof(m_avix_riff_header.four_cc);
+        if (riff_size != m_avix_riff_header.size) {
+            s_riff_patch riff_patch;
+            riff_patch.position = m_riff_start_position;
+            riff_patch.riff_size = riff_size;
+            m_riff_patches.push_back(riff_patch);
         }
-
-        fwrite_error_check(&m_movi_avix_list_header , 1 , sizeof(m_movi_avix_list_header) , mp_avi_file);
-
-        if (m_big_endian_processor) {
-            // Change structures back from little-endian to big-endian on big-endian systems
-            swap_structure_endianess(&m_movi_avix_list_header);
-        }
-
-        // Go back to the end of this RIFF
-        fseek64(mp_avi_file, riff_end_position, SEEK_SET);
     }
 
     // Grab start position of the next RIFF
@@ -861,20 +1038,26 @@ void c_pipp_avi_write::finish_riff()
 bool c_pipp_avi_write::close()
 {
     if (m_open) {
-        // Finish off this RIFF
-        finish_riff();
+        // Wait for the writer thread to write all queued chunks and free the chunk buffers
+        stop_writer_thread();
+        if (m_background_write) {
+            m_file_write_error |= m_background_write_error;
+        }
+
+        // There is no file if a split file could not be created
+        if (mp_avi_file != NULL) {
+            // Finish off this RIFF
+            finish_riff();
 
-        // Go back to start of file
-        fseek64(mp_avi_file, 0, SEEK_SET);
+            // Write the updated headers to the file
+            patch_headers();
 
-        // Write the updated headers to the file
-        write_headers();
+            fclose(mp_avi_file);
+            mp_avi_file = NULL;
+        }
 
         // Note that the AVI file is closed
         m_open = false;
-
-        fclose(mp_avi_file);
-        mp_avi_file = NULL;
     }
 
     bool ret = m_file_write_error;
@@ -891,14 +1074,52 @@ void c_pipp_avi_write::split_close()
     // Finish off this RIFF
     finish_riff();
 
+    // Write the updated headers to the file
+    patch_headers();
+
+    fclose(mp_avi_file);
+    mp_avi_file = NULL;
+}
+
+
+// ------------------------------------------
+// Write the final headers over the ones written when the file was created
+// ------------------------------------------
+void c_pipp_avi_write::patch_headers()
+{
+    if (m_file_write_error) {
+        // Early return for previous file write errors
+        return;
+    }
+
     // Go back to start of file
     fseek64(mp_avi_file, 0, SEEK_SET);
+    m_file_position = 0;
 
     // Write the updated headers to the file
     write_headers();
 
-    fclose(mp_avi_file);
-    mp_avi_file = NULL;
+    // Write the headers of RIFFs that are not the size they claimed with their correct lengths
+    for (auto riff_patch = m_riff_patches.begin(); riff_patch != m_riff_patches.end(); ++riff_patch) {
+        s_list_header avix_riff_header = m_avix_riff_header;
+        s_list_header movi_avix_list_header = m_movi_avix_list_header;
+        avix_riff_header.size = riff_patch->riff_size;
+        movi_avix_list_header.size = riff_patch->riff_size - sizeof(movi_avix_list_header);
+
+        fseek64(mp_avi_file, riff_patch->position, SEEK_SET);
+        m_file_position = riff_patch->position;
+
+        if (m_big_endian_processor) {
+            // Change structures from big-endian to little-endian on big-endian systems
+            swap_structure_endianess(&avix_riff_header);
+            swap_structure_endianess(&movi_avix_list_header);
+        }
+
+        fwrite_error_check(&avix_riff_header , 1, sizeof(avix_riff_header), mp_avi_file);
+        fwrite_error_check(&movi_avix_list_header , 1 , sizeof(movi_avix_list_header) , mp_avi_file);
+    }
+
+    m_riff_patches.clear();
 }
 
 
@@ -1,13 +1,17 @@
 #ifndef PIPP_ODML_WRITE_H
 #define PIPP_ODML_WRITE_H
 
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "pipp_video_write.h"
-#include "pipp_buffer.h"
 
 #define DEBUGF //printf
 
@@ -61,6 +65,7 @@
 #define FCC_IYUV   0x56555949
 #define FCC_YV12   0x32315659
 #define FCC_BY8    0x20385942
+#define FCC_ZLIB   0x42494C5A
 
 #define NUMBER_SUPERINDEX_ENTRIES 62
 
@@ -223,6 +228,12 @@ class c_pipp_avi_write: public c_pipp_video_write {
 
         static_assert (sizeof(s_avi_stdindex_entry) == 2 * 4, "Unexpected size for structure s_avi_stdindex_entry");
 
+        // AVIX RIFF whose headers were written with a size it did not reach
+        struct s_riff_patch {
+            int64_t position;
+            uint32_t riff_size;
+        };
+
         // Member variables
         std::unique_ptr<char[]> mp_filename;
         std::unique_ptr<char[]> mp_extension;
@@ -237,16 +248,29 @@ class c_pipp_avi_write: public c_pipp_video_write {
         int32_t m_max_frames_in_first_riff;
         int32_t m_max_frames_in_other_riffs;
         bool m_write_colour_table;
+        std::vector<uint8_t> m_format_extra_data;  // Codec specific data that follows the BITMAPINFO header
+        int32_t m_extra_chunk_buffers;  // Chunk buffers a derived class holds on to while frames are encoded
         int32_t m_total_frame_count;
         int32_t m_current_frame_count;
         int32_t m_riff_count;
         int32_t m_bytes_per_pixel;
-        int64_t m_last_frame_pos;
         int64_t m_riff_start_position;
+        std::vector<s_riff_patch> m_riff_patches;  // AVIX RIFF headers that close() must correct
+        int64_t m_file_position;  // Position that the next write to the file goes to
+        int64_t m_movi_position;  // Position of the first RIFF's movi four_cc that idx1 offsets are relative to
         bool m_file_write_error;
         bool m_big_endian_processor;
 
-        c_pipp_buffer m_temp_buffer;
+        // Background writing, frame chunks are passed to the writer thread in a small set of recycled buffers
+        bool m_background_write;
+        std::thread m_writer_thread;
+        std::mutex m_write_mutex;
+        std::condition_variable m_chunk_queued_condition;
+        std::condition_variable m_buffer_free_condition;
+        std::deque<uint8_t *> m_write_queue;
+        std::vector<uint8_t *> m_free_write_buffers;
+        bool m_stop_writer;
+        bool m_background_write_error;
 
         // Various list and chunk structures in main file
         s_list_header m_avi_riff_header;
@@ -278,7 +302,10 @@ class c_pipp_avi_write: public c_pipp_video_write {
 
         s_chunk_header m_ix00_chunk_header;
         s_avi_stdindex_header m_avi_stdindex_header;
-        s_avi_stdindex_entry m_avi_stdindex_entry;
+
+        // Index entries for the current RIFF, already little-endian, written in one go when the RIFF is finished
+        std::vector<s_avi_old_index_entry> m_avi_index_entries;
+        std::vector<s_avi_stdindex_entry> m_avi_stdindex_entries;
 
 
     // ------------------------------------------
@@ -295,8 +322,7 @@ class c_pipp_avi_write: public c_pipp_video_write {
         // ------------------------------------------
         // Destructor
         // ------------------------------------------
-        virtual ~c_pipp_avi_write() {
-        }
+        virtual ~c_pipp_avi_write();
 
 
         // ------------------------------------------
@@ -307,6 +333,17 @@ class c_pipp_avi_write: public c_pipp_video_write {
         }
 
 
+        // ------------------------------------------
+        // Write frames to the file from a separate thread, call before create()
+        // write_frame() then only has to convert the frame into a chunk buffer, and
+        // the writer thread adds the chunks and keeps the indexes in frame order.
+        // Write errors are reported by the next write_frame() call or by close().
+        // ------------------------------------------
+        void set_background_write(bool background_write) {
+            m_background_write = background_write;
+        }
+
+
         // ------------------------------------------
         // Create a new AVI file
         // ------------------------------------------
@@ -356,9 +393,33 @@ class c_pipp_avi_write: public c_pipp_video_write {
 
 
         // ------------------------------------------
-        // A new frame has been added
+        // A new frame with chunk_size bytes of data has been added
+        // ------------------------------------------
+        void frame_added(
+                uint32_t chunk_size);
+
+
+        // ------------------------------------------
+        // Get a buffer for the next 00db chunk, the frame data goes after the chunk header
+        // The buffer has room for m_frame_size bytes of frame data and a pad byte
+        // ------------------------------------------
+        uint8_t *get_chunk_buffer();
+
+
+        // ------------------------------------------
+        // Add a chunk from get_chunk_buffer() with chunk_size bytes of frame data to the file,
+        // or pass it to the writer thread.  Returns true if there has been a write error
         // ------------------------------------------
-        void frame_added();
+        bool write_chunk(
+                uint8_t *p_chunk,
+                uint32_t chunk_size);
+
+
+        // ------------------------------------------
+        // Give back a buffer from get_chunk_buffer() without writing it
+        // ------------------------------------------
+        void release_chunk_buffer(
+                uint8_t *p_chunk);
 
 
         // ------------------------------------------
@@ -391,6 +452,27 @@ class c_pipp_avi_write: public c_pipp_video_write {
         // ------------------------------------------
         void split_close();
 
+        // ------------------------------------------
+        // Write the final headers, the only writes that are not appended to the file
+        // ------------------------------------------
+        void patch_headers();
+
+        // ------------------------------------------
+        // Add a chunk to the file, keeping the index and split bookkeeping up to date
+        // ------------------------------------------
+        void add_chunk_to_file(
+                const uint8_t *p_chunk);
+
+        // ------------------------------------------
+        // Background writer thread
+        // ------------------------------------------
+        void writer_thread_function();
+
+        // ------------------------------------------
+        // Write any queued chunks, stop the writer thread and free the chunk buffers
+        // ------------------------------------------
+        void stop_writer_thread();
+
         template <typename T>
         static T swap_endianess(T data)
         {
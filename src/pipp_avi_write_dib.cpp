@@ -65,30 +65,16 @@ bool c_pipp_avi_write_dib::write_frame(
         colour = 0;
     }
 
-    // Indicate that a frame is about to be added
-    frame_added();
+    // The frame goes into a buffer after the 00db chunk header
+    uint8_t *p_chunk = get_chunk_buffer();
+    uint8_t *buffer = p_chunk + sizeof(m_00db_chunk_header);
 
-    if (m_big_endian_processor) {
-        // Change structures from big-endian to little-endian on big-endian systems
-        swap_structure_endianess(&m_00db_chunk_header);
-    }
-
-    fwrite_error_check(&m_00db_chunk_header, 1, sizeof(m_00db_chunk_header), mp_avi_file);
-
-    if (m_big_endian_processor) {
-        // Change structures back from little-endian to big-endian on big-endian systems
-        swap_structure_endianess(&m_00db_chunk_header);
-    }
-
-    uint8_t *buffer;
     int32_t line_length = m_width * m_bytes_per_pixel;
     if (m_line_gap == 0 && m_bytes_per_pixel == 3 && bpp == 1) {
-        // Use supplied data directly
-        buffer = data;
+        // Copy supplied data directly
+        memcpy(buffer, data, m_frame_size);
     } else {
         // Create version of image with line gaps in
-        buffer = m_temp_buffer.get_buffer((m_width * m_bytes_per_pixel + m_line_gap)* m_height);
-        
         if (bpp == 1) {
             if (m_bytes_per_pixel == 3) {
                 // Colour version 
@@ -144,17 +130,6 @@ bool c_pipp_avi_write_dib::write_frame(
         }
     }
 
-    // Write image data to file
-    m_last_frame_pos = ftell64(mp_avi_file);  // Grab position of last file
-    fwrite_error_check(buffer , 1 , (m_width * m_bytes_per_pixel + m_line_gap) * m_height, mp_avi_file);
-
-    // Tidy up after write failures
-    if (m_file_write_error) {
-        fclose(mp_avi_file);
-        m_open = false;
-    }
-
-    bool ret = m_file_write_error;
-    m_file_write_error = false;
-    return ret;
+    // Write chunk to file
+    return write_chunk(p_chunk, m_frame_size);
 }
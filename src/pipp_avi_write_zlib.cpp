@@ -0,0 +1,224 @@
+#include "pipp_avi_write_zlib.h"
+#include "frame_buffer_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+extern "C" {
+    #include "zlib.h"
+}
+
+
+// LCL codec values that go into the extra data after the BITMAPINFO header
+static const uint8_t C_LCL_IMGTYPE_RGB24 = 2;
+static const uint8_t C_LCL_COMP_ZLIB_HISPEED = 1;
+static const uint8_t C_LCL_CODEC_ZLIB = 3;
+
+
+// ------------------------------------------
+// Constructor
+// ------------------------------------------
+c_pipp_avi_write_zlib::c_pipp_avi_write_zlib()
+{
+    m_vids_stream_header.handler.u32 = FCC_ZLIB;  // Override value from base class
+    m_bitmap_info_header.compression.u32 = FCC_ZLIB;
+
+    // LCL extra data: 4 reserved bytes then image type, compression level, flags and codec
+    const uint8_t extra_data[8] = {4, 0, 0, 0, C_LCL_IMGTYPE_RGB24, C_LCL_COMP_ZLIB_HISPEED, 0, C_LCL_CODEC_ZLIB};
+    m_format_extra_data.assign(extra_data, extra_data + sizeof(extra_data));
+
+    // Each frame being compressed holds on to a chunk buffer
+    m_max_pending_frames = std::max(1, (int)std::thread::hardware_concurrency());
+    m_extra_chunk_buffers = m_max_pending_frames;
+}
+
+
+// ------------------------------------------
+// Destructor
+// ------------------------------------------
+c_pipp_avi_write_zlib::~c_pipp_avi_write_zlib()
+{
+    // Frames that close() did not write are discarded
+    for (s_pending_frame &pending_frame : m_pending_frames) {
+        pending_frame.compressed_size.wait();
+        c_frame_buffer_pool::release_buffer(pending_frame.p_frame);
+        release_chunk_buffer(pending_frame.p_chunk);
+    }
+
+    m_pending_frames.clear();
+}
+
+
+// ------------------------------------------
+// Set codec specific values
+// ------------------------------------------
+int32_t c_pipp_avi_write_zlib::set_codec_values()
+{
+    // The codec always stores 24-bit RGB, mono frames are written as grey
+    m_bytes_per_pixel = 3;
+    m_write_colour_table = false;
+
+    // Worst case compressed frame size, rows are not padded to 4 bytes
+    m_frame_size = compressBound(m_width * 3 * m_height);
+
+    return 0;
+}
+
+
+// ------------------------------------------
+// Write frame to AVI file
+// ------------------------------------------
+bool c_pipp_avi_write_zlib::write_frame(
+    uint8_t  *data,
+    int32_t colour,
+    uint32_t bpp,
+    void *extra_data)
+{
+    // Remove unused argument warnings
+    (void)extra_data;
+
+    // Early return if no file is open
+    if (!m_open) {
+        return true;
+    }
+
+    if (colour < 0 || colour > 2) {
+        colour = 0;
+    }
+
+    // Copy the frame so that the caller can reuse its buffer while the frame is compressed
+    size_t frame_bytes = (size_t)m_width * m_height * (m_colour ? 3 : 1) * bpp;
+    s_pending_frame pending_frame;
+    pending_frame.p_frame = c_frame_buffer_pool::get_buffer(frame_bytes);
+    memcpy(pending_frame.p_frame, data, frame_bytes);
+    pending_frame.p_chunk = get_chunk_buffer();
+    pending_frame.compressed_size = std::async(
+                std::launch::async,
+                &c_pipp_avi_write_zlib::compress_frame,
+                this,
+                pending_frame.p_frame,
+                colour,
+                bpp,
+                pending_frame.p_chunk + sizeof(m_00db_chunk_header));
+    m_pending_frames.push_back(std::move(pending_frame));
+
+    // Write out compressed frames, waiting for the oldest ones if too many are in progress
+    return write_compressed_frames(m_max_pending_frames);
+}
+
+
+// ------------------------------------------
+// Compress a frame
+// ------------------------------------------
+uint32_t c_pipp_avi_write_zlib::compress_frame(
+    const uint8_t *p_frame,
+    int32_t colour,
+    uint32_t bpp,
+    uint8_t *p_output)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK) {
+        return 0;
+    }
+
+    stream.next_out = p_output;
+    stream.avail_out = m_frame_size;
+
+    // Each line is converted to 8-bit BGR and fed to the compressor
+    int32_t samples_per_line = m_width * (m_colour ? 3 : 1);
+
+    // Mono pixels are read colour samples on, as the DIB writer does, with the last
+    // pixels of the frame clamped to the final sample rather than read past the end
+    int32_t mono_offset = (m_colour) ? 0 : colour;
+    size_t last_sample = (size_t)samples_per_line * m_height - 1;
+
+    std::vector<uint8_t> line(m_width * 3);
+    int result = Z_OK;
+    for (int32_t y = 0; y < m_height && result == Z_OK; y++) {
+        uint8_t *dst_ptr = line.data();
+        if (bpp == 1) {
+            const uint8_t *src_ptr = p_frame + y * samples_per_line;
+            if (m_colour) {
+                memcpy(dst_ptr, src_ptr, samples_per_line);
+            } else {
+                size_t sample = (size_t)y * samples_per_line + mono_offset;
+                for (int32_t x = 0; x < m_width; x++) {
+                    uint8_t value = p_frame[std::min(sample++, last_sample)];
+                    *dst_ptr++ = value;
+                    *dst_ptr++ = value;
+                    *dst_ptr++ = value;
+                }
+            }
+        } else {  // Bytes per sample == 2
+            const uint16_t *src_ptr = (const uint16_t *)p_frame + y * samples_per_line;
+            if (m_colour) {
+                for (int32_t x = 0; x < samples_per_line; x++) {
+                    *dst_ptr++ = *src_ptr++ >> 8;
+                }
+            } else {
+                size_t sample = (size_t)y * samples_per_line + mono_offset;
+                for (int32_t x = 0; x < m_width; x++) {
+                    uint8_t value = ((const uint16_t *)p_frame)[std::min(sample++, last_sample)] >> 8;
+                    *dst_ptr++ = value;
+                    *dst_ptr++ = value;
+                    *dst_ptr++ = value;
+                }
+            }
+        }
+
+        stream.next_in = line.data();
+        stream.avail_in = (uInt)line.size();
+        result = deflate(&stream, (y == m_height - 1) ? Z_FINISH : Z_NO_FLUSH);
+    }
+
+    uint32_t compressed_size = (result == Z_STREAM_END) ? (uint32_t)stream.total_out : 0;
+    deflateEnd(&stream);
+    return compressed_size;
+}
+
+
+// ------------------------------------------
+// Write compressed frames in order
+// ------------------------------------------
+bool c_pipp_avi_write_zlib::write_compressed_frames(
+    size_t max_pending)
+{
+    bool write_error = false;
+    while (m_pending_frames.size() > max_pending) {
+        s_pending_frame &pending_frame = m_pending_frames.front();
+        uint32_t compressed_size = pending_frame.compressed_size.get();
+        uint8_t *p_chunk = pending_frame.p_chunk;
+        c_frame_buffer_pool::release_buffer(pending_frame.p_frame);
+        m_pending_frames.pop_front();
+
+        if (!m_open || compressed_size == 0) {
+            // The file was closed after a write error or the frame could not be compressed
+            release_chunk_buffer(p_chunk);
+            write_error = true;
+        } else {
+            write_error |= write_chunk(p_chunk, compressed_size);
+        }
+    }
+
+    return write_error;
+}
+
+
+// ------------------------------------------
+// Write any frames still being compressed and close AVI file
+// ------------------------------------------
+bool c_pipp_avi_write_zlib::close()
+{
+    bool write_error = false;
+    if (m_open) {
+        write_error = write_compressed_frames(0);
+    }
+
+    write_error |= c_pipp_avi_write::close();
+    return write_error;
+}
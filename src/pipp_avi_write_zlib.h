@@ -0,0 +1,83 @@
+#ifndef PIPP_AVI_WRITE_ZLIB_H
+#define PIPP_AVI_WRITE_ZLIB_H
+
+#include <deque>
+#include <future>
+
+#include "pipp_video_write.h"
+#include "pipp_avi_write.h"
+
+
+// ------------------------------------------
+// Lossless AVI writer using the LCL ZLIB codec (fourcc ZLIB)
+// Frames are stored as 24-bit RGB and compressed with zlib, several frames at a time
+// ------------------------------------------
+class c_pipp_avi_write_zlib: public c_pipp_avi_write {
+private:
+    struct s_pending_frame {
+        uint8_t *p_frame;  // Copy of the frame being compressed
+        uint8_t *p_chunk;  // Chunk buffer the compressed frame goes into
+        std::future<uint32_t> compressed_size;  // 0 if compression failed
+    };
+
+    int m_max_pending_frames;
+    std::deque<s_pending_frame> m_pending_frames;  // In file order
+
+
+public:
+    // ------------------------------------------
+    // Constructor
+    // ------------------------------------------
+    c_pipp_avi_write_zlib();
+
+
+    // ------------------------------------------
+    // Destructor
+    // ------------------------------------------
+    virtual ~c_pipp_avi_write_zlib();
+
+
+    // ------------------------------------------
+    // Write frame to AVI file
+    // ------------------------------------------
+    virtual bool write_frame(
+        uint8_t *data,
+        int32_t m_colour,
+        uint32_t bpp,
+        void *extra_data = NULL);
+
+
+    // ------------------------------------------
+    // Write any frames still being compressed and close AVI file
+    // ------------------------------------------
+    virtual bool close();
+
+
+private:
+    // ------------------------------------------
+    // Set codec specific values
+    // ------------------------------------------
+    virtual int32_t set_codec_values();
+
+
+    // ------------------------------------------
+    // Compress a frame into p_output, returns the compressed size or 0 on failure
+    // ------------------------------------------
+    uint32_t compress_frame(
+        const uint8_t *p_frame,
+        int32_t colour,
+        uint32_t bpp,
+        uint8_t *p_output);
+
+
+    // ------------------------------------------
+    // Write compressed frames in order until no more than max_pending are left
+    // Returns true if there has been an error
+    // ------------------------------------------
+    bool write_compressed_frames(
+        size_t max_pending);
+};
+
+
+
+#endif  // PIPP_AVI_WRITE_ZLIB_H
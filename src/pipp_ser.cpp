@@ -51,6 +51,11 @@ int32_t c_pipp_ser::open(
         fclose(mp_ser_file);  // Close file
     }
 
+    // Release any mapping of a previous file
+    unmap_file_utf8(mp_mapped_file, m_mapped_size);
+    mp_mapped_file = nullptr;
+    m_mapped_size = 0;
+
     // Remember filename
     m_filename = filename_utf8;
 
@@ -308,6 +313,18 @@ int32_t c_pipp_ser::open(
         mp_timestamp = nullptr;
     }
 
+    // Map the file into memory if requested so that frames can be read without copying through fread()
+    // Fall back to normal file access if the mapping fails (e.g. file too large for a 32-bit address space)
+    if (m_use_memory_mapping) {
+        mp_mapped_file = map_file_utf8(filename_utf8, m_mapped_size);
+        if (mp_mapped_file != nullptr && m_mapped_size < (uint64_t)m_framesize_in * m_header.frame_count + 178) {
+            // Mapping is shorter than expected, file may have been truncated since it was opened
+            unmap_file_utf8(mp_mapped_file, m_mapped_size);
+            mp_mapped_file = nullptr;
+            m_mapped_size = 0;
+        }
+    }
+
     // Code to check m_header.pixel_depth since many software packages seem to set this incorrectly
     if (m_byte_depth_in == 2 && m_header.frame_count > 0) {
         const int FRAMES_TO_CHECK_FOR_PIXEL_DEPTH = 10;
@@ -648,6 +665,10 @@ int32_t c_pipp_ser::close() {
         mp_ser_file = nullptr;
     }
 
+    unmap_file_utf8(mp_mapped_file, m_mapped_size);
+    mp_mapped_file = nullptr;
+    m_mapped_size = 0;
+
     m_error_string.clear();
 
     return 0;
@@ -678,8 +699,11 @@ int32_t c_pipp_ser::get_frame (
     if (frame_number != m_current_frame + 1) {
         // This is not the next frame, seek to the correct frame
         m_current_frame = frame_number - 1;
-        uint64_t offset = ((uint64_t)m_current_frame * (uint64_t)m_framesize_in) + 178;
-        fseek64(mp_ser_file, offset, SEEK_SET);
+        if (mp_mapped_file == nullptr) {
+            // No seek is required when frames are read from the file mapping
+            uint64_t offset = ((uint64_t)m_current_frame * (uint64_t)m_framesize_in) + 178;
+            fseek64(mp_ser_file, offset, SEEK_SET);
+        }
 
         // Update timestamp pointer
         if (mp_timestamp != nullptr) {
@@ -692,6 +716,36 @@ int32_t c_pipp_ser::get_frame (
 }
 
 
+// ------------------------------------------
+// Get data for the current frame
+// ------------------------------------------
+const uint8_t *c_pipp_ser::read_frame_data(
+    uint32_t size)
+{
+    if (mp_mapped_file != nullptr) {
+        // Frame is read straight from the file mapping, m_current_frame has already been incremented
+        uint64_t offset = ((uint64_t)(m_current_frame - 1) * (uint64_t)m_framesize_in) + 178;
+
+        // The mapping covered every frame when it was made, it only stops being usable
+        // if the file is truncated and a read goes past the new end of the file
+        if (!mapped_file_faulted(mp_mapped_file)) {
+            return mp_mapped_file + offset;
+        }
+
+        // The file has shrunk, drop the mapping and read frames with fread() from now on
+        unmap_file_utf8(mp_mapped_file, m_mapped_size);
+        mp_mapped_file = nullptr;
+        m_mapped_size = 0;
+        fseek64(mp_ser_file, offset, SEEK_SET);
+    }
+
+    // Create a temp buffer and load frame from file into it
+    uint8_t *temp_buffer_ptr = m_temp_buffer.get_buffer(size);
+    fread(temp_buffer_ptr, 1, size, mp_ser_file);
+    return temp_buffer_ptr;
+}
+
+
 // ------------------------------------------
 // Get frame from SER file
 // ------------------------------------------
@@ -725,13 +779,12 @@ int32_t c_pipp_ser::get_frame (
                 return 0;
             }
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2 * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2 * 3, mp_ser_file);
+            // Get frame data from the file mapping or load it into a temp buffer
+            const uint16_t *temp_buffer_ptr = (const uint16_t *)read_frame_data(m_header.image_width * m_header.image_height * 2 * 3);
 
             // Copy data into supplied buffer 
-            uint8_t *read_ptr8;
-            uint16_t *read_ptr;
+            const uint8_t *read_ptr8;
+            const uint16_t *read_ptr;
             uint16_t *write_ptr = (uint16_t *)buffer;
 
             if (m_header.pixel_depth == 16) {
@@ -753,7 +806,7 @@ int32_t c_pipp_ser::get_frame (
                 } else {
                     // 16-bit data with different endianess as the processor
                     for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
+                        read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
                         for (int32_t x = 0; x < m_header.image_width; x++) {
                             uint16_t r = (*read_ptr8++) << 8;
                             r += *read_ptr8++;
@@ -795,7 +848,7 @@ int32_t c_pipp_ser::get_frame (
                     uint32_t shift1 = 16 - m_header.pixel_depth;
                     uint32_t shift2 = m_header.pixel_depth - shift1;
                     for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
+                        read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
                         for (int32_t x = 0; x < m_header.image_width; x++) {
                             uint16_t r = (*read_ptr8++) << 8;
                             r += *read_ptr8++;
@@ -821,13 +874,12 @@ int32_t c_pipp_ser::get_frame (
                 return 0;
             }
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2 * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2 * 3, mp_ser_file);
+            // Get frame data from the file mapping or load it into a temp buffer
+            const uint16_t *temp_buffer_ptr = (const uint16_t *)read_frame_data(m_header.image_width * m_header.image_height * 2 * 3);
 
             // Copy data into supplied buffer 
-            uint8_t *read_ptr8;
-            uint16_t *read_ptr;
+            const uint8_t *read_ptr8;
+            const uint16_t *read_ptr;
             uint16_t *write_ptr = (uint16_t *)buffer;
 
             if (m_header.pixel_depth == 16) {
@@ -845,7 +897,7 @@ int32_t c_pipp_ser::get_frame (
                 } else {
                     // 16-bit data with different endianess as the processor
                     for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
+                        read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
                         for (int32_t x = 0; x < m_header.image_width; x++) {
                             uint16_t b = (*read_ptr8++) << 8;
                             b += *read_ptr8++;
@@ -887,7 +939,7 @@ int32_t c_pipp_ser::get_frame (
                     uint32_t shift1 = 16 - m_header.pixel_depth;
                     uint32_t shift2 = m_header.pixel_depth - shift1;
                     for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
+                        read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
                         for (int32_t x = 0; x < m_header.image_width; x++) {
                             uint16_t b = (*read_ptr8++) << 8;
                             b += *read_ptr8++;
@@ -915,13 +967,12 @@ int32_t c_pipp_ser::get_frame (
                 return 0;
             }
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2, mp_ser_file);
+            // Get frame data from the file mapping or load it into a temp buffer
+            const uint16_t *temp_buffer_ptr = (const uint16_t *)read_frame_data(m_header.image_width * m_header.image_height * 2);
 
             // Copy data into supplied buffer 
-            uint8_t *read_ptr8;
-            uint16_t *read_ptr;
+            const uint8_t *read_ptr8;
+            const uint16_t *read_ptr;
             uint16_t *write_ptr = (uint16_t *)buffer;
 
             if (m_header.pixel_depth == 16) {
@@ -937,7 +988,7 @@ int32_t c_pipp_ser::get_frame (
                 } else {
                     // 16-bit data with different endianess as the processor
                     for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
+                        read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
                         for (int32_t x = 0; x < m_header.image_width; x++) {
                             uint16_t value = (*read_ptr8++) << 8;
                             value += *read_ptr8++;
@@ -965,7 +1016,7 @@ int32_t c_pipp_ser::get_frame (
                     uint32_t shift1 = 16 - m_header.pixel_depth;
                     uint32_t shift2 = m_header.pixel_depth - shift1;
                     for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
+                        read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
                         for (int32_t x = 0; x < m_header.image_width; x++) {
                             uint16_t value = (*read_ptr8++) << 8;
                             value += *read_ptr8++;
@@ -987,18 +1038,17 @@ int32_t c_pipp_ser::get_frame (
                 return 0;
             }
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2 * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2 * 3, mp_ser_file);
+            // Get frame data from the file mapping or load it into a temp buffer
+            const uint16_t *temp_buffer_ptr = (const uint16_t *)read_frame_data(m_header.image_width * m_header.image_height * 2 * 3);
 
             // Copy data into supplied buffer
-            uint8_t *read_ptr8;
+            const uint8_t *read_ptr8;
             uint8_t *write_ptr8 = (uint8_t *)buffer;
 
             if (m_header.little_endian == 0) {
                 // Little endian (16-bit data) but pixel depth is only 8-bits
                 for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
+                    read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
                     for (int32_t x = 0; x < m_header.image_width; x++) {
                         uint8_t r = *read_ptr8;
                         read_ptr8 += 2;
@@ -1015,7 +1065,7 @@ int32_t c_pipp_ser::get_frame (
             } else {
                 // Big endian (16-bit data) but pixel depth is only 8-bits
                 for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
+                    read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
                     read_ptr8++;
                     for (int32_t x = 0; x < m_header.image_width; x++) {
                         uint8_t r = *read_ptr8;
@@ -1040,18 +1090,17 @@ int32_t c_pipp_ser::get_frame (
                 return 0;
             }
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2 * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2 * 3, mp_ser_file);
+            // Get frame data from the file mapping or load it into a temp buffer
+            const uint16_t *temp_buffer_ptr = (const uint16_t *)read_frame_data(m_header.image_width * m_header.image_height * 2 * 3);
 
             // Copy data into supplied buffer
-            uint8_t *read_ptr8;
+            const uint8_t *read_ptr8;
             uint8_t *write_ptr8 = (uint8_t *)buffer;
 
             if (m_header.little_endian == 0) {
                 // Little endian (16-bit data) but pixel depth is only 8-bits
                 for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
+                    read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
                     for (int32_t x = 0; x < m_header.image_width; x++) {
                         uint8_t b = *read_ptr8;
                         read_ptr8 += 2;
@@ -1068,7 +1117,7 @@ int32_t c_pipp_ser::get_frame (
             } else {
                 // Big endian (16-bit data) but pixel depth is only 8-bits
                 for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
+                    read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
                     read_ptr8++;
                     for (int32_t x = 0; x < m_header.image_width; x++) {
                         uint8_t b = *read_ptr8;
@@ -1093,18 +1142,17 @@ int32_t c_pipp_ser::get_frame (
                 return 0;
             }
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2, mp_ser_file);
+            // Get frame data from the file mapping or load it into a temp buffer
+            const uint16_t *temp_buffer_ptr = (const uint16_t *)read_frame_data(m_header.image_width * m_header.image_height * 2);
 
             // Copy data into supplied buffer
-            uint8_t *read_ptr8;
+            const uint8_t *read_ptr8;
             uint8_t *write_ptr8 = (uint8_t *)buffer;
 
             if (m_header.little_endian == 0) {
                 // Little endian (16-bit data) but pixel depth is only 8-bits
                 for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
+                    read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
                     for (int32_t x = 0; x < m_header.image_width; x++) {
                         uint8_t value = *read_ptr8;
                         read_ptr8 += 2;
@@ -1115,7 +1163,7 @@ int32_t c_pipp_ser::get_frame (
             } else {
                 // Big endian (16-bit data) but pixel depth is only 8-bits
                 for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
+                    read_ptr8 = (const uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
                     read_ptr8++;
                     for (int32_t x = 0; x < m_header.image_width; x++) {
                         uint8_t value = *read_ptr8;
@@ -1137,12 +1185,11 @@ int32_t c_pipp_ser::get_frame (
                 return 0;
             }
 
-            // Create a temp buffer to load frame from file into 
-            uint8_t *temp_buffer_ptr = m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 3, mp_ser_file);
+            // Get frame data from the file mapping or load it into a temp buffer
+            const uint8_t *temp_buffer_ptr = read_frame_data(m_header.image_width * m_header.image_height * 3);
 
             // Copy data into supplied buffer 
-            uint8_t *read_ptr;
+            const uint8_t *read_ptr;
             uint8_t *write_ptr = buffer;
             for (int32_t y = m_header.image_height-1; y >= 0; y--) {
                 read_ptr = temp_buffer_ptr + y * m_header.image_width * 3;
@@ -1164,12 +1211,11 @@ int32_t c_pipp_ser::get_frame (
                 return 0;
             }
 
-            // Create a temp buffer to load frame from file into 
-            uint8_t *temp_buffer_ptr = m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 3, mp_ser_file);
+            // Get frame data from the file mapping or load it into a temp buffer
+            const uint8_t *temp_buffer_ptr = read_frame_data(m_header.image_width * m_header.image_height * 3);
 
             // Copy data into supplied buffer 
-            uint8_t *read_ptr;
+            const uint8_t *read_ptr;
             uint8_t *write_ptr = buffer;
             int32_t line_size = m_header.image_width * 3;
             for (int32_t y = m_header.image_height-1; y >= 0; y--) {
@@ -1186,12 +1232,11 @@ int32_t c_pipp_ser::get_frame (
                 return 0;
             }
 
-            // Create a temp buffer to load frame from file into 
-            uint8_t *temp_buffer_ptr = m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height, mp_ser_file);
+            // Get frame data from the file mapping or load it into a temp buffer
+            const uint8_t *temp_buffer_ptr = read_frame_data(m_header.image_width * m_header.image_height);
 
             // Copy data into supplied buffer 
-            uint8_t *read_ptr;
+            const uint8_t *read_ptr;
             uint8_t *write_ptr = buffer;
             for (int32_t y = 0; y < m_header.image_height; y++) {
                 read_ptr = temp_buffer_ptr + (m_header.image_height - 1 - y) * m_header.image_width;
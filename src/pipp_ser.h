@@ -79,6 +79,9 @@ class c_pipp_ser {
         int32_t m_fps_scale;  // Frame Per Second Scale
 
         c_pipp_buffer m_temp_buffer;
+        bool m_use_memory_mapping;
+        const uint8_t *mp_mapped_file;
+        uint64_t m_mapped_size;
         c_pipp_buffer m_timestamp_buffer;
         uint64_t *mp_timestamp;
         int64_t m_timestamp_correction_value;
@@ -110,6 +113,9 @@ class c_pipp_ser {
             m_byte_depth_in(0),
             m_byte_depth_out(0),
             m_colour(0),
+            m_use_memory_mapping(false),
+            mp_mapped_file(nullptr),
+            m_mapped_size(0),
             mp_timestamp(nullptr),
             m_error_string(""),
             m_same_data_and_processor_endian(false)
@@ -123,6 +129,7 @@ class c_pipp_ser {
         // Destructor
         // ------------------------------------------
         ~c_pipp_ser() {
+            close();
         }
 
 
@@ -141,6 +148,23 @@ class c_pipp_ser {
         int32_t close();
 
 
+        // ------------------------------------------
+        // Read frames through a memory mapping of the file
+        // Takes effect the next time a file is opened
+        // ------------------------------------------
+        void set_memory_mapping(bool enable) {
+            m_use_memory_mapping = enable;
+        }
+
+
+        // ------------------------------------------
+        // Get whether frames are read from a memory mapping
+        // ------------------------------------------
+        bool is_memory_mapped() {
+            return mp_mapped_file != nullptr;
+        }
+
+
         // ------------------------------------------
         // Fix broken SER file
         // ------------------------------------------
@@ -313,6 +337,14 @@ class c_pipp_ser {
             uint32_t frame_number,
             uint8_t *buffer);
 
+
+        // ------------------------------------------
+        // Get size of raw frame data in bytes
+        // ------------------------------------------
+        uint32_t get_raw_frame_size() {
+            return m_framesize_in;
+        }
+
         //
         // Return is SER file has timestamps
         //
@@ -344,6 +376,19 @@ class c_pipp_ser {
         }
 
 
+        //
+        // Get the timestamp of a particular frame (starting at 1) as get_timestamp()
+        // returns it once that frame has been read, 0 if there are no timestamps
+        //
+        uint64_t get_frame_timestamp(uint32_t frame_number) {
+            if (mp_timestamp == nullptr || frame_number < 1 || frame_number > (uint32_t)m_header.frame_count) {
+                return 0;
+            }
+
+            return get_timestamp(frame_number - 1) + m_timestamp_correction_value;
+        }
+
+
         //
         // Get diff between universal time and local time
         //
@@ -359,6 +404,12 @@ class c_pipp_ser {
         int32_t find_pixel_depth(
             uint32_t frame_number);
 
+        //
+        // Get data for the current frame from the mapping or via fread()
+        //
+        const uint8_t *read_frame_data(
+            uint32_t size);
+
         template <typename T>
         static T swap_endianess(T data)
         {
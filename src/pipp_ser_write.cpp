@@ -1,5 +1,6 @@
 #include "pipp_ser_write.h"
 #include "pipp_utf8.h"
+#include "frame_buffer_pool.h"
 
 #include <cstdlib>
 #include <cstdint>
@@ -13,13 +14,29 @@
 using namespace std;
 
 
+// Number of frame buffers used for background writing, one being filled, one being written and one spare
+static const int C_WRITE_BUFFER_COUNT = 3;
+
+// Most data copied from the source file in one go by copy_frame(), so the caller can show progress
+static const uint64_t C_MAX_COPY_SIZE = 64 * 1024 * 1024;
+
+// Size of the SER file ID and header before the first frame
+static const uint64_t C_SER_HEADER_SIZE = 178;
+
+
 // ------------------------------------------
 // Constructor
 // ------------------------------------------
 c_pipp_ser_write::c_pipp_ser_write() :
     mp_ser_file(nullptr),
     m_open(false),
-    m_file_write_error(false)
+    m_file_write_error(false),
+    m_background_write(false),
+    m_stop_writer(false),
+    m_background_write_error(false),
+    mp_copy_source_file(nullptr),
+    m_copy_frames(false),
+    m_copy_run_frames(0)
 {
     // Detect endianess of the processor
     m_big_endian_processor = (*(uint16_t *)"\0\xff" < 0x100);
@@ -29,6 +46,20 @@ c_pipp_ser_write::c_pipp_ser_write() :
 }
 
 
+// ------------------------------------------
+// Destructor
+// ------------------------------------------
+c_pipp_ser_write::~c_pipp_ser_write()
+{
+    // The writer thread must not outlive this object
+    stop_writer_thread();
+
+    if (mp_copy_source_file != nullptr) {
+        fclose(mp_copy_source_file);
+    }
+}
+
+
 // ------------------------------------------
 // Create a new SER file
 // ------------------------------------------
@@ -37,7 +68,8 @@ bool c_pipp_ser_write::create(
     int32_t  width,
     int32_t  height,
     bool     colour,
-    int32_t  byte_depth)
+    int32_t  byte_depth,
+    bool     background_write)
 {
     // Set member variables
     m_width = width;
@@ -45,12 +77,16 @@ bool c_pipp_ser_write::create(
     m_colour = colour;
     m_open = false;
     m_date_time_utc = 0L;
+    m_timestamps.clear();
+    m_copy_frames = false;
 
     m_bytes_per_sample = byte_depth;
     if (colour) {
         m_bytes_per_sample *= 3;
     }
 
+    m_frame_size = (size_t)m_width * m_height * m_bytes_per_sample;
+
     // Open new file
     mp_ser_file = fopen_utf8(filename.toUtf8().data(), "wb+");
 
@@ -60,23 +96,6 @@ bool c_pipp_ser_write::create(
         return true;
     }
     
-    // Generate temp index filename
-    int32_t filename_len = filename.length();
-    mp_index_filename.reset(new char[filename_len + 5]);
-    strcpy(mp_index_filename.get(), filename.toUtf8().constData());
-    strcat(mp_index_filename.get(), ".idx");
-
-    // Open index file
-    mp_ser_index_file = fopen_utf8(mp_index_filename.get(), "wb");
-
-    // Check file opened
-    // Return if file did not open
-    if (!mp_ser_index_file) {
-        // Close main SER file first
-        fclose(mp_ser_file);
-        return true;
-    }
-
     // Write SER FILE ID to start of the file
     fwrite_error_check("LUCAM-RECORDER" , 1 , 14 , mp_ser_file );
 
@@ -86,9 +105,20 @@ bool c_pipp_ser_write::create(
     if (m_file_write_error) {
         // There were file errors, handle them
         fclose(mp_ser_file);
-        fclose(mp_ser_index_file);
     } else {
         m_open = true;
+
+        m_background_write = background_write;
+        if (m_background_write) {
+            // Start the writer thread with its set of empty buffers
+            m_stop_writer = false;
+            m_background_write_error = false;
+            for (int i = 0; i < C_WRITE_BUFFER_COUNT; i++) {
+                m_free_write_buffers.push_back(c_frame_buffer_pool::get_buffer(m_frame_size));
+            }
+
+            m_writer_thread = std::thread(&c_pipp_ser_write::writer_thread_function, this);
+        }
     }
 
     bool ret = m_file_write_error;
@@ -97,6 +127,41 @@ bool c_pipp_ser_write::create(
 }
 
 
+// ------------------------------------------
+// Create a new SER file that frames are copied into from another SER file
+// ------------------------------------------
+bool c_pipp_ser_write::create_copy(
+    const QString &filename,
+    const std::string &source_filename,
+    int32_t  width,
+    int32_t  height,
+    int32_t  colour_id,
+    int32_t  pixel_depth,
+    int32_t  little_endian)
+{
+    bool colour = (colour_id == COLOURID_RGB || colour_id == COLOURID_BGR);
+    int32_t byte_depth = (pixel_depth > 8) ? 2 : 1;
+    if (create(filename, width, height, colour, byte_depth)) {
+        return true;
+    }
+
+    // Open the source file separately so its reader is not disturbed
+    mp_copy_source_file = fopen_utf8(source_filename, "rb");
+    if (!mp_copy_source_file) {
+        fclose(mp_ser_file);
+        m_open = false;
+        return true;
+    }
+
+    m_copy_frames = true;
+    m_copy_colour_id = colour_id;
+    m_copy_pixel_depth = pixel_depth;
+    m_copy_little_endian = little_endian;
+    m_copy_run_frames = 0;
+    return false;
+}
+
+
 // ------------------------------------------
 // Write frame to SER file
 // ------------------------------------------
@@ -114,70 +179,89 @@ bool c_pipp_ser_write::write_frame(
         m_date_time_utc = timestamp;
     }
 
-    // Generate buffer
-    std::unique_ptr<uint8_t[]> p_buffer(new uint8_t[m_width * m_height * m_bytes_per_sample]);
+    if (m_background_write) {
+        // Wait for a free buffer, there is only none if the writer thread has fallen behind
+        uint8_t *p_buffer;
+        {
+            std::unique_lock<std::mutex> lock(m_write_mutex);
+            m_buffer_free_condition.wait(lock, [&] { return !m_free_write_buffers.empty(); });
+            p_buffer = m_free_write_buffers.back();
+            m_free_write_buffers.pop_back();
+        }
 
-    if (m_bytes_per_sample == 1) {
-        // 8-bit mono data
-        uint8_t *write_ptr = p_buffer.get();
-        uint8_t *read_ptr;
+        flip_frame(data, p_buffer);
 
-        for (int32_t y = m_height-1; y >= 0; y--) {
-            read_ptr = data + (y * m_width);
-            memcpy(write_ptr, read_ptr, m_width);
-            write_ptr += m_width;
-        }
-    } else if (m_bytes_per_sample == 2) {
-        // 16-bit mono data write
-        uint16_t *write_ptr = (uint16_t *)p_buffer.get();
-        uint16_t *read_ptr;
-        uint16_t *data_16 = (uint16_t *)data;
-        for (int32_t y = m_height-1; y >= 0; y--) {
-            read_ptr = data_16 + (y * m_width);
-            memcpy(write_ptr, read_ptr, m_width * 2);
-            write_ptr += m_width;
-        }
-    } else if (m_bytes_per_sample == 3) {
-        // 24-bit colour data
-        uint8_t *write_ptr = p_buffer.get();
-        uint8_t *read_ptr;
-
-        for (int32_t y = m_height-1; y >= 0; y--) {
-            read_ptr = data + (y * m_width * 3);
-            memcpy(write_ptr, read_ptr, m_width * 3);
-            write_ptr += m_width * 3;
-        }
-    } else if (m_bytes_per_sample == 6) {
-        // 48-bit colour data
-        uint16_t *write_ptr = (uint16_t *)p_buffer.get();
-        uint16_t *read_ptr;
-        uint16_t *data_16 = (uint16_t *)data;
-        for (int32_t y = m_height-1; y >= 0; y--) {
-            read_ptr = data_16 + y * m_width * 3;
-            memcpy(write_ptr, read_ptr, m_width * 3 * 2);
-            write_ptr += m_width * 3;
+        // Hand the frame to the writer thread
+        {
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            m_write_queue.push_back(p_buffer);
         }
+
+        m_frame_queued_condition.notify_one();
+    } else {
+        c_pooled_buffer p_buffer(m_frame_size);
+        flip_frame(data, p_buffer.get());
+        fwrite_error_check(p_buffer.get(), 1, m_frame_size, mp_ser_file);
     }
 
-    fwrite_error_check(p_buffer.get(), 1, m_width * m_height * m_bytes_per_sample, mp_ser_file);
-    p_buffer.reset(nullptr);
+    add_timestamp(timestamp);
 
-    if (m_date_time_utc != 0) {
-        if (m_big_endian_processor) {
-            timestamp = swap_endianess(timestamp);  // timestamp must be in little endian format
-        }
+    // Increment frame count
+    m_header.frame_count++;
 
-        // Write timestamp to temp timestamp file
-        fwrite_error_check(&timestamp, 8, 1, mp_ser_index_file);
+    // Tidy up after write failures
+    if (m_file_write_error) {
+        fclose(mp_ser_file);
+        m_timestamps.clear();
+        m_open = false;
+    }
+
+    bool ret = m_file_write_error;
+    m_file_write_error = false;
+    return ret;
+}
+
+
+// ------------------------------------------
+// Copy frame from the source SER file
+// ------------------------------------------
+bool c_pipp_ser_write::copy_frame(
+    uint32_t frame_number,
+    uint64_t timestamp)
+{
+    // Early return if the file is not open for copying
+    if (!m_open || mp_copy_source_file == nullptr) {
+        return true;
     }
 
+    // Grab first timestamp
+    if (m_header.frame_count == 0) {
+        m_date_time_utc = timestamp;
+    }
+
+    // Frames that follow on from the waiting frames are copied with them
+    if (m_copy_run_frames > 0 &&
+        (frame_number != m_copy_run_start + m_copy_run_frames ||
+         (uint64_t)(m_copy_run_frames + 1) * m_frame_size > C_MAX_COPY_SIZE)) {
+        copy_pending_frames();
+    }
+
+    if (m_copy_run_frames == 0) {
+        m_copy_run_start = frame_number;
+    }
+
+    m_copy_run_frames++;
+    add_timestamp(timestamp);
+
     // Increment frame count
     m_header.frame_count++;
 
     // Tidy up after write failures
     if (m_file_write_error) {
         fclose(mp_ser_file);
-        fclose(mp_ser_index_file);
+        fclose(mp_copy_source_file);
+        mp_copy_source_file = nullptr;
+        m_timestamps.clear();
         m_open = false;
     }
 
@@ -202,7 +286,12 @@ bool c_pipp_ser_write::set_details(
     m_header.little_endian = 0;
     m_header.image_width = m_width;
     m_header.image_height = m_height;
-    if (!m_colour) {
+    if (m_copy_frames) {
+        // Copied frame data is unchanged so keep the source file's format
+        m_header.little_endian = m_copy_little_endian;
+        m_header.pixel_depth = m_copy_pixel_depth;
+        m_header.colour_id = m_copy_colour_id;
+    } else if (!m_colour) {
         m_header.pixel_depth = 8 * m_bytes_per_sample;
         if (colour_id >= 0) {
             m_header.colour_id = colour_id;  // Keep original colour_id from SER file
@@ -234,43 +323,33 @@ bool c_pipp_ser_write::set_details(
 bool c_pipp_ser_write::close()
 {
     if (m_open) {
-        // Close index file which may be empty
-        fclose(mp_ser_index_file);
-
-        // Open index file to read if we are using indexes
-        if (m_date_time_utc != 0) {
-            // Open index file to read
-            mp_ser_index_file = fopen_utf8(mp_index_filename.get(), "rb");
-
-            // Get file size
-            fseek64(mp_ser_index_file, 0, SEEK_END);
-            size_t filesize = ftell64(mp_ser_index_file);
-            fseek64(mp_ser_index_file, 0, SEEK_SET);
-
-            // Get buffer to store index in
-            std::unique_ptr<uint8_t[]> p_buffer(new uint8_t[(uint32_t)filesize]);
-
-            // Read data into buffer
-            size_t read_size = fread(p_buffer.get(), 1, filesize, mp_ser_index_file);
-            fclose(mp_ser_index_file);
-
-            // Write index data to output file
-            if (read_size == filesize) {
-                fwrite_error_check(p_buffer.get(), 1, (uint32_t)filesize, mp_ser_file);
-            }
+        // Wait for the writer thread to write the frames it still has
+        if (m_background_write) {
+            stop_writer_thread();
+            m_file_write_error |= m_background_write_error;
+        }
 
-            p_buffer.reset(nullptr);
+        // Copy any frames still waiting to be copied
+        if (mp_copy_source_file != nullptr) {
+            copy_pending_frames();
+            fclose(mp_copy_source_file);
+            mp_copy_source_file = nullptr;
         }
 
-        // Close index file and remove it
-        remove_utf8(mp_index_filename.get());
+        // Write timestamps trailer
+        if (!m_timestamps.empty()) {
+            fwrite_error_check(m_timestamps.data(), 8, m_timestamps.size(), mp_ser_file);
+        }
 
         // Goto start of file after SER FILE ID field
         fseek64(mp_ser_file, 14, SEEK_SET);
 
         // Write header to file
         if (m_big_endian_processor) {
-            m_header.little_endian = 1;  // Note data is in big-endian format on big-endian systems
+            if (!m_copy_frames) {
+                m_header.little_endian = 1;  // Note data is in big-endian format on big-endian systems
+            }
+
             swap_header_endianess(&m_header);  // Header must be in little-endian format
         }
 
@@ -287,8 +366,8 @@ bool c_pipp_ser_write::close()
         mp_ser_file = nullptr;
     }
 
-    // Release filename memory
-    mp_index_filename.reset(nullptr);
+    // Release timestamps memory
+    m_timestamps = std::vector<uint64_t>();
 
     bool ret = m_file_write_error;
     m_file_write_error = false;
@@ -296,9 +375,6 @@ bool c_pipp_ser_write::close()
 }
 
 
-// ------------------------------------------
-// fwrite() function with error checking
-// ------------------------------------------
 // ------------------------------------------
 // fwrite() function with error checking
 // ------------------------------------------
@@ -315,3 +391,106 @@ void c_pipp_ser_write::fwrite_error_check(
         }
     }
 }
+
+
+// ------------------------------------------
+// Copy frame to buffer, flipping it vertically
+// ------------------------------------------
+void c_pipp_ser_write::flip_frame(
+    const uint8_t *p_data,
+    uint8_t *p_buffer)
+{
+    size_t line_size = (size_t)m_width * m_bytes_per_sample;
+    uint8_t *write_ptr = p_buffer;
+    for (int32_t y = m_height-1; y >= 0; y--) {
+        memcpy(write_ptr, p_data + y * line_size, line_size);
+        write_ptr += line_size;
+    }
+}
+
+
+// ------------------------------------------
+// Background writer thread
+// ------------------------------------------
+void c_pipp_ser_write::writer_thread_function()
+{
+    std::unique_lock<std::mutex> lock(m_write_mutex);
+    while (true) {
+        m_frame_queued_condition.wait(lock, [&] { return !m_write_queue.empty() || m_stop_writer; });
+        if (m_write_queue.empty()) {
+            // Stopping and all frames have been written
+            break;
+        }
+
+        uint8_t *p_buffer = m_write_queue.front();
+        m_write_queue.pop_front();
+        bool write_error = m_background_write_error;
+        lock.unlock();
+
+        // Do not continue writing after an error has occured, the rest of the frames are discarded
+        if (!write_error) {
+            write_error = fwrite(p_buffer, 1, m_frame_size, mp_ser_file) != m_frame_size;
+        }
+
+        lock.lock();
+        m_background_write_error |= write_error;
+        m_free_write_buffers.push_back(p_buffer);
+        m_buffer_free_condition.notify_one();
+    }
+}
+
+
+// ------------------------------------------
+// Write any queued frames, stop the writer thread and free its buffers
+// ------------------------------------------
+void c_pipp_ser_write::stop_writer_thread()
+{
+    if (m_writer_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            m_stop_writer = true;
+        }
+
+        m_frame_queued_condition.notify_one();
+        m_writer_thread.join();
+    }
+
+    for (uint8_t *p_buffer : m_free_write_buffers) {
+        c_frame_buffer_pool::release_buffer(p_buffer);
+    }
+
+    m_free_write_buffers.clear();
+}
+
+
+// ------------------------------------------
+// Keep the timestamp of a frame for the trailer
+// ------------------------------------------
+void c_pipp_ser_write::add_timestamp(
+    uint64_t timestamp)
+{
+    if (m_date_time_utc != 0) {
+        if (m_big_endian_processor) {
+            timestamp = swap_endianess(timestamp);  // timestamp must be in little endian format
+        }
+
+        // Keep timestamp for the trailer written by close()
+        m_timestamps.push_back(timestamp);
+    }
+}
+
+
+// ------------------------------------------
+// Copy the frames waiting to be copied from the source file
+// ------------------------------------------
+void c_pipp_ser_write::copy_pending_frames()
+{
+    if (m_copy_run_frames > 0 && !m_file_write_error) {
+        uint64_t source_offset = C_SER_HEADER_SIZE + (uint64_t)(m_copy_run_start - 1) * m_frame_size;
+        if (!copy_file_data(mp_copy_source_file, source_offset, mp_ser_file, (uint64_t)m_copy_run_frames * m_frame_size)) {
+            m_file_write_error = true;
+        }
+    }
+
+    m_copy_run_frames = 0;
+}
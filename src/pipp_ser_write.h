@@ -1,8 +1,15 @@
 #ifndef PIPP_SER_WRITE_H
 #define PIPP_SER_WRITE_H
 
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <QString>
 
 
@@ -46,18 +53,38 @@ static_assert (sizeof(s_ser_header) == 7 * 4 + 3 * 40 + 2 * 8, "Unexpected size
 
         // Member variables
         FILE *mp_ser_file;
-        std::unique_ptr<char[]> mp_index_filename;
-        FILE *mp_ser_index_file;
+        std::vector<uint64_t> m_timestamps;  // Timestamps for the trailer, already little-endian
         s_ser_header m_header;
         bool m_open;
         int32_t m_width;
         int32_t m_height;
         bool m_colour;
         int32_t m_bytes_per_sample;
+        size_t m_frame_size;
         int64_t m_date_time_utc;
         bool m_file_write_error;
         bool m_big_endian_processor;
 
+        // Background writing, frames are passed to the writer thread in a small set of recycled buffers
+        bool m_background_write;
+        std::thread m_writer_thread;
+        std::mutex m_write_mutex;
+        std::condition_variable m_frame_queued_condition;
+        std::condition_variable m_buffer_free_condition;
+        std::deque<uint8_t *> m_write_queue;
+        std::vector<uint8_t *> m_free_write_buffers;
+        bool m_stop_writer;
+        bool m_background_write_error;
+
+        // Copying frames unchanged from another SER file, contiguous frames are copied in one go
+        FILE *mp_copy_source_file;
+        bool m_copy_frames;
+        int32_t m_copy_colour_id;
+        int32_t m_copy_pixel_depth;
+        int32_t m_copy_little_endian;
+        uint32_t m_copy_run_start;
+        uint32_t m_copy_run_frames;
+
 
     // ------------------------------------------
     // Public definitions
@@ -73,8 +100,7 @@ static_assert (sizeof(s_ser_header) == 7 * 4 + 3 * 40 + 2 * 8, "Unexpected size
         // ------------------------------------------
         // Destructor
         // ------------------------------------------
-        ~c_pipp_ser_write() {
-        }
+        ~c_pipp_ser_write();
 
 
         // ------------------------------------------
@@ -87,21 +113,49 @@ static_assert (sizeof(s_ser_header) == 7 * 4 + 3 * 40 + 2 * 8, "Unexpected size
 
         // ------------------------------------------
         // Create a new SER file
+        // With background_write frames are written to the file by a separate thread
+        // so write_frame() only has to copy the frame.  Errors writing frames are
+        // then not reported by write_frame() but by close().
         // ------------------------------------------
         bool create(
             const QString &filename,
             int32_t  width,
             int32_t  height,
             bool     colour,
-            int32_t  byte_depth);
+            int32_t  byte_depth,
+            bool     background_write = false);
             
 
+        // ------------------------------------------
+        // Create a new SER file that frames are copied into unchanged from another SER file
+        // The frame format in the header is taken from the colour_id, pixel_depth and
+        // little_endian values of the source file.  Add frames with copy_frame().
+        // ------------------------------------------
+        bool create_copy(
+            const QString &filename,
+            const std::string &source_filename,
+            int32_t  width,
+            int32_t  height,
+            int32_t  colour_id,
+            int32_t  pixel_depth,
+            int32_t  little_endian);
+
+
         // ------------------------------------------
         // Write frame to SER file
         // ------------------------------------------
         bool write_frame(
             uint8_t  *data,
             uint64_t timestamp);
+
+
+        // ------------------------------------------
+        // Copy frame from the source file given to create_copy(), frame numbers start at 1
+        // Copying may be deferred so errors can be reported for a later frame or by close()
+        // ------------------------------------------
+        bool copy_frame(
+            uint32_t frame_number,
+            uint64_t timestamp);
             
           
         // ------------------------------------------
@@ -137,6 +191,39 @@ static_assert (sizeof(s_ser_header) == 7 * 4 + 3 * 40 + 2 * 8, "Unexpected size
                 FILE *p_stream);
 
 
+        // ------------------------------------------
+        // Keep the timestamp of a frame for the trailer
+        // ------------------------------------------
+        void add_timestamp(
+                uint64_t timestamp);
+
+
+        // ------------------------------------------
+        // Copy the frames waiting to be copied from the source file
+        // ------------------------------------------
+        void copy_pending_frames();
+
+
+        // ------------------------------------------
+        // Copy frame to buffer, flipping it vertically
+        // ------------------------------------------
+        void flip_frame(
+                const uint8_t *p_data,
+                uint8_t *p_buffer);
+
+
+        // ------------------------------------------
+        // Background writer thread
+        // ------------------------------------------
+        void writer_thread_function();
+
+
+        // ------------------------------------------
+        // Write any queued frames, stop the writer thread and free its buffers
+        // ------------------------------------------
+        void stop_writer_thread();
+
+
         template <typename T>
         static T swap_endianess(T data)
         {
@@ -17,9 +17,11 @@
 
 
 #include <Windows.h>
+#include <io.h>
 #include <cstdio>
 #include <cwchar>
 #include <cstring>
+#include <memory>
 #include <iostream>
 #include "pipp_utf8.h"
 
@@ -217,3 +219,113 @@ const char *pipp_get_filename_from_filepath(
 
     return p_name;
 }
+
+
+// ------------------------------------------
+// map_file_utf8
+// ------------------------------------------
+const uint8_t *map_file_utf8(
+    const std::string &filename,
+    uint64_t &size)
+{
+    size = 0;
+
+    // Convert filename from utf-8 to wchat_t
+    int length = MultiByteToWideChar(CP_UTF8, 0, filename.c_str(), -1, 0, 0);
+    wchar_t *w_fname = new wchar_t[length];
+    MultiByteToWideChar(CP_UTF8, 0, filename.c_str(), -1, w_fname, length);
+
+    HANDLE file_handle = CreateFileW(
+        w_fname,
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL);
+
+    delete [] w_fname;
+
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        // File did not open
+        return nullptr;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart <= 0) {
+        CloseHandle(file_handle);
+        return nullptr;
+    }
+
+    HANDLE mapping_handle = CreateFileMappingW(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_handle == NULL) {
+        CloseHandle(file_handle);
+        return nullptr;
+    }
+
+    void *p_map = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+
+    // The view keeps the mapping alive after both handles are closed
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+
+    if (p_map == NULL) {
+        return nullptr;
+    }
+
+    size = (uint64_t)file_size.QuadPart;
+    return (const uint8_t *)p_map;
+}
+
+
+// ------------------------------------------
+// unmap_file_utf8
+// ------------------------------------------
+void unmap_file_utf8(
+    const uint8_t *p_data,
+    uint64_t size)
+{
+    (void)size;  // Remove unused parameter warning
+    if (p_data != nullptr) {
+        UnmapViewOfFile(p_data);
+    }
+}
+
+
+// ------------------------------------------
+// mapped_file_faulted
+// ------------------------------------------
+bool mapped_file_faulted(
+    const uint8_t *p_data)
+{
+    // Windows does not allow a file with a mapped view to be truncated
+    (void)p_data;  // Remove unused parameter warning
+    return false;
+}
+
+
+// ------------------------------------------
+// copy_file_data
+// ------------------------------------------
+bool copy_file_data(
+    FILE *p_source_file,
+    uint64_t source_offset,
+    FILE *p_dest_file,
+    uint64_t size)
+{
+    // Large blocks so the copy is limited by the disks rather than the number of calls
+    const uint64_t C_BLOCK_SIZE = 8 * 1024 * 1024;
+    std::unique_ptr<uint8_t[]> p_buffer(new uint8_t[(size_t)((size < C_BLOCK_SIZE) ? size : C_BLOCK_SIZE)]);
+
+    int64_t source_position = ftell64(p_source_file);
+    bool ok = fseek64(p_source_file, source_offset, SEEK_SET) == 0;
+    while (ok && size > 0) {
+        size_t block_size = (size_t)((size < C_BLOCK_SIZE) ? size : C_BLOCK_SIZE);
+        ok = fread(p_buffer.get(), 1, block_size, p_source_file) == block_size &&
+             fwrite(p_buffer.get(), 1, block_size, p_dest_file) == block_size;
+        size -= block_size;
+    }
+
+    fseek64(p_source_file, source_position, SEEK_SET);
+    return ok;
+}
@@ -20,6 +20,7 @@
 #define PIPP_UTF8_H
 
 #include <cstdio>
+#include <cstdint>
 #include <string>
 
 FILE *fopen_utf8(
@@ -51,6 +52,32 @@ const char *pipp_get_filename_from_filepath(
     const std::string &path);
 
 
+// Map a whole file read-only into memory, returns nullptr on failure
+const uint8_t *map_file_utf8(
+    const std::string &filename,
+    uint64_t &size);
+
+void unmap_file_utf8(
+    const uint8_t *p_data,
+    uint64_t size);
+
+
+// True if the file has been truncated since it was mapped and a read went past its new end
+// The data read from beyond the end of the file is zeros, the mapping should no longer be used
+bool mapped_file_faulted(
+    const uint8_t *p_data);
+
+
+// Copy size bytes starting at source_offset in one open file to the current position of another
+// Uses the kernel's file copy where it is available, the source file position is unchanged
+// Returns true on success
+bool copy_file_data(
+    FILE *p_source_file,
+    uint64_t source_offset,
+    FILE *p_dest_file,
+    uint64_t size);
+
+
 // 64-bit fseek for various platforms
 #if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
 #include <sys/param.h>        // define or not BSD macro
@@ -19,6 +19,7 @@
 #include <cstdio>
 #include <cwchar>
 #include <cstring>
+#include <memory>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -157,3 +158,29 @@ const char *pipp_get_filename_from_filepath(
     return name;
 }
 
+
+// ------------------------------------------
+// copy_file_data
+// ------------------------------------------
+bool copy_file_data(
+    FILE *p_source_file,
+    uint64_t source_offset,
+    FILE *p_dest_file,
+    uint64_t size)
+{
+    // Large blocks so the copy is limited by the disks rather than the number of calls
+    const uint64_t C_BLOCK_SIZE = 8 * 1024 * 1024;
+    std::unique_ptr<uint8_t[]> p_buffer(new uint8_t[(size_t)((size < C_BLOCK_SIZE) ? size : C_BLOCK_SIZE)]);
+
+    int64_t source_position = ftell64(p_source_file);
+    bool ok = fseek64(p_source_file, source_offset, SEEK_SET) == 0;
+    while (ok && size > 0) {
+        size_t block_size = (size_t)((size < C_BLOCK_SIZE) ? size : C_BLOCK_SIZE);
+        ok = fread(p_buffer.get(), 1, block_size, p_source_file) == block_size &&
+             fwrite(p_buffer.get(), 1, block_size, p_dest_file) == block_size;
+        size -= block_size;
+    }
+
+    fseek64(p_source_file, source_position, SEEK_SET);
+    return ok;
+}
@@ -19,6 +19,7 @@
 #include <cstdio>
 #include <cwchar>
 #include <cstring>
+#include <memory>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/sendfile.h>
@@ -154,3 +155,87 @@ const char *pipp_get_filename_from_filepath(
     return name;
 }
 
+
+// ------------------------------------------
+// copy_file_data with fread() and fwrite(), for when the kernel cannot copy between the files
+// ------------------------------------------
+static bool copy_file_data_buffered(
+    FILE *p_source_file,
+    uint64_t source_offset,
+    FILE *p_dest_file,
+    uint64_t size)
+{
+    // Large blocks so the copy is limited by the disks rather than the number of calls
+    const uint64_t C_BLOCK_SIZE = 8 * 1024 * 1024;
+    std::unique_ptr<uint8_t[]> p_buffer(new uint8_t[(size_t)((size < C_BLOCK_SIZE) ? size : C_BLOCK_SIZE)]);
+
+    int64_t source_position = ftell64(p_source_file);
+    bool ok = fseek64(p_source_file, source_offset, SEEK_SET) == 0;
+    while (ok && size > 0) {
+        size_t block_size = (size_t)((size < C_BLOCK_SIZE) ? size : C_BLOCK_SIZE);
+        ok = fread(p_buffer.get(), 1, block_size, p_source_file) == block_size &&
+             fwrite(p_buffer.get(), 1, block_size, p_dest_file) == block_size;
+        size -= block_size;
+    }
+
+    fseek64(p_source_file, source_position, SEEK_SET);
+    return ok;
+}
+
+
+// ------------------------------------------
+// copy_file_data
+// ------------------------------------------
+bool copy_file_data(
+    FILE *p_source_file,
+    uint64_t source_offset,
+    FILE *p_dest_file,
+    uint64_t size)
+{
+    // Write out anything buffered so the file descriptor is in step with the stream
+    if (fflush(p_dest_file) != 0) {
+        return false;
+    }
+
+    int source_fd = fileno(p_source_file);
+    int dest_fd = fileno(p_dest_file);
+    off64_t source_position = (off64_t)source_offset;
+    off64_t dest_position = ftell64(p_dest_file);
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    // copy_file_range() can share blocks or copy on the storage side, but older kernels
+    // and some filesystems do not support it between these two files
+    while (size > 0) {
+        ssize_t copied = copy_file_range(source_fd, &source_position, dest_fd, &dest_position, size, 0);
+        if (copied <= 0) {
+            break;
+        }
+
+        size -= copied;
+    }
+#endif
+
+    // sendfile() still avoids copying the data through user space, it writes at the file position of dest_fd
+    if (size > 0 && lseek64(dest_fd, dest_position, SEEK_SET) == dest_position) {
+        while (size > 0) {
+            ssize_t copied = sendfile64(dest_fd, source_fd, &source_position, size);
+            if (copied <= 0) {
+                break;
+            }
+
+            dest_position += copied;
+            size -= copied;
+        }
+    }
+
+    // Put the stream at the end of the copied data
+    if (fseek64(p_dest_file, dest_position, SEEK_SET) != 0) {
+        return false;
+    }
+
+    if (size > 0) {
+        return copy_file_data_buffered(p_source_file, (uint64_t)source_position, p_dest_file, size);
+    }
+
+    return true;
+}
@@ -0,0 +1,195 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+//
+// File mapping shared by the Linux, BSD and OS X versions of pipp_utf8_XXX.cpp
+//
+// Reading a mapped page beyond the end of a file that has been truncated since it was
+// mapped raises SIGBUS.  Rather than checking the file size before every read, a SIGBUS
+// handler replaces the faulting page with a page of zeros and marks the mapping as
+// faulted, the reader then checks mapped_file_faulted() and stops using the mapping.
+//
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <mutex>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "pipp_utf8.h"
+
+
+// Mappings that can be open at the same time, further files are not mapped and are read with fread()
+static const int C_MAX_MAPPINGS = 32;
+
+// Mapped address ranges, read by the SIGBUS handler so only lock-free atomics are used
+struct s_mapping {
+    std::atomic<uintptr_t> start;  // 0 if this entry is free
+    std::atomic<uintptr_t> end;
+    std::atomic<bool> faulted;
+};
+
+static s_mapping g_mappings[C_MAX_MAPPINGS];
+static uintptr_t g_page_size;
+static struct sigaction g_previous_sigbus_action;
+
+
+// ------------------------------------------
+// SIGBUS handler for reads beyond the end of a truncated mapped file
+// ------------------------------------------
+static void sigbus_handler(
+    int signal_number,
+    siginfo_t *p_info,
+    void *p_context)
+{
+    uintptr_t address = (uintptr_t)p_info->si_addr;
+    for (int i = 0; i < C_MAX_MAPPINGS; i++) {
+        uintptr_t start = g_mappings[i].start.load();
+        if (start != 0 && address >= start && address < g_mappings[i].end.load()) {
+            // Replace the page with zeros so the read can complete
+            void *p_page = (void *)(address & ~(g_page_size - 1));
+            if (mmap(p_page, g_page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+                g_mappings[i].faulted.store(true);
+                return;
+            }
+        }
+    }
+
+    // Not a mapped file read, pass the signal on to the previous action
+    if (g_previous_sigbus_action.sa_flags & SA_SIGINFO) {
+        g_previous_sigbus_action.sa_sigaction(signal_number, p_info, p_context);
+    } else {
+        sigaction(SIGBUS, &g_previous_sigbus_action, nullptr);
+        raise(signal_number);
+    }
+}
+
+
+// ------------------------------------------
+// Install the SIGBUS handler the first time a file is mapped
+// ------------------------------------------
+static void install_sigbus_handler()
+{
+    static std::once_flag installed;
+    std::call_once(installed, []() {
+        g_page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+
+        struct sigaction action;
+        action.sa_sigaction = sigbus_handler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigaction(SIGBUS, &action, &g_previous_sigbus_action);
+    });
+}
+
+
+// ------------------------------------------
+// map_file_utf8
+// ------------------------------------------
+const uint8_t *map_file_utf8(
+    const std::string &filename,
+    uint64_t &size)
+{
+    size = 0;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        // File did not open
+        return nullptr;
+    }
+
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0 || stat_buf.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void *p_map = mmap(nullptr, (size_t)stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping stays valid after the file descriptor is closed
+    close(fd);
+
+    if (p_map == MAP_FAILED) {
+        return nullptr;
+    }
+
+    // Register the mapping with the SIGBUS handler, do not use the mapping if there is no free entry
+    install_sigbus_handler();
+    int i = 0;
+    for (; i < C_MAX_MAPPINGS; i++) {
+        // end is 0 in free entries so the handler ignores an entry until end is set
+        uintptr_t free_entry = 0;
+        if (g_mappings[i].start.compare_exchange_strong(free_entry, (uintptr_t)p_map)) {
+            g_mappings[i].faulted.store(false);
+            g_mappings[i].end.store((uintptr_t)p_map + (uintptr_t)stat_buf.st_size);
+            break;
+        }
+    }
+
+    if (i == C_MAX_MAPPINGS) {
+        munmap(p_map, (size_t)stat_buf.st_size);
+        return nullptr;
+    }
+
+    // Frames are mostly read in order during playback
+    madvise(p_map, (size_t)stat_buf.st_size, MADV_SEQUENTIAL);
+
+    size = (uint64_t)stat_buf.st_size;
+    return (const uint8_t *)p_map;
+}
+
+
+// ------------------------------------------
+// unmap_file_utf8
+// ------------------------------------------
+void unmap_file_utf8(
+    const uint8_t *p_data,
+    uint64_t size)
+{
+    if (p_data != nullptr) {
+        for (int i = 0; i < C_MAX_MAPPINGS; i++) {
+            if (g_mappings[i].start.load() == (uintptr_t)p_data) {
+                g_mappings[i].end.store(0);
+                g_mappings[i].start.store(0);
+                break;
+            }
+        }
+
+        munmap((void *)p_data, (size_t)size);
+    }
+}
+
+
+// ------------------------------------------
+// mapped_file_faulted
+// ------------------------------------------
+bool mapped_file_faulted(
+    const uint8_t *p_data)
+{
+    for (int i = 0; i < C_MAX_MAPPINGS; i++) {
+        if (g_mappings[i].start.load() == (uintptr_t)p_data) {
+            return g_mappings[i].faulted.load();
+        }
+    }
+
+    return false;
+}
@@ -25,6 +25,7 @@
 #include <QPushButton>
 #include <QTimer>
 #include <QMouseEvent>
+#include <QSignalBlocker>
 #include <QDebug>
 
 #include "playback_controls_widget.h"
@@ -46,6 +47,7 @@ c_playback_controls_widget::c_playback_controls_widget(QWidget *parent)
     m_back_button_held = false;
     m_forward_button_held = false;
     m_current_state = STATE_NO_FILE;
+    m_fps = 0;
     
     mp_frame_Slider = new c_frame_slider(this);
     mp_frame_Slider->set_maximum_frame(99);
@@ -122,7 +124,9 @@ c_playback_controls_widget::c_playback_controls_widget(QWidget *parent)
     mp_fps_Label = new QLabel;
     m_fps_label_String = tr("%1 FPS", "Framerate label");
     mp_fps_Label->setText(m_fps_label_String.arg("--"));
-    mp_fps_Label->setToolTip(tr("Display Frame rate", "Tool tip"));
+    m_achieved_fps_label_String = tr("%1/%2 FPS", "Achieved/selected framerate label");
+    m_fps_tooltip_String = tr("Display Frame rate", "Tool tip");
+    mp_fps_Label->setToolTip(m_fps_tooltip_String);
 
     mp_colour_id_Label = new QLabel;
     mp_colour_id_Label->setText("----");
@@ -285,9 +289,21 @@ void c_playback_controls_widget::goto_first_frame()
 }
 
 
-bool c_playback_controls_widget::goto_next_frame()
+bool c_playback_controls_widget::goto_next_frame(int skip_count)
 {
-    bool ret = mp_frame_Slider->goto_next_frame();
+    bool ret = true;
+    if (skip_count > 0) {
+        // Move past the skipped frames without displaying them
+        QSignalBlocker slider_blocker(mp_frame_Slider);
+        for (int skip = 0; skip < skip_count && ret; skip++) {
+            ret = mp_frame_Slider->goto_next_frame();
+        }
+    }
+
+    if (ret) {
+        ret = mp_frame_Slider->goto_next_frame();
+    }
+
     if (!ret) {
         emit stop_playing_signal();
         m_current_state = STATE_FINISHED;
@@ -309,6 +325,12 @@ int c_playback_controls_widget::get_end_frame()
 }
 
 
+QVector<int> c_playback_controls_widget::get_upcoming_frames(int count)
+{
+    return mp_frame_Slider->get_upcoming_frames(count);
+}
+
+
 void c_playback_controls_widget::show_markers_dialog(bool show)
 {
     return mp_frame_Slider->show_markers_dialog(show);
@@ -633,7 +655,16 @@ void c_playback_controls_widget::update_zoom_label_slot(int zoom)
 
 void c_playback_controls_widget::update_fps_label(int fps)
 {
+    m_fps = fps;
     mp_fps_Label->setText(m_fps_label_String.arg(fps));
+    mp_fps_Label->setToolTip(m_fps_tooltip_String);
+}
+
+
+void c_playback_controls_widget::update_playback_stats(double achieved_fps, const QString &details)
+{
+    mp_fps_Label->setText(m_achieved_fps_label_String.arg(achieved_fps, 0, 'f', 1).arg(m_fps));
+    mp_fps_Label->setToolTip(m_fps_tooltip_String + "\n" + details);
 }
 
 
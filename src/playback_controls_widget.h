@@ -20,6 +20,7 @@
 #define PLAYBACK_CONTROLS_WIDGET_H
 
 #include <QWidget>
+#include <QVector>
 #include <cstdint>
 
 class QLabel;
@@ -41,9 +42,10 @@ public:
     bool get_markers_enable();
     void set_repeat(bool repeat);
     void goto_first_frame();
-    bool goto_next_frame();
+    bool goto_next_frame(int skip_count = 0);
     int get_start_frame();
     int get_end_frame();
+    QVector<int> get_upcoming_frames(int count);
     bool is_playing();
     void reset_labels();
     void update_framecount_label(int count, int maxcount);
@@ -51,6 +53,7 @@ public:
     void update_pixel_depth_label(int depth);
     void update_frame_size_label(int width, int height);
     void update_fps_label(int fps);
+    void update_playback_stats(double achieved_fps, const QString &details);
     void update_timestamp_label(uint64_t timestamp);
 
 signals:
@@ -117,6 +120,9 @@ private:
     QLabel *mp_pixel_depth_Label;
     QLabel *mp_colour_id_Label;
     QString m_fps_label_String;
+    QString m_achieved_fps_label_String;
+    QString m_fps_tooltip_String;
+    int m_fps;
     QLabel *mp_fps_Label;
     QString m_framecount_label_String;
     QLabel *mp_framecount_Label;
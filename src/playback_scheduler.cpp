@@ -0,0 +1,219 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#include <algorithm>
+
+#include "playback_scheduler.h"
+
+
+// Number of recent frames used for the achieved framerate
+static const int C_FPS_WINDOW_FRAMES = 64;
+
+// Number of recent samples kept for each stage
+static const int C_STAGE_SAMPLE_COUNT = 256;
+
+// Minimum time between statistics updates
+static const qint64 C_STATS_UPDATE_PERIOD_MS = 1000;
+
+
+// ------------------------------------------
+// Constructor
+// ------------------------------------------
+c_playback_scheduler::c_playback_scheduler()
+    : m_drop_frames(false),
+      m_next_deadline(0.0),
+      m_target_frame_time(0.0),
+      m_displayed_frames(0),
+      m_dropped_frames(0),
+      m_late_frames(0),
+      m_last_stats_update(0),
+      m_display_times_pos(0)
+{
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        m_stage_times_pos[stage] = 0;
+    }
+
+    m_clock.start();
+}
+
+
+// ------------------------------------------
+// Start timing playback
+// ------------------------------------------
+void c_playback_scheduler::start(
+        double next_interval_ms)
+{
+    m_clock.restart();
+    m_next_deadline = next_interval_ms;
+    m_target_frame_time = next_interval_ms;
+    m_displayed_frames = 0;
+    m_dropped_frames = 0;
+    m_late_frames = 0;
+    m_last_stats_update = 0;
+    m_display_times.clear();
+    m_display_times.push_back(0.0);
+    m_display_times_pos = 0;
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        m_stage_times[stage].clear();
+        m_stage_times_pos[stage] = 0;
+    }
+}
+
+
+// ------------------------------------------
+// Time until next frame is due
+// ------------------------------------------
+double c_playback_scheduler::get_time_to_deadline() const
+{
+    return m_next_deadline - m_clock.nsecsElapsed() / 1000000.0;
+}
+
+
+// ------------------------------------------
+// Check if the next frame should be dropped
+// ------------------------------------------
+bool c_playback_scheduler::is_next_frame_stale(
+        double following_interval_ms) const
+{
+    if (!m_drop_frames) {
+        return false;
+    }
+
+    return get_time_to_deadline() + following_interval_ms <= 0.0;
+}
+
+
+// ------------------------------------------
+// Next frame was skipped
+// ------------------------------------------
+void c_playback_scheduler::frame_dropped(
+        double following_interval_ms)
+{
+    m_dropped_frames++;
+    m_next_deadline += following_interval_ms;
+}
+
+
+// ------------------------------------------
+// Next frame has been displayed
+// ------------------------------------------
+void c_playback_scheduler::frame_displayed(
+        double next_interval_ms)
+{
+    double now = m_clock.nsecsElapsed() / 1000000.0;
+
+    // Allow a little slack for timer granularity before calling a frame late
+    if (now > m_next_deadline + 2.0) {
+        if (!m_drop_frames) {
+            m_late_frames++;
+        }
+    }
+
+    m_displayed_frames++;
+    m_target_frame_time += (next_interval_ms - m_target_frame_time) / 16.0;
+    m_next_deadline += next_interval_ms;
+    if (!m_drop_frames && m_next_deadline < now) {
+        // Slow down rather than rushing through frames to catch up
+        m_next_deadline = now;
+    }
+
+    if ((int)m_display_times.size() < C_FPS_WINDOW_FRAMES) {
+        m_display_times.push_back(now);
+    } else {
+        m_display_times[m_display_times_pos] = now;
+        m_display_times_pos = (m_display_times_pos + 1) % C_FPS_WINDOW_FRAMES;
+    }
+}
+
+
+// ------------------------------------------
+// Record time taken by a stage
+// ------------------------------------------
+void c_playback_scheduler::add_stage_time(
+        e_stage stage,
+        double time_ms)
+{
+    std::vector<double> &times = m_stage_times[stage];
+    if ((int)times.size() < C_STAGE_SAMPLE_COUNT) {
+        times.push_back(time_ms);
+    } else {
+        times[m_stage_times_pos[stage]] = time_ms;
+        m_stage_times_pos[stage] = (m_stage_times_pos[stage] + 1) % C_STAGE_SAMPLE_COUNT;
+    }
+}
+
+
+// ------------------------------------------
+// Check if statistics should be refreshed
+// ------------------------------------------
+bool c_playback_scheduler::stats_update_due()
+{
+    qint64 now = m_clock.elapsed();
+    if (now - m_last_stats_update < C_STATS_UPDATE_PERIOD_MS) {
+        return false;
+    }
+
+    m_last_stats_update = now;
+    return true;
+}
+
+
+// ------------------------------------------
+// Get playback statistics
+// ------------------------------------------
+c_playback_scheduler::s_stats c_playback_scheduler::get_stats() const
+{
+    s_stats stats;
+    stats.displayed_frames = m_displayed_frames;
+    stats.dropped_frames = m_dropped_frames;
+    stats.late_frames = m_late_frames;
+    stats.target_fps = (m_target_frame_time > 0.0) ? 1000.0 / m_target_frame_time : 0.0;
+
+    // Achieved framerate from the oldest and newest display times in the window
+    stats.achieved_fps = 0.0;
+    int time_count = (int)m_display_times.size();
+    if (time_count > 1) {
+        int oldest = (time_count < C_FPS_WINDOW_FRAMES) ? 0 : m_display_times_pos;
+        int newest = (oldest + time_count - 1) % time_count;
+        double period = m_display_times[newest] - m_display_times[oldest];
+        if (period > 0.0) {
+            stats.achieved_fps = (1000.0 * (time_count - 1)) / period;
+        }
+    }
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        s_stage_stats &stage_stats = stats.stages[stage];
+        std::vector<double> times = m_stage_times[stage];
+        stage_stats.sample_count = (int)times.size();
+        if (times.empty()) {
+            stage_stats.p50_ms = 0.0;
+            stage_stats.p90_ms = 0.0;
+            stage_stats.p99_ms = 0.0;
+            stage_stats.max_ms = 0.0;
+        } else {
+            std::sort(times.begin(), times.end());
+            int last = (int)times.size() - 1;
+            stage_stats.p50_ms = times[(last * 50) / 100];
+            stage_stats.p90_ms = times[(last * 90) / 100];
+            stage_stats.p99_ms = times[(last * 99) / 100];
+            stage_stats.max_ms = times[last];
+        }
+    }
+
+    return stats;
+}
@@ -0,0 +1,121 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#ifndef PLAYBACK_SCHEDULER_H
+#define PLAYBACK_SCHEDULER_H
+
+#include <QElapsedTimer>
+#include <cstdint>
+#include <vector>
+
+
+//
+// Keeps track of when each frame should be displayed during playback
+// Deadlines are measured from the start of playback so time spent reading, processing
+// and displaying frames does not make the playback rate drift.  When playback falls
+// behind, frames are either dropped to keep to real speed or playback slows down.
+// Also collects statistics on the achieved framerate and how long each stage of
+// getting a frame onto the screen takes.
+//
+class c_playback_scheduler
+{
+public:
+    enum e_stage {
+        STAGE_READ = 0,  // Reading frame from the cache or file, on the GUI thread or a pipeline worker
+        STAGE_PROCESS,  // Processing frame, on the GUI thread or a pipeline worker
+        STAGE_HANDOFF,  // Taking a processed frame from the pipeline
+        STAGE_DISPLAY,  // Drawing frame in the image widget
+        STAGE_COUNT};
+
+    struct s_stage_stats {
+        int sample_count;
+        double p50_ms;
+        double p90_ms;
+        double p99_ms;
+        double max_ms;
+    };
+
+    struct s_stats {
+        double achieved_fps;  // Over the last second or so of playback
+        double target_fps;
+        uint64_t displayed_frames;
+        uint64_t dropped_frames;
+        uint64_t late_frames;  // Frames displayed after their deadline when not dropping frames
+        s_stage_stats stages[STAGE_COUNT];
+    };
+
+    // Constructor
+    c_playback_scheduler();
+
+    // Drop frames when behind rather than slowing playback down
+    void set_drop_frames(bool drop_frames)
+    {
+        m_drop_frames = drop_frames;
+    }
+
+    bool get_drop_frames() const
+    {
+        return m_drop_frames;
+    }
+
+    // Start timing playback, the current frame is treated as displayed now
+    // next_interval_ms is the time until the next frame should be displayed
+    void start(double next_interval_ms);
+
+    // Time in ms until the next frame should be displayed, negative if it is late
+    double get_time_to_deadline() const;
+
+    // Check whether the frame after the next one is already due, in which case the
+    // next frame should be dropped.  Always false when not dropping frames
+    bool is_next_frame_stale(double following_interval_ms) const;
+
+    // Record that the next frame was skipped
+    void frame_dropped(double following_interval_ms);
+
+    // Record that the next frame has been displayed
+    void frame_displayed(double next_interval_ms);
+
+    // Record time taken by one stage of getting a frame displayed
+    void add_stage_time(e_stage stage, double time_ms);
+
+    // Returns true at most once a second while playing, when the statistics should be refreshed
+    bool stats_update_due();
+
+    s_stats get_stats() const;
+
+
+private:
+    bool m_drop_frames;
+    QElapsedTimer m_clock;
+    double m_next_deadline;  // ms since start of playback
+    double m_target_frame_time;  // Average of requested intervals, ms
+    uint64_t m_displayed_frames;
+    uint64_t m_dropped_frames;
+    uint64_t m_late_frames;
+    qint64 m_last_stats_update;
+
+    // Display times of recent frames for calculating the achieved framerate
+    std::vector<double> m_display_times;
+    int m_display_times_pos;
+
+    // Ring buffers of recent stage times
+    std::vector<double> m_stage_times[STAGE_COUNT];
+    int m_stage_times_pos[STAGE_COUNT];
+};
+
+#endif // PLAYBACK_SCHEDULER_H
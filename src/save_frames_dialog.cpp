@@ -492,11 +492,17 @@ c_save_frames_dialog::c_save_frames_dialog(QWidget *parent,
     avi_old_format_HLayout->addWidget(mp_avi_max_size_Combox);
     avi_old_format_HLayout->addStretch();
 
+    mp_avi_lossless_compression_CBox = new QCheckBox(tr("Lossless Compression (ZLIB)", "Save frames dialog"));
+    mp_avi_lossless_compression_CBox->setToolTip(tr("Compress frames with the lossless ZLIB codec to create "
+                                                    "a much smaller AVI file.  Frames are stored as 8-bit RGB, "
+                                                    "the player used to view the file must support the ZLIB codec.") + "<b></b>");
+
     QVBoxLayout *avi_file_options_VLayout = new QVBoxLayout;
     avi_file_options_VLayout->setMargin(INSIDE_GBOX_MARGIN);
     avi_file_options_VLayout->setSpacing(INSIDE_GBOX_SPACING);
     avi_file_options_VLayout->addLayout(avi_framerate_HLayout);
     avi_file_options_VLayout->addLayout(avi_old_format_HLayout);
+    avi_file_options_VLayout->addWidget(mp_avi_lossless_compression_CBox);
     QGroupBox *avi_file_options_GBox = new QGroupBox(tr("AVI File Options", "Save frames dialog"));
     avi_file_options_GBox->setLayout(avi_file_options_VLayout);
     if (save_type != SAVE_AVI) {
@@ -535,6 +541,19 @@ c_save_frames_dialog::c_save_frames_dialog(QWidget *parent,
     mp_gif_colour_quantisation_type_ComboBox = new QComboBox;
     mp_gif_colour_quantisation_type_ComboBox->addItem(tr("Neural-Net Quantisation"));
     mp_gif_colour_quantisation_type_ComboBox->addItem(tr("Median Cut Quantisation"));
+    mp_gif_colour_quantisation_type_ComboBox->addItem(tr("Neural-Net Quantisation (Fast)"));
+    mp_gif_colour_quantisation_type_ComboBox->setToolTip(tr("Fast neural-net quantisation learns from fewer pixels and "
+                                                             "starts each frame from an earlier frame's colours, "
+                                                             "it is much quicker but colours may be slightly less accurate"));
+
+    // Items are in c_gif_write::e_palette_mode order
+    mp_gif_palette_mode_Label = new QLabel(tr("Colour Table:"));
+    mp_gif_palette_mode_ComboBox = new QComboBox;
+    mp_gif_palette_mode_ComboBox->addItem(tr("Per Frame", "GIF colour table option"));
+    mp_gif_palette_mode_ComboBox->addItem(tr("Global (From Sample Frames)", "GIF colour table option"));
+    mp_gif_palette_mode_ComboBox->addItem(tr("Adaptive (Update When Colours Change)", "GIF colour table option"));
+    mp_gif_palette_mode_ComboBox->setToolTip(tr("A global colour table is much faster to create and makes smaller files, "
+                                                "but may not suit every frame if the colours change a lot"));
 
     QPushButton *p_gif_test_options_PButton = new QPushButton(tr("Review Animated GIF In Browser"));
     connect(p_gif_test_options_PButton,
@@ -542,6 +561,27 @@ c_save_frames_dialog::c_save_frames_dialog(QWidget *parent,
             this,
             SLOT(gif_test_options_button_pressed_slot()));
 
+    mp_gif_quick_review_CBox = new QCheckBox(tr("Quick Review (Sample Frames Only)"));
+    mp_gif_quick_review_CBox->setToolTip(tr("Only encode the first, middle and last frames and a short burst of consecutive frames, "
+                                            "the file size and save time are estimated from these frames"));
+    mp_gif_quick_review_CBox->setChecked(true);
+
+    mp_gif_keep_review_frames_CBox = new QCheckBox(tr("Keep Processed Frames Between Reviews"));
+    mp_gif_keep_review_frames_CBox->setToolTip(tr("Frames are only read and processed once while reviewing, "
+                                                  "repeat reviews with different GIF options start encoding straight away"));
+    mp_gif_keep_review_frames_CBox->setChecked(true);
+    connect(mp_gif_quick_review_CBox,
+            SIGNAL(toggled(bool)),
+            mp_gif_keep_review_frames_CBox,
+            SLOT(setEnabled(bool)));
+
+    QHBoxLayout *gif_review_options_HLayout = new QHBoxLayout;
+    gif_review_options_HLayout->setMargin(0);
+    gif_review_options_HLayout->setSpacing(10);
+    gif_review_options_HLayout->addWidget(mp_gif_quick_review_CBox);
+    gif_review_options_HLayout->addWidget(mp_gif_keep_review_frames_CBox);
+    gif_review_options_HLayout->addStretch();
+
     QGridLayout *gif_file_options_FLayout = new QGridLayout;
     gif_file_options_FLayout->setHorizontalSpacing(10);
     gif_file_options_FLayout->setVerticalSpacing(5);
@@ -551,8 +591,10 @@ c_save_frames_dialog::c_save_frames_dialog(QWidget *parent,
     gif_file_options_FLayout->addWidget(mp_gif_final_frame_delay_DSpinBox, 1, 1);
     gif_file_options_FLayout->addWidget(mp_gif_colour_quantisation_type_Label, 2, 0);
     gif_file_options_FLayout->addWidget(mp_gif_colour_quantisation_type_ComboBox, 2, 1);
-    gif_file_options_FLayout->addWidget(new QLabel(tr("Preset Advanced Options:")), 3, 0);
-    gif_file_options_FLayout->addWidget(mp_gif_preset_options_ComboBox, 3, 1);
+    gif_file_options_FLayout->addWidget(mp_gif_palette_mode_Label, 3, 0);
+    gif_file_options_FLayout->addWidget(mp_gif_palette_mode_ComboBox, 3, 1);
+    gif_file_options_FLayout->addWidget(new QLabel(tr("Preset Advanced Options:")), 4, 0);
+    gif_file_options_FLayout->addWidget(mp_gif_preset_options_ComboBox, 4, 1);
 
     QHBoxLayout *gif_file_options_HLayout = new QHBoxLayout;
     gif_file_options_HLayout->setMargin(0);
@@ -623,6 +665,7 @@ c_save_frames_dialog::c_save_frames_dialog(QWidget *parent,
     gif_file_options_VLayout->setSpacing(INSIDE_GBOX_SPACING);
     gif_file_options_VLayout->addLayout(gif_file_options_HLayout);
     gif_file_options_VLayout->addWidget(gif_advanced_options_GBox);
+    gif_file_options_VLayout->addLayout(gif_review_options_HLayout);
     gif_file_options_VLayout->addWidget(p_gif_test_options_PButton);
 
     QGroupBox *gif_file_options_GBox = new QGroupBox(tr("Animated GIF Options", "Save frames dialog"));
@@ -949,9 +992,13 @@ void c_save_frames_dialog::colour_updated()
         (!mp_processing_enable_CBox->isChecked() && m_is_colour_raw)) {
         mp_gif_colour_quantisation_type_Label->show();
         mp_gif_colour_quantisation_type_ComboBox->show();
+        mp_gif_palette_mode_Label->show();
+        mp_gif_palette_mode_ComboBox->show();
     } else {
         mp_gif_colour_quantisation_type_Label->hide();
         mp_gif_colour_quantisation_type_ComboBox->hide();
+        mp_gif_palette_mode_Label->hide();
+        mp_gif_palette_mode_ComboBox->hide();
     }
 }
 
@@ -1377,7 +1424,15 @@ int c_save_frames_dialog::get_gif_transparent_pixel_tolerance()
 
 int c_save_frames_dialog::get_gif_colour_quantisation_type()
 {
-    return mp_gif_colour_quantisation_type_ComboBox->currentIndex();
+    // Fast neural-net quantisation is the same type with different options
+    int index = mp_gif_colour_quantisation_type_ComboBox->currentIndex();
+    return (index == 2) ? 0 : index;
+}
+
+
+bool c_save_frames_dialog::get_gif_neuquant_fast()
+{
+    return mp_gif_colour_quantisation_type_ComboBox->currentIndex() == 2;
 }
 
 
@@ -1387,6 +1442,30 @@ QString c_save_frames_dialog::get_gif_colour_quantisation_name()
 }
 
 
+int c_save_frames_dialog::get_gif_palette_mode()
+{
+    return mp_gif_palette_mode_ComboBox->currentIndex();
+}
+
+
+QString c_save_frames_dialog::get_gif_palette_mode_name()
+{
+    return mp_gif_palette_mode_ComboBox->currentText();
+}
+
+
+bool c_save_frames_dialog::get_gif_quick_review()
+{
+    return mp_gif_quick_review_CBox->isChecked();
+}
+
+
+bool c_save_frames_dialog::get_gif_keep_review_frames()
+{
+    return mp_gif_quick_review_CBox->isChecked() && mp_gif_keep_review_frames_CBox->isChecked();
+}
+
+
 int c_save_frames_dialog::get_gif_pixel_bit_depth()
 {
     int pixel_depth = 8;
@@ -1543,3 +1622,8 @@ int c_save_frames_dialog::get_avi_max_size()
 {
     return mp_avi_max_size_Combox->currentData().toInt();
 }
+
+bool c_save_frames_dialog::get_avi_lossless_compression()
+{
+    return mp_avi_lossless_compression_CBox->isChecked();
+}
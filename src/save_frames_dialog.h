@@ -77,8 +77,13 @@ public:
     int get_gif_transparent_pixel_tolerance();
     int get_gif_colour_quantisation_type();
     QString get_gif_colour_quantisation_name();
+    bool get_gif_neuquant_fast();
+    int get_gif_palette_mode();
+    QString get_gif_palette_mode_name();
     int get_gif_pixel_bit_depth();
     int get_gif_lossy_compression_level();
+    bool get_gif_quick_review();
+    bool get_gif_keep_review_frames();
     bool get_gif_test_run()
     {
         return m_test_run;
@@ -110,6 +115,7 @@ public:
     double get_avi_framerate();
     bool get_avi_old_format();
     int get_avi_max_size();
+    bool get_avi_lossless_compression();
 
     // Last save directory
     void set_last_save_directory(QString dir)
@@ -189,6 +195,7 @@ private:
     // AVI Options
     QCheckBox *mp_avi_old_format_CBox;
     QComboBox *mp_avi_max_size_Combox;
+    QCheckBox *mp_avi_lossless_compression_CBox;
     QDoubleSpinBox *mp_avi_framerate_DSpinbox;
 
     // Animated GIF options
@@ -196,6 +203,8 @@ private:
     QDoubleSpinBox *mp_gif_final_frame_delay_DSpinBox;
     QLabel *mp_gif_colour_quantisation_type_Label;
     QComboBox *mp_gif_colour_quantisation_type_ComboBox;
+    QLabel *mp_gif_palette_mode_Label;
+    QComboBox *mp_gif_palette_mode_ComboBox;
     QComboBox *mp_gif_preset_options_ComboBox;
     QCheckBox *mp_gif_unchanged_border_tolerance_CBox;
     QSpinBox *mp_gif_unchanged_border_tolerance_SpinBox;
@@ -205,6 +214,8 @@ private:
     QSpinBox *mp_gif_lossy_compression_level_SpinBox;
     QCheckBox *mp_gif_reduce_pixel_depth_CBox;
     QSpinBox *mp_gif_reduce_pixel_depth_SpinBox;
+    QCheckBox *mp_gif_quick_review_CBox;
+    QCheckBox *mp_gif_keep_review_frames_CBox;
 
 
     QLabel *mp_total_frames_to_save_Label;
@@ -23,8 +23,10 @@
 #include <QDesktopServices>
 #include <QDesktopWidget>
 #include <QDragEnterEvent>
+#include <QElapsedTimer>
 #include <QFileDialog>
 #include <QFuture>
+#include <QHash>
 #include <QImage>
 #include <QImageWriter>
 #include <QLabel>
@@ -37,9 +39,11 @@
 #include <QPushButton>
 #include <QSpinBox>
 #include <QTemporaryFile>
+#include <QtConcurrent>
 #include <QThread>
 #include <QTimer>
 #include <QUrl>
+#include <QVector>
 #include <QWidgetAction>
 
 #include <cmath>
@@ -50,6 +54,10 @@
 #include "tiff_write.h"
 #include "png_write.h"
 #include "histogram_thread.h"
+#include "frame_cache.h"
+#include "frame_pipeline.h"
+#include "frame_buffer_pool.h"
+#include "playback_scheduler.h"
 #include "histogram_dialog.h"
 #include "image.h"
 #include "ser_player.h"
@@ -57,6 +65,7 @@
 #include "pipp_timestamp.h"
 #include "pipp_ser.h"
 #include "pipp_avi_write_dib.h"
+#include "pipp_avi_write_zlib.h"
 #include "pipp_ser_write.h"
 #include "pipp_utf8.h"
 #include "image_widget.h"
@@ -73,6 +82,30 @@
 
 const QString c_ser_player::C_WINDOW_TITLE_QSTRING = QString("SER Player");
 
+// Most frames that will be dropped in one go when playback has fallen behind
+static const int C_MAX_DROPPED_FRAMES = 16;
+
+// Frames spread across the selected range that a global GIF colour table is made from
+static const int C_GIF_PALETTE_SAMPLE_FRAMES = 8;
+
+// NeuQuant sample factor used by fast neural-net GIF colour quantisation
+static const int C_GIF_NEUQUANT_FAST_SAMPLE_FACTOR = 10;
+
+// Limits on the number of frames processed at the same time when saving an AVI file
+static const int C_AVI_MIN_FRAMES_IN_FLIGHT = 2;
+static const int C_AVI_MAX_FRAMES_IN_FLIGHT = 16;
+
+// Consecutive frames from the middle of the range encoded by a quick GIF review
+static const int C_GIF_REVIEW_BURST_FRAMES = 10;
+
+// A frame ready for the GIF writer, kept between GIF reviews
+struct s_gif_review_frame {
+    QByteArray data;  // Frame data after conv_data_ready_for_gif()
+    int byte_depth;
+    bool colour;
+    qint64 processing_time;  // Nanoseconds taken to read and process the frame
+};
+
 // These phrases are not used in the application but are included so that translations are available for the debian appdata XML file
 const QString c_ser_player::C_DEBIAN_XML_TEXT1 = tr("SER Player is a video player for playing SER files. SER files are used for planetary, lunar and solar captures and this player allows these captures to be viewed in the same way AVI files are viewed with a standard video player.",
                                                     "Overall description of SER Player");
@@ -203,6 +236,11 @@ c_ser_player::c_ser_player(QWidget *parent)
 
     connect(fps_ActGroup, SIGNAL(triggered(QAction *)), this, SLOT(fps_changed_slot(QAction *)));
 
+    mp_drop_frames_Act = playback_menu->addAction(tr("Drop Frames To Keep Up", "Playback menu"));
+    mp_drop_frames_Act->setCheckable(true);
+    mp_drop_frames_Act->setChecked(c_persistent_data::m_drop_frames);
+    connect(mp_drop_frames_Act, SIGNAL(triggered(bool)), this, SLOT(drop_frames_slot(bool)));
+
 
     //
     // Tools menu
@@ -440,9 +478,26 @@ c_ser_player::c_ser_player(QWidget *parent)
     setCentralWidget(main_widget);
     setWindowTitle(C_WINDOW_TITLE_QSTRING);
 
+    // Frame processing is split across this many threads
+    c_image::set_thread_count(c_persistent_data::m_processing_thread_count);
+
     mp_ser_file = new c_pipp_ser;
+    mp_ser_file->set_memory_mapping(true);  // Read frames through a file mapping where possible
+    m_frame_timestamp = 0;
+
+    // Frames are read ahead in the background during playback
+    mp_frame_cache = new c_frame_cache;
+    mp_frame_cache->set_memory_budget((uint64_t)c_persistent_data::m_read_ahead_cache_size * 1024 * 1024);
 
+    // Upcoming frames are processed on the thread pool during playback
+    mp_frame_pipeline = new c_frame_pipeline(mp_frame_cache);
+
+    // Playback timing, the frame timer is restarted for each frame's deadline
+    mp_playback_scheduler = new c_playback_scheduler;
+    mp_playback_scheduler->set_drop_frames(c_persistent_data::m_drop_frames);
     mp_frame_Timer = new QTimer(this);
+    mp_frame_Timer->setSingleShot(true);
+    mp_frame_Timer->setTimerType(Qt::PreciseTimer);
     connect(mp_frame_Timer, SIGNAL(timeout()), this, SLOT(frame_timer_timeout_slot()));
 
 //    mp_resize_Timer = new QTimer(this);
@@ -482,6 +537,10 @@ c_ser_player::c_ser_player(QWidget *parent)
 
 c_ser_player::~c_ser_player()
 {
+    // Stop worker threads before the window goes away
+    delete mp_frame_pipeline;
+    delete mp_frame_cache;
+    delete mp_playback_scheduler;
 }
 
 
@@ -628,6 +687,13 @@ void c_ser_player::fps_changed_slot(QAction *action)
 }
 
 
+void c_ser_player::drop_frames_slot(bool drop_frames)
+{
+    c_persistent_data::m_drop_frames = drop_frames;
+    mp_playback_scheduler->set_drop_frames(drop_frames);
+}
+
+
 void c_ser_player::playback_controls_double_clicked_slot()
 {
     detach_playback_controls_slot(!mp_detach_playback_controls_Act->isChecked());
@@ -674,6 +740,7 @@ void c_ser_player::histogram_viewer_slot(bool checked)
     if (checked) {
         mp_histogram_dialog->show();
         mp_histogram_dialog->move_to_default_position();
+        mp_frame_pipeline->cancel();  // Frames processed for display only cannot be used for the histogram
         frame_slider_changed_slot();
     } else {
         mp_histogram_dialog->hide();
@@ -742,6 +809,7 @@ void c_ser_player::crop_changed_slot(bool crop_enable, int crop_x, int crop_y, i
         mp_playback_controls_widget->update_frame_size_label(mp_ser_file->get_width(), mp_ser_file->get_height());
     }
 
+    mp_frame_pipeline->cancel();  // Frames in flight were processed with the old settings
     frame_slider_changed_slot();
     resize_window_100_percent_slot();
 }
@@ -751,6 +819,7 @@ void c_ser_player::monochrome_conversion_changed_slot(bool enabled, int selectio
 {
     m_monochrome_conversion_enable = enabled;
     m_monochrome_conversion_type = selection;
+    mp_frame_pipeline->cancel();  // Frames in flight were processed with the old settings
     frame_slider_changed_slot();
 }
 
@@ -851,6 +920,15 @@ void c_ser_player::save_frames_as_ser_slot()
             bool include_timestamps = mp_save_frames_as_ser_Dialog->get_include_timestamps_in_ser_file();
             bool do_frame_processing = mp_save_frames_as_ser_Dialog->get_processing_enable();
 
+            // Without processing or resizing the frame data can be copied straight from this SER file
+            // Files where the pixel depth check changed the byte depth still need converting
+            bool copy_raw_frames = !do_frame_processing &&
+                                   frame_active_width == mp_ser_file->get_width() &&
+                                   frame_active_height == mp_ser_file->get_height() &&
+                                   frame_total_width == mp_ser_file->get_width() &&
+                                   frame_total_height == mp_ser_file->get_height() &&
+                                   (int32_t)mp_ser_file->get_raw_frame_size() == mp_ser_file->get_buffer_size();
+
             c_pipp_ser_write ser_write_file;
 
             // Keep list of last saved folders up to date
@@ -886,32 +964,54 @@ void c_ser_player::save_frames_as_ser_slot()
                     saved_frames++;
                     save_progress_dialog.set_value(saved_frames);
 
-                    // Get frame from SER file
-                    bool valid_frame = get_and_process_frame(abs(frame_number),  // frame_number
-                                                             false,  // conv_to_8_bit
-                                                             do_frame_processing);  // do_processing
+                    bool valid_frame = true;
+                    if (!copy_raw_frames) {
+                        // Get frame from SER file
+                        valid_frame = get_and_process_frame(abs(frame_number),  // frame_number
+                                                            false,  // conv_to_8_bit
+                                                            do_frame_processing);  // do_processing
 
-                    mp_frame_image->resize_image(frame_active_width, frame_active_height);
-                    mp_frame_image->add_bars(frame_total_width, frame_total_height);
+                        mp_frame_image->resize_image(frame_active_width, frame_active_height);
+                        mp_frame_image->add_bars(frame_total_width, frame_total_height);
+                    }
 
                     if (valid_frame) {
                         // Get timestamp for frame if required
                         uint64_t timestamp = 0;
                         if (include_timestamps) {
-                            timestamp = mp_ser_file->get_timestamp();
+                            if (copy_raw_frames) {
+                                timestamp = mp_ser_file->get_frame_timestamp(abs(frame_number));
+                            } else {
+                                timestamp = mp_ser_file->get_timestamp();
+                            }
                         }
 
-                        if (!ser_write_file.get_open()) {
+                        if (!ser_write_file.get_open() && copy_raw_frames) {
+                            // Create SER file for copied frames - only done once
+                            file_create_error |= ser_write_file.create_copy(
+                                        filename,  // QString filename
+                                        mp_ser_file->get_filename(),  // std::string source_filename
+                                        mp_ser_file->get_width(),  // int32_t width
+                                        mp_ser_file->get_height(),  // int32_t height
+                                        mp_ser_file->get_colour_id(),  // int32_t colour_id
+                                        mp_ser_file->get_pixel_depth(),  // int32_t pixel_depth
+                                        mp_ser_file->get_little_endian());  // int32_t little_endian
+                        } else if (!ser_write_file.get_open()) {
                             // Create SER file - only done once
                             file_create_error |= ser_write_file.create(filename, //  QString filename
                                                                  mp_frame_image->get_width(),  // int32_t  width
                                                                  mp_frame_image->get_height(), // int32_t  height
                                                                  mp_frame_image->get_colour(),  //mp_ser_file->get_colour() != 0,  // bool     colour
-                                                                 mp_frame_image->get_byte_depth());  //mp_ser_file->get_byte_depth());  // int32_t  byte_depth
+                                                                 mp_frame_image->get_byte_depth(),  //mp_ser_file->get_byte_depth());  // int32_t  byte_depth
+                                                                 true);  // bool background_write
                         }
 
                         // Write frame to SER file
-                        if (!file_create_error && !file_write_error) {
+                        if (!file_create_error && !file_write_error && copy_raw_frames) {
+                            file_write_error |= ser_write_file.copy_frame(
+                                abs(frame_number),  // uint32_t frame_number
+                                timestamp);  // uint64_t timestamp
+                        } else if (!file_create_error && !file_write_error) {
                             file_write_error |= ser_write_file.write_frame(
                                 mp_frame_image->get_p_buffer(),  // uint8_t  *data,
                                 timestamp);  // uint64_t timestamp);
@@ -1091,7 +1191,15 @@ void c_ser_player::save_frames_as_avi_slot()
                 }
             }
 
-            c_pipp_video_write *p_avi_write_file = new c_pipp_avi_write_dib();
+            c_pipp_avi_write *p_avi_write_file;
+            if (mp_save_frames_as_avi_Dialog->get_avi_lossless_compression()) {
+                p_avi_write_file = new c_pipp_avi_write_zlib();
+            } else {
+                p_avi_write_file = new c_pipp_avi_write_dib();
+            }
+
+            // Chunks are added to the file by the writer thread while the next frames are processed
+            p_avi_write_file->set_background_write(true);
 
             // Keep list of last saved folders up to date
             add_string_to_stringlist(c_persistent_data::m_recent_save_folders, QFileInfo(filename).absolutePath());
@@ -1108,11 +1216,11 @@ void c_ser_player::save_frames_as_avi_slot()
             bool file_create_error = false;
             bool file_write_error = false;
 
-            // Direction loop
+            // List the frames in the order they are to be written
+            QVector<int> frame_numbers;
             int start_dir = (sequence_direction == 1) ? 1 : 0;
             int end_dir = (sequence_direction == 0) ? 0 : 1;
-            bool loop_break = false;
-            for(int current_dir = start_dir; current_dir <= end_dir && !loop_break; current_dir++) {
+            for(int current_dir = start_dir; current_dir <= end_dir; current_dir++) {
                 int start_frame = min_frame;
                 int end_frame = max_frame;
                 if (current_dir == 1) {  // Reverse direction - count backwards
@@ -1121,48 +1229,108 @@ void c_ser_player::save_frames_as_avi_slot()
                     end_frame = -min_frame;
                 }
 
-                for (int frame_number = start_frame; frame_number <= end_frame && !loop_break; frame_number += decimate_value) {
-                    // Update progress bar
-                    saved_frames++;
-                    save_progress_dialog.set_value(saved_frames);
-
-                    // Get frame from SER file
-                    bool valid_frame = get_and_process_frame(abs(frame_number),  // frame_number
-                                                             false,  // conv_to_8_bit
-                                                             do_frame_processing);  // do_processing
+                for (int frame_number = start_frame; frame_number <= end_frame; frame_number += decimate_value) {
+                    frame_numbers.append(abs(frame_number));
+                }
+            }
 
-                    mp_frame_image->resize_image(frame_active_width, frame_active_height);
-                    mp_frame_image->add_bars(frame_total_width, frame_total_height);
+            // Frames are read here in order and processed on the thread pool, several at a time.
+            // Each frame in flight has its own c_image and the frames are written in order.
+            struct s_avi_frame_slot {
+                std::unique_ptr<c_image> p_image;
+                QFuture<void> future;
+                bool valid;
+            };
+
+            int slot_count = QThread::idealThreadCount();
+            slot_count = (slot_count < C_AVI_MIN_FRAMES_IN_FLIGHT) ? C_AVI_MIN_FRAMES_IN_FLIGHT : slot_count;
+            slot_count = (slot_count > C_AVI_MAX_FRAMES_IN_FLIGHT) ? C_AVI_MAX_FRAMES_IN_FLIGHT : slot_count;
+            std::vector<s_avi_frame_slot> frame_slots(slot_count);
+            for (s_avi_frame_slot &slot : frame_slots) {
+                slot.p_image.reset(new c_image);
+                slot.p_image->copy_processing_settings(*mp_frame_image);
+                slot.valid = false;
+            }
 
-                    if (valid_frame) {
-                        if (!p_avi_write_file->get_open()) {
-                            // Create AVI file - only done once
-                            file_create_error |= p_avi_write_file->create(
-                                filename.toUtf8().constData(),  // const char *filename
-                                mp_frame_image->get_width(),  // int32_t m_width
-                                mp_frame_image->get_height(),  // int32_t m_height
-                                mp_frame_image->get_colour(),  // bool m_colour
-                                fps_rate,  // int32_t fps_rate
-                                fps_scale, // int32_t fps_scale
-                                old_format,  // int32_t m_old_avi_format
-                                0);  // int32_t quality
-                        }
+            const c_frame_pipeline::s_frame_processing processing = get_frame_processing(false, do_frame_processing);
+            bool is_colour = mp_ser_file->get_colour_id() == COLOURID_RGB || mp_ser_file->get_colour_id() == COLOURID_BGR;
+
+            auto start_frame_slot = [&](int frame_index) {
+                s_avi_frame_slot &slot = frame_slots[frame_index % slot_count];
+                c_image *p_image = slot.p_image.get();
+                p_image->set_image_details(
+                            mp_ser_file->get_width(),  // width
+                            mp_ser_file->get_height(),  // height
+                            mp_ser_file->get_byte_depth(),  // byte_depth
+                            mp_ser_file->get_colour_id(),  // colour_id
+                            is_colour);  // colour
+
+                // Get frame from SER file
+                slot.valid = mp_ser_file->get_frame(frame_numbers[frame_index], p_image->get_p_buffer()) >= 0;
+                if (slot.valid) {
+                    slot.future = QtConcurrent::run([p_image, &processing, frame_active_width, frame_active_height, frame_total_width, frame_total_height]() {
+                        c_frame_pipeline::process_image(p_image, processing);
+                        p_image->resize_image(frame_active_width, frame_active_height);
+                        p_image->add_bars(frame_total_width, frame_total_height);
+                    });
+                } else {
+                    slot.future = QFuture<void>();
+                }
+            };
 
+            int frames_started = 0;
+            while (frames_started < frame_numbers.size() && frames_started < slot_count) {
+                start_frame_slot(frames_started++);
+            }
 
-                        // Write frame to AVI file
-                        if (!file_write_error) {
-                            file_write_error |= p_avi_write_file->write_frame(
-                                mp_frame_image->get_p_buffer(),  // uint8_t *data
-                                0,  // int32_t m_colour
-                                mp_frame_image->get_byte_depth());  // uint32_t bpp
-                        }
+            for (int frame_index = 0; frame_index < frame_numbers.size(); frame_index++) {
+                // Update progress bar
+                saved_frames++;
+                save_progress_dialog.set_value(saved_frames);
+
+                s_avi_frame_slot &slot = frame_slots[frame_index % slot_count];
+                slot.future.waitForFinished();
+                bool valid_frame = slot.valid;
+                c_image *p_image = slot.p_image.get();
+
+                if (valid_frame) {
+                    if (!p_avi_write_file->get_open()) {
+                        // Create AVI file - only done once
+                        file_create_error |= p_avi_write_file->create(
+                            filename.toUtf8().constData(),  // const char *filename
+                            p_image->get_width(),  // int32_t m_width
+                            p_image->get_height(),  // int32_t m_height
+                            p_image->get_colour(),  // bool m_colour
+                            fps_rate,  // int32_t fps_rate
+                            fps_scale, // int32_t fps_scale
+                            old_format,  // int32_t m_old_avi_format
+                            0);  // int32_t quality
                     }
 
-                    if (save_progress_dialog.was_cancelled() || !valid_frame || file_write_error || file_create_error) {
-                        // Abort frame saving
-                        loop_break = true;
+
+                    // Write frame to AVI file
+                    if (!file_write_error) {
+                        file_write_error |= p_avi_write_file->write_frame(
+                            p_image->get_p_buffer(),  // uint8_t *data
+                            0,  // int32_t m_colour
+                            p_image->get_byte_depth());  // uint32_t bpp
                     }
                 }
+
+                if (save_progress_dialog.was_cancelled() || !valid_frame || file_write_error || file_create_error) {
+                    // Abort frame saving
+                    break;
+                }
+
+                // The frame has been copied by write_frame() so the slot can take the next frame
+                if (frames_started < frame_numbers.size()) {
+                    start_frame_slot(frames_started++);
+                }
+            }
+
+            // Wait for frames still being processed after an abort
+            for (s_avi_frame_slot &slot : frame_slots) {
+                slot.future.waitForFinished();
             }
 
             // Write header and close SER file
@@ -1252,6 +1420,8 @@ void c_ser_player::save_frames_as_gif_slot()
     uint64_t filesize_after_last_frame = 0;
     uint64_t final_filesize = 0;
     int written_framecount = 0;
+    QHash<int, s_gif_review_frame> kept_review_frames;  // Keyed by frame number
+    QString kept_review_frame_settings;  // Processing settings used for kept_review_frames
     do {  // Loop for doing GIF animation test runs
         save_frames_dialog_ret = mp_save_frames_as_gif_Dialog->exec();  // Show dialog
 
@@ -1336,6 +1506,8 @@ void c_ser_player::save_frames_as_gif_slot()
                 unchanged_border_tolerance = mp_save_frames_as_gif_Dialog->get_gif_unchanged_border_tolerance();
                 transparent_pixel_enable = mp_save_frames_as_gif_Dialog->get_gif_transparent_pixel_enable();
                 int colour_quantisation_type = mp_save_frames_as_gif_Dialog->get_gif_colour_quantisation_type();
+                bool neuquant_fast = mp_save_frames_as_gif_Dialog->get_gif_neuquant_fast();
+                c_gif_write::e_palette_mode palette_mode = (c_gif_write::e_palette_mode)mp_save_frames_as_gif_Dialog->get_gif_palette_mode();
                 transparent_pixel_tolerence = mp_save_frames_as_gif_Dialog->get_gif_transparent_pixel_tolerance();
                 lossy_compression_level = mp_save_frames_as_gif_Dialog->get_gif_lossy_compression_level();
                 pixel_depth = mp_save_frames_as_gif_Dialog->get_gif_pixel_bit_depth();
@@ -1348,8 +1520,73 @@ void c_ser_player::save_frames_as_gif_slot()
                     update_recent_save_folders_menu();
                 }
 
+                // List the frames to be saved in the order they will be written
+                QVector<int> frame_sequence;
+                int start_dir = (sequence_direction == 1) ? 1 : 0;
+                int end_dir = (sequence_direction == 0) ? 0 : 1;
+                for (int current_dir = start_dir; current_dir <= end_dir; current_dir++) {
+                    int start_frame = min_frame;
+                    int end_frame = max_frame;
+                    if (current_dir == 1) {  // Reverse direction - count backwards
+                        // Use negative numbers so for loop works counting up or down
+                        start_frame = -max_frame;
+                        end_frame = -min_frame;
+                    }
+
+                    for (int frame_number = start_frame; frame_number <= end_frame; frame_number += decimate_value) {
+                        frame_sequence.append(abs(frame_number));
+                    }
+                }
+
+                // A quick review only encodes the first and last frames and a burst of consecutive frames
+                // from the middle, the burst shows how well the frames compress against each other
+                QVector<int> frames_to_write;  // Indexes into frame_sequence
+                bool quick_review = is_test_run &&
+                                    mp_save_frames_as_gif_Dialog->get_gif_quick_review() &&
+                                    frame_sequence.size() > C_GIF_REVIEW_BURST_FRAMES + 2;
+                if (quick_review) {
+                    int burst_start = qMin(frame_sequence.size() / 2, frame_sequence.size() - 1 - C_GIF_REVIEW_BURST_FRAMES);
+                    frames_to_write.append(0);
+                    for (int i = burst_start; i < burst_start + C_GIF_REVIEW_BURST_FRAMES; i++) {
+                        frames_to_write.append(i);
+                    }
+
+                    frames_to_write.append(frame_sequence.size() - 1);
+                } else {
+                    for (int i = 0; i < frame_sequence.size(); i++) {
+                        frames_to_write.append(i);
+                    }
+                }
+
+                // Processed frames kept from the last review can be used if the frames are processed the same way
+                QString review_frame_settings = QString("%1 %2 %3 %4 %5")
+                                                .arg(do_frame_processing)
+                                                .arg(frame_active_width)
+                                                .arg(frame_active_height)
+                                                .arg(frame_total_width)
+                                                .arg(frame_total_height);
+                bool keep_review_frames = quick_review && mp_save_frames_as_gif_Dialog->get_gif_keep_review_frames();
+                if (!keep_review_frames || review_frame_settings != kept_review_frame_settings) {
+                    kept_review_frames.clear();
+                    kept_review_frame_settings = review_frame_settings;
+                }
+
+                // Read, process and convert a frame ready for the GIF writer, leaves it in mp_frame_image
+                auto get_gif_frame = [&](int frame_number) -> bool {
+                    bool valid = get_and_process_frame(frame_number,  // frame_number
+                                                       false,  // conv_to_8_bit
+                                                       do_frame_processing);  // do_processing
+                    if (valid) {
+                        mp_frame_image->resize_image(frame_active_width, frame_active_height);
+                        mp_frame_image->add_bars(frame_total_width, frame_total_height);
+                        mp_frame_image->conv_data_ready_for_gif();
+                    }
+
+                    return valid;
+                };
+
                 // Setup progress dialog
-                c_save_frames_progress_dialog save_progress_dialog(this, 1, frames_to_be_saved);
+                c_save_frames_progress_dialog save_progress_dialog(this, 1, frames_to_write.size());
                 save_progress_dialog.setWindowTitle(tr("Save Frames As Animated GIF"));
                 if (is_test_run) {
                     // Change button label from 'Abort' to 'Truncate' when doing a test run
@@ -1362,80 +1599,146 @@ void c_ser_player::save_frames_as_gif_slot()
                 bool file_create_error = false;
                 bool file_write_error = false;
 
-                // Direction loop
-                int start_dir = (sequence_direction == 1) ? 1 : 0;
-                int end_dir = (sequence_direction == 0) ? 0 : 1;
-                bool loop_break = false;
-                for (int current_dir = start_dir; current_dir <= end_dir && !loop_break; current_dir++) {
-                    int start_frame = min_frame;
-                    int end_frame = max_frame;
-                    if (current_dir == 1) {  // Reverse direction - count backwards
-                        // Use negative numbers so for loop works counting up or down
-                        start_frame = -max_frame;
-                        end_frame = -min_frame;
-                    }
+                // Details for estimating the size and save time of the whole animation
+                uint64_t first_frame_bytes = 0;
+                uint64_t jump_frame_bytes = 0;  // Frames that do not follow on from the frame before in the sequence
+                int jump_frame_count = 0;
+                qint64 kept_frames_processing_time = 0;  // Time that processing the frames taken from kept_review_frames took
+                qint64 palette_sample_time = 0;
+                QElapsedTimer save_timer;
+                save_timer.start();
 
-                    for (int frame_number = start_frame; frame_number <= end_frame && !loop_break; frame_number += decimate_value) {
-                        // Update progress bar
-                        saved_frames++;
-                        save_progress_dialog.set_value(saved_frames);
+                for (int write_index = 0; write_index < frames_to_write.size(); write_index++) {
+                    int sequence_index = frames_to_write[write_index];
+                    int frame_number = frame_sequence[sequence_index];
 
-                        // Get frame from SER file
-                        bool valid_frame = get_and_process_frame(abs(frame_number),  // frame_number
-                                                                 false,  // conv_to_8_bit
-                                                                 do_frame_processing);  // do_processing
+                    // Update progress bar
+                    saved_frames++;
+                    save_progress_dialog.set_value(saved_frames);
 
+                    // Get frame, from the frames kept from the last review if it is there
+                    uint8_t *p_frame_data = nullptr;
+                    int frame_byte_depth = 1;
+                    bool frame_colour = false;
+                    bool frame_is_kept = false;  // p_frame_data is in kept_review_frames rather than mp_frame_image
+                    bool valid_frame;
+                    if (kept_review_frames.contains(frame_number)) {
+                        s_gif_review_frame &review_frame = kept_review_frames[frame_number];
+                        p_frame_data = (uint8_t *)review_frame.data.data();
+                        frame_byte_depth = review_frame.byte_depth;
+                        frame_colour = review_frame.colour;
+                        kept_frames_processing_time += review_frame.processing_time;
+                        frame_is_kept = true;
+                        valid_frame = true;
+                    } else {
+                        QElapsedTimer processing_timer;
+                        processing_timer.start();
+                        valid_frame = get_gif_frame(frame_number);
                         if (valid_frame) {
-                            mp_frame_image->resize_image(frame_active_width, frame_active_height);
-                            mp_frame_image->add_bars(frame_total_width, frame_total_height);
-                            mp_frame_image->conv_data_ready_for_gif();
-
-                            if (!gif_write_file.is_open()) {
-                                file_create_error |= gif_write_file.create(
-                                        gif_filename,  // const QString &filename
-                                        frame_total_width,  // int width
-                                        frame_total_height,  // int height
-                                        mp_frame_image->get_byte_depth(), // int byte_depth
-                                        mp_frame_image->get_colour(), // bool colour
-                                        0,  // int repeat_count
-                                        (c_gif_write::e_colour_quant_type)colour_quantisation_type,
-                                        unchanged_border_tolerance, // int unchanged_border_tolerance
-                                        transparent_pixel_enable,  // bool use_transparent_pixels
-                                        transparent_pixel_tolerence, // int transparent_tolerence
-                                        lossy_compression_level,  // int lossy_compression_level
-                                        pixel_depth);  // int bit_depth
-
-                                filesize_after_first_frame = 0;
-                                written_framecount = 0;
+                            p_frame_data = mp_frame_image->get_p_buffer();
+                            frame_byte_depth = mp_frame_image->get_byte_depth();
+                            frame_colour = mp_frame_image->get_colour();
+                            if (keep_review_frames) {
+                                s_gif_review_frame &review_frame = kept_review_frames[frame_number];
+                                int frame_size = frame_total_width * frame_total_height * ((frame_colour) ? 3 : 1);
+                                review_frame.data = QByteArray((const char *)p_frame_data, frame_size);
+                                review_frame.byte_depth = frame_byte_depth;
+                                review_frame.colour = frame_colour;
+                                review_frame.processing_time = processing_timer.nsecsElapsed();
+                                p_frame_data = (uint8_t *)review_frame.data.data();
+                                frame_is_kept = true;
                             }
+                        }
+                    }
 
-                            if (saved_frames == frames_to_be_saved) {
-                                // Use final frame time for last frame
-                                frametime = final_frametime;
+                    if (valid_frame) {
+                        if (!gif_write_file.is_open()) {
+                            file_create_error |= gif_write_file.create(
+                                    gif_filename,  // const QString &filename
+                                    frame_total_width,  // int width
+                                    frame_total_height,  // int height
+                                    frame_byte_depth, // int byte_depth
+                                    frame_colour, // bool colour
+                                    0,  // int repeat_count
+                                    (c_gif_write::e_colour_quant_type)colour_quantisation_type,
+                                    unchanged_border_tolerance, // int unchanged_border_tolerance
+                                    transparent_pixel_enable,  // bool use_transparent_pixels
+                                    transparent_pixel_tolerence, // int transparent_tolerence
+                                    lossy_compression_level,  // int lossy_compression_level
+                                    pixel_depth,  // int bit_depth
+                                    palette_mode);  // e_palette_mode palette_mode
+
+                            if (!file_create_error && neuquant_fast) {
+                                gif_write_file.set_neuquant_options(C_GIF_NEUQUANT_FAST_SAMPLE_FACTOR, true);
                             }
 
-                            if (!file_write_error && !file_create_error) {
-                                written_framecount++;
-                                file_write_error |= gif_write_file.write_frame(
-                                          mp_frame_image->get_p_buffer(),  // uint8_t  *p_data
-                                          frametime);  // uint16_t display_time
+                            filesize_after_first_frame = 0;
+                            written_framecount = 0;
+
+                            if (!file_create_error &&
+                                palette_mode != c_gif_write::PALETTE_MODE_LOCAL &&
+                                frame_colour &&
+                                max_frame > min_frame) {
+                                // Pre-pass to give the GIF writer frames from across the whole range for the global colour table
+                                QElapsedTimer palette_sample_timer;
+                                palette_sample_timer.start();
+                                int sample_count = qMin(C_GIF_PALETTE_SAMPLE_FRAMES, max_frame - min_frame + 1);
+                                for (int sample = 0; sample < sample_count; sample++) {
+                                    int sample_frame = min_frame + ((max_frame - min_frame) * sample) / (sample_count - 1);
+                                    if (get_gif_frame(sample_frame)) {
+                                        gif_write_file.add_palette_sample(mp_frame_image->get_p_buffer());
+                                    }
+                                }
+
+                                if (!frame_is_kept) {
+                                    // Get the frame to be written back again
+                                    valid_frame = get_gif_frame(frame_number);
+                                    p_frame_data = mp_frame_image->get_p_buffer();
+                                }
+
+                                palette_sample_time = palette_sample_timer.nsecsElapsed();
                             }
+                        }
+
+                        if (saved_frames == frames_to_write.size()) {
+                            // Use final frame time for last frame
+                            frametime = final_frametime;
+                        }
 
-                            if (filesize_after_first_frame == 0) {
-                                filesize_after_first_frame = gif_write_file.get_current_filesize();
+                        if (valid_frame && !file_write_error && !file_create_error) {
+                            written_framecount++;
+                            file_write_error |= gif_write_file.write_frame(
+                                      p_frame_data,  // uint8_t  *p_data
+                                      frametime);  // uint16_t display_time
+
+                            if (write_index > 0 && sequence_index != frames_to_write[write_index - 1] + 1 && !file_write_error) {
+                                // This frame was compared with a frame from elsewhere in the sequence so its size is not typical
+                                file_write_error |= gif_write_file.flush();
+                                jump_frame_bytes += gif_write_file.get_stats().last_frame_bytes;
+                                jump_frame_count++;
                             }
                         }
 
-                        if (save_progress_dialog.was_cancelled() || !valid_frame || file_write_error || file_create_error) {
-                            // Abort frame saving
-                            loop_break = true;
+                        if (filesize_after_first_frame == 0) {
+                            filesize_after_first_frame = gif_write_file.get_current_filesize();
+                            first_frame_bytes = gif_write_file.get_stats().last_frame_bytes;
                         }
                     }
+
+                    if (save_progress_dialog.was_cancelled() || !valid_frame || file_write_error || file_create_error) {
+                        // Abort frame saving
+                        break;
+                    }
+                }
+
+                // Wait for frames still being encoded, then close file
+                if (!file_create_error && !file_write_error) {
+                    file_write_error |= gif_write_file.flush();
                 }
 
-                // Close file
                 filesize_after_last_frame = gif_write_file.get_current_filesize();
                 final_filesize = gif_write_file.close();
+                qint64 save_time = save_timer.nsecsElapsed();
 
                 // Processing has completed
                 save_progress_dialog.set_complete();
@@ -1483,6 +1786,8 @@ void c_ser_player::save_frames_as_gif_slot()
 
                         stream << tr("Colour Quantisation: ") << mp_save_frames_as_gif_Dialog->get_gif_colour_quantisation_name() << "<br>" << endl;
 
+                        stream << tr("Colour Table: ") << mp_save_frames_as_gif_Dialog->get_gif_palette_mode_name() << "<br>" << endl;
+
                         stream << tr("Unchanged Border Tolerance: ") << unchanged_border_tolerance << "<br>" << endl;
 
                         if (transparent_pixel_enable) {
@@ -1504,10 +1809,24 @@ void c_ser_player::save_frames_as_gif_slot()
                         }
 
                         stream << "<hr>" << endl;
-                        stream << "<b>" << tr("Frames Saved: %1 of %2").arg(written_framecount).arg(frames_to_be_saved) << "</b><br>" << endl;
+                        if (quick_review) {
+                            stream << "<b>" << tr("Quick Review: %1 of %2 frames encoded").arg(written_framecount).arg(frames_to_be_saved) << "</b><br>" << endl;
+                        } else {
+                            stream << "<b>" << tr("Frames Saved: %1 of %2").arg(written_framecount).arg(frames_to_be_saved) << "</b><br>" << endl;
+                        }
+
+                        // Frames that follow on from the frame before them in the sequence are typical of the whole animation
+                        c_gif_write::s_stats gif_stats = gif_write_file.get_stats();
+                        int typical_frame_count = gif_stats.frame_count - 1 - jump_frame_count;
 
                         uint32_t filesize;
-                        if (written_framecount < frames_to_be_saved) {
+                        if (quick_review && written_framecount == frames_to_write.size() && typical_frame_count > 0) {
+                            uint64_t typical_frame_bytes = gif_stats.total_frame_bytes - first_frame_bytes - jump_frame_bytes;
+                            uint64_t other_bytes = final_filesize - gif_stats.total_frame_bytes;  // Header, comment and terminator
+                            filesize = (uint32_t)(other_bytes +
+                                                  first_frame_bytes +
+                                                  (typical_frame_bytes / typical_frame_count) * (frames_to_be_saved - 1));
+                        } else if (written_framecount < frames_to_be_saved && written_framecount > 1) {
                             uint32_t size_of_average_frame = (uint32_t)(filesize_after_last_frame - filesize_after_first_frame);
                             size_of_average_frame /= (written_framecount - 1);
                             uint32_t size_after_last_frame = (uint32_t)(final_filesize - filesize_after_last_frame);
@@ -1543,6 +1862,33 @@ void c_ser_player::save_frames_as_gif_slot()
                             }
                         }
 
+                        if (written_framecount > 0) {
+                            double save_time_s;
+                            if (written_framecount < frames_to_be_saved) {
+                                // Frames taken from kept_review_frames would have to be processed for a real save
+                                qint64 time_per_frame = (save_time - palette_sample_time + kept_frames_processing_time) / written_framecount;
+                                save_time_s = (palette_sample_time + time_per_frame * frames_to_be_saved) / 1e9;
+                                save_time_s = (floor(save_time_s * 10)) / 10;  // Round to 1 decimal place
+                                stream << tr("Estimated Save Time: %1 s").arg(save_time_s) << "<br>" << endl;
+                            } else {
+                                save_time_s = save_time / 1e9;
+                                save_time_s = (floor(save_time_s * 10)) / 10;  // Round to 1 decimal place
+                                stream << tr("Save Time: %1 s").arg(save_time_s) << "<br>" << endl;
+                            }
+                        }
+
+                        if (gif_stats.frame_count > 0) {
+                            double average_frame_kb = (double)gif_stats.total_frame_bytes / gif_stats.frame_count / 1024;
+                            average_frame_kb = (floor(average_frame_kb * 100)) / 100;  // Round to 2 decimal places
+                            double largest_frame_kb = (double)gif_stats.max_frame_bytes / 1024;
+                            largest_frame_kb = (floor(largest_frame_kb * 100)) / 100;  // Round to 2 decimal places
+                            double average_encode_ms = 1000 * gif_stats.total_encode_time / gif_stats.frame_count;
+                            average_encode_ms = (floor(average_encode_ms * 10)) / 10;  // Round to 1 decimal place
+                            stream << tr("Average Frame Size: %1 KB").arg(average_frame_kb) << "<br>" << endl;
+                            stream << tr("Largest Frame Size: %1 KB").arg(largest_frame_kb) << "<br>" << endl;
+                            stream << tr("Average Encode Time: %1 ms per frame").arg(average_encode_ms) << "<br>" << endl;
+                        }
+
                         stream << "</td></tr></table>" << endl;
                         stream << "</p>" << endl;
                         stream << "<img src=\"file:///" << temp_gif_filename << "\">" << endl;
@@ -1792,10 +2138,11 @@ void c_ser_player::save_frames_as_images_slot()
                                 mp_frame_image->get_colour());
                         } else {
                             // Other image files are saved using stangard QT QImage methods
-                            mp_frame_image->conv_data_ready_for_qimage();
-                            QImage save_qimage = QImage(mp_frame_image->get_p_buffer(),
+                            mp_frame_image->conv_data_ready_for_display(false);
+                            QImage save_qimage = QImage(mp_frame_image->get_p_display_buffer(),
                                                         mp_frame_image->get_width(),
                                                         mp_frame_image->get_height(),
+                                                        mp_frame_image->get_display_bytes_per_line(),
                                                         QImage::Format_RGB888);
 
                             // Open file for writing
@@ -1858,6 +2205,7 @@ void c_ser_player::open_save_folder_slot(QAction *action)
 void c_ser_player::invert_changed_slot(bool invert)
 {
     mp_frame_image->set_invert_image(invert);
+    mp_frame_pipeline->cancel();  // Frames in flight were processed with the old settings
     frame_slider_changed_slot();
 }
 
@@ -1865,6 +2213,7 @@ void c_ser_player::invert_changed_slot(bool invert)
 void c_ser_player::gain_changed_slot(double gain)
 {
     mp_frame_image->set_gain(gain);
+    mp_frame_pipeline->cancel();  // Frames in flight were processed with the old settings
     frame_slider_changed_slot();
 }
 
@@ -1872,6 +2221,7 @@ void c_ser_player::gain_changed_slot(double gain)
 void c_ser_player::gamma_changed_slot(double gamma)
 {
     mp_frame_image->set_gamma(gamma);
+    mp_frame_pipeline->cancel();  // Frames in flight were processed with the old settings
     frame_slider_changed_slot();
 }
 
@@ -1879,6 +2229,7 @@ void c_ser_player::gamma_changed_slot(double gamma)
 void c_ser_player::colour_balance_changed_slot(double red, double green, double blue)
 {
     mp_frame_image->set_colour_balance(red, green, blue);
+    mp_frame_pipeline->cancel();  // Frames in flight were processed with the old settings
     frame_slider_changed_slot();
 }
 
@@ -1890,6 +2241,7 @@ void c_ser_player::colour_align_changed_slot(
         int blue_align_y)
 {
     mp_frame_image->set_colour_align(red_align_x, red_align_y, blue_align_x, blue_align_y);
+    mp_frame_pipeline->cancel();  // Frames in flight were processed with the old settings
     frame_slider_changed_slot();
 }
 
@@ -2008,7 +2360,10 @@ void c_ser_player::open_ser_file(const QString &filename)
     mp_playback_controls_widget->reset_all_markers_slot();  // Ensure start marker is reset
     mp_playback_controls_widget->stop_playback();  // Stop and reset and currently playing frame
 
+    mp_frame_pipeline->close();
+    mp_frame_cache->close();
     mp_ser_file->close();
+    c_frame_buffer_pool::free_unused_buffers();  // Buffers sized for the last file's frames
     m_ser_file_loaded = false;
     m_total_frames = mp_ser_file->open(filename.toUtf8().constData(), 0, 0);
 
@@ -2066,6 +2421,10 @@ void c_ser_player::open_ser_file(const QString &filename)
     if (!ser_file_broken) {
         // This is a valid SER file
 
+        // Start read-ahead cache and processing pipeline for playback, playback still works without them
+        mp_frame_cache->open(filename.toUtf8().constData());
+        mp_frame_pipeline->open(filename.toUtf8().constData());
+
         // Delete previous save frames dialogs to remove remembered settings
         delete mp_save_frames_as_ser_Dialog;
         mp_save_frames_as_ser_Dialog = nullptr;
@@ -2252,9 +2611,37 @@ void c_ser_player::frame_slider_changed_slot()
     if (!m_ser_file_loaded) {
         mp_playback_controls_widget->stop_playback();
     } else {
-        bool valid_frame = get_and_process_frame(mp_playback_controls_widget->slider_value(),  // frame_number
-                                               true,  // conv_to_8_bit
-                                               true);  // do_processing
+        bool valid_frame = false;
+        bool is_playing = mp_playback_controls_widget->is_playing();
+        QElapsedTimer stage_timer;
+        if (is_playing) {
+            // Use this frame if the pipeline has already processed it
+            // The worker's read and process times are recorded along with the hand-off
+            c_frame_pipeline::s_frame_times frame_times;
+            stage_timer.start();
+            valid_frame = mp_frame_pipeline->take_frame(mp_playback_controls_widget->slider_value(), mp_frame_image, m_frame_timestamp, frame_times);
+            if (valid_frame) {
+                mp_playback_scheduler->add_stage_time(c_playback_scheduler::STAGE_HANDOFF, stage_timer.nsecsElapsed() / 1000000.0);
+                mp_playback_scheduler->add_stage_time(c_playback_scheduler::STAGE_READ, frame_times.read_ms);
+                mp_playback_scheduler->add_stage_time(c_playback_scheduler::STAGE_PROCESS, frame_times.process_ms);
+            }
+
+            // Read and process the following frames in the background while this one is displayed
+            int read_ahead = qMax(mp_frame_cache->get_slot_count(), mp_frame_pipeline->get_slot_count());
+            QVector<int> upcoming_frames = mp_playback_controls_widget->get_upcoming_frames(read_ahead);
+            mp_frame_cache->set_upcoming_frames(upcoming_frames);
+            mp_frame_pipeline->schedule_frames(upcoming_frames.mid(0, mp_frame_pipeline->get_slot_count()),
+                                               mp_frame_image,  // Settings image
+                                               get_frame_processing(true, true, true));
+        }
+
+        if (!valid_frame) {
+            valid_frame = get_and_process_frame(mp_playback_controls_widget->slider_value(),  // frame_number
+                                                true,  // conv_to_8_bit
+                                                true,  // do_processing
+                                                true,  // use_cache
+                                                true);  // for_display
+        }
 
         if (valid_frame) {
             // Start histogram generation if one is not already being generated
@@ -2262,18 +2649,22 @@ void c_ser_player::frame_slider_changed_slot()
                 mp_histogram_thread->generate_histogram(mp_frame_image, mp_playback_controls_widget->slider_value());
             }
 
-            mp_frame_image->conv_data_ready_for_qimage();
-
-            QImage frame_qimage = QImage(mp_frame_image->get_p_buffer(),
+            // The frame has already been converted into the display buffer
+            stage_timer.start();
+            QImage frame_qimage = QImage(mp_frame_image->get_p_display_buffer(),
                                          mp_frame_image->get_width(),
                                          mp_frame_image->get_height(),
+                                         mp_frame_image->get_display_bytes_per_line(),
                                          QImage::Format_RGB888);
 
-            // Upate image in player
-            mp_frame_image_Widget->setPixmap(QPixmap::fromImage(frame_qimage));
+            // Upate image in player, the widget copies it into its own backing store
+            mp_frame_image_Widget->set_image(frame_qimage);
+            if (is_playing) {
+                mp_playback_scheduler->add_stage_time(c_playback_scheduler::STAGE_DISPLAY, stage_timer.nsecsElapsed() / 1000000.0);
+            }
 
             // Update timestamp label
-            mp_playback_controls_widget->update_timestamp_label(mp_ser_file->get_timestamp());
+            mp_playback_controls_widget->update_timestamp_label(m_frame_timestamp);
 
             // Ensure displayed histogram matches displayed frame
             if (!mp_playback_controls_widget->is_playing()) {
@@ -2297,7 +2688,22 @@ void c_ser_player::frame_timer_timeout_slot()
     if (!m_ser_file_loaded) {
         mp_playback_controls_widget->stop_playback();
     } else {
-        if (!mp_playback_controls_widget->goto_next_frame()) {
+        // Skip frames that are already too late to be worth displaying
+        int skip_count = 0;
+        if (mp_playback_scheduler->get_drop_frames()) {
+            QVector<int> upcoming_frames = mp_playback_controls_widget->get_upcoming_frames(C_MAX_DROPPED_FRAMES + 1);
+            while (skip_count + 1 < upcoming_frames.size()) {
+                double following_interval = get_frame_interval(upcoming_frames[skip_count], upcoming_frames[skip_count + 1]);
+                if (!mp_playback_scheduler->is_next_frame_stale(following_interval)) {
+                    break;
+                }
+
+                mp_playback_scheduler->frame_dropped(following_interval);
+                skip_count++;
+            }
+        }
+
+        if (!mp_playback_controls_widget->goto_next_frame(skip_count)) {
             // End of playback
             if (mp_histogram_dialog->isVisible()) {
                 // A slightly messy way to ensure the displayed histogram matches the displayed frame
@@ -2308,6 +2714,14 @@ void c_ser_player::frame_timer_timeout_slot()
 
         if (!mp_playback_controls_widget->is_playing()) {
             mp_playback_controls_widget->stop_playback();
+        } else {
+            // Set timer for the next frame's deadline
+            QVector<int> next_frame = mp_playback_controls_widget->get_upcoming_frames(1);
+            double next_interval = next_frame.isEmpty() ? m_display_frame_time :
+                                   get_frame_interval(mp_playback_controls_widget->slider_value(), next_frame[0]);
+            mp_playback_scheduler->frame_displayed(next_interval);
+            update_playback_stats();
+            mp_frame_Timer->start(qMax(0, (int)ceil(mp_playback_scheduler->get_time_to_deadline())));
         }
     }
 }
@@ -2382,6 +2796,7 @@ void c_ser_player::check_for_updates_slot(bool enabled)
 
 void c_ser_player::debayer_enable_slot()
 {
+    mp_frame_pipeline->cancel();  // Frames in flight were processed with the old settings
     frame_slider_changed_slot();
 }
 
@@ -2402,7 +2817,14 @@ void c_ser_player::histogram_done_slot()
 
 void c_ser_player::start_playing_slot()
 {
-    mp_frame_Timer->start(m_display_frame_time);
+    // The current frame has just been displayed
+    QVector<int> next_frame = mp_playback_controls_widget->get_upcoming_frames(1);
+    double next_interval = next_frame.isEmpty() ? m_display_frame_time :
+                           get_frame_interval(mp_playback_controls_widget->slider_value(), next_frame[0]);
+    mp_playback_scheduler->start(next_interval);
+    mp_frame_cache->reset_stats();
+    c_frame_buffer_pool::reset_stats();
+    mp_frame_Timer->start(qMax(0, (int)ceil(next_interval)));
 }
 
 
@@ -2624,11 +3046,109 @@ void c_ser_player::calculate_display_framerate()
     }
 
     mp_playback_controls_widget->update_fps_label(fps);
-    mp_frame_Timer->setInterval(m_display_frame_time);
 }
 
 
-bool c_ser_player::get_and_process_frame(int frame_number, bool conv_to_8_bit, bool do_processing)
+double c_ser_player::get_frame_interval(int from_frame, int to_frame)
+{
+    // Use the SER timestamps between neighbouring frames when the framerate is from the timestamps
+    if (m_display_framerate < 0 && mp_ser_file->has_timestamps() && qAbs(to_frame - from_frame) == 1) {
+        uint64_t from_timestamp = mp_ser_file->get_timestamp(from_frame - 1);
+        uint64_t to_timestamp = mp_ser_file->get_timestamp(to_frame - 1);
+        uint64_t diff = (to_timestamp > from_timestamp) ? to_timestamp - from_timestamp : from_timestamp - to_timestamp;
+        double interval = diff / 10000.0;  // Timestamps are in 100ns units
+
+        // Gaps in the capture and broken timestamps are played at the average rate
+        if (interval > 0.0 && interval < 10.0 * m_display_frame_time) {
+            return interval;
+        }
+    }
+
+    return m_display_frame_time;
+}
+
+
+void c_ser_player::update_playback_stats()
+{
+    if (!mp_playback_scheduler->stats_update_due()) {
+        return;
+    }
+
+    c_playback_scheduler::s_stats stats = mp_playback_scheduler->get_stats();
+    QString details = tr("Achieved: %1 FPS, target: %2 FPS", "Playback statistics")
+                      .arg(stats.achieved_fps, 0, 'f', 1)
+                      .arg(stats.target_fps, 0, 'f', 1);
+    details += "\n" + tr("Displayed frames: %1, dropped: %2, late: %3", "Playback statistics")
+                      .arg(stats.displayed_frames)
+                      .arg(stats.dropped_frames)
+                      .arg(stats.late_frames);
+
+    const QString stage_names[c_playback_scheduler::STAGE_COUNT] = {
+        tr("Read", "Playback statistics"),
+        tr("Process", "Playback statistics"),
+        tr("Hand-off", "Playback statistics"),
+        tr("Display", "Playback statistics")};
+    for (int stage = 0; stage < c_playback_scheduler::STAGE_COUNT; stage++) {
+        const c_playback_scheduler::s_stage_stats &stage_stats = stats.stages[stage];
+        if (stage_stats.sample_count > 0) {
+            details += "\n" + tr("%1: p50 %2 ms, p90 %3 ms, p99 %4 ms, max %5 ms", "Playback statistics")
+                              .arg(stage_names[stage])
+                              .arg(stage_stats.p50_ms, 0, 'f', 1)
+                              .arg(stage_stats.p90_ms, 0, 'f', 1)
+                              .arg(stage_stats.p99_ms, 0, 'f', 1)
+                              .arg(stage_stats.max_ms, 0, 'f', 1);
+        }
+    }
+
+    uint64_t cache_hits = mp_frame_cache->get_hit_count();
+    uint64_t cache_misses = mp_frame_cache->get_miss_count();
+    if (cache_hits + cache_misses > 0) {
+        details += "\n" + tr("Frame cache: %1 hits, %2 misses", "Playback statistics")
+                          .arg(cache_hits)
+                          .arg(cache_misses);
+    }
+
+    c_frame_buffer_pool::s_stats pool_stats = c_frame_buffer_pool::get_stats();
+    details += "\n" + tr("Frame buffers: %1 reused, %2 allocated, %3 MB in use (peak %4 MB), %5 MB pooled", "Playback statistics")
+                      .arg(pool_stats.hit_count)
+                      .arg(pool_stats.miss_count)
+                      .arg((double)pool_stats.bytes_in_use / (1024 * 1024), 0, 'f', 1)
+                      .arg((double)pool_stats.peak_bytes_in_use / (1024 * 1024), 0, 'f', 1)
+                      .arg((double)pool_stats.pooled_bytes / (1024 * 1024), 0, 'f', 1);
+
+    mp_playback_controls_widget->update_playback_stats(stats.achieved_fps, details);
+}
+
+
+c_frame_pipeline::s_frame_processing c_ser_player::get_frame_processing(bool conv_to_8_bit, bool do_processing, bool for_display)
+{
+    c_frame_pipeline::s_frame_processing processing;
+    processing.conv_to_8_bit = conv_to_8_bit;
+    processing.do_processing = do_processing;
+    processing.debayer_enable = mp_processing_options_Dialog->get_debayer_enable();
+    processing.debayer_colour_id = mp_processing_options_Dialog->get_debayer_pattern();
+    if (processing.debayer_colour_id < 0) {
+        // No colour_id specified, use value from SER file
+        processing.debayer_colour_id = mp_ser_file->get_colour_id();
+    }
+
+    processing.crop_enable = m_crop_enable;
+    processing.crop_x_pos = m_crop_x_pos;
+    processing.crop_y_pos = m_crop_y_pos;
+    processing.crop_width = m_crop_width;
+    processing.crop_height = m_crop_height;
+    processing.monochrome_conversion_enable = m_monochrome_conversion_enable;
+    processing.monochrome_conversion_type = m_monochrome_conversion_type;
+    processing.colour_saturation = mp_processing_options_Dialog->get_colour_saturation();
+    processing.display_conversion = for_display;
+
+    // The histogram needs the processed frame data, not just the displayed image
+    processing.display_only = for_display && !mp_histogram_dialog->isVisible();
+    return processing;
+}
+
+
+bool c_ser_player::get_and_process_frame(int frame_number, bool conv_to_8_bit, bool do_processing, bool use_cache, bool for_display)
 {
     bool is_colour = false;
     if (mp_ser_file->get_colour_id() == COLOURID_RGB || mp_ser_file->get_colour_id() == COLOURID_BGR) {
@@ -2642,44 +3162,26 @@ bool c_ser_player::get_and_process_frame(int frame_number, bool conv_to_8_bit, b
                 mp_ser_file->get_colour_id(),  // colour_id
                 is_colour);  // colour
 
-    int32_t ret = mp_ser_file->get_frame(frame_number, mp_frame_image->get_p_buffer());
+    QElapsedTimer stage_timer;
+    stage_timer.start();
+    int32_t ret;
+    if (use_cache && mp_frame_cache->get_frame(frame_number, mp_frame_image->get_p_buffer(), m_frame_timestamp)) {
+        // Frame was already read by the read-ahead thread
+        ret = 0;
+    } else {
+        ret = mp_ser_file->get_frame(frame_number, mp_frame_image->get_p_buffer());
+        m_frame_timestamp = mp_ser_file->get_timestamp();
+    }
 
     if (ret >= 0) {
-        if (conv_to_8_bit) {
-            mp_frame_image->convert_image_to_8bit();
+        if (for_display) {
+            mp_playback_scheduler->add_stage_time(c_playback_scheduler::STAGE_READ, stage_timer.nsecsElapsed() / 1000000.0);
+            stage_timer.start();
         }
 
-        if (do_processing) {
-            // Debayer frame if required
-            if (mp_processing_options_Dialog->get_debayer_enable()) {
-                int colour_id = mp_processing_options_Dialog->get_debayer_pattern();
-                if (colour_id < 0) {
-                    // No colour_id specified, use value from SER file
-                    colour_id = mp_ser_file->get_colour_id();
-                }
-
-                mp_frame_image->debayer_image_bilinear(colour_id);
-            }
-
-            //
-            if (m_crop_enable) {
-                mp_frame_image->crop_image(
-                        m_crop_x_pos,
-                        m_crop_y_pos,
-                        m_crop_width,
-                        m_crop_height);
-            }
-
-            mp_frame_image->align_colour_channels();
-
-            if (m_monochrome_conversion_enable) {
-                mp_frame_image->monochrome_conversion(m_monochrome_conversion_type);
-            }
-
-            mp_frame_image->do_lut_based_processing();
-
-            // Adjust colour saturation if required
-            mp_frame_image->change_colour_saturation(mp_processing_options_Dialog->get_colour_saturation());
+        c_frame_pipeline::process_image(mp_frame_image, get_frame_processing(conv_to_8_bit, do_processing, for_display));
+        if (for_display) {
+            mp_playback_scheduler->add_stage_time(c_playback_scheduler::STAGE_PROCESS, stage_timer.nsecsElapsed() / 1000000.0);
         }
     }
 
@@ -23,6 +23,8 @@
 #include <QFile>
 #include <cstdint>
 
+#include "frame_pipeline.h"
+
 class QAction;
 class QActionGroup;
 class QLabel;
@@ -42,6 +44,8 @@ class c_save_frames_dialog;
 class c_image_Widget;
 class c_image;
 class c_histogram_thread;
+class c_frame_cache;
+class c_playback_scheduler;
 
 
 class c_ser_player : public QMainWindow
@@ -69,6 +73,7 @@ private:
     QAction *mp_processing_options_Act;
     QAction *mp_markers_dialog_Act;
     QAction *mp_detach_playback_controls_Act;
+    QAction *mp_drop_frames_Act;
 
     // Dialogs
     c_playback_controls_dialog *mp_playback_controls_dialog;
@@ -95,7 +100,11 @@ private:
     // Other
     bool m_ser_file_loaded;
     c_pipp_ser *mp_ser_file;
+    c_frame_cache *mp_frame_cache;
+    c_frame_pipeline *mp_frame_pipeline;
+    c_playback_scheduler *mp_playback_scheduler;
     c_image *mp_frame_image;
+    uint64_t m_frame_timestamp;
     QString m_ser_directory;
     int m_total_frames;
     int m_display_framerate;
@@ -120,6 +129,7 @@ public:
 
 public slots:
     void fps_changed_slot(QAction *);
+    void drop_frames_slot(bool drop_frames);
     void header_details_dialog_closed_slot();
     void header_details_dialog_slot(bool checked);
     void histogram_viewer_closed_slot();
@@ -175,8 +185,11 @@ private:
     void update_recent_save_folders_menu();
     void populate_recent_save_folders_menu();
     void create_no_file_open_image();
-    bool get_and_process_frame(int frame_number, bool conv_to_8_bit, bool do_processing);
+    c_frame_pipeline::s_frame_processing get_frame_processing(bool conv_to_8_bit, bool do_processing, bool for_display = false);
+    bool get_and_process_frame(int frame_number, bool conv_to_8_bit, bool do_processing, bool use_cache = false, bool for_display = false);
     void calculate_display_framerate();
+    double get_frame_interval(int from_frame, int to_frame);
+    void update_playback_stats();
     void resize_window_with_zoom(int zoom);
     void set_defaut_histogram_position();
 };